@@ -0,0 +1,171 @@
+/**
+ * @file bench.c
+ * @author Dorian Benech
+ * @brief Host micro-benchmarks: decode, checksum, JSON, topic and Tuya dps building, in ns per frame
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2023 GammaTroniques
+ *
+ */
+
+/*==============================================================================
+ Local Include
+===============================================================================*/
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "config.h"
+#include "linky.h"
+#include "web.h"
+#include "mqtt.h"
+#include "tuya.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*==============================================================================
+ Local Define
+===============================================================================*/
+#define TAG "HOST_BENCH"
+#define BENCH_ITERATIONS 1000 // Frames measured by default
+#define BENCH_TUYA_TIMEOUT 1000 // ms
+
+/*==============================================================================
+ Local Macro
+===============================================================================*/
+
+/*==============================================================================
+ Local Type
+===============================================================================*/
+
+/*==============================================================================
+ Local Function Declaration
+===============================================================================*/
+
+/*==============================================================================
+Public Variable
+===============================================================================*/
+
+/*==============================================================================
+ Local Variable
+===============================================================================*/
+
+/*==============================================================================
+Function Implementation
+===============================================================================*/
+
+/**
+ * @brief Fill linky_data with a reading of the standard mode, as the "bench" test of the firmware
+ */
+static void bench_std_data()
+{
+    linky_set_mode(MODE_STD);
+    linky_clear_data();
+    linky_data.std = (linky_data_std){
+        .ADSC = "123456789012",
+        .VTIC = "2",
+        .DATE = {.value = 0, .time = 1710017481},
+        .NGTF = "TEMPO",
+        .LTARF = "HP  BLEU",
+        .EAST = 50019226,
+        .EASF01 = 22235340,
+        .EASF02 = 26587280,
+        .EASF03 = 26587270,
+        .EASF04 = 494614,
+        .EASF05 = 115045,
+        .EASF06 = 161261,
+        .EASD01 = 11,
+        .EASD02 = 12,
+        .EASD03 = 13,
+        .EASD04 = 14,
+        .IRMS1 = 15,
+        .URMS1 = 230,
+        .PREF = 9,
+        .PCOUP = 9,
+        .SINSTS = 1520,
+    };
+    linky_data.timestamp = 1710017481;
+}
+
+/**
+ * @brief Measure tuya_send_data() with the fake Tuya cloud, the dps of linky_data are built and reported
+ */
+static esp_err_t bench_tuya(uint32_t iterations)
+{
+    strcpy(config_values.tuya.device_uuid, "uuidhost");
+    strcpy(config_values.tuya.device_auth, "authhost");
+    tuya_init();
+    if (tuya_wait_event(TUYA_EVENT_MQTT_CONNECTED, BENCH_TUYA_TIMEOUT) != 0)
+    {
+        ESP_LOGE(TAG, "Tuya not connected");
+        tuya_deinit();
+        return ESP_FAIL;
+    }
+
+    // tuya_send_data() prints every json: stdout is muted during the measure
+    fflush(stdout);
+    int saved_stdout = dup(STDOUT_FILENO);
+    int null_fd = open("/dev/null", O_WRONLY);
+    dup2(null_fd, STDOUT_FILENO);
+    uint32_t failed = 0;
+    int64_t start = esp_timer_get_time();
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+        failed += tuya_send_data(&linky_data) != 0;
+    }
+    int64_t time = esp_timer_get_time() - start;
+    fflush(stdout);
+    dup2(saved_stdout, STDOUT_FILENO);
+    close(saved_stdout);
+    close(null_fd);
+    tuya_deinit();
+
+    ESP_LOGI(TAG, "Benchmark: tuya dps: %" PRId64 " ns/frame", time * 1000 / iterations);
+    if (failed > 0)
+    {
+        ESP_LOGE(TAG, "%" PRIu32 " tuya reports failed", failed);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t iterations = argc > 1 ? strtoul(argv[1], NULL, 10) : BENCH_ITERATIONS;
+    if (iterations == 0)
+    {
+        fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+        return 2;
+    }
+    esp_log_level_set("*", ESP_LOG_INFO);
+    config_erase();
+    config_values.linky_mode = MODE_STD;
+    linky_init(0);
+    esp_log_level_set("LINKY", ESP_LOG_INFO); // linky_init() enables its debug logs
+
+    ESP_LOGI(TAG, "%" PRIu32 " iterations", iterations);
+    // decode and checksum of the standard debug frame
+    esp_err_t err = linky_benchmark(iterations);
+
+    // messages built from a standard reading
+    bench_std_data();
+    if (web_benchmark(&linky_data, iterations) != ESP_OK)
+    {
+        err = ESP_FAIL;
+    }
+    if (mqtt_benchmark(iterations) != ESP_OK)
+    {
+        err = ESP_FAIL;
+    }
+    if (bench_tuya(iterations) != ESP_OK)
+    {
+        err = ESP_FAIL;
+    }
+    linky_stop();
+
+    printf("Benchmark %s\n", err == ESP_OK ? "done" : "failed");
+    return err == ESP_OK ? 0 : 1;
+}
@@ -0,0 +1,15 @@
+/**
+ * @file console.h
+ * @author Dorian Benech
+ * @brief Host shim: NimBLE, not used by the host build (the BLE pairing of tuya.c)
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2023 GammaTroniques
+ *
+ */
+
+#ifndef CONSOLE_CONSOLE_H
+#define CONSOLE_CONSOLE_H
+
+#endif /* CONSOLE_CONSOLE_H */
@@ -0,0 +1,17 @@
+/**
+ * @file gpio.h
+ * @author Dorian Benech
+ * @brief Host shim: the GPIO types of ESP-IDF
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2023 GammaTroniques
+ *
+ */
+
+#ifndef DRIVER_GPIO_H
+#define DRIVER_GPIO_H
+
+typedef int gpio_num_t;
+
+#endif /* DRIVER_GPIO_H */
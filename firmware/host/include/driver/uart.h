@@ -0,0 +1,151 @@
+/**
+ * @file uart.h
+ * @author Dorian Benech
+ * @brief Host shim: UART driver fed by uart_host_receive(), with the events, the pattern detection and the ring buffer of ESP-IDF
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2023 GammaTroniques
+ *
+ */
+
+#ifndef UART_H
+#define UART_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
+#define UART_NUM_0 0
+#define UART_NUM_1 1
+#define UART_NUM_MAX 2
+#define UART_PIN_NO_CHANGE (-1)
+#define UART_HW_FIFO_LEN(uart_num) 128
+
+#define UART_RXFIFO_FULL_INT_ENA_M (1 << 0)
+#define UART_PARITY_ERR_INT_ENA_M (1 << 2)
+#define UART_FRM_ERR_INT_ENA_M (1 << 3)
+#define UART_RXFIFO_OVF_INT_ENA_M (1 << 4)
+#define UART_BRK_DET_INT_ENA_M (1 << 7)
+#define UART_RXFIFO_TOUT_INT_ENA_M (1 << 8)
+
+typedef int uart_port_t;
+
+typedef enum
+{
+    UART_DATA_5_BITS,
+    UART_DATA_6_BITS,
+    UART_DATA_7_BITS,
+    UART_DATA_8_BITS,
+} uart_word_length_t;
+
+typedef enum
+{
+    UART_PARITY_DISABLE = 0,
+    UART_PARITY_EVEN = 2,
+    UART_PARITY_ODD = 3,
+} uart_parity_t;
+
+typedef enum
+{
+    UART_STOP_BITS_1 = 1,
+    UART_STOP_BITS_1_5 = 2,
+    UART_STOP_BITS_2 = 3,
+} uart_stop_bits_t;
+
+typedef enum
+{
+    UART_HW_FLOWCTRL_DISABLE,
+} uart_hw_flowcontrol_t;
+
+typedef enum
+{
+    UART_SCLK_DEFAULT,
+} uart_sclk_t;
+
+typedef struct
+{
+    int baud_rate;
+    uart_word_length_t data_bits;
+    uart_parity_t parity;
+    uart_stop_bits_t stop_bits;
+    uart_hw_flowcontrol_t flow_ctrl;
+    uint8_t rx_flow_ctrl_thresh;
+    uart_sclk_t source_clk;
+} uart_config_t;
+
+typedef struct
+{
+    uint32_t intr_enable_mask;
+    uint8_t rx_timeout_thresh;
+    uint8_t txfifo_empty_intr_thresh;
+    uint8_t rxfifo_full_thresh;
+} uart_intr_config_t;
+
+typedef enum
+{
+    UART_DATA,
+    UART_BREAK,
+    UART_BUFFER_FULL,
+    UART_FIFO_OVF,
+    UART_FRAME_ERR,
+    UART_PARITY_ERR,
+    UART_DATA_BREAK,
+    UART_PATTERN_DET,
+    UART_EVENT_MAX,
+} uart_event_type_t;
+
+typedef struct
+{
+    uart_event_type_t type;
+    size_t size;
+    bool timeout_flag;
+} uart_event_t;
+
+esp_err_t uart_driver_install(uart_port_t uart_num, int rx_buffer_size, int tx_buffer_size, int queue_size, QueueHandle_t *uart_queue, int intr_alloc_flags);
+esp_err_t uart_driver_delete(uart_port_t uart_num);
+bool uart_is_driver_installed(uart_port_t uart_num);
+esp_err_t uart_param_config(uart_port_t uart_num, const uart_config_t *uart_config);
+esp_err_t uart_set_pin(uart_port_t uart_num, int tx_io_num, int rx_io_num, int rts_io_num, int cts_io_num);
+esp_err_t uart_set_baudrate(uart_port_t uart_num, uint32_t baudrate);
+esp_err_t uart_intr_config(uart_port_t uart_num, const uart_intr_config_t *intr_conf);
+esp_err_t uart_disable_intr_mask(uart_port_t uart_num, uint32_t disable_mask);
+esp_err_t uart_set_wakeup_threshold(uart_port_t uart_num, int wakeup_threshold);
+esp_err_t uart_enable_pattern_det_baud_intr(uart_port_t uart_num, char pattern_chr, uint8_t chr_num, int chr_tout, int post_idle, int pre_idle);
+esp_err_t uart_pattern_queue_reset(uart_port_t uart_num, int queue_length);
+int uart_pattern_pop_pos(uart_port_t uart_num);
+int uart_read_bytes(uart_port_t uart_num, void *buf, uint32_t length, TickType_t ticks_to_wait);
+esp_err_t uart_flush_input(uart_port_t uart_num);
+
+/**
+ * @brief Receive bytes on the RX line of the fake UART, as the driver ISR: the bytes go through the RX FIFO, are
+ * moved to the ring buffer by the enabled interrupts (FIFO full, pattern, and timeout as the line is idle after
+ * the bytes) and the events are sent to the queue of the driver (UART_DATA, UART_PATTERN_DET, UART_BUFFER_FULL,
+ * UART_FIFO_OVF)
+ *
+ * @param uart_num the UART
+ * @param data the received bytes
+ * @param size the number of bytes
+ * @return esp_err_t ESP_ERR_INVALID_STATE if the driver is not installed
+ */
+esp_err_t uart_host_receive(uart_port_t uart_num, const void *data, size_t size);
+
+/**
+ * @brief Send an event without data to the queue of the driver (UART_PARITY_ERR, UART_FRAME_ERR...)
+ */
+esp_err_t uart_host_event(uart_port_t uart_num, uart_event_type_t type);
+
+/**
+ * @brief Get the baud rate set by the firmware
+ */
+uint32_t uart_host_get_baudrate(uart_port_t uart_num);
+
+/**
+ * @brief Get the interrupts enabled by the firmware and by the driver (UART_RXFIFO_TOUT_INT_ENA_M...)
+ */
+uint32_t uart_host_get_intr_mask(uart_port_t uart_num);
+
+#endif /* UART_H */
@@ -0,0 +1,27 @@
+/**
+ * @file adc_oneshot.h
+ * @author Dorian Benech
+ * @brief Host shim: the ADC channels used by gpio.h
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2023 GammaTroniques
+ *
+ */
+
+#ifndef ADC_ONESHOT_H
+#define ADC_ONESHOT_H
+
+#include "freertos/task.h"
+#include "driver/gpio.h"
+
+typedef enum
+{
+    ADC_CHANNEL_0,
+    ADC_CHANNEL_1,
+    ADC_CHANNEL_2,
+    ADC_CHANNEL_3,
+    ADC_CHANNEL_4,
+} adc_channel_t;
+
+#endif /* ADC_ONESHOT_H */
@@ -0,0 +1,19 @@
+/**
+ * @file esp_crc.h
+ * @author Dorian Benech
+ * @brief Host shim: CRC32 of the ROM
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2023 GammaTroniques
+ *
+ */
+
+#ifndef ESP_CRC_H
+#define ESP_CRC_H
+
+#include <stdint.h>
+
+uint32_t esp_crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len);
+
+#endif /* ESP_CRC_H */
@@ -0,0 +1,24 @@
+/**
+ * @file esp_efuse.h
+ * @author Dorian Benech
+ * @brief Host shim: the efuse field type of efuse_table.h
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2023 GammaTroniques
+ *
+ */
+
+#ifndef ESP_EFUSE_H
+#define ESP_EFUSE_H
+
+#include <stdint.h>
+
+typedef struct
+{
+    int efuse_block;
+    uint8_t bit_start;
+    uint16_t bit_count;
+} esp_efuse_desc_t;
+
+#endif /* ESP_EFUSE_H */
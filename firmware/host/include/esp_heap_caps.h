@@ -0,0 +1,36 @@
+/**
+ * @file esp_heap_caps.h
+ * @author Dorian Benech
+ * @brief Host shim: heap information of the allocations of the firmware
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2023 GammaTroniques
+ *
+ */
+
+#ifndef ESP_HEAP_CAPS_H
+#define ESP_HEAP_CAPS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MALLOC_CAP_DEFAULT (1 << 12)
+
+typedef struct
+{
+    size_t total_free_bytes;
+    size_t total_allocated_bytes;
+    size_t largest_free_block;
+    size_t minimum_free_bytes;
+    size_t allocated_blocks;
+    size_t free_blocks;
+    size_t total_blocks;
+} multi_heap_info_t;
+
+/**
+ * @brief Blocks and bytes allocated by malloc, calloc and realloc, counted by their wrappers (see CMakeLists.txt)
+ */
+void heap_caps_get_info(multi_heap_info_t *info, uint32_t caps);
+
+#endif /* ESP_HEAP_CAPS_H */
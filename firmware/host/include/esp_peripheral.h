@@ -0,0 +1,15 @@
+/**
+ * @file esp_peripheral.h
+ * @author Dorian Benech
+ * @brief Host shim: NimBLE, not used by the host build (the BLE pairing of tuya.c)
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2023 GammaTroniques
+ *
+ */
+
+#ifndef ESP_PERIPHERAL_H
+#define ESP_PERIPHERAL_H
+
+#endif /* ESP_PERIPHERAL_H */
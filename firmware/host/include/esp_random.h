@@ -0,0 +1,19 @@
+/**
+ * @file esp_random.h
+ * @author Dorian Benech
+ * @brief Host shim: random numbers, from rand()
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2023 GammaTroniques
+ *
+ */
+
+#ifndef ESP_RANDOM_H
+#define ESP_RANDOM_H
+
+#include <stdint.h>
+
+uint32_t esp_random(void);
+
+#endif /* ESP_RANDOM_H */
@@ -0,0 +1,19 @@
+/**
+ * @file esp_sleep.h
+ * @author Dorian Benech
+ * @brief Host shim: sleep wakeup sources, which do nothing
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2023 GammaTroniques
+ *
+ */
+
+#ifndef ESP_SLEEP_H
+#define ESP_SLEEP_H
+
+#include "esp_err.h"
+
+esp_err_t esp_sleep_enable_uart_wakeup(int uart_num);
+
+#endif /* ESP_SLEEP_H */
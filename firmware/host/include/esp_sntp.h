@@ -0,0 +1,15 @@
+/**
+ * @file esp_sntp.h
+ * @author Dorian Benech
+ * @brief Host shim: SNTP, not used by the host build
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2023 GammaTroniques
+ *
+ */
+
+#ifndef ESP_SNTP_H
+#define ESP_SNTP_H
+
+#endif /* ESP_SNTP_H */
@@ -0,0 +1,19 @@
+/**
+ * @file esp_system.h
+ * @author Dorian Benech
+ * @brief Host shim: system functions of ESP-IDF
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2023 GammaTroniques
+ *
+ */
+
+#ifndef ESP_SYSTEM_H
+#define ESP_SYSTEM_H
+
+#include "esp_err.h"
+
+void esp_restart(void);
+
+#endif /* ESP_SYSTEM_H */
@@ -0,0 +1,19 @@
+/**
+ * @file esp_timer.h
+ * @author Dorian Benech
+ * @brief Host shim: time since the start of the program, from the monotonic clock
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2023 GammaTroniques
+ *
+ */
+
+#ifndef ESP_TIMER_H
+#define ESP_TIMER_H
+
+#include <stdint.h>
+
+int64_t esp_timer_get_time(void);
+
+#endif /* ESP_TIMER_H */
@@ -0,0 +1,45 @@
+/**
+ * @file esp_zigbee_core.h
+ * @author Dorian Benech
+ * @brief Host shim: the ZCL attribute types of the label list
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2023 GammaTroniques
+ *
+ */
+
+#ifndef ESP_ZIGBEE_CORE_H
+#define ESP_ZIGBEE_CORE_H
+
+#include <stdint.h>
+
+typedef enum
+{
+    ESP_ZB_ZCL_ATTR_TYPE_BOOL = 0x10,
+    ESP_ZB_ZCL_ATTR_TYPE_U8 = 0x20,
+    ESP_ZB_ZCL_ATTR_TYPE_U16 = 0x21,
+    ESP_ZB_ZCL_ATTR_TYPE_U24 = 0x22,
+    ESP_ZB_ZCL_ATTR_TYPE_U32 = 0x23,
+    ESP_ZB_ZCL_ATTR_TYPE_U48 = 0x25,
+    ESP_ZB_ZCL_ATTR_TYPE_U64 = 0x27,
+    ESP_ZB_ZCL_ATTR_TYPE_S8 = 0x28,
+    ESP_ZB_ZCL_ATTR_TYPE_S16 = 0x29,
+    ESP_ZB_ZCL_ATTR_TYPE_S24 = 0x2a,
+    ESP_ZB_ZCL_ATTR_TYPE_S32 = 0x2b,
+    ESP_ZB_ZCL_ATTR_TYPE_S48 = 0x2d,
+    ESP_ZB_ZCL_ATTR_TYPE_S64 = 0x2f,
+    ESP_ZB_ZCL_ATTR_TYPE_8BIT_ENUM = 0x30,
+    ESP_ZB_ZCL_ATTR_TYPE_OCTET_STRING = 0x41,
+    ESP_ZB_ZCL_ATTR_TYPE_CHAR_STRING = 0x42,
+} esp_zb_zcl_attr_type_t;
+
+typedef enum
+{
+    ESP_ZB_ZCL_ATTR_ACCESS_READ_ONLY = 0x01,
+    ESP_ZB_ZCL_ATTR_ACCESS_WRITE_ONLY = 0x02,
+    ESP_ZB_ZCL_ATTR_ACCESS_READ_WRITE = 0x03,
+    ESP_ZB_ZCL_ATTR_ACCESS_REPORTING = 0x04,
+} esp_zb_zcl_attr_access_t;
+
+#endif /* ESP_ZIGBEE_CORE_H */
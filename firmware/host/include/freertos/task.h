@@ -0,0 +1,34 @@
+/**
+ * @file task.h
+ * @author Dorian Benech
+ * @brief Host shim: the FreeRTOS tasks, run by threads
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2023 GammaTroniques
+ *
+ */
+
+#ifndef TASK_H
+#define TASK_H
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct host_task *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+/**
+ * @brief Start a thread: the stack size and the priority are ignored
+ */
+BaseType_t xTaskCreate(TaskFunction_t function, const char *name, uint32_t stack_depth, void *parameters, UBaseType_t priority, TaskHandle_t *handle);
+
+/**
+ * @brief Delete a task: the calling thread exits with NULL, an other one is cancelled at its next wait
+ */
+void vTaskDelete(TaskHandle_t task);
+void vTaskDelay(TickType_t ticks);
+TickType_t xTaskGetTickCount(void);
+void vTaskSuspend(TaskHandle_t task);
+void vTaskResume(TaskHandle_t task);
+
+#endif /* TASK_H */
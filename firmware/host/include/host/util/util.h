@@ -0,0 +1,15 @@
+/**
+ * @file util.h
+ * @author Dorian Benech
+ * @brief Host shim: NimBLE, not used by the host build (the BLE pairing of tuya.c)
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2023 GammaTroniques
+ *
+ */
+
+#ifndef HOST_UTIL_UTIL_H
+#define HOST_UTIL_UTIL_H
+
+#endif /* HOST_UTIL_UTIL_H */
@@ -0,0 +1,17 @@
+/**
+ * @file lwip/err.h
+ * @author Dorian Benech
+ * @brief Host shim: lwIP errors
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2023 GammaTroniques
+ *
+ */
+
+#ifndef LWIP_ERR_H
+#define LWIP_ERR_H
+
+typedef signed char err_t;
+
+#endif /* LWIP_ERR_H */
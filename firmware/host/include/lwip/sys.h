@@ -0,0 +1,22 @@
+/**
+ * @file lwip/sys.h
+ * @author Dorian Benech
+ * @brief Host shim: the address type of wifi.h
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2023 GammaTroniques
+ *
+ */
+
+#ifndef LWIP_SYS_H
+#define LWIP_SYS_H
+
+#include <stdint.h>
+
+typedef struct
+{
+    uint32_t addr;
+} ip_addr_t;
+
+#endif /* LWIP_SYS_H */
@@ -0,0 +1,15 @@
+/**
+ * @file mbedtls/md.h
+ * @author Dorian Benech
+ * @brief Host shim: mbedtls, not used by the host build
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2023 GammaTroniques
+ *
+ */
+
+#ifndef MBEDTLS_MD_H
+#define MBEDTLS_MD_H
+
+#endif /* MBEDTLS_MD_H */
@@ -0,0 +1,15 @@
+/**
+ * @file modlog.h
+ * @author Dorian Benech
+ * @brief Host shim: NimBLE, not used by the host build (the BLE pairing of tuya.c)
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2023 GammaTroniques
+ *
+ */
+
+#ifndef MODLOG_MODLOG_H
+#define MODLOG_MODLOG_H
+
+#endif /* MODLOG_MODLOG_H */
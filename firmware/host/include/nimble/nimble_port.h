@@ -0,0 +1,15 @@
+/**
+ * @file nimble_port.h
+ * @author Dorian Benech
+ * @brief Host shim: NimBLE, not used by the host build (the BLE pairing of tuya.c)
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2023 GammaTroniques
+ *
+ */
+
+#ifndef NIMBLE_NIMBLE_PORT_H
+#define NIMBLE_NIMBLE_PORT_H
+
+#endif /* NIMBLE_NIMBLE_PORT_H */
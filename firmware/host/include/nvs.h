@@ -0,0 +1,20 @@
+/**
+ * @file nvs.h
+ * @author Dorian Benech
+ * @brief Host shim: the NVS types, the firmware reads and writes the NVS through config.c, replaced by shims/config.c
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2023 GammaTroniques
+ *
+ */
+
+#ifndef NVS_H
+#define NVS_H
+
+#include <stdint.h>
+#include "esp_err.h"
+
+typedef uint32_t nvs_handle_t;
+
+#endif /* NVS_H */
@@ -0,0 +1,17 @@
+/**
+ * @file nvs_flash.h
+ * @author Dorian Benech
+ * @brief Host shim: the NVS partition
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2023 GammaTroniques
+ *
+ */
+
+#ifndef NVS_FLASH_H
+#define NVS_FLASH_H
+
+#include "nvs.h"
+
+#endif /* NVS_FLASH_H */
@@ -0,0 +1,15 @@
+/**
+ * @file ble_svc_gap.h
+ * @author Dorian Benech
+ * @brief Host shim: NimBLE, not used by the host build (the BLE pairing of tuya.c)
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2023 GammaTroniques
+ *
+ */
+
+#ifndef SERVICES_GAP_BLE_SVC_GAP_H
+#define SERVICES_GAP_BLE_SVC_GAP_H
+
+#endif /* SERVICES_GAP_BLE_SVC_GAP_H */
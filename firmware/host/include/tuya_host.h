@@ -0,0 +1,30 @@
+/**
+ * @file tuya_host.h
+ * @author Dorian Benech
+ * @brief Host shim: access to the dps received by the fake Tuya cloud of shims/tuya_iot.c
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2023 GammaTroniques
+ *
+ */
+
+#ifndef TUYA_HOST_H
+#define TUYA_HOST_H
+
+#include <stdint.h>
+
+/**
+ * @brief Get the json of the last dp report received by the cloud
+ *
+ * @param count the number of reports since the last tuya_host_clear(), can be NULL
+ * @return const char* the dps, NULL if none
+ */
+const char *tuya_host_last_dps(uint32_t *count);
+
+/**
+ * @brief Forget the reports received by the cloud
+ */
+void tuya_host_clear();
+
+#endif /* TUYA_HOST_H */
@@ -0,0 +1,395 @@
+/**
+ * @file replay.c
+ * @author Dorian Benech
+ * @brief Host replay of a Linky capture through the UART shim and the firmware decoder, at the line rate or faster
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2023 GammaTroniques
+ *
+ */
+
+/*==============================================================================
+ Local Include
+===============================================================================*/
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "driver/uart.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "config.h"
+#include "linky.h"
+#include "capture.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*==============================================================================
+ Local Define
+===============================================================================*/
+#define TAG "HOST_REPLAY"
+#define REPLAY_LINKY_UART UART_NUM_1 // LINKY_UART of linky.c
+#define REPLAY_MAX_RECORDS 1024
+#define REPLAY_BURST 32              // Bytes received at once by the UART, as the RX FIFO fills at the line rate
+#define REPLAY_DRAIN_TIMEOUT 1000    // Time given to the decoder after the last record (ms)
+#define START_OF_FRAME 0x02
+#define END_OF_FRAME 0x03
+
+/*==============================================================================
+ Local Macro
+===============================================================================*/
+
+/*==============================================================================
+ Local Type
+===============================================================================*/
+typedef struct
+{
+    capture_record_t header;
+    uint8_t *data;
+} replay_record_t;
+
+typedef struct
+{
+    replay_record_t records[REPLAY_MAX_RECORDS];
+    uint32_t count;
+    uint32_t bytes;
+} replay_capture_t;
+
+/*==============================================================================
+ Local Function Declaration
+===============================================================================*/
+static bool replay_add(replay_capture_t *capture, uint32_t time, linky_mode_t mode, const uint8_t *data, uint32_t size);
+static bool replay_load_binary(replay_capture_t *capture, const uint8_t *content, uint32_t size);
+static bool replay_load_text(replay_capture_t *capture, const char *content, uint32_t size);
+static esp_err_t replay_uart(const replay_capture_t *capture, uint32_t speed, const linky_replay_t *reference, const linky_data_t *reference_data);
+static uint32_t replay_compare(const linky_data_t *reference, linky_mode_t mode);
+
+/*==============================================================================
+Public Variable
+===============================================================================*/
+extern uint8_t linky_reading; // linky.c: the received frames are decoded while it is set
+
+/*==============================================================================
+ Local Variable
+===============================================================================*/
+static replay_capture_t replay_capture = {0};
+static linky_data_t replay_reference_data = {0}; // the values decoded by the parser, without the UART
+
+/*==============================================================================
+Function Implementation
+===============================================================================*/
+
+/**
+ * @brief Get the baud rate of a mode, to compute the arrival time of the bytes
+ */
+static uint32_t replay_baud_rate(linky_mode_t mode)
+{
+    return mode == MODE_HIST ? 1200 : 9600;
+}
+
+/**
+ * @brief Add a record to the capture, the bytes are copied
+ */
+static bool replay_add(replay_capture_t *capture, uint32_t time, linky_mode_t mode, const uint8_t *data, uint32_t size)
+{
+    if (capture->count >= REPLAY_MAX_RECORDS)
+    {
+        ESP_LOGE(TAG, "More than %d records", REPLAY_MAX_RECORDS);
+        return false;
+    }
+    replay_record_t *record = &capture->records[capture->count];
+    record->data = malloc(size);
+    if (record->data == NULL)
+    {
+        return false;
+    }
+    memcpy(record->data, data, size);
+    record->header.time = time;
+    record->header.size = size;
+    record->header.mode = mode;
+    capture->count++;
+    capture->bytes += size;
+    return true;
+}
+
+/**
+ * @brief Load the records downloaded from /capture: a capture_record_t followed by the bytes, as scripts/capture.py
+ */
+static bool replay_load_binary(replay_capture_t *capture, const uint8_t *content, uint32_t size)
+{
+    uint32_t offset = 0;
+    while (offset + sizeof(capture_record_t) <= size)
+    {
+        capture_record_t header;
+        memcpy(&header, content + offset, sizeof(header));
+        offset += sizeof(header);
+        if (offset + header.size > size)
+        {
+            ESP_LOGW(TAG, "Truncated record at %" PRIu32 " ms", header.time);
+            break;
+        }
+        if (!replay_add(capture, header.time, header.mode, content + offset, header.size))
+        {
+            return false;
+        }
+        offset += header.size;
+    }
+    return capture->count > 0;
+}
+
+/**
+ * @brief Load a frame in the notation of tramesLinky and scripts/trames.py: the control characters are written
+ * as [decimal], the line breaks of the file are not received bytes
+ * The capture is cut in a record per frame, timed at the line rate of its mode (tab separators: standard)
+ */
+static bool replay_load_text(replay_capture_t *capture, const char *content, uint32_t size)
+{
+    uint8_t *bytes = malloc(size);
+    if (bytes == NULL)
+    {
+        return false;
+    }
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < size; i++)
+    {
+        char *end = NULL;
+        if (content[i] == '\n' || content[i] == '\r')
+        {
+            continue;
+        }
+        if (content[i] == '[' && (content[i + 1] >= '0' && content[i + 1] <= '9'))
+        {
+            unsigned long value = strtoul(content + i + 1, &end, 10);
+            if (*end == ']' && value <= UINT8_MAX)
+            {
+                bytes[count++] = value;
+                i = end - content;
+                continue;
+            }
+        }
+        bytes[count++] = content[i];
+    }
+
+    linky_mode_t mode = memchr(bytes, '\t', count) != NULL ? MODE_STD : MODE_HIST;
+    uint32_t baud_rate = replay_baud_rate(mode);
+    uint32_t start = 0;
+    bool ok = true;
+    for (uint32_t i = 0; i < count && ok; i++)
+    {
+        if (bytes[i] == END_OF_FRAME)
+        {
+            // 10 bits per byte: the time of the END_OF_FRAME since the first byte
+            ok = replay_add(capture, (uint64_t)(i + 1) * 10 * 1000 / baud_rate, mode, bytes + start, i + 1 - start);
+            start = i + 1;
+        }
+    }
+    free(bytes);
+    return ok && capture->count > 0;
+}
+
+/**
+ * @brief Compare the values decoded in a mode with the values of the reference decoding
+ *
+ * @return uint32_t the number of labels with another value
+ */
+static uint32_t replay_compare(const linky_data_t *reference, linky_mode_t mode)
+{
+    uint32_t differences = 0;
+    uint32_t count = 0;
+    const uint8_t *labels = linky_get_mode_labels(mode, &count);
+    for (uint32_t n = 0; n < count; n++)
+    {
+        const linky_value_t *label = &linky_label_list[labels[n]];
+        if (label->mode != mode)
+        {
+            continue; // computed from the decoded values
+        }
+        const uint8_t *decoded = label->data;
+        const uint8_t *expected = (const uint8_t *)reference + (decoded - (const uint8_t *)&linky_data);
+        bool same = true;
+        switch (label->type)
+        {
+        case STRING:
+            same = strncmp((const char *)decoded, (const char *)expected, label->size + 1) == 0;
+            break;
+        case UINT8:
+        case UINT16:
+        case UINT32:
+        case UINT64:
+            same = memcmp(decoded, expected, label->type) == 0; // the type is the size of the value
+            break;
+        case UINT32_TIME:
+            same = memcmp(decoded, expected, sizeof(time_label_t)) == 0;
+            break;
+        default:
+            break;
+        }
+        if (!same)
+        {
+            ESP_LOGE(TAG, "%s: not the value of the reference decoding", label->label);
+            differences++;
+        }
+    }
+    return differences;
+}
+
+/**
+ * @brief Send the capture to the UART shim and check what the firmware decodes
+ *
+ * @param speed 1 for the line rate, 1000 to go 1000 times faster, 0 to not wait
+ * @param reference the counters of the reference decoding
+ * @param reference_data the values of the reference decoding
+ * @return esp_err_t ESP_FAIL if the firmware decoded something else
+ */
+static esp_err_t replay_uart(const replay_capture_t *capture, uint32_t speed, const linky_replay_t *reference, const linky_data_t *reference_data)
+{
+    linky_clear_data();
+    linky_metrics_reset();
+    linky_reading = 1;
+
+    // the bytes arrive at the line rate (10 bits per byte), a record ends at its time
+    const capture_record_t *first = &capture->records[0].header;
+    int64_t origin = (int64_t)first->time * 1000 - first->size * ((int64_t)10 * 1000000 / replay_baud_rate(first->mode));
+    int64_t start = esp_timer_get_time();
+    for (uint32_t i = 0; i < capture->count; i++)
+    {
+        const replay_record_t *record = &capture->records[i];
+        if (record->header.mode != linky_mode)
+        {
+            linky_set_mode(record->header.mode); // the capture was recorded across a mode change
+        }
+        int64_t byte_time = (int64_t)10 * 1000000 / replay_baud_rate(record->header.mode);
+        int64_t due = (int64_t)record->header.time * 1000 - record->header.size * byte_time - origin;
+        for (uint32_t offset = 0; offset < record->header.size; offset += REPLAY_BURST)
+        {
+            if (speed > 0)
+            {
+                int64_t wait = start + (due + (offset + REPLAY_BURST) * byte_time) / speed - esp_timer_get_time();
+                if (wait >= 1000)
+                {
+                    vTaskDelay(wait / 1000 / portTICK_PERIOD_MS);
+                }
+            }
+            uart_host_receive(REPLAY_LINKY_UART, record->data + offset, MIN(REPLAY_BURST, record->header.size - offset));
+        }
+    }
+    int64_t feed_time = esp_timer_get_time() - start;
+
+    // the UART task and the decoder task finish the last frames
+    const linky_metrics_t *m = &linky_metrics;
+    for (uint32_t i = 0; i < REPLAY_DRAIN_TIMEOUT && (m->frames_received < reference->frames || m->frames_decoded + m->frames_dropped < m->frames_received); i++)
+    {
+        vTaskDelay(1 / portTICK_PERIOD_MS);
+    }
+    int64_t time = esp_timer_get_time() - start;
+    linky_reading = 0;
+
+    ESP_LOGI(TAG, "Replay x%" PRIu32 ": %" PRIu32 " frames in %" PRId64 " ms (%" PRId64 " B/s), %" PRIu32 " valid, %" PRIu32 " dropped, %" PRIu32 " checksum errors, decode max %" PRIu32 " us",
+             speed, m->frames_received, time / 1000, feed_time > 0 ? (int64_t)capture->bytes * 1000000 / feed_time : 0, m->frames_valid, m->frames_dropped, m->checksum_errors,
+             m->decode_time_max);
+
+    esp_err_t err = ESP_OK;
+    if (m->frames_received != reference->frames || m->frames_valid != reference->frames_valid || m->checksum_errors != reference->checksum_errors)
+    {
+        ESP_LOGE(TAG, "Replay x%" PRIu32 ": %" PRIu32 "/%" PRIu32 " valid frames and %" PRIu32 " checksum errors, the parser found %" PRIu32 "/%" PRIu32 " and %" PRIu32, speed,
+                 m->frames_valid, m->frames_received, m->checksum_errors, reference->frames_valid, reference->frames, reference->checksum_errors);
+        err = ESP_FAIL;
+    }
+    if (m->frames_dropped > 0 || m->uart_fifo_overflow > 0 || m->uart_buffer_full > 0 || m->uart_pattern_overflow > 0)
+    {
+        ESP_LOGE(TAG, "Replay x%" PRIu32 ": bytes lost: %" PRIu32 " frames dropped, fifo overflow: %" PRIu32 ", buffer full: %" PRIu32 ", pattern overflow: %" PRIu32, speed,
+                 m->frames_dropped, m->uart_fifo_overflow, m->uart_buffer_full, m->uart_pattern_overflow);
+        err = ESP_FAIL;
+    }
+    if (replay_compare(reference_data, linky_mode) > 0)
+    {
+        err = ESP_FAIL;
+    }
+    return err;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s <capture.bin | frame.txt> [speed...]\n", argv[0]);
+        fprintf(stderr, "  capture.bin: downloaded from http://<ip>/capture, frame.txt: notation of tramesLinky\n");
+        fprintf(stderr, "  speed: 1 for the line rate, 1000 to go 1000 times faster, 0 to not wait (default: 1 1000)\n");
+        return 2;
+    }
+
+    FILE *file = fopen(argv[1], "rb");
+    if (file == NULL)
+    {
+        perror(argv[1]);
+        return 2;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char *content = malloc(size + 1);
+    if (content == NULL || fread(content, 1, size, file) != (size_t)size)
+    {
+        fprintf(stderr, "%s: can't read the capture\n", argv[1]);
+        fclose(file);
+        return 2;
+    }
+    fclose(file);
+    content[size] = '\0';
+
+    const char *extension = strrchr(argv[1], '.');
+    bool text = extension != NULL && strcmp(extension, ".txt") == 0;
+    bool loaded = text ? replay_load_text(&replay_capture, content, size) : replay_load_binary(&replay_capture, (uint8_t *)content, size);
+    free(content);
+    if (!loaded)
+    {
+        fprintf(stderr, "%s: no record\n", argv[1]);
+        return 2;
+    }
+
+    esp_log_level_set("*", ESP_LOG_INFO);
+    config_erase();
+    config_values.linky_mode = replay_capture.records[0].header.mode;
+    linky_init(0);
+    esp_log_level_set("LINKY", ESP_LOG_WARN); // a log per frame otherwise
+    ESP_LOGI(TAG, "%s: %" PRIu32 " records, %" PRIu32 " bytes, %s", argv[1], replay_capture.count, replay_capture.bytes,
+             linky_str_mode[replay_capture.records[0].header.mode]);
+
+    // reference: the bytes fed directly to the parser, as capture-replay on the device
+    linky_replay_t reference = {0};
+    linky_replay_start(replay_capture.records[0].header.mode);
+    for (uint32_t i = 0; i < replay_capture.count; i++)
+    {
+        const replay_record_t *record = &replay_capture.records[i];
+        linky_replay_feed(record->data, record->header.size, record->header.mode, &reference);
+    }
+    replay_reference_data = linky_data; // linky_replay_end() clears it
+    linky_replay_end();
+    ESP_LOGI(TAG, "Parser: %" PRIu32 " frames, %" PRIu32 " valid, %" PRIu32 " groups, %" PRIu32 " checksum errors, %" PRIu32 " value errors, %" PRId64 " us/frame",
+             reference.frames, reference.frames_valid, reference.groups, reference.checksum_errors, reference.value_errors,
+             reference.frames > 0 ? reference.decode_time / reference.frames : 0);
+
+    esp_err_t err = ESP_OK;
+    static const char *const default_speeds[] = {"1", "1000"};
+    const char *const *speeds = argc > 2 ? (const char *const *)argv + 2 : default_speeds;
+    uint32_t speed_count = argc > 2 ? argc - 2 : sizeof(default_speeds) / sizeof(default_speeds[0]);
+    for (uint32_t i = 0; i < speed_count; i++)
+    {
+        if (replay_uart(&replay_capture, strtoul(speeds[i], NULL, 10), &reference, &replay_reference_data) != ESP_OK)
+        {
+            err = ESP_FAIL;
+        }
+        if (linky_mode != replay_capture.records[0].header.mode)
+        {
+            linky_set_mode(replay_capture.records[0].header.mode); // the next speed starts as the capture
+        }
+    }
+    linky_stop();
+
+    for (uint32_t i = 0; i < replay_capture.count; i++)
+    {
+        free(replay_capture.records[i].data);
+    }
+    printf("Replay %s\n", err == ESP_OK ? "done" : "failed");
+    return err == ESP_OK ? 0 : 1;
+}
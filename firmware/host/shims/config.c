@@ -0,0 +1,236 @@
+/**
+ * @file config.c
+ * @author Dorian Benech
+ * @brief Host shim: config.c over a NVS in RAM, with the efuse values of a test device
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2023 GammaTroniques
+ *
+ */
+
+/*==============================================================================
+ Local Include
+===============================================================================*/
+#include "config.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*==============================================================================
+ Local Define
+===============================================================================*/
+#define TAG "CONFIG"
+#define NVS_KEY_SIZE 16 // 15 characters and the terminator, as the NVS keys
+
+/*==============================================================================
+ Local Macro
+===============================================================================*/
+
+/*==============================================================================
+ Local Type
+===============================================================================*/
+typedef struct nvs_entry_t
+{
+    char name[NVS_KEY_SIZE];
+    void *value;
+    size_t size;
+    struct nvs_entry_t *next;
+} nvs_entry_t;
+
+/*==============================================================================
+ Local Function Declaration
+===============================================================================*/
+static nvs_entry_t *nvs_find(const char *name);
+
+/*==============================================================================
+Public Variable
+===============================================================================*/
+const char *const MODES[] = {
+    [MODE_NONE] = "NONE",
+    [MODE_HTTP] = "WEB",
+    [MODE_MQTT] = "MQTT",
+    [MODE_MQTT_HA] = "MQTT_HA",
+    [MODE_ZIGBEE] = "ZIGBEE",
+    [MODE_MATTER] = "MATTER",
+    [MODE_TUYA] = "TUYA",
+};
+
+config_t config_values = {0};
+efuse_t efuse_values = {
+    .serial_number = "H0000000001",
+    .mac_address = "A0B765000001",
+    .hw_version = {3, 2, 0},
+};
+uint32_t config_generation = 0; // Incremented when config_values is read or written
+
+/*==============================================================================
+ Local Variable
+===============================================================================*/
+static nvs_entry_t *nvs_entries = NULL;
+static pthread_mutex_t nvs_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/*==============================================================================
+Function Implementation
+===============================================================================*/
+
+const char *config_get_str_mode()
+{
+    const char *mode = MODES[config_values.mode];
+    if (mode == NULL)
+    {
+        mode = "UNKNOWN";
+    }
+    return mode;
+}
+
+int8_t config_erase()
+{
+    // the defaults of the firmware
+    config_t blank_config = {
+        .initialized = 1,
+        .refresh_rate = 60,
+        .sleep = 1,
+        .linky_mode = AUTO,
+        .last_linky_mode = NONE,
+        .mode = MODE_MQTT_HA,
+
+        .mqtt.port = 1883,
+        .pairing_state = TUYA_NOT_CONFIGURED,
+        .zigbee.state = ZIGBEE_NOT_CONFIGURED,
+        .index_offset = {0},
+
+        .web.store_before_send = 3,
+    };
+
+    snprintf(blank_config.mqtt.topic, sizeof(blank_config.mqtt.topic), "TICMeter/%s", efuse_values.mac_address + 6);
+    config_values = blank_config;
+    return 0;
+}
+
+int8_t config_begin()
+{
+    if (config_read() != 0)
+    {
+        config_erase();
+        config_write();
+    }
+    return 0;
+}
+
+int8_t config_read()
+{
+    config_generation++;
+    return config_read_blob("config", &config_values, sizeof(config_values)) == ESP_OK ? 0 : -1;
+}
+
+int8_t config_write()
+{
+    config_generation++;
+    return config_write_blob("config", &config_values, sizeof(config_values)) == ESP_OK ? 0 : -1;
+}
+
+uint8_t config_factory_reset()
+{
+    config_erase_partition("nvs");
+    config_erase();
+    return 0;
+}
+
+esp_err_t config_erase_partition(const char *partition_label)
+{
+    if (strcmp(partition_label, "nvs") != 0)
+    {
+        return ESP_ERR_NOT_FOUND; // the NVS is the only partition of the config
+    }
+    pthread_mutex_lock(&nvs_mutex);
+    while (nvs_entries != NULL)
+    {
+        nvs_entry_t *next = nvs_entries->next;
+        free(nvs_entries->value);
+        free(nvs_entries);
+        nvs_entries = next;
+    }
+    pthread_mutex_unlock(&nvs_mutex);
+    return ESP_OK;
+}
+
+/**
+ * @brief Find a key of the NVS, the mutex must be taken
+ */
+static nvs_entry_t *nvs_find(const char *name)
+{
+    for (nvs_entry_t *entry = nvs_entries; entry != NULL; entry = entry->next)
+    {
+        if (strcmp(entry->name, name) == 0)
+        {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+esp_err_t config_read_blob(const char *name, void *value, size_t size)
+{
+    pthread_mutex_lock(&nvs_mutex);
+    esp_err_t err = ESP_ERR_NVS_NOT_FOUND;
+    nvs_entry_t *entry = nvs_find(name);
+    if (entry != NULL && entry->size != size)
+    {
+        err = ESP_ERR_NVS_INVALID_LENGTH; // written by another firmware version
+    }
+    else if (entry != NULL)
+    {
+        memcpy(value, entry->value, size);
+        err = ESP_OK;
+    }
+    pthread_mutex_unlock(&nvs_mutex);
+    return err;
+}
+
+esp_err_t config_write_blob(const char *name, const void *value, size_t size)
+{
+    if (strlen(name) >= NVS_KEY_SIZE)
+    {
+        ESP_LOGE(TAG, "Key too long: %s", name);
+        return ESP_ERR_NVS_KEY_TOO_LONG;
+    }
+    void *copy = malloc(size);
+    if (copy == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(copy, value, size);
+
+    pthread_mutex_lock(&nvs_mutex);
+    esp_err_t err = ESP_OK;
+    nvs_entry_t *entry = nvs_find(name);
+    if (entry == NULL)
+    {
+        entry = calloc(1, sizeof(nvs_entry_t));
+        if (entry != NULL)
+        {
+            strcpy(entry->name, name);
+            entry->next = nvs_entries;
+            nvs_entries = entry;
+        }
+    }
+    if (entry != NULL)
+    {
+        free(entry->value);
+        entry->value = copy;
+        entry->size = size;
+    }
+    else
+    {
+        free(copy);
+        err = ESP_ERR_NO_MEM;
+    }
+    pthread_mutex_unlock(&nvs_mutex);
+    return err;
+}
+
+uint32_t config_get_hw_version()
+{
+    return (efuse_values.hw_version[0] << 16) | (efuse_values.hw_version[1] << 8) | efuse_values.hw_version[2];
+}
@@ -0,0 +1,100 @@
+/**
+ * @file firmware.c
+ * @author Dorian Benech
+ * @brief Host shim: the parts of the firmware outside of the host build (LEDs, GPIO, WiFi, OTA and capture)
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2023 GammaTroniques
+ *
+ */
+
+/*==============================================================================
+ Local Include
+===============================================================================*/
+#include <stdbool.h> // before led.h, which does not include it
+#include "led.h"
+#include "gpio.h"
+#include "wifi.h"
+#include "ota.h"
+#include "ota_zlib.h"
+#include "capture.h"
+#include <time.h>
+
+/*==============================================================================
+ Local Define
+===============================================================================*/
+#define HOST_VCONDO 4.0 // V: the supercapacitor is charged
+
+/*==============================================================================
+ Local Macro
+===============================================================================*/
+
+/*==============================================================================
+ Local Type
+===============================================================================*/
+
+/*==============================================================================
+ Local Function Declaration
+===============================================================================*/
+
+/*==============================================================================
+Public Variable
+===============================================================================*/
+wifi_state_t wifi_state = WIFI_CONNECTED; // the fake MQTT broker is always reachable
+bool ota_available = false;
+TaskHandle_t gpio_led_pairing_task_handle = NULL;
+
+/*==============================================================================
+ Local Variable
+===============================================================================*/
+
+/*==============================================================================
+Function Implementation
+===============================================================================*/
+void led_start_pattern(led_pattern_t pattern)
+{
+}
+
+void led_stop_pattern(led_pattern_t pattern)
+{
+}
+
+float gpio_get_vcondo()
+{
+    return HOST_VCONDO;
+}
+
+esp_err_t wifi_connect()
+{
+    return wifi_state == WIFI_CONNECTED ? ESP_OK : ESP_FAIL;
+}
+
+void wifi_set_credentials(const char *ssid, const char *password)
+{
+}
+
+time_t wifi_get_timestamp()
+{
+    return time(NULL);
+}
+
+esp_err_t ota_zlib_init()
+{
+    return ESP_ERR_NOT_SUPPORTED; // no OTA in the host build
+}
+
+esp_err_t ota_zlib_write(const uint8_t *data, size_t len)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t ota_zlib_end()
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+void capture_add(const uint8_t *data, uint32_t size, linky_mode_t mode)
+{
+    // no capture in the host build
+}
@@ -0,0 +1,438 @@
+/**
+ * @file freertos.c
+ * @author Dorian Benech
+ * @brief Host shim: FreeRTOS tasks, queues and event groups over POSIX threads
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2023 GammaTroniques
+ *
+ */
+
+/*==============================================================================
+ Local Include
+===============================================================================*/
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/event_groups.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+
+/*==============================================================================
+ Local Define
+===============================================================================*/
+
+/*==============================================================================
+ Local Macro
+===============================================================================*/
+
+/*==============================================================================
+ Local Type
+===============================================================================*/
+struct host_task
+{
+    pthread_t thread;
+    TaskFunction_t function;
+    void *parameters;
+};
+
+struct host_queue
+{
+    pthread_mutex_t mutex;
+    pthread_cond_t changed;
+    uint8_t *items;
+    UBaseType_t length;
+    UBaseType_t item_size;
+    UBaseType_t count;
+    UBaseType_t head; // Next item to receive
+};
+
+struct host_event_group
+{
+    pthread_mutex_t mutex;
+    pthread_cond_t changed;
+    EventBits_t bits;
+};
+
+/*==============================================================================
+ Local Function Declaration
+===============================================================================*/
+
+/*==============================================================================
+Public Variable
+===============================================================================*/
+
+/*==============================================================================
+ Local Variable
+===============================================================================*/
+static pthread_mutex_t critical_mutex;
+static pthread_once_t critical_once = PTHREAD_ONCE_INIT;
+static __thread struct host_task *current_task = NULL;
+static __thread uint32_t critical_nesting = 0;
+static __thread int critical_cancel_state; // Restored at the end of the outer critical section
+static struct timespec tick_start; // The tick count starts at the first call
+static pthread_once_t tick_once = PTHREAD_ONCE_INIT;
+
+/*==============================================================================
+Function Implementation
+===============================================================================*/
+
+/**
+ * @brief Get the deadline of a wait of some ticks
+ */
+static void freertos_deadline(TickType_t ticks, struct timespec *deadline)
+{
+    clock_gettime(CLOCK_MONOTONIC, deadline);
+    uint64_t ns = deadline->tv_nsec + (uint64_t)ticks * portTICK_PERIOD_MS * 1000000;
+    deadline->tv_sec += ns / 1000000000;
+    deadline->tv_nsec = ns % 1000000000;
+}
+
+/**
+ * @brief Wait for a change of a queue or an event group, until the deadline
+ *
+ * @return true if the deadline is not reached
+ */
+static bool freertos_wait(pthread_cond_t *changed, pthread_mutex_t *mutex, TickType_t ticks, const struct timespec *deadline)
+{
+    if (ticks == 0)
+    {
+        return false;
+    }
+    if (ticks == portMAX_DELAY)
+    {
+        pthread_cond_wait(changed, mutex);
+        return true;
+    }
+    return pthread_cond_timedwait(changed, mutex, deadline) != ETIMEDOUT;
+}
+
+/**
+ * @brief Create a condition on the monotonic clock, as the deadlines
+ */
+static void freertos_cond_init(pthread_cond_t *cond)
+{
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+static void freertos_unlock(void *mutex)
+{
+    pthread_mutex_unlock(mutex);
+}
+
+static void *freertos_task_entry(void *arg)
+{
+    struct host_task *task = arg;
+    current_task = task;
+    task->function(task->parameters);
+    pthread_detach(pthread_self()); // returned without vTaskDelete(NULL)
+    return NULL;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char *name, uint32_t stack_depth, void *parameters, UBaseType_t priority, TaskHandle_t *handle)
+{
+    struct host_task *task = calloc(1, sizeof(struct host_task));
+    if (task == NULL)
+    {
+        return pdFAIL;
+    }
+    task->function = function;
+    task->parameters = parameters;
+    if (pthread_create(&task->thread, NULL, freertos_task_entry, task) != 0)
+    {
+        free(task);
+        return pdFAIL;
+    }
+    if (handle != NULL)
+    {
+        *handle = task;
+    }
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    if (task == NULL || task == current_task)
+    {
+        // the handle is kept: it may still be compared by the firmware
+        pthread_detach(pthread_self());
+        pthread_exit(NULL);
+    }
+    // as FreeRTOS, the task is gone on return: the caller may free what it was using
+    pthread_cancel(task->thread); // at its next wait or delay
+    pthread_join(task->thread, NULL);
+    free(task);
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    struct timespec delay = {
+        .tv_sec = (uint64_t)ticks * portTICK_PERIOD_MS / 1000,
+        .tv_nsec = ((uint64_t)ticks * portTICK_PERIOD_MS % 1000) * 1000000,
+    };
+    while (nanosleep(&delay, &delay) != 0 && errno == EINTR)
+    {
+    }
+}
+
+static void tick_init(void)
+{
+    clock_gettime(CLOCK_MONOTONIC, &tick_start);
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    pthread_once(&tick_once, tick_init);
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((now.tv_sec - tick_start.tv_sec) * 1000 + (now.tv_nsec - tick_start.tv_nsec) / 1000000) / portTICK_PERIOD_MS;
+}
+
+void vTaskSuspend(TaskHandle_t task)
+{
+    // not used by the modules of the host build
+}
+
+void vTaskResume(TaskHandle_t task)
+{
+}
+
+static void critical_init(void)
+{
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&critical_mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+}
+
+void vPortEnterCritical(portMUX_TYPE *mux)
+{
+    pthread_once(&critical_once, critical_init);
+    pthread_mutex_lock(&critical_mutex);
+    if (critical_nesting++ == 0)
+    {
+        // the scheduler does not run in a critical section: the task can't be deleted with the mutex
+        pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &critical_cancel_state);
+    }
+}
+
+void vPortExitCritical(portMUX_TYPE *mux)
+{
+    if (--critical_nesting == 0)
+    {
+        pthread_setcancelstate(critical_cancel_state, NULL);
+    }
+    pthread_mutex_unlock(&critical_mutex);
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    struct host_queue *queue = calloc(1, sizeof(struct host_queue));
+    if (queue == NULL)
+    {
+        return NULL;
+    }
+    queue->items = calloc(length, item_size > 0 ? item_size : 1);
+    if (queue->items == NULL)
+    {
+        free(queue);
+        return NULL;
+    }
+    queue->length = length;
+    queue->item_size = item_size;
+    pthread_mutex_init(&queue->mutex, NULL);
+    freertos_cond_init(&queue->changed);
+    return queue;
+}
+
+void vQueueDelete(QueueHandle_t queue)
+{
+    if (queue == NULL)
+    {
+        return;
+    }
+    pthread_mutex_destroy(&queue->mutex);
+    pthread_cond_destroy(&queue->changed);
+    free(queue->items);
+    free(queue);
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks)
+{
+    struct timespec deadline;
+    freertos_deadline(ticks, &deadline);
+    BaseType_t ret = pdTRUE;
+    pthread_mutex_lock(&queue->mutex);
+    pthread_cleanup_push(freertos_unlock, &queue->mutex);
+    while (queue->count == queue->length)
+    {
+        if (!freertos_wait(&queue->changed, &queue->mutex, ticks, &deadline))
+        {
+            ret = pdFALSE;
+            break;
+        }
+    }
+    if (ret == pdTRUE)
+    {
+        UBaseType_t tail = (queue->head + queue->count) % queue->length;
+        if (item != NULL)
+        {
+            memcpy(queue->items + tail * queue->item_size, item, queue->item_size);
+        }
+        queue->count++;
+        pthread_cond_broadcast(&queue->changed);
+    }
+    pthread_cleanup_pop(1);
+    return ret;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks)
+{
+    struct timespec deadline;
+    freertos_deadline(ticks, &deadline);
+    BaseType_t ret = pdTRUE;
+    pthread_mutex_lock(&queue->mutex);
+    pthread_cleanup_push(freertos_unlock, &queue->mutex);
+    while (queue->count == 0)
+    {
+        if (!freertos_wait(&queue->changed, &queue->mutex, ticks, &deadline))
+        {
+            ret = pdFALSE;
+            break;
+        }
+    }
+    if (ret == pdTRUE)
+    {
+        if (item != NULL)
+        {
+            memcpy(item, queue->items + queue->head * queue->item_size, queue->item_size);
+        }
+        queue->head = (queue->head + 1) % queue->length;
+        queue->count--;
+        pthread_cond_broadcast(&queue->changed);
+    }
+    pthread_cleanup_pop(1);
+    return ret;
+}
+
+BaseType_t xQueueReset(QueueHandle_t queue)
+{
+    pthread_mutex_lock(&queue->mutex);
+    queue->count = 0;
+    queue->head = 0;
+    pthread_cond_broadcast(&queue->changed);
+    pthread_mutex_unlock(&queue->mutex);
+    return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+    pthread_mutex_lock(&queue->mutex);
+    UBaseType_t count = queue->count;
+    pthread_mutex_unlock(&queue->mutex);
+    return count;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    SemaphoreHandle_t semaphore = xQueueCreate(1, 0);
+    if (semaphore != NULL)
+    {
+        xSemaphoreGive(semaphore); // a mutex is created available
+    }
+    return semaphore;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    return xQueueCreate(1, 0);
+}
+
+EventGroupHandle_t xEventGroupCreate(void)
+{
+    struct host_event_group *group = calloc(1, sizeof(struct host_event_group));
+    if (group == NULL)
+    {
+        return NULL;
+    }
+    pthread_mutex_init(&group->mutex, NULL);
+    freertos_cond_init(&group->changed);
+    return group;
+}
+
+void vEventGroupDelete(EventGroupHandle_t group)
+{
+    if (group == NULL)
+    {
+        return;
+    }
+    pthread_mutex_destroy(&group->mutex);
+    pthread_cond_destroy(&group->changed);
+    free(group);
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits)
+{
+    pthread_mutex_lock(&group->mutex);
+    group->bits |= bits;
+    EventBits_t value = group->bits;
+    pthread_cond_broadcast(&group->changed);
+    pthread_mutex_unlock(&group->mutex);
+    return value;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits)
+{
+    pthread_mutex_lock(&group->mutex);
+    EventBits_t value = group->bits; // the bits before the clear, as FreeRTOS
+    group->bits &= ~bits;
+    pthread_mutex_unlock(&group->mutex);
+    return value;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group)
+{
+    pthread_mutex_lock(&group->mutex);
+    EventBits_t value = group->bits;
+    pthread_mutex_unlock(&group->mutex);
+    return value;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clear_on_exit, BaseType_t wait_for_all, TickType_t ticks)
+{
+    struct timespec deadline;
+    freertos_deadline(ticks, &deadline);
+    EventBits_t value = 0; // outside of the cleanup block
+    pthread_mutex_lock(&group->mutex);
+    pthread_cleanup_push(freertos_unlock, &group->mutex);
+    for (;;)
+    {
+        EventBits_t set = group->bits & bits;
+        if (wait_for_all ? set == bits : set != 0)
+        {
+            break;
+        }
+        if (!freertos_wait(&group->changed, &group->mutex, ticks, &deadline))
+        {
+            break;
+        }
+    }
+    value = group->bits;
+    EventBits_t set = value & bits;
+    if (clear_on_exit && (wait_for_all ? set == bits : set != 0))
+    {
+        group->bits &= ~bits;
+    }
+    pthread_cleanup_pop(1);
+    return value;
+}
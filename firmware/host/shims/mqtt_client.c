@@ -0,0 +1,376 @@
+/**
+ * @file mqtt_client.c
+ * @author Dorian Benech
+ * @brief Host shim: esp-mqtt client with its outbox, connected to a fake broker that records and acknowledges the messages
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2023 GammaTroniques
+ *
+ */
+
+/*==============================================================================
+ Local Include
+===============================================================================*/
+#include "mqtt_client.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+
+/*==============================================================================
+ Local Define
+===============================================================================*/
+
+/*==============================================================================
+ Local Macro
+===============================================================================*/
+
+/*==============================================================================
+ Local Type
+===============================================================================*/
+typedef struct mqtt_outbox_item_t
+{
+    mqtt_host_message_t message;
+    size_t size;
+    struct mqtt_outbox_item_t *next;
+} mqtt_outbox_item_t;
+
+struct esp_mqtt_client
+{
+    pthread_mutex_t mutex;
+    pthread_cond_t changed;
+    pthread_t thread;
+    bool started;
+    bool stopping;
+    esp_event_handler_t handler;
+    void *handler_arg;
+    int next_msg_id;
+    mqtt_outbox_item_t *outbox; // Messages not sent yet, in order
+    size_t outbox_size;
+    size_t outbox_limit;
+};
+
+/*==============================================================================
+ Local Function Declaration
+===============================================================================*/
+static void mqtt_dispatch(esp_mqtt_client_handle_t client, esp_mqtt_event_id_t id, int msg_id);
+static void *mqtt_broker_task(void *arg);
+
+/*==============================================================================
+Public Variable
+===============================================================================*/
+
+/*==============================================================================
+ Local Variable
+===============================================================================*/
+static pthread_mutex_t broker_mutex = PTHREAD_MUTEX_INITIALIZER;
+static mqtt_host_message_t *broker_messages = NULL;
+static uint32_t broker_count = 0;
+static uint32_t broker_capacity = 0;
+static uint32_t broker_drop = 0; // Next messages to drop
+
+/*==============================================================================
+Function Implementation
+===============================================================================*/
+
+static void mqtt_dispatch(esp_mqtt_client_handle_t client, esp_mqtt_event_id_t id, int msg_id)
+{
+    esp_mqtt_error_codes_t error = {0};
+    esp_mqtt_event_t event = {
+        .event_id = id,
+        .client = client,
+        .msg_id = msg_id,
+        .error_handle = &error,
+    };
+    if (client->handler != NULL)
+    {
+        client->handler(client->handler_arg, "MQTT_EVENTS", id, &event);
+    }
+}
+
+/**
+ * @brief Record a message in the broker
+ *
+ * @return true if it is dropped
+ */
+static bool mqtt_broker_receive(mqtt_host_message_t *message)
+{
+    pthread_mutex_lock(&broker_mutex);
+    bool dropped = broker_drop > 0;
+    if (dropped)
+    {
+        broker_drop--;
+    }
+    else
+    {
+        if (broker_count == broker_capacity)
+        {
+            broker_capacity = MAX(broker_capacity * 2, 64);
+            broker_messages = realloc(broker_messages, broker_capacity * sizeof(mqtt_host_message_t));
+            assert(broker_messages != NULL);
+        }
+        broker_messages[broker_count++] = *message;
+        message->topic = NULL; // owned by the broker
+        message->data = NULL;
+    }
+    pthread_mutex_unlock(&broker_mutex);
+    return dropped;
+}
+
+/**
+ * @brief The connection: connects, then sends the outbox to the broker as the messages are enqueued
+ */
+static void *mqtt_broker_task(void *arg)
+{
+    esp_mqtt_client_handle_t client = arg;
+    mqtt_dispatch(client, MQTT_EVENT_CONNECTED, 0);
+
+    pthread_mutex_lock(&client->mutex);
+    while (!client->stopping)
+    {
+        mqtt_outbox_item_t *item = client->outbox;
+        if (item == NULL)
+        {
+            pthread_cond_wait(&client->changed, &client->mutex);
+            continue;
+        }
+        client->outbox = item->next;
+        client->outbox_size -= item->size;
+        pthread_mutex_unlock(&client->mutex);
+
+        int msg_id = item->message.msg_id;
+        int qos = item->message.qos;
+        bool dropped = mqtt_broker_receive(&item->message);
+        free(item->message.topic);
+        free(item->message.data);
+        free(item);
+        if (dropped)
+        {
+            mqtt_dispatch(client, MQTT_EVENT_DELETED, msg_id); // expired in the outbox
+        }
+        else if (qos > 0)
+        {
+            mqtt_dispatch(client, MQTT_EVENT_PUBLISHED, msg_id);
+        }
+        pthread_mutex_lock(&client->mutex);
+    }
+    pthread_mutex_unlock(&client->mutex);
+    return NULL;
+}
+
+esp_mqtt_client_handle_t esp_mqtt_client_init(const esp_mqtt_client_config_t *config)
+{
+    esp_mqtt_client_handle_t client = calloc(1, sizeof(struct esp_mqtt_client));
+    if (client == NULL)
+    {
+        return NULL;
+    }
+    pthread_mutex_init(&client->mutex, NULL);
+    pthread_cond_init(&client->changed, NULL);
+    client->next_msg_id = 1;
+    client->outbox_limit = config->outbox.limit;
+    return client;
+}
+
+esp_err_t esp_mqtt_client_register_event(esp_mqtt_client_handle_t client, esp_mqtt_event_id_t event, esp_event_handler_t event_handler, void *event_handler_arg)
+{
+    if (client == NULL || event != MQTT_EVENT_ANY)
+    {
+        return ESP_ERR_INVALID_ARG; // the firmware registers a single handler for every event
+    }
+    client->handler = event_handler;
+    client->handler_arg = event_handler_arg;
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_start(esp_mqtt_client_handle_t client)
+{
+    if (client == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&client->mutex);
+    esp_err_t err = ESP_FAIL; // as esp-mqtt: already started
+    if (!client->started)
+    {
+        client->stopping = false;
+        err = pthread_create(&client->thread, NULL, mqtt_broker_task, client) == 0 ? ESP_OK : ESP_FAIL;
+        client->started = err == ESP_OK;
+    }
+    pthread_mutex_unlock(&client->mutex);
+    return err;
+}
+
+esp_err_t esp_mqtt_client_reconnect(esp_mqtt_client_handle_t client)
+{
+    return client != NULL ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t esp_mqtt_client_disconnect(esp_mqtt_client_handle_t client)
+{
+    return client != NULL ? ESP_OK : ESP_ERR_INVALID_ARG; // the connection ends with esp_mqtt_client_stop
+}
+
+esp_err_t esp_mqtt_client_stop(esp_mqtt_client_handle_t client)
+{
+    if (client == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&client->mutex);
+    bool started = client->started;
+    client->stopping = true;
+    pthread_cond_broadcast(&client->changed);
+    pthread_mutex_unlock(&client->mutex);
+    if (!started)
+    {
+        return ESP_FAIL;
+    }
+    pthread_join(client->thread, NULL);
+    pthread_mutex_lock(&client->mutex);
+    client->started = false;
+    pthread_mutex_unlock(&client->mutex);
+    mqtt_dispatch(client, MQTT_EVENT_DISCONNECTED, 0);
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_destroy(esp_mqtt_client_handle_t client)
+{
+    if (client == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_mqtt_client_stop(client);
+    while (client->outbox != NULL)
+    {
+        mqtt_outbox_item_t *next = client->outbox->next;
+        free(client->outbox->message.topic);
+        free(client->outbox->message.data);
+        free(client->outbox);
+        client->outbox = next;
+    }
+    pthread_mutex_destroy(&client->mutex);
+    pthread_cond_destroy(&client->changed);
+    free(client);
+    return ESP_OK;
+}
+
+int esp_mqtt_client_subscribe(esp_mqtt_client_handle_t client, const char *topic, int qos)
+{
+    if (client == NULL)
+    {
+        return -1;
+    }
+    pthread_mutex_lock(&client->mutex);
+    int msg_id = client->next_msg_id++;
+    pthread_mutex_unlock(&client->mutex);
+    return msg_id;
+}
+
+int esp_mqtt_client_enqueue(esp_mqtt_client_handle_t client, const char *topic, const char *data, int len, int qos, int retain, bool store)
+{
+    if (client == NULL || topic == NULL)
+    {
+        return -1;
+    }
+    len = len > 0 ? len : (data != NULL ? strlen(data) : 0);
+    mqtt_outbox_item_t *item = calloc(1, sizeof(mqtt_outbox_item_t));
+    char *data_copy = malloc(len + 1);
+    char *topic_copy = strdup(topic);
+    if (item == NULL || data_copy == NULL || topic_copy == NULL)
+    {
+        free(item);
+        free(data_copy);
+        free(topic_copy);
+        return -1;
+    }
+    memcpy(data_copy, data, len);
+    data_copy[len] = '\0';
+
+    pthread_mutex_lock(&client->mutex);
+    size_t size = strlen(topic) + len;
+    if (client->outbox_limit > 0 && client->outbox_size + size > client->outbox_limit)
+    {
+        pthread_mutex_unlock(&client->mutex);
+        free(item);
+        free(data_copy);
+        free(topic_copy);
+        return -2; // as esp-mqtt: the outbox is full
+    }
+    int msg_id = qos > 0 ? client->next_msg_id++ : 0;
+    item->message = (mqtt_host_message_t){.topic = topic_copy, .data = data_copy, .qos = qos, .retain = retain, .msg_id = msg_id};
+    item->size = size;
+    mqtt_outbox_item_t **last = &client->outbox;
+    while (*last != NULL)
+    {
+        last = &(*last)->next;
+    }
+    *last = item;
+    client->outbox_size += size;
+    pthread_cond_broadcast(&client->changed);
+    pthread_mutex_unlock(&client->mutex);
+    return msg_id;
+}
+
+int esp_mqtt_client_publish(esp_mqtt_client_handle_t client, const char *topic, const char *data, int len, int qos, int retain)
+{
+    return esp_mqtt_client_enqueue(client, topic, data, len, qos, retain, true);
+}
+
+int esp_mqtt_client_get_outbox_size(esp_mqtt_client_handle_t client)
+{
+    if (client == NULL)
+    {
+        return 0;
+    }
+    pthread_mutex_lock(&client->mutex);
+    int size = client->outbox_size;
+    pthread_mutex_unlock(&client->mutex);
+    return size;
+}
+
+void mqtt_host_drop(uint32_t count)
+{
+    pthread_mutex_lock(&broker_mutex);
+    broker_drop = count;
+    pthread_mutex_unlock(&broker_mutex);
+}
+
+const mqtt_host_message_t *mqtt_host_messages(uint32_t *count)
+{
+    pthread_mutex_lock(&broker_mutex);
+    *count = broker_count;
+    const mqtt_host_message_t *messages = broker_messages;
+    pthread_mutex_unlock(&broker_mutex);
+    return messages;
+}
+
+const mqtt_host_message_t *mqtt_host_find(const char *topic)
+{
+    const mqtt_host_message_t *found = NULL;
+    pthread_mutex_lock(&broker_mutex);
+    for (uint32_t i = 0; i < broker_count; i++)
+    {
+        if (strcmp(broker_messages[i].topic, topic) == 0)
+        {
+            found = &broker_messages[i];
+        }
+    }
+    pthread_mutex_unlock(&broker_mutex);
+    return found;
+}
+
+void mqtt_host_clear()
+{
+    pthread_mutex_lock(&broker_mutex);
+    for (uint32_t i = 0; i < broker_count; i++)
+    {
+        free(broker_messages[i].topic);
+        free(broker_messages[i].data);
+    }
+    broker_count = 0;
+    broker_drop = 0;
+    pthread_mutex_unlock(&broker_mutex);
+}
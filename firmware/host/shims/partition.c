@@ -0,0 +1,129 @@
+/**
+ * @file partition.c
+ * @author Dorian Benech
+ * @brief Host shim: the data partitions of partitions.csv used by the host build, in RAM
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2023 GammaTroniques
+ *
+ */
+
+/*==============================================================================
+ Local Include
+===============================================================================*/
+#include "esp_partition.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*==============================================================================
+ Local Define
+===============================================================================*/
+#define PARTITION_SECTOR_SIZE 4096
+
+/*==============================================================================
+ Local Macro
+===============================================================================*/
+
+/*==============================================================================
+ Local Type
+===============================================================================*/
+typedef struct
+{
+    esp_partition_t partition;
+    uint8_t *data; // Allocated and erased at the first use
+} host_partition_t;
+
+/*==============================================================================
+ Local Function Declaration
+===============================================================================*/
+
+/*==============================================================================
+Public Variable
+===============================================================================*/
+
+/*==============================================================================
+ Local Variable
+===============================================================================*/
+static host_partition_t partitions[] = {
+    // as partitions.csv
+    {.partition = {.type = ESP_PARTITION_TYPE_DATA, .subtype = ESP_PARTITION_SUBTYPE_DATA_UNDEFINED, .address = 0x3F0000, .size = 64 * 1024, .erase_size = PARTITION_SECTOR_SIZE, .label = "history"}},
+};
+
+/*==============================================================================
+Function Implementation
+===============================================================================*/
+
+static host_partition_t *partition_get(const esp_partition_t *partition)
+{
+    for (uint32_t i = 0; i < sizeof(partitions) / sizeof(partitions[0]); i++)
+    {
+        if (&partitions[i].partition == partition)
+        {
+            return &partitions[i];
+        }
+    }
+    return NULL;
+}
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype, const char *label)
+{
+    for (uint32_t i = 0; i < sizeof(partitions) / sizeof(partitions[0]); i++)
+    {
+        host_partition_t *host = &partitions[i];
+        if (host->partition.type != type || (subtype != ESP_PARTITION_SUBTYPE_ANY && host->partition.subtype != subtype) ||
+            (label != NULL && strcmp(host->partition.label, label) != 0))
+        {
+            continue;
+        }
+        if (host->data == NULL)
+        {
+            host->data = malloc(host->partition.size);
+            if (host->data == NULL)
+            {
+                return NULL;
+            }
+            memset(host->data, 0xFF, host->partition.size);
+        }
+        return &host->partition;
+    }
+    return NULL;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t src_offset, void *dst, size_t size)
+{
+    host_partition_t *host = partition_get(partition);
+    if (host == NULL || dst == NULL || src_offset > partition->size || size > partition->size - src_offset)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memcpy(dst, host->data + src_offset, size);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *partition, size_t dst_offset, const void *src, size_t size)
+{
+    host_partition_t *host = partition_get(partition);
+    if (host == NULL || src == NULL || dst_offset > partition->size || size > partition->size - dst_offset)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    const uint8_t *bytes = src;
+    for (size_t i = 0; i < size; i++)
+    {
+        host->data[dst_offset + i] &= bytes[i]; // the flash can only clear bits
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition, size_t offset, size_t size)
+{
+    host_partition_t *host = partition_get(partition);
+    if (host == NULL || offset % PARTITION_SECTOR_SIZE != 0 || size % PARTITION_SECTOR_SIZE != 0 || offset > partition->size ||
+        size > partition->size - offset)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(host->data + offset, 0xFF, size);
+    return ESP_OK;
+}
@@ -0,0 +1,353 @@
+/**
+ * @file system.c
+ * @author Dorian Benech
+ * @brief Host shim: logs, errors, timer, CRC, random numbers, power management, heap information and HTTP client of ESP-IDF
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2023 GammaTroniques
+ *
+ */
+
+/*==============================================================================
+ Local Include
+===============================================================================*/
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_crc.h"
+#include "esp_random.h"
+#include "esp_pm.h"
+#include "esp_sleep.h"
+#include "esp_system.h"
+#include "esp_heap_caps.h"
+#include "esp_ota_ops.h"
+#include "esp_http_client.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <time.h>
+#include <malloc.h>
+#include <pthread.h>
+
+/*==============================================================================
+ Local Define
+===============================================================================*/
+#define LOG_TAG_MAX 16 // Tags with their own level
+
+/*==============================================================================
+ Local Macro
+===============================================================================*/
+
+/*==============================================================================
+ Local Type
+===============================================================================*/
+typedef struct
+{
+    const char *tag;
+    esp_log_level_t level;
+} log_tag_level_t;
+
+/*==============================================================================
+ Local Function Declaration
+===============================================================================*/
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+
+/*==============================================================================
+Public Variable
+===============================================================================*/
+
+/*==============================================================================
+ Local Variable
+===============================================================================*/
+static esp_log_level_t log_default_level = ESP_LOG_INFO;
+static log_tag_level_t log_levels[LOG_TAG_MAX];
+static uint32_t log_levels_count = 0;
+static pthread_mutex_t log_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static atomic_size_t heap_allocated_blocks = 0;
+static atomic_size_t heap_allocated_bytes = 0;
+
+static const esp_app_desc_t app_desc = {
+    .magic_word = 0xABCD5432,
+    .version = "v0.0.0-host", // "v<version>-<build>" as the firmware
+    .project_name = "TICMeter",
+    .idf_ver = "host",
+};
+
+/*==============================================================================
+Function Implementation
+===============================================================================*/
+const char *esp_err_to_name(esp_err_t code)
+{
+    switch (code)
+    {
+    case ESP_OK:
+        return "ESP_OK";
+    case ESP_FAIL:
+        return "ESP_FAIL";
+    case ESP_ERR_NO_MEM:
+        return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG:
+        return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE:
+        return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_INVALID_SIZE:
+        return "ESP_ERR_INVALID_SIZE";
+    case ESP_ERR_NOT_FOUND:
+        return "ESP_ERR_NOT_FOUND";
+    case ESP_ERR_NOT_SUPPORTED:
+        return "ESP_ERR_NOT_SUPPORTED";
+    case ESP_ERR_TIMEOUT:
+        return "ESP_ERR_TIMEOUT";
+    case ESP_ERR_INVALID_RESPONSE:
+        return "ESP_ERR_INVALID_RESPONSE";
+    case ESP_ERR_INVALID_CRC:
+        return "ESP_ERR_INVALID_CRC";
+    case ESP_ERR_INVALID_VERSION:
+        return "ESP_ERR_INVALID_VERSION";
+    case ESP_ERR_NVS_NOT_FOUND:
+        return "ESP_ERR_NVS_NOT_FOUND";
+    case ESP_ERR_NVS_KEY_TOO_LONG:
+        return "ESP_ERR_NVS_KEY_TOO_LONG";
+    case ESP_ERR_NVS_INVALID_LENGTH:
+        return "ESP_ERR_NVS_INVALID_LENGTH";
+    default:
+        return "UNKNOWN ERROR";
+    }
+}
+
+void esp_log_level_set(const char *tag, esp_log_level_t level)
+{
+    pthread_mutex_lock(&log_mutex);
+    if (strcmp(tag, "*") == 0)
+    {
+        log_default_level = level;
+        log_levels_count = 0;
+    }
+    else
+    {
+        uint32_t i = 0;
+        while (i < log_levels_count && strcmp(log_levels[i].tag, tag) != 0)
+        {
+            i++;
+        }
+        if (i < LOG_TAG_MAX)
+        {
+            log_levels[i].tag = tag; // the tags are string literals
+            log_levels[i].level = level;
+            log_levels_count = MAX(log_levels_count, i + 1);
+        }
+    }
+    pthread_mutex_unlock(&log_mutex);
+}
+
+/**
+ * @brief Get the level of a tag
+ */
+static esp_log_level_t log_get_level(const char *tag)
+{
+    esp_log_level_t level = log_default_level;
+    pthread_mutex_lock(&log_mutex);
+    for (uint32_t i = 0; i < log_levels_count; i++)
+    {
+        if (strcmp(log_levels[i].tag, tag) == 0)
+        {
+            level = log_levels[i].level;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&log_mutex);
+    return level;
+}
+
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...)
+{
+    // "*" sets a maximum level: the firmware raises the level of its own tags, the tests and the benchmarks are kept readable
+    if (level > log_get_level(tag) || level > log_default_level)
+    {
+        return;
+    }
+    static const char letters[] = {'N', 'E', 'W', 'I', 'D', 'V'};
+    int cancel_state;
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &cancel_state); // a deleted task must not keep the lock of stdout
+    flockfile(stdout);
+    printf("%c (%lu) %s: ", letters[level], (unsigned long)xTaskGetTickCount(), tag);
+    va_list args;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+    putchar('\n');
+    funlockfile(stdout);
+    pthread_setcancelstate(cancel_state, NULL);
+}
+
+void esp_log_buffer_hexdump_internal(const char *tag, const void *buffer, uint16_t size, esp_log_level_t level)
+{
+    const uint8_t *bytes = buffer;
+    for (uint16_t offset = 0; offset < size; offset += 16)
+    {
+        char line[16 * 3 + 1] = {0};
+        for (uint16_t i = 0; i < 16 && offset + i < size; i++)
+        {
+            snprintf(line + i * 3, sizeof(line) - i * 3, "%02x ", bytes[offset + i]);
+        }
+        esp_log_write(level, tag, "%p: %s", bytes + offset, line);
+    }
+}
+
+int64_t esp_timer_get_time(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+uint32_t esp_crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len)
+{
+    // as the ROM: reflected polynomial 0xEDB88320, the value is inverted before and after
+    crc = ~crc;
+    for (uint32_t i = 0; i < len; i++)
+    {
+        crc ^= buf[i];
+        for (uint8_t bit = 0; bit < 8; bit++)
+        {
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+        }
+    }
+    return ~crc;
+}
+
+uint32_t esp_random(void)
+{
+    return ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+}
+
+esp_err_t esp_pm_lock_create(esp_pm_lock_type_t lock_type, int arg, const char *name, esp_pm_lock_handle_t *out_handle)
+{
+    static int lock; // the handle is only compared with NULL
+    *out_handle = (esp_pm_lock_handle_t)&lock;
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_delete(esp_pm_lock_handle_t handle)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_acquire(esp_pm_lock_handle_t handle)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_release(esp_pm_lock_handle_t handle)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_sleep_enable_uart_wakeup(int uart_num)
+{
+    return ESP_OK;
+}
+
+void esp_restart(void)
+{
+    ESP_LOGE("HOST", "esp_restart");
+    exit(1);
+}
+
+const esp_app_desc_t *esp_app_get_description(void)
+{
+    return &app_desc;
+}
+
+void heap_caps_get_info(multi_heap_info_t *info, uint32_t caps)
+{
+    memset(info, 0, sizeof(multi_heap_info_t));
+    info->allocated_blocks = heap_allocated_blocks;
+    info->total_allocated_bytes = heap_allocated_bytes;
+}
+
+/**
+ * @brief Count an allocation, with the usable size: the heap of ESP-IDF also counts the rounding
+ */
+static void *heap_count(void *ptr)
+{
+    if (ptr != NULL)
+    {
+        heap_allocated_blocks++;
+        heap_allocated_bytes += malloc_usable_size(ptr);
+    }
+    return ptr;
+}
+
+void *__wrap_malloc(size_t size)
+{
+    return heap_count(__real_malloc(size));
+}
+
+void *__wrap_calloc(size_t count, size_t size)
+{
+    return heap_count(__real_calloc(count, size));
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    if (ptr != NULL)
+    {
+        heap_allocated_blocks--;
+        heap_allocated_bytes -= malloc_usable_size(ptr);
+    }
+    void *new_ptr = __real_realloc(ptr, size);
+    if (new_ptr == NULL && ptr != NULL && size > 0)
+    {
+        return heap_count(ptr); // not moved: still allocated
+    }
+    return heap_count(new_ptr);
+}
+
+void __wrap_free(void *ptr)
+{
+    if (ptr != NULL)
+    {
+        heap_allocated_blocks--;
+        heap_allocated_bytes -= malloc_usable_size(ptr);
+    }
+    __real_free(ptr);
+}
+
+esp_http_client_handle_t esp_http_client_init(const esp_http_client_config_t *config)
+{
+    static int client; // no network: the requests fail in esp_http_client_perform
+    return (esp_http_client_handle_t)&client;
+}
+
+esp_err_t esp_http_client_set_post_field(esp_http_client_handle_t client, const char *data, int len)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_set_header(esp_http_client_handle_t client, const char *key, const char *value)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_perform(esp_http_client_handle_t client)
+{
+    return ESP_FAIL;
+}
+
+int esp_http_client_get_status_code(esp_http_client_handle_t client)
+{
+    return 0;
+}
+
+esp_err_t esp_http_client_cleanup(esp_http_client_handle_t client)
+{
+    return ESP_OK;
+}
@@ -0,0 +1,204 @@
+/**
+ * @file tuya_iot.c
+ * @author Dorian Benech
+ * @brief Host shim: Tuya IoT client connected to a fake cloud that records and acknowledges the dp reports
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2023 GammaTroniques
+ *
+ */
+
+/*==============================================================================
+ Local Include
+===============================================================================*/
+#include "tuya_iot.h"
+#include "tuya_ota.h"
+#include "tuya_wifi_provisioning.h"
+#include "tuya_host.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "wifi.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*==============================================================================
+ Local Define
+===============================================================================*/
+#define TUYA_HOST_YIELD_PERIOD 10 // ms, as the keepalive loop of the SDK
+
+/*==============================================================================
+ Local Macro
+===============================================================================*/
+
+/*==============================================================================
+ Local Type
+===============================================================================*/
+
+/*==============================================================================
+ Local Function Declaration
+===============================================================================*/
+static void tuya_host_event(tuya_iot_client_t *client, tuya_event_id_t id);
+
+/*==============================================================================
+Public Variable
+===============================================================================*/
+
+/*==============================================================================
+ Local Variable
+===============================================================================*/
+static pthread_mutex_t tuya_host_mutex = PTHREAD_MUTEX_INITIALIZER;
+static char *tuya_host_dps = NULL;
+static uint32_t tuya_host_report_count = 0;
+
+/*==============================================================================
+Function Implementation
+===============================================================================*/
+
+/**
+ * @brief Call the event handler of the client, as the SDK does from tuya_iot_yield()
+ */
+static void tuya_host_event(tuya_iot_client_t *client, tuya_event_id_t id)
+{
+    client->event.id = id;
+    client->event.type = TUYA_DATE_TYPE_UNDEFINED;
+    if (client->config.event_handler != NULL)
+    {
+        client->config.event_handler(client, &client->event);
+    }
+}
+
+int tuya_iot_init(tuya_iot_client_t *client, const tuya_iot_config_t *config)
+{
+    if (client == NULL || config == NULL || config->productkey == NULL || config->uuid == NULL || config->authkey == NULL)
+    {
+        return OPRT_INVALID_PARM;
+    }
+    memset(client, 0, sizeof(tuya_iot_client_t));
+    client->config = *config;
+    client->is_activated = true; // the device is paired
+    client->state = TUYA_STATUS_UNCONNECT_ROUTER;
+    client->nextstate = TUYA_STATUS_UNCONNECT_ROUTER;
+    return OPRT_OK;
+}
+
+int tuya_iot_start(tuya_iot_client_t *client)
+{
+    client->nextstate = TUYA_STATUS_MQTT_CONNECTED; // connected by the next tuya_iot_yield()
+    return OPRT_OK;
+}
+
+int tuya_iot_stop(tuya_iot_client_t *client)
+{
+    client->state = TUYA_STATUS_UNCONNECT_ROUTER;
+    client->nextstate = TUYA_STATUS_UNCONNECT_ROUTER;
+    return OPRT_OK;
+}
+
+int tuya_iot_reset(tuya_iot_client_t *client)
+{
+    client->state = TUYA_STATUS_UNCONNECT_ROUTER;
+    return OPRT_OK;
+}
+
+int tuya_iot_reconnect(tuya_iot_client_t *client)
+{
+    tuya_iot_stop(client);
+    return tuya_iot_start(client);
+}
+
+int tuya_iot_yield(tuya_iot_client_t *client)
+{
+    if (client->state != client->nextstate && wifi_state == WIFI_CONNECTED)
+    {
+        client->state = client->nextstate;
+        if (client->state == TUYA_STATUS_MQTT_CONNECTED)
+        {
+            tuya_host_event(client, TUYA_EVENT_MQTT_CONNECTED);
+        }
+    }
+    vTaskDelay(TUYA_HOST_YIELD_PERIOD / portTICK_PERIOD_MS);
+    return OPRT_OK;
+}
+
+int tuya_iot_dp_report_json(tuya_iot_client_t *client, const char *dps)
+{
+    return tuya_iot_dp_report_json_with_notify(client, dps, NULL, NULL, NULL, 0);
+}
+
+int tuya_iot_dp_report_json_with_notify(tuya_iot_client_t *client, const char *dps, const char *time, tuya_dp_notify_cb_t cb, void *user_data, int timeout_ms)
+{
+    if (client == NULL || dps == NULL)
+    {
+        return OPRT_INVALID_PARM;
+    }
+    if (client->state != TUYA_STATUS_MQTT_CONNECTED)
+    {
+        return OPRT_NETWORK_ERROR;
+    }
+    char *copy = strdup(dps);
+    if (copy == NULL)
+    {
+        return OPRT_MALLOC_FAILED;
+    }
+
+    pthread_mutex_lock(&tuya_host_mutex);
+    free(tuya_host_dps);
+    tuya_host_dps = copy;
+    tuya_host_report_count++;
+    pthread_mutex_unlock(&tuya_host_mutex);
+
+    if (cb != NULL)
+    {
+        cb(OPRT_OK, user_data); // acknowledged by the cloud
+    }
+    return OPRT_OK;
+}
+
+int tuya_iot_activated_data_remove(tuya_iot_client_t *client)
+{
+    client->is_activated = false;
+    return OPRT_OK;
+}
+
+int tuya_ota_init(tuya_ota_handle_t *handle, const tuya_ota_config_t *config)
+{
+    return OPRT_OK;
+}
+
+int tuya_ota_begin(tuya_ota_handle_t *handle, cJSON *upgrade)
+{
+    return OPRT_COM_ERROR; // no OTA in the host build
+}
+
+int tuya_ota_upgrade_status_report(tuya_ota_handle_t *handle, int status)
+{
+    return OPRT_OK;
+}
+
+int tuya_wifi_provisioning(tuya_iot_client_t *client, tuya_wifi_provisioning_mode_t mode, wifi_info_get_callback cb)
+{
+    return OPRT_COM_ERROR; // no BLE in the host build
+}
+
+const char *tuya_host_last_dps(uint32_t *count)
+{
+    pthread_mutex_lock(&tuya_host_mutex);
+    const char *dps = tuya_host_dps;
+    if (count != NULL)
+    {
+        *count = tuya_host_report_count;
+    }
+    pthread_mutex_unlock(&tuya_host_mutex);
+    return dps;
+}
+
+void tuya_host_clear()
+{
+    pthread_mutex_lock(&tuya_host_mutex);
+    free(tuya_host_dps);
+    tuya_host_dps = NULL;
+    tuya_host_report_count = 0;
+    pthread_mutex_unlock(&tuya_host_mutex);
+}
@@ -0,0 +1,412 @@
+/**
+ * @file uart.c
+ * @author Dorian Benech
+ * @brief Host shim: UART driver with a ring buffer, an event queue and the pattern detection, fed by uart_host_receive()
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2023 GammaTroniques
+ *
+ */
+
+/*==============================================================================
+ Local Include
+===============================================================================*/
+#include "driver/uart.h"
+#include "freertos/task.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*==============================================================================
+ Local Define
+===============================================================================*/
+#define UART_PATTERN_MAX 64 // Pattern positions kept when the firmware does not set the queue length
+#define UART_FULL_THRESH_DEFAULT 120 // RX FIFO full threshold set by uart_driver_install()
+#define UART_RX_INTR_DEFAULT (UART_RXFIFO_FULL_INT_ENA_M | UART_RXFIFO_TOUT_INT_ENA_M) // Enabled by the driver, and again by uart_flush_input()
+
+/*==============================================================================
+ Local Macro
+===============================================================================*/
+
+/*==============================================================================
+ Local Type
+===============================================================================*/
+typedef struct
+{
+    bool installed;
+    QueueHandle_t queue;
+    uint8_t *buffer;
+    size_t size;
+    size_t head;  // Next byte to read
+    size_t count; // Bytes in buffer
+    uint64_t read_total;
+    uint64_t received_total;
+    uint32_t baud_rate;
+    char pattern;
+    bool pattern_enabled;
+    uint64_t *patterns; // Positions of the pattern, counted from the first received byte
+    int pattern_max;
+    int pattern_count;
+    uint32_t intr_mask;
+    uint32_t full_thresh;
+    uint8_t fifo[UART_HW_FIFO_LEN(0)]; // RX FIFO: the bytes are moved to the buffer by an interrupt
+    size_t fifo_count;
+} host_uart_t;
+
+/*==============================================================================
+ Local Function Declaration
+===============================================================================*/
+
+/*==============================================================================
+Public Variable
+===============================================================================*/
+
+/*==============================================================================
+ Local Variable
+===============================================================================*/
+static host_uart_t uarts[UART_NUM_MAX];
+static pthread_mutex_t uart_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/*==============================================================================
+Function Implementation
+===============================================================================*/
+
+static host_uart_t *uart_get(uart_port_t uart_num)
+{
+    return (uart_num >= 0 && uart_num < UART_NUM_MAX && uarts[uart_num].installed) ? &uarts[uart_num] : NULL;
+}
+
+static void uart_send_event(host_uart_t *uart, uart_event_type_t type, size_t size)
+{
+    uart_event_t event = {.type = type, .size = size};
+    if (uart->queue != NULL)
+    {
+        xQueueSend(uart->queue, &event, 0); // the ISR does not wait: the event is lost if the queue is full
+    }
+}
+
+esp_err_t uart_driver_install(uart_port_t uart_num, int rx_buffer_size, int tx_buffer_size, int queue_size, QueueHandle_t *uart_queue, int intr_alloc_flags)
+{
+    if (uart_num < 0 || uart_num >= UART_NUM_MAX || rx_buffer_size <= UART_HW_FIFO_LEN(uart_num))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    host_uart_t *uart = &uarts[uart_num];
+    if (uart->installed)
+    {
+        return ESP_FAIL;
+    }
+    memset(uart, 0, sizeof(host_uart_t));
+    uart->buffer = malloc(rx_buffer_size);
+    uart->patterns = malloc(UART_PATTERN_MAX * sizeof(uint64_t));
+    if (uart->buffer == NULL || uart->patterns == NULL)
+    {
+        free(uart->buffer);
+        free(uart->patterns);
+        return ESP_ERR_NO_MEM;
+    }
+    uart->size = rx_buffer_size;
+    uart->pattern_max = UART_PATTERN_MAX;
+    uart->intr_mask = UART_RX_INTR_DEFAULT | UART_RXFIFO_OVF_INT_ENA_M;
+    uart->full_thresh = UART_FULL_THRESH_DEFAULT;
+    if (queue_size > 0 && uart_queue != NULL)
+    {
+        uart->queue = xQueueCreate(queue_size, sizeof(uart_event_t));
+        *uart_queue = uart->queue;
+    }
+    uart->installed = true;
+    return ESP_OK;
+}
+
+esp_err_t uart_driver_delete(uart_port_t uart_num)
+{
+    pthread_mutex_lock(&uart_mutex);
+    host_uart_t *uart = uart_get(uart_num);
+    if (uart != NULL)
+    {
+        // the queue is deleted by the firmware, as with ESP-IDF it belongs to the driver: not freed here
+        free(uart->buffer);
+        free(uart->patterns);
+        memset(uart, 0, sizeof(host_uart_t));
+    }
+    pthread_mutex_unlock(&uart_mutex);
+    return ESP_OK;
+}
+
+bool uart_is_driver_installed(uart_port_t uart_num)
+{
+    return uart_get(uart_num) != NULL;
+}
+
+esp_err_t uart_param_config(uart_port_t uart_num, const uart_config_t *uart_config)
+{
+    host_uart_t *uart = uart_get(uart_num);
+    if (uart == NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    uart->baud_rate = uart_config->baud_rate;
+    return ESP_OK;
+}
+
+esp_err_t uart_set_pin(uart_port_t uart_num, int tx_io_num, int rx_io_num, int rts_io_num, int cts_io_num)
+{
+    return ESP_OK;
+}
+
+esp_err_t uart_set_baudrate(uart_port_t uart_num, uint32_t baudrate)
+{
+    host_uart_t *uart = uart_get(uart_num);
+    if (uart == NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    uart->baud_rate = baudrate;
+    return ESP_OK;
+}
+
+uint32_t uart_host_get_baudrate(uart_port_t uart_num)
+{
+    host_uart_t *uart = uart_get(uart_num);
+    return uart != NULL ? uart->baud_rate : 0;
+}
+
+esp_err_t uart_intr_config(uart_port_t uart_num, const uart_intr_config_t *intr_conf)
+{
+    pthread_mutex_lock(&uart_mutex);
+    host_uart_t *uart = uart_get(uart_num);
+    if (uart != NULL)
+    {
+        // as ESP-IDF: the interrupts of the mask are enabled, the others are left as they are
+        uart->intr_mask |= intr_conf->intr_enable_mask;
+        if (intr_conf->intr_enable_mask & UART_RXFIFO_FULL_INT_ENA_M)
+        {
+            uart->full_thresh = MIN(MAX(intr_conf->rxfifo_full_thresh, 1), UART_HW_FIFO_LEN(uart_num));
+        }
+    }
+    pthread_mutex_unlock(&uart_mutex);
+    return uart != NULL ? ESP_OK : ESP_ERR_INVALID_STATE;
+}
+
+esp_err_t uart_disable_intr_mask(uart_port_t uart_num, uint32_t disable_mask)
+{
+    pthread_mutex_lock(&uart_mutex);
+    host_uart_t *uart = uart_get(uart_num);
+    if (uart != NULL)
+    {
+        uart->intr_mask &= ~disable_mask;
+    }
+    pthread_mutex_unlock(&uart_mutex);
+    return uart != NULL ? ESP_OK : ESP_ERR_INVALID_STATE;
+}
+
+uint32_t uart_host_get_intr_mask(uart_port_t uart_num)
+{
+    host_uart_t *uart = uart_get(uart_num);
+    return uart != NULL ? uart->intr_mask : 0;
+}
+
+esp_err_t uart_set_wakeup_threshold(uart_port_t uart_num, int wakeup_threshold)
+{
+    return ESP_OK;
+}
+
+esp_err_t uart_enable_pattern_det_baud_intr(uart_port_t uart_num, char pattern_chr, uint8_t chr_num, int chr_tout, int post_idle, int pre_idle)
+{
+    host_uart_t *uart = uart_get(uart_num);
+    if (uart == NULL || chr_num != 1)
+    {
+        return uart == NULL ? ESP_ERR_INVALID_STATE : ESP_ERR_NOT_SUPPORTED; // the firmware only detects a single character
+    }
+    uart->pattern = pattern_chr;
+    uart->pattern_enabled = true;
+    return ESP_OK;
+}
+
+esp_err_t uart_pattern_queue_reset(uart_port_t uart_num, int queue_length)
+{
+    pthread_mutex_lock(&uart_mutex);
+    host_uart_t *uart = uart_get(uart_num);
+    esp_err_t err = ESP_ERR_INVALID_STATE;
+    if (uart != NULL)
+    {
+        uint64_t *patterns = realloc(uart->patterns, queue_length * sizeof(uint64_t));
+        err = patterns != NULL ? ESP_OK : ESP_ERR_NO_MEM;
+        if (patterns != NULL)
+        {
+            uart->patterns = patterns;
+            uart->pattern_max = queue_length;
+            uart->pattern_count = 0;
+        }
+    }
+    pthread_mutex_unlock(&uart_mutex);
+    return err;
+}
+
+int uart_pattern_pop_pos(uart_port_t uart_num)
+{
+    pthread_mutex_lock(&uart_mutex);
+    host_uart_t *uart = uart_get(uart_num);
+    int position = -1;
+    if (uart != NULL && uart->pattern_count > 0)
+    {
+        // as ESP-IDF: the position is counted from the next byte to read
+        position = uart->patterns[0] - uart->read_total;
+        uart->pattern_count--;
+        memmove(uart->patterns, uart->patterns + 1, uart->pattern_count * sizeof(uint64_t));
+    }
+    pthread_mutex_unlock(&uart_mutex);
+    return position;
+}
+
+int uart_read_bytes(uart_port_t uart_num, void *buf, uint32_t length, TickType_t ticks_to_wait)
+{
+    TickType_t start = xTaskGetTickCount();
+    uint32_t read = 0;
+    for (;;)
+    {
+        pthread_mutex_lock(&uart_mutex);
+        host_uart_t *uart = uart_get(uart_num);
+        if (uart == NULL)
+        {
+            pthread_mutex_unlock(&uart_mutex);
+            return -1;
+        }
+        while (read < length && uart->count > 0)
+        {
+            size_t chunk = MIN(MIN(length - read, uart->count), uart->size - uart->head);
+            memcpy((uint8_t *)buf + read, uart->buffer + uart->head, chunk);
+            uart->head = (uart->head + chunk) % uart->size;
+            uart->count -= chunk;
+            uart->read_total += chunk;
+            read += chunk;
+        }
+        pthread_mutex_unlock(&uart_mutex);
+        if (read == length || xTaskGetTickCount() - start >= ticks_to_wait)
+        {
+            return read;
+        }
+        vTaskDelay(1);
+    }
+}
+
+esp_err_t uart_flush_input(uart_port_t uart_num)
+{
+    pthread_mutex_lock(&uart_mutex);
+    host_uart_t *uart = uart_get(uart_num);
+    if (uart != NULL)
+    {
+        uart->read_total += uart->count;
+        uart->head = 0;
+        uart->count = 0;
+        uart->pattern_count = 0; // the flushed patterns can't be read
+        uart->fifo_count = 0;
+        uart->intr_mask |= UART_RX_INTR_DEFAULT; // as ESP-IDF, whatever the firmware configured
+    }
+    pthread_mutex_unlock(&uart_mutex);
+    return uart != NULL ? ESP_OK : ESP_ERR_INVALID_STATE;
+}
+
+/**
+ * @brief Move the RX FIFO to the ring buffer, as the ISR of the driver, and send the event
+ *
+ * Called with uart_mutex locked, unlocks it.
+ */
+static void uart_fifo_drain(host_uart_t *uart, uart_event_type_t type)
+{
+    size_t size = uart->fifo_count;
+    uart->fifo_count = 0;
+    if (uart->count + size > uart->size)
+    {
+        // the ring buffer is full: the bytes are dropped until the firmware reads or flushes it
+        pthread_mutex_unlock(&uart_mutex);
+        uart_send_event(uart, UART_BUFFER_FULL, 0);
+        return;
+    }
+    for (size_t i = 0; i < size; i++)
+    {
+        uart->buffer[(uart->head + uart->count + i) % uart->size] = uart->fifo[i];
+    }
+    uart->count += size;
+    uart->received_total += size;
+    if (type == UART_PATTERN_DET && uart->pattern_count < uart->pattern_max)
+    {
+        uart->patterns[uart->pattern_count++] = uart->received_total - 1;
+    }
+    else if (type == UART_PATTERN_DET)
+    {
+        uart->pattern_count = 0; // the queue overflowed: uart_pattern_pop_pos() returns -1
+    }
+    pthread_mutex_unlock(&uart_mutex);
+    uart_send_event(uart, type, size);
+}
+
+esp_err_t uart_host_receive(uart_port_t uart_num, const void *data, size_t size)
+{
+    const uint8_t *bytes = data;
+    for (size_t i = 0; i < size; i++)
+    {
+        pthread_mutex_lock(&uart_mutex);
+        host_uart_t *uart = uart_get(uart_num);
+        if (uart == NULL)
+        {
+            pthread_mutex_unlock(&uart_mutex);
+            return ESP_ERR_INVALID_STATE;
+        }
+        if (uart->fifo_count == sizeof(uart->fifo))
+        {
+            // no interrupt drained the FIFO: the ISR resets it
+            uart->fifo_count = 0;
+            pthread_mutex_unlock(&uart_mutex);
+            if (uart->intr_mask & UART_RXFIFO_OVF_INT_ENA_M)
+            {
+                uart_send_event(uart, UART_FIFO_OVF, 0);
+            }
+            pthread_mutex_lock(&uart_mutex);
+        }
+        uart->fifo[uart->fifo_count++] = bytes[i];
+
+        if (uart->pattern_enabled && bytes[i] == uart->pattern)
+        {
+            uart_fifo_drain(uart, UART_PATTERN_DET);
+        }
+        else if ((uart->intr_mask & UART_RXFIFO_FULL_INT_ENA_M) && uart->fifo_count >= uart->full_thresh)
+        {
+            uart_fifo_drain(uart, UART_DATA);
+        }
+        else
+        {
+            pthread_mutex_unlock(&uart_mutex);
+        }
+    }
+
+    // the line is idle after the bytes: the timeout interrupt drains the rest of the FIFO
+    pthread_mutex_lock(&uart_mutex);
+    host_uart_t *uart = uart_get(uart_num);
+    if (uart == NULL)
+    {
+        pthread_mutex_unlock(&uart_mutex);
+        return ESP_ERR_INVALID_STATE;
+    }
+    if ((uart->intr_mask & UART_RXFIFO_TOUT_INT_ENA_M) && uart->fifo_count > 0)
+    {
+        uart_fifo_drain(uart, UART_DATA);
+    }
+    else
+    {
+        pthread_mutex_unlock(&uart_mutex);
+    }
+    return ESP_OK;
+}
+
+esp_err_t uart_host_event(uart_port_t uart_num, uart_event_type_t type)
+{
+    host_uart_t *uart = uart_get(uart_num);
+    if (uart == NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    uart_send_event(uart, type, 0);
+    return ESP_OK;
+}
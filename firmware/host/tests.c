@@ -0,0 +1,411 @@
+/**
+ * @file tests.c
+ * @author Dorian Benech
+ * @brief Host unit tests: the self tests of the modules, and the Linky and MQTT paths over the shims
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2023 GammaTroniques
+ *
+ */
+
+/*==============================================================================
+ Local Include
+===============================================================================*/
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "driver/uart.h"
+#include "mqtt_client.h"
+#include "esp_log.h"
+#include "config.h"
+#include "linky.h"
+#include "record.h"
+#include "history.h"
+#include "aggregate.h"
+#include "json_writer.h"
+#include "mqtt.h"
+#include "tuya.h"
+#include "tuya_host.h"
+#include "wifi.h"
+#include <stdio.h>
+#include <string.h>
+
+/*==============================================================================
+ Local Define
+===============================================================================*/
+#define TAG "HOST_TESTS"
+#define TESTS_LINKY_UART UART_NUM_1 // LINKY_UART of linky.c
+#define TESTS_FRAME_SIZE 1024
+#define TESTS_FRAME_PERIOD 50 // Time between two frames fed to the UART (ms)
+#define TESTS_READING_TIMEOUT 3000 // ms
+#define TESTS_HISTORY_COUNT 200 // Readings written and read back from the history partition
+#define TESTS_TUYA_TIMEOUT 1000 // ms
+#define TESTS_WAKEUPS_PER_FRAME 4 // UART events per frame: FIFO full and END_OF_FRAME, not one per group
+
+/*==============================================================================
+ Local Macro
+===============================================================================*/
+#define TESTS_CHECK(condition)                                                        \
+    do                                                                                \
+    {                                                                                 \
+        if (!(condition))                                                             \
+        {                                                                             \
+            ESP_LOGE(TAG, "%s:%d: check failed: %s", __FILE__, __LINE__, #condition); \
+            return ESP_FAIL;                                                          \
+        }                                                                             \
+    } while (0)
+
+/*==============================================================================
+ Local Type
+===============================================================================*/
+typedef struct
+{
+    const char *name;
+    esp_err_t (*function)();
+} host_test_t;
+
+typedef struct
+{
+    uint8_t data[TESTS_FRAME_SIZE];
+    uint32_t size;
+    bool groups; // each group in its own burst, the line is idle between them
+    volatile bool stop;
+    volatile bool stopped;
+} tests_feeder_t;
+
+/*==============================================================================
+ Local Function Declaration
+===============================================================================*/
+static esp_err_t test_json_writer();
+static esp_err_t test_aggregate();
+static esp_err_t test_linky_time();
+static esp_err_t test_linky_sniff();
+static esp_err_t test_record();
+static esp_err_t test_history();
+static esp_err_t test_linky_uart();
+static esp_err_t test_linky_wakeups();
+static esp_err_t test_mqtt_send();
+static esp_err_t test_mqtt_lost();
+static esp_err_t test_tuya_send();
+
+/*==============================================================================
+Public Variable
+===============================================================================*/
+
+/*==============================================================================
+ Local Variable
+===============================================================================*/
+static const host_test_t tests[] = {
+    {"json_writer", test_json_writer},
+    {"aggregate", test_aggregate},
+    {"linky_time", test_linky_time},
+    {"linky_sniff", test_linky_sniff},
+    {"record", test_record},
+    {"history", test_history},
+    {"linky_uart", test_linky_uart}, // leaves the decoded reading in linky_data for the MQTT tests
+    {"linky_wakeups", test_linky_wakeups},
+    {"mqtt_send", test_mqtt_send},
+    {"mqtt_lost", test_mqtt_lost},
+    {"tuya_send", test_tuya_send},
+};
+
+/*==============================================================================
+Function Implementation
+===============================================================================*/
+
+/**
+ * @brief Append a group of the standard mode to a frame, with its checksum
+ *
+ * @param frame the frame, started with START_OF_FRAME
+ * @param time the horodate, NULL if the label has none
+ */
+static void tests_frame_add(tests_feeder_t *frame, const char *label, const char *time, const char *value)
+{
+    char group[128];
+    int size = time != NULL ? snprintf(group, sizeof(group), "%s\t%s\t%s\t", label, time, value) : snprintf(group, sizeof(group), "%s\t%s\t", label, value);
+    uint8_t sum = 0;
+    for (int i = 0; i < size; i++)
+    {
+        sum += group[i];
+    }
+    frame->size += snprintf((char *)frame->data + frame->size, sizeof(frame->data) - frame->size, "\n%s%c\r", group, (sum & 0x3F) + 0x20);
+}
+
+/**
+ * @brief Build the frame of the standard mode read by the tests
+ */
+static void tests_frame_std(tests_feeder_t *frame)
+{
+    frame->size = 0;
+    frame->data[frame->size++] = 0x02; // START_OF_FRAME
+    tests_frame_add(frame, "ADSC", NULL, "123456789012");
+    tests_frame_add(frame, "VTIC", NULL, "02");
+    tests_frame_add(frame, "DATE", "H240309213121", "");
+    tests_frame_add(frame, "NGTF", NULL, "     TEMPO      ");
+    tests_frame_add(frame, "LTARF", NULL, "    HP  BLEU    ");
+    tests_frame_add(frame, "EAST", NULL, "050019226");
+    tests_frame_add(frame, "IRMS1", NULL, "007");
+    tests_frame_add(frame, "URMS1", NULL, "232");
+    tests_frame_add(frame, "PREF", NULL, "09");
+    tests_frame_add(frame, "SINSTS", NULL, "01520");
+    frame->data[frame->size++] = 0x03; // END_OF_FRAME
+}
+
+/**
+ * @brief Send the frame to the UART periodically, as the meter
+ */
+static void tests_feeder_task(void *pvParameters)
+{
+    tests_feeder_t *feeder = pvParameters;
+    while (!feeder->stop)
+    {
+        uint32_t offset = 0;
+        while (offset < feeder->size)
+        {
+            uint32_t size = feeder->size - offset;
+            const uint8_t *end = feeder->groups ? memchr(feeder->data + offset, '\r', size) : NULL;
+            if (end != NULL)
+            {
+                size = end - (feeder->data + offset) + 1;
+            }
+            uart_host_receive(TESTS_LINKY_UART, feeder->data + offset, size);
+            offset += size;
+        }
+        vTaskDelay(TESTS_FRAME_PERIOD / portTICK_PERIOD_MS);
+    }
+    feeder->stopped = true;
+    vTaskDelete(NULL);
+}
+
+/**
+ * @brief Read the frames of the feeder until a reading is decoded
+ *
+ * @param wakeups the UART events per frame (x10)
+ */
+static esp_err_t tests_linky_read(tests_feeder_t *feeder, uint32_t *wakeups)
+{
+    uint32_t wakeups_start = linky_metrics.uart_wakeups;
+    uint32_t frames_start = linky_metrics.frames_received;
+    feeder->stop = false;
+    feeder->stopped = false;
+    TESTS_CHECK(xTaskCreate(tests_feeder_task, "tests_feeder_task", 4096, feeder, 1, NULL) == pdPASS);
+    char ret = linky_update(TESTS_READING_TIMEOUT);
+    feeder->stop = true;
+    while (!feeder->stopped)
+    {
+        vTaskDelay(10 / portTICK_PERIOD_MS);
+    }
+    TESTS_CHECK(ret == 1);
+
+    uint32_t frames = linky_metrics.frames_received - frames_start;
+    TESTS_CHECK(frames > 0);
+    if (wakeups != NULL)
+    {
+        *wakeups = (linky_metrics.uart_wakeups - wakeups_start) * 10 / frames;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t test_json_writer()
+{
+    return json_writer_test();
+}
+
+static esp_err_t test_aggregate()
+{
+    return aggregate_test();
+}
+
+static esp_err_t test_linky_time()
+{
+    return linky_time_test();
+}
+
+static esp_err_t test_linky_sniff()
+{
+    return linky_sniff_test();
+}
+
+static esp_err_t test_record()
+{
+    // a sequence of readings with a few changes, encoded then decoded
+    linky_data_t readings[3] = {0};
+    readings[0].mode = MODE_STD;
+    strcpy(readings[0].std.ADSC, "123456789012");
+    strcpy(readings[0].std.LTARF, "HP  BLEU");
+    readings[0].std.EAST = 50019226;
+    readings[0].std.SINSTS = 1520;
+    readings[0].timestamp = 1710017481;
+    readings[1] = readings[0];
+    readings[1].std.EAST += 12;
+    readings[1].std.SINSTS = 1480;
+    readings[1].timestamp += 60;
+    readings[2] = readings[1];
+    strcpy(readings[2].std.LTARF, "HC  BLEU");
+    readings[2].timestamp += 60;
+
+    record_reset();
+    for (uint32_t i = 0; i < 3; i++)
+    {
+        TESTS_CHECK(record_add(&readings[i]) == ESP_OK);
+    }
+    TESTS_CHECK(record_count() == 3);
+
+    record_iterator_t it;
+    record_iterator_init(&it);
+    for (uint32_t i = 0; i < 3; i++)
+    {
+        TESTS_CHECK(record_next(&it));
+        TESTS_CHECK(it.state.data.timestamp == readings[i].timestamp);
+        TESTS_CHECK(it.state.data.std.EAST == readings[i].std.EAST);
+        TESTS_CHECK(it.state.data.std.SINSTS == readings[i].std.SINSTS);
+        TESTS_CHECK(strcmp(it.state.data.std.LTARF, readings[i].std.LTARF) == 0);
+        TESTS_CHECK(strcmp(it.state.data.std.ADSC, readings[i].std.ADSC) == 0);
+    }
+    TESTS_CHECK(!record_next(&it));
+    ESP_LOGI(TAG, "3 records in %" PRIu32 " bytes", record_size());
+    record_reset();
+    return ESP_OK;
+}
+
+static esp_err_t test_history()
+{
+    TESTS_CHECK(history_init() == ESP_OK);
+    return history_benchmark(TESTS_HISTORY_COUNT);
+}
+
+static esp_err_t test_linky_uart()
+{
+    static tests_feeder_t feeder = {0};
+    tests_frame_std(&feeder);
+
+    config_values.linky_mode = MODE_STD;
+    config_values.last_linky_mode = MODE_STD;
+    linky_init(0);
+    TESTS_CHECK(linky_mode == MODE_STD);
+    TESTS_CHECK(uart_host_get_baudrate(TESTS_LINKY_UART) == 9600);
+
+    TESTS_CHECK(tests_linky_read(&feeder, NULL) == ESP_OK);
+
+    TESTS_CHECK(strcmp(linky_data.std.ADSC, "123456789012") == 0);
+    TESTS_CHECK(linky_data.std.EAST == 50019226);
+    TESTS_CHECK(linky_data.std.IRMS1 == 7);
+    TESTS_CHECK(linky_data.std.URMS1 == 232);
+    TESTS_CHECK(linky_data.std.SINSTS == 1520);
+    TESTS_CHECK(linky_data.std.DATE.time != 0);
+    TESTS_CHECK(linky_metrics.checksum_errors == 0);
+    TESTS_CHECK(linky_metrics.frames_valid > 0);
+    return ESP_OK;
+}
+
+static esp_err_t test_linky_wakeups()
+{
+    static tests_feeder_t feeder = {0};
+    tests_frame_std(&feeder);
+    feeder.groups = true; // a RX timeout interrupt would give an event per group
+
+    uint32_t wakeups = 0;
+    TESTS_CHECK(tests_linky_read(&feeder, &wakeups) == ESP_OK);
+    ESP_LOGI(TAG, "UART wakeups per frame: %" PRIu32 ".%" PRIu32, wakeups / 10, wakeups % 10);
+    TESTS_CHECK(wakeups <= TESTS_WAKEUPS_PER_FRAME * 10);
+
+    // each baud rate change flushes the UART, which enables the default RX interrupts again
+    linky_set_mode(MODE_HIST);
+    linky_set_mode(MODE_STD);
+    TESTS_CHECK((uart_host_get_intr_mask(TESTS_LINKY_UART) & UART_RXFIFO_TOUT_INT_ENA_M) == 0);
+    TESTS_CHECK(tests_linky_read(&feeder, &wakeups) == ESP_OK);
+    ESP_LOGI(TAG, "UART wakeups per frame after a mode switch: %" PRIu32 ".%" PRIu32, wakeups / 10, wakeups % 10);
+    TESTS_CHECK(wakeups <= TESTS_WAKEUPS_PER_FRAME * 10);
+    return ESP_OK;
+}
+
+/**
+ * @brief Wait for the end of the disconnection started by mqtt_send, before the next send
+ */
+static void tests_mqtt_wait_disconnect()
+{
+    vTaskDelay(200 / portTICK_PERIOD_MS);
+}
+
+static esp_err_t test_mqtt_send()
+{
+    config_values.mode = MODE_MQTT;
+    strcpy(config_values.mqtt.host, "broker.host");
+    strcpy(config_values.mqtt.topic, "TICMeter/host");
+    wifi_state = WIFI_CONNECTED;
+    TESTS_CHECK(mqtt_init() == 1);
+
+    mqtt_host_clear();
+    linky_data.timestamp = 1710017481;
+    TESTS_CHECK(mqtt_prepare_history(&linky_data, NULL) == ESP_OK);
+    TESTS_CHECK(mqtt_send() == 1);
+    tests_mqtt_wait_disconnect();
+
+    const mqtt_host_message_t *message = mqtt_host_find("TICMeter/host/history");
+    TESTS_CHECK(message != NULL);
+    TESTS_CHECK(message->qos > 0);
+    TESTS_CHECK(strstr(message->data, "\"timestamp\":1710017481") != NULL);
+    TESTS_CHECK(strstr(message->data, "\"EAST\":50019226") != NULL);
+    return ESP_OK;
+}
+
+static esp_err_t test_mqtt_lost()
+{
+    // a message deleted from the outbox fails the send, as it never reached the broker
+    mqtt_host_clear();
+    mqtt_host_drop(1);
+    TESTS_CHECK(mqtt_prepare_history(&linky_data, NULL) == ESP_OK);
+    TESTS_CHECK(mqtt_send() == 0);
+    tests_mqtt_wait_disconnect();
+    TESTS_CHECK(mqtt_host_find("TICMeter/host/history") == NULL);
+
+    // the next send is not affected by the lost message
+    TESTS_CHECK(mqtt_prepare_history(&linky_data, NULL) == ESP_OK);
+    TESTS_CHECK(mqtt_send() == 1);
+    tests_mqtt_wait_disconnect();
+    TESTS_CHECK(mqtt_host_find("TICMeter/host/history") != NULL);
+    mqtt_deinit();
+    return ESP_OK;
+}
+
+static esp_err_t test_tuya_send()
+{
+    config_values.mode = MODE_TUYA;
+    strcpy(config_values.tuya.device_uuid, "uuidhost");
+    strcpy(config_values.tuya.device_auth, "authhost");
+    TESTS_CHECK(tuya_available());
+    tuya_init();
+    TESTS_CHECK(tuya_wait_event(TUYA_EVENT_MQTT_CONNECTED, TESTS_TUYA_TIMEOUT) == 0);
+
+    tuya_host_clear();
+    TESTS_CHECK(tuya_send_data(&linky_data) == 0);
+    uint32_t count = 0;
+    const char *dps = tuya_host_last_dps(&count);
+    TESTS_CHECK(count == 1 && dps != NULL);
+    TESTS_CHECK(strstr(dps, "\"105\":\"STANDARD\"") != NULL);
+    TESTS_CHECK(strstr(dps, "\"111\":50019226") != NULL); // EAST, the total index of a TEMPO contract
+    TESTS_CHECK(strstr(dps, "\"193\":\"H0000000001\"") != NULL);
+    tuya_deinit();
+    return ESP_OK;
+}
+
+int main(int argc, char **argv)
+{
+    esp_log_level_set("*", ESP_LOG_INFO);
+    config_erase();
+
+    uint32_t failed = 0;
+    for (uint32_t i = 0; i < sizeof(tests) / sizeof(tests[0]); i++)
+    {
+        if (argc > 1 && strcmp(argv[1], tests[i].name) != 0)
+        {
+            continue; // a single test
+        }
+        ESP_LOGI(TAG, "---------- %s ----------", tests[i].name);
+        esp_err_t err = tests[i].function();
+        ESP_LOGI(TAG, "%s: %s", tests[i].name, err == ESP_OK ? "PASS" : "FAIL");
+        failed += err != ESP_OK;
+    }
+    printf("%" PRIu32 " test(s) failed\n", failed);
+    return failed > 0 ? 1 : 0;
+}
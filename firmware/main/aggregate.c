@@ -0,0 +1,516 @@
+/**
+ * @file aggregate.c
+ * @author Dorian Benech
+ * @brief Energy consumed per tariff index over fixed periods (load curve)
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2023 GammaTroniques
+ *
+ */
+
+/*==============================================================================
+ Local Include
+===============================================================================*/
+#include "aggregate.h"
+#include "config.h"
+#include "esp_log.h"
+#include <string.h>
+#include <stddef.h>
+#include <sys/param.h>
+
+/*==============================================================================
+ Local Define
+===============================================================================*/
+#define TAG "AGGREGATE"
+
+#define AGGREGATE_INDEX_MODULO 1000000000ULL // The indexes have 9 digits (Wh)
+#define AGGREGATE_MAX_POWER 250000           // Highest power of a meter (W), a larger step is a reset
+#define AGGREGATE_MIN_TIME 1672531200        // 2023-01-01: older timestamps are not synchronized
+
+/*==============================================================================
+ Local Macro
+===============================================================================*/
+#define AGGREGATE_VALUE(data, offset) (*(const uint64_t *)((const uint8_t *)(data) + (offset)))
+
+/*==============================================================================
+ Local Type
+===============================================================================*/
+typedef struct
+{
+    const char *label;
+    size_t offset; // Offset of the uint64_t index in linky_data_t
+} aggregate_counter_t;
+
+typedef struct
+{
+    bool open;                               // A bucket is being filled
+    bool wall_clock;                         // The times are timestamps, else uptimes
+    linky_mode_t mode;                       // Mode of the last reading
+    time_t start;                            // Start of the current bucket, in the time base of the readings
+    time_t last_time;                        // Time of the last reading (s)
+    uint64_t last[AGGREGATE_COUNTER_COUNT];  // Index values of the last reading
+    uint16_t last_valid;                     // Bit n set if last[n] is available
+    uint64_t power_sum;                      // Sum of the apparent power of the bucket
+    uint16_t power_samples;                  // Number of readings with an apparent power
+    aggregate_bucket_t bucket;               // The bucket being filled
+} aggregate_state_t;
+
+/*==============================================================================
+ Local Function Declaration
+===============================================================================*/
+static time_t aggregate_time(const linky_data_t *data, bool *wall_clock);
+static bool aggregate_delta(uint64_t last, uint64_t value, uint32_t elapsed, uint32_t *delta);
+static void aggregate_share(const uint32_t *delta, uint32_t *shared, uint16_t counted, uint32_t time, uint32_t elapsed);
+static void aggregate_open(time_t start, const linky_data_t *data);
+static void aggregate_close();
+static void aggregate_add_power(const linky_data_t *data);
+
+/*==============================================================================
+Public Variable
+===============================================================================*/
+
+/*==============================================================================
+ Local Variable
+===============================================================================*/
+// clang-format off
+static const aggregate_counter_t aggregate_counters[][AGGREGATE_COUNTER_COUNT] = {
+    [MODE_HIST] = {
+        {"TOTAL",   offsetof(linky_data_t, hist.TOTAL)},
+        {"BASE",    offsetof(linky_data_t, hist.BASE)},
+        {"HCHC",    offsetof(linky_data_t, hist.HCHC)},
+        {"HCHP",    offsetof(linky_data_t, hist.HCHP)},
+        {"EJPHN",   offsetof(linky_data_t, hist.EJPHN)},
+        {"EJPHPM",  offsetof(linky_data_t, hist.EJPHPM)},
+        {"BBRHCJB", offsetof(linky_data_t, hist.BBRHCJB)},
+        {"BBRHPJB", offsetof(linky_data_t, hist.BBRHPJB)},
+        {"BBRHCJW", offsetof(linky_data_t, hist.BBRHCJW)},
+        {"BBRHPJW", offsetof(linky_data_t, hist.BBRHPJW)},
+        {"BBRHCJR", offsetof(linky_data_t, hist.BBRHCJR)},
+        {"BBRHPJR", offsetof(linky_data_t, hist.BBRHPJR)},
+    },
+    [MODE_STD] = {
+        {"EAST",    offsetof(linky_data_t, std.EAST)},
+        {"EAIT",    offsetof(linky_data_t, std.EAIT)},
+        {"EASF01",  offsetof(linky_data_t, std.EASF01)},
+        {"EASF02",  offsetof(linky_data_t, std.EASF02)},
+        {"EASF03",  offsetof(linky_data_t, std.EASF03)},
+        {"EASF04",  offsetof(linky_data_t, std.EASF04)},
+        {"EASF05",  offsetof(linky_data_t, std.EASF05)},
+        {"EASF06",  offsetof(linky_data_t, std.EASF06)},
+        {"EASF07",  offsetof(linky_data_t, std.EASF07)},
+        {"EASF08",  offsetof(linky_data_t, std.EASF08)},
+        {"EASF09",  offsetof(linky_data_t, std.EASF09)},
+        {"EASF10",  offsetof(linky_data_t, std.EASF10)},
+    },
+};
+// clang-format on
+
+static aggregate_state_t aggregate_state = {0};
+static aggregate_bucket_t aggregate_queue[AGGREGATE_QUEUE_SIZE] = {0}; // Closed buckets, oldest at aggregate_queue_head
+static uint32_t aggregate_queue_head = 0;
+static uint32_t aggregate_queue_count = 0;
+static portMUX_TYPE aggregate_lock = portMUX_INITIALIZER_UNLOCKED; // The queue is filled by the decoder and read by the senders
+
+/*==============================================================================
+Function Implementation
+===============================================================================*/
+void aggregate_update(const linky_data_t *data)
+{
+    uint16_t period = config_values.aggregate_period;
+    if (period == 0 || (data->mode != MODE_HIST && data->mode != MODE_STD))
+    {
+        aggregate_state.open = false;
+        return;
+    }
+
+    bool wall_clock;
+    time_t now = aggregate_time(data, &wall_clock);
+    uint32_t length = period * 60;
+    time_t start = now - now % length;
+    aggregate_state_t *state = &aggregate_state;
+
+    if (state->open && (data->mode != state->mode || wall_clock != state->wall_clock || period != state->bucket.period || now < state->last_time))
+    {
+        // the previous readings can not be compared to this one: close the bucket as it is
+        aggregate_close();
+    }
+
+    uint64_t values[AGGREGATE_COUNTER_COUNT];
+    uint16_t valid = 0;
+    for (uint32_t i = 0; i < AGGREGATE_COUNTER_COUNT; i++)
+    {
+        values[i] = AGGREGATE_VALUE(data, aggregate_counters[data->mode][i].offset);
+        if (values[i] < AGGREGATE_INDEX_MODULO) // unavailable indexes are UINT64_MAX (UINT32_MAX for an unknown TOTAL)
+        {
+            valid |= 1 << i;
+        }
+    }
+
+    if (!state->open)
+    {
+        state->mode = data->mode;
+        state->wall_clock = wall_clock;
+        aggregate_open(start, data);
+    }
+    else
+    {
+        uint32_t elapsed = now - state->last_time;
+        uint32_t delta[AGGREGATE_COUNTER_COUNT] = {0};
+        uint32_t shared[AGGREGATE_COUNTER_COUNT] = {0}; // Part of delta already added to the previous buckets
+        uint16_t counted = 0;                           // Bit n set if delta[n] is available
+
+        for (uint32_t i = 0; i < AGGREGATE_COUNTER_COUNT; i++)
+        {
+            if (!(valid & state->last_valid & (1 << i)))
+            {
+                continue;
+            }
+            if (!aggregate_delta(state->last[i], values[i], elapsed, &delta[i]))
+            {
+                ESP_LOGW(TAG, "%s reset: %" PRIu64 " -> %" PRIu64, aggregate_counters[data->mode][i].label, state->last[i], values[i]);
+                state->bucket.resets++;
+                continue;
+            }
+            counted |= 1 << i;
+        }
+
+        uint32_t periods = (start - state->start) / length; // Periods ended since the last reading
+        if (periods > AGGREGATE_QUEUE_SIZE)
+        {
+            // the step would fill the queue with estimated buckets: it is not counted
+            ESP_LOGW(TAG, "No reading during %" PRIu32 " periods: step not counted", periods - 1);
+            counted = 0;
+            aggregate_close();
+            aggregate_open(start, data);
+        }
+        // the step is shared between the periods it spans, in proportion to the time spent in each one
+        while (state->open && state->start != start)
+        {
+            time_t end = state->start + length;
+            aggregate_share(delta, shared, counted, end - state->last_time, elapsed);
+            aggregate_close();
+            aggregate_open(end, data);
+            if (end != start)
+            {
+                // period without reading: its energy is estimated from the step
+                state->bucket.uptime -= MIN(state->bucket.uptime, state->wall_clock ? now - end : 0);
+                state->bucket.available = counted;
+            }
+        }
+        aggregate_share(delta, shared, counted, elapsed, elapsed);
+    }
+
+    memcpy(state->last, values, sizeof(values));
+    state->last_valid = valid;
+    state->last_time = now;
+    state->bucket.available |= valid;
+    state->bucket.samples++;
+    aggregate_add_power(data);
+}
+
+uint32_t aggregate_read(aggregate_bucket_t *buckets, uint32_t max)
+{
+    uint32_t count = 0;
+    taskENTER_CRITICAL(&aggregate_lock);
+    for (; count < max && count < aggregate_queue_count; count++)
+    {
+        buckets[count] = aggregate_queue[(aggregate_queue_head + count) % AGGREGATE_QUEUE_SIZE];
+    }
+    taskEXIT_CRITICAL(&aggregate_lock);
+    return count;
+}
+
+void aggregate_consume(uint32_t count)
+{
+    taskENTER_CRITICAL(&aggregate_lock);
+    if (count > aggregate_queue_count)
+    {
+        count = aggregate_queue_count;
+    }
+    aggregate_queue_head = (aggregate_queue_head + count) % AGGREGATE_QUEUE_SIZE;
+    aggregate_queue_count -= count;
+    taskEXIT_CRITICAL(&aggregate_lock);
+}
+
+void aggregate_reset()
+{
+    taskENTER_CRITICAL(&aggregate_lock);
+    memset(&aggregate_state, 0, sizeof(aggregate_state));
+    aggregate_queue_head = 0;
+    aggregate_queue_count = 0;
+    taskEXIT_CRITICAL(&aggregate_lock);
+}
+
+const char *aggregate_counter_label(linky_mode_t mode, uint32_t counter)
+{
+    if ((mode != MODE_HIST && mode != MODE_STD) || counter >= AGGREGATE_COUNTER_COUNT)
+    {
+        return "";
+    }
+    return aggregate_counters[mode][counter].label;
+}
+
+void aggregate_write_json(json_writer_t *writer, const aggregate_bucket_t *bucket)
+{
+    json_writer_object_start(writer, NULL);
+    if (bucket->start != 0)
+    {
+        json_writer_int(writer, "start", bucket->start);
+    }
+    json_writer_uint(writer, "uptime", bucket->uptime);
+    json_writer_uint(writer, "period", bucket->period);
+    json_writer_uint(writer, "samples", bucket->samples);
+    json_writer_uint(writer, "resets", bucket->resets);
+
+    json_writer_object_start(writer, "energy");
+    for (uint32_t i = 0; i < AGGREGATE_COUNTER_COUNT; i++)
+    {
+        if (bucket->available & (1 << i))
+        {
+            json_writer_uint(writer, aggregate_counter_label(bucket->mode, i), bucket->energy[i]);
+        }
+    }
+    json_writer_object_end(writer);
+
+    if (bucket->power_max != 0 || bucket->power_min != UINT32_MAX)
+    {
+        json_writer_uint(writer, "power_min", bucket->power_min);
+        json_writer_uint(writer, "power_max", bucket->power_max);
+        json_writer_uint(writer, "power_mean", bucket->power_mean);
+    }
+    json_writer_object_end(writer);
+}
+
+void aggregate_print()
+{
+    if (config_values.aggregate_period == 0)
+    {
+        printf("Aggregation disabled\n");
+        return;
+    }
+    aggregate_bucket_t buckets[AGGREGATE_QUEUE_SIZE + 1];
+    uint32_t count = aggregate_read(buckets, AGGREGATE_QUEUE_SIZE);
+    if (aggregate_state.open)
+    {
+        buckets[count++] = aggregate_state.bucket;
+    }
+    printf("Period: %d min, closed buckets: %" PRIu32 "\n", config_values.aggregate_period, aggregate_queue_count);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        char json[AGGREGATE_JSON_SIZE];
+        json_writer_t writer;
+        json_writer_init(&writer, json, sizeof(json), NULL, NULL);
+        aggregate_write_json(&writer, &buckets[i]);
+        if (json_writer_end(&writer) != ESP_OK)
+        {
+            json[0] = '\0';
+        }
+        printf("%s%s\n", (aggregate_state.open && i == count - 1) ? "current: " : "", json);
+    }
+}
+
+/**
+ * @brief Get the time of a reading: the synchronized time, the time of the meter or the uptime
+ *
+ * @param data the reading
+ * @param wall_clock set to false if the uptime is returned
+ * @return time_t the time in seconds
+ */
+static time_t aggregate_time(const linky_data_t *data, bool *wall_clock)
+{
+    *wall_clock = true;
+    if (data->timestamp >= AGGREGATE_MIN_TIME)
+    {
+        return data->timestamp;
+    }
+    if (data->mode == MODE_STD && data->std.DATE.time >= AGGREGATE_MIN_TIME)
+    {
+        return data->std.DATE.time;
+    }
+    *wall_clock = false;
+    return data->uptime / 1000;
+}
+
+/**
+ * @brief Compute the energy consumed between two index values
+ *
+ * @param last the previous value
+ * @param value the new value
+ * @param elapsed the time between the two values (s)
+ * @param delta the energy (Wh)
+ * @return true if the step is possible, false if the index was reset
+ */
+static bool aggregate_delta(uint64_t last, uint64_t value, uint32_t elapsed, uint32_t *delta)
+{
+    uint64_t step = value >= last ? value - last : value + AGGREGATE_INDEX_MODULO - last; // the index wrapped
+    // a step backward gives a step close to the modulo: more than the meter can count
+    if (step > (uint64_t)AGGREGATE_MAX_POWER * (elapsed + 1) / 3600)
+    {
+        return false;
+    }
+    *delta = step;
+    return true;
+}
+
+/**
+ * @brief Add to the current bucket the part of the steps up to a time
+ *
+ * @param delta the steps of the counters
+ * @param shared the part of the steps already added, updated
+ * @param counted bit n set if delta[n] is available
+ * @param time the time from the previous reading to the end of the part (s)
+ * @param elapsed the time between the two readings (s)
+ */
+static void aggregate_share(const uint32_t *delta, uint32_t *shared, uint16_t counted, uint32_t time, uint32_t elapsed)
+{
+    for (uint32_t i = 0; i < AGGREGATE_COUNTER_COUNT; i++)
+    {
+        if (!(counted & (1 << i)))
+        {
+            continue;
+        }
+        // the sum of the parts is the step: the rounding is not lost
+        uint32_t total = (elapsed > 0) ? (uint64_t)delta[i] * time / elapsed : delta[i];
+        aggregate_state.bucket.energy[i] += total - shared[i];
+        shared[i] = total;
+    }
+}
+
+/**
+ * @brief Start a new bucket
+ *
+ * @param start the start of the period (timestamp or uptime)
+ * @param data the first reading of the bucket
+ */
+static void aggregate_open(time_t start, const linky_data_t *data)
+{
+    aggregate_state_t *state = &aggregate_state;
+    memset(&state->bucket, 0, sizeof(state->bucket));
+    state->start = start;
+    state->bucket.start = state->wall_clock ? start : 0;
+    state->bucket.uptime = state->wall_clock ? data->uptime / 1000 : start;
+    state->bucket.period = config_values.aggregate_period;
+    state->bucket.mode = data->mode;
+    state->bucket.power_min = UINT32_MAX;
+    state->power_sum = 0;
+    state->power_samples = 0;
+    state->open = true;
+}
+
+/**
+ * @brief Move the current bucket to the closed buckets
+ */
+static void aggregate_close()
+{
+    aggregate_state_t *state = &aggregate_state;
+    if (state->power_samples > 0)
+    {
+        state->bucket.power_mean = state->power_sum / state->power_samples;
+    }
+
+    taskENTER_CRITICAL(&aggregate_lock);
+    if (aggregate_queue_count == AGGREGATE_QUEUE_SIZE)
+    {
+        // not published in time: drop the oldest bucket
+        aggregate_queue_head = (aggregate_queue_head + 1) % AGGREGATE_QUEUE_SIZE;
+        aggregate_queue_count--;
+    }
+    aggregate_queue[(aggregate_queue_head + aggregate_queue_count) % AGGREGATE_QUEUE_SIZE] = state->bucket;
+    aggregate_queue_count++;
+    taskEXIT_CRITICAL(&aggregate_lock);
+
+    ESP_LOGI(TAG, "Bucket closed: start: %" PRId64 ", samples: %d, %s: %" PRIu32 " Wh", state->bucket.start, state->bucket.samples,
+             aggregate_counter_label(state->bucket.mode, 0), state->bucket.energy[0]);
+    state->open = false;
+}
+
+/**
+ * @brief Add the apparent power of a reading to the current bucket
+ *
+ * @param data the reading
+ */
+static void aggregate_add_power(const linky_data_t *data)
+{
+    uint32_t power = data->mode == MODE_HIST ? data->hist.PAPP : data->std.SINSTS;
+    if (power == UINT32_MAX)
+    {
+        return;
+    }
+    aggregate_bucket_t *bucket = &aggregate_state.bucket;
+    bucket->power_min = MIN(bucket->power_min, power);
+    bucket->power_max = MAX(bucket->power_max, power);
+    aggregate_state.power_sum += power;
+    aggregate_state.power_samples++;
+}
+
+/**
+ * @brief Create a standard reading for aggregate_test
+ *
+ * @param data the reading to fill
+ * @param time the timestamp
+ * @param index the value of EAST and EASF01
+ * @param power the apparent power
+ */
+static void aggregate_test_reading(linky_data_t *data, time_t time, uint64_t index, uint32_t power)
+{
+    memset(data, 0xFF, sizeof(*data)); // every value unavailable
+    data->mode = MODE_STD;
+    data->timestamp = time;
+    data->uptime = 0;
+    data->std.EAST = index;
+    data->std.EASF01 = index;
+    data->std.SINSTS = power;
+}
+
+esp_err_t aggregate_test()
+{
+    // 10 Wh per minute, read every minute then every 7 minutes, then no reading during 30 minutes
+    // EAST wraps at 20 minutes and the meter is replaced at 50 minutes: the step before is lost
+    // the bucket without reading gets its part of the step over the gap
+    const time_t t0 = 1699999200; // aligned on 15 minutes
+    const uint64_t base = AGGREGATE_INDEX_MODULO - 200;
+    const uint32_t expected_energy[] = {150, 150, 150, 140, 150, 150, 150, 150};
+    const uint8_t expected_resets[] = {0, 0, 0, 2, 0, 0, 0, 0};
+    const uint16_t expected_samples[] = {15, 15, 15, 15, 3, 2, 1, 0};
+    const uint32_t expected_count = sizeof(expected_energy) / sizeof(expected_energy[0]);
+
+    uint16_t period = config_values.aggregate_period;
+    config_values.aggregate_period = 15;
+    aggregate_reset();
+
+    static linky_data_t data;
+    uint32_t reading = 0;
+    for (uint32_t t = 0; t <= 7500; t += (t < 3600 ? 60 : (t < 5700 ? 420 : 1800)), reading++)
+    {
+        uint64_t index = t < 3000 ? (base + t / 6) % AGGREGATE_INDEX_MODULO : 100 + (t - 3000) / 6;
+        aggregate_test_reading(&data, t0 + t, index, 500 + (reading % 3) * 100);
+        aggregate_update(&data);
+    }
+
+    aggregate_bucket_t buckets[AGGREGATE_QUEUE_SIZE];
+    uint32_t count = aggregate_read(buckets, AGGREGATE_QUEUE_SIZE);
+    esp_err_t err = (count == expected_count) ? ESP_OK : ESP_FAIL;
+    ESP_LOGI(TAG, "Closed buckets: %" PRIu32 ", expected %" PRIu32, count, expected_count);
+    for (uint32_t i = 0; i < count && i < expected_count; i++)
+    {
+        const aggregate_bucket_t *b = &buckets[i];
+        bool ok = b->start == t0 + i * 900 && b->energy[0] == expected_energy[i] && b->energy[2] == expected_energy[i] &&
+                  b->energy[1] == 0 && b->available == 0x5 && b->resets == expected_resets[i] && b->samples == expected_samples[i];
+        ESP_LOGI(TAG, "Bucket %" PRIu32 ": start: +%" PRId64 ", EAST: %" PRIu32 " Wh, EASF01: %" PRIu32 " Wh, resets: %d, samples: %d, power: %" PRIu32 "/%" PRIu32 "/%" PRIu32 " VA: %s", i, b->start - t0,
+                 b->energy[0], b->energy[2], b->resets, b->samples, b->power_min, b->power_mean, b->power_max, ok ? "OK" : "FAIL");
+        if (!ok)
+        {
+            err = ESP_FAIL;
+        }
+    }
+    if (count > 0 && (buckets[0].power_min != 500 || buckets[0].power_max != 700 || buckets[0].power_mean != 600))
+    {
+        ESP_LOGE(TAG, "Bad power of the first bucket");
+        err = ESP_FAIL;
+    }
+
+    config_values.aggregate_period = period;
+    aggregate_reset();
+    return err;
+}
@@ -0,0 +1,334 @@
+/**
+ * @file capture.c
+ * @author Dorian Benech
+ * @brief Record of the raw bytes received from the Linky, to debug and replay real frames
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2023 GammaTroniques
+ *
+ * The UART task copies each frame read from the driver to a ring buffer, without waiting.
+ * A low priority task writes them to CAPTURE_PATH on the storage partition. When the file is full,
+ * it is renamed to CAPTURE_OLD_PATH, dropping the oldest records: both files form a ring.
+ */
+
+/*==============================================================================
+ Local Include
+===============================================================================*/
+#include "capture.h"
+#include "config.h"
+#include "esp_log.h"
+#include "esp_spiffs.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/ringbuf.h"
+#include <string.h>
+#include <stdlib.h>
+#include <sys/param.h>
+
+/*==============================================================================
+ Local Define
+===============================================================================*/
+#define TAG "CAPTURE"
+#define CAPTURE_RAM_SIZE (8 * 1024)    // Ring buffer between the UART task and the capture task
+#define CAPTURE_MIN_SIZE (4 * 1024)    // Smaller captures would not hold a few standard frames
+#define CAPTURE_FREE_MARGIN (4 * 1024) // Space left free on the storage partition
+#define CAPTURE_DUMP_LINE 32           // Bytes per line of capture_dump()
+
+/*==============================================================================
+ Local Macro
+===============================================================================*/
+
+/*==============================================================================
+ Local Type
+===============================================================================*/
+typedef struct
+{
+    bool started;
+    uint32_t speed;
+    uint32_t first_time;  // Time of the first record (ms)
+    int64_t replay_start; // esp_timer_get_time() at the first record
+    uint32_t records;
+    linky_replay_t replay;
+} capture_replay_t;
+
+/*==============================================================================
+ Local Function Declaration
+===============================================================================*/
+static void capture_task(void *pvParameters);
+static bool capture_dump_record(const capture_record_t *record, const uint8_t *data, void *arg);
+static bool capture_replay_record(const capture_record_t *record, const uint8_t *data, void *arg);
+
+/*==============================================================================
+ Public Variable
+===============================================================================*/
+
+/*==============================================================================
+ Local Variable
+===============================================================================*/
+static RingbufHandle_t capture_ringbuf = NULL;
+static volatile bool capture_active = false;    // Records are added by the UART task
+static volatile bool capture_file_open = false; // The capture task still has records to write
+static uint32_t capture_file_size = 0;          // Maximum size of each file
+static uint32_t capture_start_time = 0;         // MILLIS at capture_start()
+static uint32_t capture_records = 0;
+static uint32_t capture_dropped = 0; // Records lost: ring buffer full or file error
+
+/*==============================================================================
+Function Implementation
+===============================================================================*/
+
+esp_err_t capture_start(uint32_t max_size)
+{
+    if (capture_active || capture_file_open)
+    {
+        ESP_LOGE(TAG, "A capture is already in progress");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    remove(CAPTURE_PATH);
+    remove(CAPTURE_OLD_PATH);
+    size_t total = 0;
+    size_t used = 0;
+    esp_err_t err = esp_spiffs_info(NULL, &total, &used);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Storage partition not mounted: %s", esp_err_to_name(err));
+        return err;
+    }
+    uint32_t free_size = total > used + CAPTURE_FREE_MARGIN ? total - used - CAPTURE_FREE_MARGIN : 0;
+    uint32_t size = MIN(max_size > 0 ? max_size : CAPTURE_MAX_SIZE, free_size);
+    if (size < CAPTURE_MIN_SIZE)
+    {
+        ESP_LOGE(TAG, "Not enough space on the storage partition: %ld bytes free", free_size);
+        return ESP_ERR_NO_MEM;
+    }
+
+    if (capture_ringbuf == NULL)
+    {
+        capture_ringbuf = xRingbufferCreate(CAPTURE_RAM_SIZE, RINGBUF_TYPE_NOSPLIT);
+        if (capture_ringbuf == NULL)
+        {
+            ESP_LOGE(TAG, "Failed to create the ring buffer");
+            return ESP_ERR_NO_MEM;
+        }
+        xTaskCreate(capture_task, "capture_task", 4 * 1024, NULL, PRIORITY_CAPTURE, NULL);
+    }
+
+    capture_file_size = size / 2;
+    capture_records = 0;
+    capture_dropped = 0;
+    capture_start_time = MILLIS;
+    capture_active = true;
+    ESP_LOGI(TAG, "Capture started: %ld bytes", size);
+    return ESP_OK;
+}
+
+void capture_stop()
+{
+    if (!capture_active)
+    {
+        return;
+    }
+    capture_active = false;
+    // wait for the capture task to write the last records
+    for (uint32_t i = 0; i < 30 && capture_file_open; i++)
+    {
+        vTaskDelay(100 / portTICK_PERIOD_MS);
+    }
+    ESP_LOGI(TAG, "Capture stopped: %ld records in %ld s, %ld dropped", capture_records, (MILLIS - capture_start_time) / 1000, capture_dropped);
+}
+
+bool capture_running()
+{
+    return capture_active;
+}
+
+void capture_add(const uint8_t *data, uint32_t size, linky_mode_t mode)
+{
+    if (!capture_active || size == 0)
+    {
+        return;
+    }
+    size = MIN(size, CAPTURE_RECORD_MAX);
+    capture_record_t record = {
+        .time = MILLIS - capture_start_time,
+        .size = size,
+        .mode = mode,
+    };
+
+    void *item = NULL;
+    if (xRingbufferSendAcquire(capture_ringbuf, &item, sizeof(record) + size, 0) != pdTRUE)
+    {
+        capture_dropped++; // the capture task is late: don't slow down the UART task
+        return;
+    }
+    memcpy(item, &record, sizeof(record));
+    memcpy((uint8_t *)item + sizeof(record), data, size);
+    xRingbufferSendComplete(capture_ringbuf, item);
+}
+
+/**
+ * @brief Write the records of the ring buffer to the capture files
+ */
+static void capture_task(void *pvParameters)
+{
+    FILE *file = NULL;
+    uint32_t file_size = 0;
+    for (;;)
+    {
+        size_t size = 0;
+        uint8_t *item = xRingbufferReceive(capture_ringbuf, &size, 500 / portTICK_PERIOD_MS);
+        if (item == NULL)
+        {
+            if (!capture_active && file != NULL)
+            {
+                fclose(file); // stopped and every record written
+                file = NULL;
+            }
+            capture_file_open = file != NULL;
+            continue;
+        }
+
+        capture_file_open = true;
+        if (file != NULL && file_size + size > capture_file_size)
+        {
+            // the current file is full: it becomes the old one
+            fclose(file);
+            file = NULL;
+            remove(CAPTURE_OLD_PATH);
+            rename(CAPTURE_PATH, CAPTURE_OLD_PATH);
+        }
+        if (file == NULL)
+        {
+            file = fopen(CAPTURE_PATH, "w");
+            file_size = 0;
+        }
+        if (file != NULL && fwrite(item, 1, size, file) == size)
+        {
+            fflush(file);
+            file_size += size;
+            capture_records++;
+        }
+        else
+        {
+            ESP_LOGE(TAG, "Failed to write %s", CAPTURE_PATH);
+            capture_dropped++;
+        }
+        vRingbufferReturnItem(capture_ringbuf, item);
+    }
+    vTaskDelete(NULL);
+}
+
+esp_err_t capture_read(capture_callback_t callback, void *arg)
+{
+    if (capture_active || capture_file_open)
+    {
+        ESP_LOGE(TAG, "Stop the capture first");
+        return ESP_ERR_INVALID_STATE;
+    }
+    uint8_t *buffer = malloc(CAPTURE_RECORD_MAX);
+    if (buffer == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    const char *paths[] = {CAPTURE_OLD_PATH, CAPTURE_PATH}; // oldest first
+    uint32_t count = 0;
+    bool next = true;
+    for (uint32_t i = 0; i < sizeof(paths) / sizeof(paths[0]) && next; i++)
+    {
+        FILE *file = fopen(paths[i], "r");
+        if (file == NULL)
+        {
+            continue;
+        }
+        capture_record_t record;
+        while (next && fread(&record, sizeof(record), 1, file) == 1)
+        {
+            if (record.size > CAPTURE_RECORD_MAX || fread(buffer, 1, record.size, file) != record.size)
+            {
+                ESP_LOGW(TAG, "%s: truncated record", paths[i]);
+                break;
+            }
+            next = callback(&record, buffer, arg);
+            count++;
+        }
+        fclose(file);
+    }
+    free(buffer);
+    return count > 0 ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+static bool capture_dump_record(const capture_record_t *record, const uint8_t *data, void *arg)
+{
+    printf("#%ld %d %d\n", record->time, record->mode, record->size);
+    for (uint32_t i = 0; i < record->size; i++)
+    {
+        printf("%02x", data[i]);
+        if ((i + 1) % CAPTURE_DUMP_LINE == 0 || i + 1 == record->size)
+        {
+            printf("\n");
+        }
+    }
+    return true;
+}
+
+esp_err_t capture_dump()
+{
+    printf("# capture: time (ms) mode size, then the bytes in hexadecimal\n");
+    esp_err_t err = capture_read(capture_dump_record, NULL);
+    printf("# end\n");
+    return err;
+}
+
+static bool capture_replay_record(const capture_record_t *record, const uint8_t *data, void *arg)
+{
+    capture_replay_t *ctx = arg;
+    if (!ctx->started)
+    {
+        linky_replay_start(record->mode);
+        ctx->started = true;
+        ctx->first_time = record->time;
+        ctx->replay_start = esp_timer_get_time();
+    }
+    else if (ctx->speed > 0)
+    {
+        // wait for the arrival time of the record, divided by the speed
+        int64_t due = ctx->replay_start + (int64_t)(record->time - ctx->first_time) * 1000 / ctx->speed;
+        int64_t now = esp_timer_get_time();
+        if (due > now)
+        {
+            vTaskDelay(MAX((due - now) / 1000 / portTICK_PERIOD_MS, 1));
+        }
+    }
+    linky_replay_feed(data, record->size, record->mode, &ctx->replay);
+    ctx->records++;
+    return true;
+}
+
+esp_err_t capture_replay(uint32_t speed)
+{
+    capture_replay_t ctx = {.speed = speed};
+    esp_err_t err = capture_read(capture_replay_record, &ctx);
+    if (!ctx.started)
+    {
+        return err;
+    }
+    int64_t duration = (esp_timer_get_time() - ctx.replay_start) / 1000;
+    linky_print();
+    linky_replay_end();
+
+    const linky_replay_t *replay = &ctx.replay;
+    ESP_LOGI(TAG, "Replay: %ld records, %ld bytes in %lld ms", ctx.records, replay->bytes, duration);
+    ESP_LOGI(TAG, "Replay: %ld frames, %ld valid, %ld groups, %ld checksum errors, %ld invalid values", replay->frames, replay->frames_valid, replay->groups,
+             replay->checksum_errors, replay->value_errors);
+    ESP_LOGI(TAG, "Replay: decode %lld us, %lld us/frame, %lld kB/s", replay->decode_time, replay->frames > 0 ? replay->decode_time / replay->frames : 0,
+             replay->decode_time > 0 ? (int64_t)replay->bytes * 1000 / replay->decode_time : 0);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+    return replay->frames_valid == replay->frames ? ESP_OK : ESP_FAIL;
+}
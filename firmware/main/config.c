@@ -15,6 +15,7 @@
 #include "config.h"
 #include "linky.h"
 #include "zigbee.h"
+#include "aggregate.h"
 #include "esp_efuse.h"
 #include "efuse_table.h"
 #include "esp_efuse_table.h"
@@ -67,6 +68,7 @@ const char *const MODES[] = {
 
 config_t config_values = {0};
 efuse_t efuse_values = {0};
+uint32_t config_generation = 0; // Incremented when config_values is read or written
 static esp_efuse_coding_scheme_t config_efuse_coding_scheme = EFUSE_CODING_SCHEME_NONE;
 /*==============================================================================
  Local Variable
@@ -96,6 +98,10 @@ static struct config_item_t config_items[] = {
     {"sleep",           UINT8,  &config_values.sleep,           sizeof(config_values.sleep),            &config_handle},
     {"index-offset",    BLOB,   &config_values.index_offset,    sizeof(config_values.index_offset),     &config_handle},
     {"boot-pairing",    UINT8,  &config_values.boot_pairing,    sizeof(config_values.boot_pairing),     &config_handle},
+    {"aggregate",       UINT8,  &config_values.aggregate_period, sizeof(config_values.aggregate_period), &config_handle},
+    {"stream",          UINT8,  &config_values.stream,          sizeof(config_values.stream),           &config_handle},
+    {"mqtt-batch",      UINT8,  &config_values.mqtt_batch,      sizeof(config_values.mqtt_batch),       &config_handle},
+    {"publish",         BLOB,   &config_values.publish,         sizeof(config_values.publish),          &config_handle},
 
 };
 static const int32_t config_items_size = sizeof(config_items) / sizeof(config_items[0]);
@@ -297,6 +303,12 @@ int8_t config_begin()
         edited = 1;
     }
 
+    if (!AGGREGATE_PERIOD_VALID(config_values.aggregate_period))
+    {
+        config_values.aggregate_period = 0;
+        edited = 1;
+    }
+
     if (edited)
     {
         config_write();
@@ -339,6 +351,7 @@ int8_t config_read()
 {
     esp_err_t err = 0;
     size_t totalBytesRead = 0;
+    config_generation++;
     for (int i = 0; i < config_items_size; i++)
     {
         size_t bytesRead = 0;
@@ -390,6 +403,7 @@ int8_t config_write()
 {
     esp_err_t err = 0;
     size_t totalBytesWritten = 0;
+    config_generation++;
     for (int i = 0; i < config_items_size; i++)
     {
         if (config_items[i].handle == &ro_config_handle && config_tuya_rw == 0)
@@ -757,6 +771,31 @@ esp_err_t config_erase_partition(const char *partition_label)
     return err;
 }
 
+esp_err_t config_read_blob(const char *name, void *value, size_t size)
+{
+    size_t read = size;
+    esp_err_t err = nvs_get_blob(config_handle, name, value, &read);
+    if (err == ESP_OK && read != size)
+    {
+        return ESP_ERR_NVS_INVALID_LENGTH; // written by another firmware version
+    }
+    return err;
+}
+
+esp_err_t config_write_blob(const char *name, const void *value, size_t size)
+{
+    esp_err_t err = nvs_set_blob(config_handle, name, value, size);
+    if (err == ESP_OK)
+    {
+        err = nvs_commit(config_handle);
+    }
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Error (0x%x %s) writing %s", err, esp_err_to_name(err), name);
+    }
+    return err;
+}
+
 uint32_t config_get_hw_version()
 {
     return (efuse_values.hw_version[0] << 16) | (efuse_values.hw_version[1] << 8) | efuse_values.hw_version[2];
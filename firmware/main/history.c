@@ -0,0 +1,593 @@
+/**
+ * @file history.c
+ * @author Dorian Benech
+ * @brief Flash log of the readings that could not be sent
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2023 GammaTroniques
+ *
+ * The partition is a ring of sectors. Each sector starts with a header holding a sequence number,
+ * followed by records encoded by record_encode(): the first record of a sector does not depend on
+ * the previous sectors, so erasing the oldest sector never breaks the delta chain.
+ * A record is marked as sent by clearing its sent byte, without erasing the sector.
+ */
+
+/*==============================================================================
+ Local Include
+===============================================================================*/
+#include "history.h"
+#include "record.h"
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "esp_crc.h"
+#include "esp_timer.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <inttypes.h>
+#include <sys/param.h>
+
+/*==============================================================================
+ Local Define
+===============================================================================*/
+#define TAG "HISTORY"
+#define HISTORY_SECTOR_SIZE 4096
+#define HISTORY_MAGIC 0x48434954 // "TICH"
+#define HISTORY_RECORD_MAX 512   // Maximum size of an encoded reading
+#define HISTORY_FREE 0xFFFF      // Size of an erased entry
+#define HISTORY_NOT_SENT 0xFF
+#define HISTORY_SENT 0x00
+
+/*==============================================================================
+ Local Macro
+===============================================================================*/
+
+/*==============================================================================
+ Local Type
+===============================================================================*/
+typedef struct
+{
+    uint32_t magic;
+    uint32_t sequence; // Incremented for each new sector, the oldest sector has the lowest sequence
+    uint32_t layout;   // history_layout_hash() of the firmware that wrote the sector
+    uint32_t crc;      // CRC of magic, sequence and layout
+} history_sector_t;
+
+typedef struct
+{
+    uint16_t size; // Size of the record following the entry
+    uint8_t sent;  // HISTORY_NOT_SENT, cleared to HISTORY_SENT once replayed
+    uint8_t reserved;
+    uint32_t crc; // CRC of the record
+} history_entry_t;
+
+/**
+ * @brief Called for each valid entry of a sector
+ *
+ * @param offset the offset of the entry in the partition
+ * @param entry the entry
+ * @param data the decoded reading
+ * @param arg the argument of history_scan_sector()
+ * @return true to continue, false to stop the scan
+ */
+typedef bool (*history_visitor_t)(uint32_t offset, const history_entry_t *entry, const linky_data_t *data, void *arg);
+
+typedef struct
+{
+    history_callback_t callback;
+    void *arg;
+    uint32_t max;
+    uint32_t count;
+} history_read_t;
+
+/*==============================================================================
+ Local Function Declaration
+===============================================================================*/
+static uint32_t history_layout_hash();
+static esp_err_t history_read_sector(uint32_t sector, uint32_t *sequence);
+static uint32_t history_scan_sector(uint32_t sector, record_state_t *state, history_visitor_t visitor, void *arg, bool *stopped);
+static bool history_walk(history_visitor_t visitor, void *arg);
+static esp_err_t history_next_sector();
+static bool history_count_visitor(uint32_t offset, const history_entry_t *entry, const linky_data_t *data, void *arg);
+static bool history_read_visitor(uint32_t offset, const history_entry_t *entry, const linky_data_t *data, void *arg);
+static bool history_consume_visitor(uint32_t offset, const history_entry_t *entry, const linky_data_t *data, void *arg);
+static esp_err_t history_check_visitor(const linky_data_t *data, void *arg);
+
+/*==============================================================================
+Public Variable
+===============================================================================*/
+
+/*==============================================================================
+ Local Variable
+===============================================================================*/
+static const esp_partition_t *history_partition = NULL;
+static uint32_t history_sectors = 0;
+static uint32_t history_head = 0;        // Sector being written
+static uint32_t history_head_offset = 0; // Offset of the next entry in the head sector
+static uint32_t history_sequence = 0;    // Sequence of the head sector
+static uint32_t history_pending = 0;     // Readings not sent yet
+static uint32_t history_layout = 0;      // Layout of the records written by this firmware
+
+static record_state_t history_write_state; // Reference of the deltas of the next record of the head sector
+static record_state_t history_scan_state;  // Used to decode the sectors
+static uint8_t history_buffer[HISTORY_RECORD_MAX + sizeof(history_entry_t)];
+
+static uint32_t history_flash_bytes = 0;   // Bytes written to the flash, headers included
+static uint32_t history_record_bytes = 0;  // Bytes of the records
+static uint32_t history_erase_count = 0;   // Sectors erased
+static uint32_t history_dropped = 0;       // Readings erased before being sent
+static uint64_t history_append_time = 0;   // Total time spent in history_append (us)
+static uint32_t history_append_count = 0;
+
+/*==============================================================================
+Function Implementation
+===============================================================================*/
+
+esp_err_t history_init()
+{
+    history_partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, HISTORY_PARTITION);
+    if (history_partition == NULL)
+    {
+        // the partition table is not updated by OTA: the history needs a serial flash of the new table
+        ESP_LOGW(TAG, "No %s partition: the unsent readings are not kept", HISTORY_PARTITION);
+        return ESP_ERR_NOT_FOUND;
+    }
+    history_sectors = history_partition->size / HISTORY_SECTOR_SIZE;
+    history_layout = history_layout_hash();
+
+    // the head is the sector with the highest sequence
+    bool found = false;
+    for (uint32_t i = 0; i < history_sectors; i++)
+    {
+        uint32_t sequence;
+        esp_err_t err = history_read_sector(i, &sequence);
+        if (err == ESP_ERR_INVALID_VERSION)
+        {
+            // written by a firmware with other labels: its records can't be decoded
+            ESP_LOGW(TAG, "Sector %" PRIu32 " has another layout, erased", i);
+            esp_partition_erase_range(history_partition, i * HISTORY_SECTOR_SIZE, HISTORY_SECTOR_SIZE);
+            history_erase_count++;
+        }
+        else if (err == ESP_OK && (!found || sequence > history_sequence))
+        {
+            found = true;
+            history_head = i;
+            history_sequence = sequence;
+        }
+    }
+
+    if (!found)
+    {
+        ESP_LOGI(TAG, "Empty history");
+        history_head = history_sectors - 1; // the first append starts at sector 0
+        history_head_offset = HISTORY_SECTOR_SIZE;
+        history_pending = 0;
+        return ESP_OK;
+    }
+
+    // rebuild the deltas of the head sector to continue writing it
+    record_state_init(&history_write_state);
+    history_head_offset = history_scan_sector(history_head, &history_write_state, NULL, NULL, NULL);
+
+    history_pending = 0;
+    history_walk(history_count_visitor, &history_pending);
+    ESP_LOGI(TAG, "History: %" PRIu32 " readings not sent, head sector %" PRIu32 " at %" PRIu32, history_pending, history_head, history_head_offset);
+    return ESP_OK;
+}
+
+esp_err_t history_append(const linky_data_t *data)
+{
+    if (history_partition == NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    uint64_t start = esp_timer_get_time();
+
+    uint32_t available = 0;
+    if (history_head_offset + sizeof(history_entry_t) < HISTORY_SECTOR_SIZE)
+    {
+        available = MIN(HISTORY_SECTOR_SIZE - history_head_offset - sizeof(history_entry_t), HISTORY_RECORD_MAX);
+    }
+    uint32_t size = record_encode(&history_write_state, data, history_buffer + sizeof(history_entry_t), available);
+    if (size == 0)
+    {
+        esp_err_t err = history_next_sector();
+        if (err != ESP_OK)
+        {
+            return err;
+        }
+        size = record_encode(&history_write_state, data, history_buffer + sizeof(history_entry_t), HISTORY_RECORD_MAX);
+        if (size == 0)
+        {
+            ESP_LOGE(TAG, "Reading too big");
+            return ESP_ERR_INVALID_SIZE;
+        }
+    }
+
+    history_entry_t *entry = (history_entry_t *)history_buffer;
+    entry->size = size;
+    entry->sent = HISTORY_NOT_SENT;
+    entry->reserved = 0xFF;
+    entry->crc = esp_crc32_le(0, history_buffer + sizeof(history_entry_t), size);
+
+    uint32_t offset = history_head * HISTORY_SECTOR_SIZE + history_head_offset;
+    esp_err_t err = esp_partition_write(history_partition, offset, history_buffer, sizeof(history_entry_t) + size);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Write failed: %s", esp_err_to_name(err));
+        history_head_offset = HISTORY_SECTOR_SIZE; // dont write again in a damaged sector
+        return err;
+    }
+    history_head_offset += sizeof(history_entry_t) + size;
+    history_pending++;
+
+    history_flash_bytes += sizeof(history_entry_t) + size;
+    history_record_bytes += size;
+    history_append_time += esp_timer_get_time() - start;
+    history_append_count++;
+    ESP_LOGI(TAG, "Reading stored: %" PRIu32 " bytes, %" PRIu32 " readings not sent", size, history_pending);
+    return ESP_OK;
+}
+
+uint32_t history_read(history_callback_t callback, void *arg, uint32_t max)
+{
+    history_read_t read = {
+        .callback = callback,
+        .arg = arg,
+        .max = max,
+    };
+    if (history_partition == NULL || history_pending == 0 || max == 0)
+    {
+        return 0;
+    }
+    history_walk(history_read_visitor, &read);
+    return read.count;
+}
+
+esp_err_t history_consume(uint32_t count)
+{
+    if (history_partition == NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (count == 0)
+    {
+        return ESP_OK;
+    }
+    history_walk(history_consume_visitor, &count);
+    ESP_LOGI(TAG, "%" PRIu32 " readings not sent", history_pending);
+    return count == 0 ? ESP_OK : ESP_FAIL;
+}
+
+uint32_t history_count()
+{
+    return history_pending;
+}
+
+esp_err_t history_erase()
+{
+    if (history_partition == NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    esp_err_t err = esp_partition_erase_range(history_partition, 0, history_partition->size);
+    history_erase_count += history_sectors;
+    history_head = history_sectors - 1;
+    history_head_offset = HISTORY_SECTOR_SIZE;
+    history_sequence = 0;
+    history_pending = 0;
+    return err;
+}
+
+void history_stats()
+{
+    ESP_LOGI(TAG, "-------------------");
+    ESP_LOGI(TAG, "History readings not sent: %" PRIu32, history_pending);
+    ESP_LOGI(TAG, "History readings dropped: %" PRIu32, history_dropped);
+    ESP_LOGI(TAG, "History bytes written: %" PRIu32 " (records: %" PRIu32 ")", history_flash_bytes, history_record_bytes);
+    ESP_LOGI(TAG, "History sectors erased: %" PRIu32, history_erase_count);
+    if (history_record_bytes > 0)
+    {
+        // an erase rewrites the whole sector
+        uint64_t flash_bytes = history_flash_bytes + (uint64_t)history_erase_count * HISTORY_SECTOR_SIZE;
+        ESP_LOGI(TAG, "History write amplification: %.2f", (float)flash_bytes / history_record_bytes);
+    }
+    if (history_append_count > 0)
+    {
+        ESP_LOGI(TAG, "History append time: %" PRIu64 " us", history_append_time / history_append_count);
+    }
+    ESP_LOGI(TAG, "-------------------");
+}
+
+esp_err_t history_benchmark(uint32_t count)
+{
+    if (history_partition == NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (history_pending > 0)
+    {
+        // the benchmark erases the partition
+        ESP_LOGE(TAG, "%" PRIu32 " readings not sent: send them before the benchmark", history_pending);
+        return ESP_ERR_INVALID_STATE;
+    }
+    history_erase();
+    history_flash_bytes = 0;
+    history_record_bytes = 0;
+    history_erase_count = 0;
+    history_dropped = 0;
+    history_append_time = 0;
+    history_append_count = 0;
+
+    // readings with a few changing values, like a real meter
+    linky_data_t *data = malloc(sizeof(linky_data_t));
+    if (data == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    *data = linky_data;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        data->timestamp = 1700000000 + i * 30;
+        data->uptime = i * 30000;
+        if (data->mode == MODE_HIST)
+        {
+            data->hist.BASE = 1000000 + i * 7;
+            data->hist.PAPP = 800 + (i * 37) % 400;
+            data->hist.IINST = (800 + (i * 37) % 400) / 230;
+        }
+        else
+        {
+            data->std.EAST = 1000000 + i * 7;
+            data->std.EASF01 = 1000000 + i * 7;
+            data->std.SINSTS = 800 + (i * 37) % 400;
+            data->std.IRMS1 = (800 + (i * 37) % 400) / 230;
+        }
+        if (history_append(data) != ESP_OK)
+        {
+            free(data);
+            return ESP_FAIL;
+        }
+    }
+    free(data);
+
+    // read back every reading still in the partition
+    uint32_t expected = history_pending;
+    time_t timestamp = 1700000000 + (count - expected) * 30;
+    uint32_t read = history_read(history_check_visitor, &timestamp, UINT32_MAX);
+    history_stats();
+    history_erase();
+    if (read != expected)
+    {
+        ESP_LOGE(TAG, "Read %" PRIu32 " readings, expected %" PRIu32, read, expected);
+        return ESP_FAIL;
+    }
+    ESP_LOGI(TAG, "%" PRIu32 " readings checked", read);
+    return ESP_OK;
+}
+
+/**
+ * @brief Hash of what the records depend on: the labels, their type and size, and the size of linky_data_t
+ */
+static uint32_t history_layout_hash()
+{
+    uint32_t hash = esp_crc32_le(0, (uint8_t *)&linky_label_list_size, sizeof(linky_label_list_size));
+    uint32_t data_size = sizeof(linky_data_t);
+    hash = esp_crc32_le(hash, (uint8_t *)&data_size, sizeof(data_size));
+    for (uint32_t i = 0; i < linky_label_list_size; i++)
+    {
+        uint8_t label[2] = {linky_label_list[i].type, linky_label_list[i].size};
+        hash = esp_crc32_le(hash, label, sizeof(label));
+    }
+    return hash;
+}
+
+/**
+ * @brief Read the header of a sector
+ *
+ * @param sector the sector index
+ * @param sequence the sequence of the sector
+ * @return esp_err_t ESP_OK if the header is valid, ESP_ERR_INVALID_VERSION if the sector has another layout
+ */
+static esp_err_t history_read_sector(uint32_t sector, uint32_t *sequence)
+{
+    history_sector_t header;
+    esp_err_t err = esp_partition_read(history_partition, sector * HISTORY_SECTOR_SIZE, &header, sizeof(header));
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+    if (header.magic != HISTORY_MAGIC || header.crc != esp_crc32_le(0, (uint8_t *)&header, offsetof(history_sector_t, crc)))
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (header.layout != history_layout)
+    {
+        return ESP_ERR_INVALID_VERSION;
+    }
+    *sequence = header.sequence;
+    return ESP_OK;
+}
+
+/**
+ * @brief Decode the entries of a sector
+ *
+ * @param sector the sector index
+ * @param state the state used to decode the records
+ * @param visitor called for each entry, can be NULL
+ * @param arg argument of the visitor
+ * @param stopped set to true if the visitor stopped the scan, can be NULL
+ * @return uint32_t the offset of the first free entry, HISTORY_SECTOR_SIZE if the sector can't be written anymore
+ */
+static uint32_t history_scan_sector(uint32_t sector, record_state_t *state, history_visitor_t visitor, void *arg, bool *stopped)
+{
+    uint32_t offset = sizeof(history_sector_t);
+    record_state_init(state);
+    while (offset + sizeof(history_entry_t) < HISTORY_SECTOR_SIZE)
+    {
+        uint32_t address = sector * HISTORY_SECTOR_SIZE + offset;
+        history_entry_t *entry = (history_entry_t *)history_buffer;
+        if (esp_partition_read(history_partition, address, entry, sizeof(history_entry_t)) != ESP_OK)
+        {
+            return HISTORY_SECTOR_SIZE;
+        }
+        if (entry->size == HISTORY_FREE)
+        {
+            return offset;
+        }
+        if (entry->size > HISTORY_RECORD_MAX || offset + sizeof(history_entry_t) + entry->size > HISTORY_SECTOR_SIZE)
+        {
+            ESP_LOGE(TAG, "Invalid entry in sector %" PRIu32 " at %" PRIu32, sector, offset);
+            return HISTORY_SECTOR_SIZE;
+        }
+
+        uint8_t *record = history_buffer + sizeof(history_entry_t);
+        if (esp_partition_read(history_partition, address + sizeof(history_entry_t), record, entry->size) != ESP_OK ||
+            entry->crc != esp_crc32_le(0, record, entry->size) ||
+            record_decode(state, record, entry->size) == 0)
+        {
+            // interrupted write: the next records depend on this one
+            ESP_LOGE(TAG, "Corrupted entry in sector %" PRIu32 " at %" PRIu32, sector, offset);
+            return HISTORY_SECTOR_SIZE;
+        }
+
+        if (visitor != NULL && !visitor(address, entry, &state->data, arg))
+        {
+            if (stopped != NULL)
+            {
+                *stopped = true;
+            }
+            return offset;
+        }
+        offset += sizeof(history_entry_t) + entry->size;
+    }
+    return HISTORY_SECTOR_SIZE;
+}
+
+/**
+ * @brief Visit the entries of every sector, from the oldest to the newest
+ *
+ * @param visitor called for each entry
+ * @param arg argument of the visitor
+ * @return true if every entry was visited
+ */
+static bool history_walk(history_visitor_t visitor, void *arg)
+{
+    bool stopped = false;
+    // the sectors are written in a ring: the oldest one follows the head
+    for (uint32_t i = 1; i <= history_sectors && !stopped; i++)
+    {
+        uint32_t sector = (history_head + i) % history_sectors;
+        uint32_t sequence;
+        if (history_read_sector(sector, &sequence) == ESP_OK)
+        {
+            history_scan_sector(sector, &history_scan_state, visitor, arg, &stopped);
+        }
+    }
+    return !stopped;
+}
+
+/**
+ * @brief Start writing the next sector of the ring, erasing the oldest readings
+ *
+ * @return esp_err_t ESP_OK on success
+ */
+static esp_err_t history_next_sector()
+{
+    uint32_t sector = (history_head + 1) % history_sectors;
+    uint32_t sequence;
+    if (history_read_sector(sector, &sequence) == ESP_OK)
+    {
+        uint32_t lost = 0;
+        history_scan_sector(sector, &history_scan_state, history_count_visitor, &lost, NULL);
+        if (lost > 0)
+        {
+            ESP_LOGW(TAG, "History full: %" PRIu32 " readings not sent are erased", lost);
+            history_pending -= MIN(lost, history_pending);
+            history_dropped += lost;
+        }
+    }
+
+    esp_err_t err = esp_partition_erase_range(history_partition, sector * HISTORY_SECTOR_SIZE, HISTORY_SECTOR_SIZE);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Erase failed: %s", esp_err_to_name(err));
+        return err;
+    }
+    history_erase_count++;
+
+    history_sector_t header = {
+        .magic = HISTORY_MAGIC,
+        .sequence = history_sequence + 1,
+        .layout = history_layout,
+    };
+    header.crc = esp_crc32_le(0, (uint8_t *)&header, offsetof(history_sector_t, crc));
+    err = esp_partition_write(history_partition, sector * HISTORY_SECTOR_SIZE, &header, sizeof(header));
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Write failed: %s", esp_err_to_name(err));
+        return err;
+    }
+    history_flash_bytes += sizeof(header);
+
+    history_head = sector;
+    history_sequence = header.sequence;
+    history_head_offset = sizeof(history_sector_t);
+    record_state_init(&history_write_state); // the first record of a sector has no reference
+    return ESP_OK;
+}
+
+static bool history_count_visitor(uint32_t offset, const history_entry_t *entry, const linky_data_t *data, void *arg)
+{
+    if (entry->sent == HISTORY_NOT_SENT)
+    {
+        (*(uint32_t *)arg)++;
+    }
+    return true;
+}
+
+static bool history_read_visitor(uint32_t offset, const history_entry_t *entry, const linky_data_t *data, void *arg)
+{
+    history_read_t *read = arg;
+    if (entry->sent != HISTORY_NOT_SENT)
+    {
+        return true;
+    }
+    if (read->count >= read->max || read->callback(data, read->arg) != ESP_OK)
+    {
+        return false;
+    }
+    read->count++;
+    return read->count < read->max;
+}
+
+static bool history_consume_visitor(uint32_t offset, const history_entry_t *entry, const linky_data_t *data, void *arg)
+{
+    uint32_t *count = arg;
+    if (entry->sent != HISTORY_NOT_SENT)
+    {
+        return true;
+    }
+    uint8_t sent = HISTORY_SENT; // clearing bits does not need an erase
+    if (esp_partition_write(history_partition, offset + offsetof(history_entry_t, sent), &sent, sizeof(sent)) != ESP_OK)
+    {
+        return false;
+    }
+    history_flash_bytes += sizeof(sent);
+    history_pending--;
+    (*count)--;
+    return *count > 0;
+}
+
+static esp_err_t history_check_visitor(const linky_data_t *data, void *arg)
+{
+    time_t *timestamp = arg;
+    if (data->timestamp != *timestamp)
+    {
+        ESP_LOGE(TAG, "Timestamp %" PRId64 ", expected %" PRId64, data->timestamp, *timestamp);
+        return ESP_FAIL;
+    }
+    *timestamp += 30;
+    return ESP_OK;
+}
@@ -5,12 +5,16 @@
 #include <stdlib.h>
 #include <string.h>
 #include "cJSON.h"
+#include "json_writer.h"
 #include "tuya.h"
 #include "mqtt.h"
+#include "aggregate.h"
+#include "capture.h"
 #include "mqtt_bind.h"
 
 static const char *TAG = "HTTP"; // TAG for debug
 #define INDEX_HTML_PATH "/spiffs/index.html"
+#define HTTP_JSON_CHUNK 256 // Chunk of the json sent by the metrics handler
 
 #define LOCAL_IP "http://4.3.2.1"
 
@@ -366,6 +370,37 @@ esp_err_t save_config_handler(httpd_req_t *req)
         }
     }
 
+    item = cJSON_GetObjectItem(jsonObject, "aggregate-period");
+    if (item != NULL)
+    {
+        uint8_t period = atoi(item->valuestring);
+        if (AGGREGATE_PERIOD_VALID(period))
+        {
+            config_values.aggregate_period = period;
+        }
+    }
+
+    item = cJSON_GetObjectItem(jsonObject, "stream");
+    if (item != NULL)
+    {
+        config_values.stream = atoi(item->valuestring) ? 1 : 0;
+    }
+
+    item = cJSON_GetObjectItem(jsonObject, "mqtt-batch");
+    if (item != NULL)
+    {
+        config_values.mqtt_batch = atoi(item->valuestring) ? 1 : 0;
+    }
+
+    item = cJSON_GetObjectItem(jsonObject, "mqtt-publish");
+    if (item != NULL && cJSON_IsString(item))
+    {
+        if (linky_publish_parse(item->valuestring, config_values.publish) != ESP_OK)
+        {
+            ESP_LOGE(TAG, "Invalid publish policies: %s", item->valuestring);
+        }
+    }
+
     cJSON_Delete(jsonObject);
     free(buf);
 
@@ -401,6 +436,12 @@ esp_err_t get_config_handler(httpd_req_t *req)
     cJSON_AddStringToObject(jsonObject, "tuya-device-uuid", config_values.tuya.device_uuid);
     cJSON_AddNumberToObject(jsonObject, "tuya-device-auth", strnlen(config_values.tuya.device_auth, sizeof(config_values.tuya.device_auth)));
     cJSON_AddNumberToObject(jsonObject, "refresh-rate", config_values.refresh_rate);
+    cJSON_AddNumberToObject(jsonObject, "aggregate-period", config_values.aggregate_period);
+    cJSON_AddNumberToObject(jsonObject, "stream", config_values.stream);
+    cJSON_AddNumberToObject(jsonObject, "mqtt-batch", config_values.mqtt_batch);
+    char policies[LINKY_PUBLISH_OVERRIDES * 32];
+    linky_publish_format(policies, sizeof(policies));
+    cJSON_AddStringToObject(jsonObject, "mqtt-publish", policies);
 
     char *jsonString = cJSON_PrintUnformatted(jsonObject);
     httpd_resp_set_type(req, "application/json");
@@ -410,6 +451,53 @@ esp_err_t get_config_handler(httpd_req_t *req)
     return ESP_OK;
 }
 
+static esp_err_t send_json_chunk(const char *data, size_t size, void *arg)
+{
+    return httpd_resp_send_chunk((httpd_req_t *)arg, data, size);
+}
+
+esp_err_t get_metrics_handler(httpd_req_t *req)
+{
+    // sent chunk by chunk as it is written, without building the whole json
+    char chunk[HTTP_JSON_CHUNK];
+    json_writer_t writer;
+    json_writer_init(&writer, chunk, sizeof(chunk), send_json_chunk, req);
+    httpd_resp_set_type(req, "application/json");
+    json_writer_object_start(&writer, NULL);
+    linky_write_metrics(&writer);
+    json_writer_object_end(&writer);
+    if (json_writer_end(&writer) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Cant send the metrics");
+    }
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+static bool send_capture_record(const capture_record_t *record, const uint8_t *data, void *arg)
+{
+    httpd_req_t *req = arg;
+    return httpd_resp_send_chunk(req, (const char *)record, sizeof(*record)) == ESP_OK &&
+           httpd_resp_send_chunk(req, (const char *)data, record->size) == ESP_OK;
+}
+
+esp_err_t get_capture_handler(httpd_req_t *req)
+{
+    if (capture_running())
+    {
+        httpd_resp_set_status(req, "409 Conflict");
+        httpd_resp_send(req, "Capture in progress", HTTPD_RESP_USE_STRLEN);
+        return ESP_OK;
+    }
+    httpd_resp_set_type(req, "application/octet-stream");
+    httpd_resp_set_hdr(req, "Content-Disposition", "attachment; filename=\"capture.bin\"");
+    esp_err_t err = capture_read(send_capture_record, req);
+    if (err == ESP_ERR_NOT_FOUND)
+    {
+        return httpd_resp_send_404(req);
+    }
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
 esp_err_t wifi_scan_handler(httpd_req_t *req)
 {
     uint16_t ap_num = 0;
@@ -584,6 +672,7 @@ esp_err_t test_start_handler(httpd_req_t *req)
         break;
     }
     case MQTT_PUBLISH:
+        linky_set_dirty(); // publish every value, not only the changed ones
         err = mqtt_prepare_publish(&linky_data);
         if (err == 0)
         {
@@ -703,6 +792,8 @@ struct request_item_t requests[] = {
     {"/test-start",             HTTP_GET,   test_start_handler},
     {"/reboot",                 HTTP_GET,   get_reboot_handler},
     {"/wifi-scan",              HTTP_GET,   wifi_scan_handler},
+    {"/metrics",                HTTP_GET,   get_metrics_handler},
+    {"/capture",                HTTP_GET,   get_capture_handler},
     {"/wpad.dat",               HTTP_GET,   get_req_404_handler},
     {"/chat",                   HTTP_GET,   get_req_404_handler},
     {"/connecttest.txt",        HTTP_GET,   get_req_logout_handler},
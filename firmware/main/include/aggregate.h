@@ -0,0 +1,121 @@
+/**
+ * @file aggregate.h
+ * @author Dorian Benech
+ * @brief Energy consumed per tariff index over fixed periods (load curve)
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2023 GammaTroniques
+ *
+ */
+
+#ifndef AGGREGATE_H
+#define AGGREGATE_H
+
+/*==============================================================================
+ Local Include
+===============================================================================*/
+#include <stdio.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "json_writer.h"
+#include "linky.h"
+
+/*==============================================================================
+ Public Defines
+==============================================================================*/
+#define AGGREGATE_COUNTER_COUNT 12 // Energy indexes followed in each mode (total + tariff indexes)
+#define AGGREGATE_QUEUE_SIZE 8     // Closed buckets kept until they are published
+#define AGGREGATE_JSON_SIZE 640    // Json of a bucket with every counter
+
+/*==============================================================================
+ Public Macro
+==============================================================================*/
+#define AGGREGATE_PERIOD_VALID(period) ((period) == 0 || (period) == 15 || (period) == 30 || (period) == 60)
+
+/*==============================================================================
+ Public Type
+==============================================================================*/
+typedef struct
+{
+    time_t start;                             // Start of the bucket, aligned on the period (0 if the time is unknown)
+    uint32_t uptime;                          // Uptime at the start of the bucket (s)
+    uint16_t period;                          // Duration of the bucket (minutes)
+    linky_mode_t mode;                        // Mode of the counters
+    uint32_t energy[AGGREGATE_COUNTER_COUNT]; // Energy of each counter during the bucket (Wh)
+    uint16_t available;                       // Bit n set if counter n was read in the bucket
+    uint32_t power_min;                       // Apparent power: PAPP or SINSTS (VA)
+    uint32_t power_max;
+    uint32_t power_mean;
+    uint16_t samples; // Number of readings in the bucket
+    uint8_t resets;   // Number of counters reset (meter change, bad value): their step is not counted
+} aggregate_bucket_t;
+
+/*==============================================================================
+ Public Variables Declaration
+==============================================================================*/
+
+/*==============================================================================
+ Public Functions Declaration
+==============================================================================*/
+
+/**
+ * @brief Add a reading to the current bucket, close it when the reading belongs to the next period
+ * The periods without reading are closed with their part of the step, up to AGGREGATE_QUEUE_SIZE periods
+ * Does nothing if config_values.aggregate_period is 0
+ *
+ * @param data the computed reading
+ */
+void aggregate_update(const linky_data_t *data);
+
+/**
+ * @brief Read the oldest closed buckets, without removing them
+ *
+ * @param buckets the destination
+ * @param max the size of the destination
+ * @return uint32_t the number of buckets copied
+ */
+uint32_t aggregate_read(aggregate_bucket_t *buckets, uint32_t max);
+
+/**
+ * @brief Remove the oldest closed buckets, after a successful send
+ *
+ * @param count the number of buckets
+ */
+void aggregate_consume(uint32_t count);
+
+/**
+ * @brief Drop the current bucket and the closed buckets
+ */
+void aggregate_reset();
+
+/**
+ * @brief Get the name of a counter
+ *
+ * @param mode the mode of the bucket
+ * @param counter the counter number
+ * @return const char* the label of the counter
+ */
+const char *aggregate_counter_label(linky_mode_t mode, uint32_t counter);
+
+/**
+ * @brief Write the json object of a bucket
+ *
+ * @param writer the writer, the object is added to the current array or at the root
+ * @param bucket the bucket
+ */
+void aggregate_write_json(json_writer_t *writer, const aggregate_bucket_t *bucket);
+
+/**
+ * @brief Print the current bucket and the closed buckets
+ */
+void aggregate_print();
+
+/**
+ * @brief Check the buckets computed from generated readings: period change, index wrap and meter reset
+ *
+ * @return esp_err_t ESP_OK if every bucket is correct
+ */
+esp_err_t aggregate_test();
+
+#endif /* AGGREGATE_H */
@@ -0,0 +1,117 @@
+/**
+ * @file capture.h
+ * @author Dorian Benech
+ * @brief Record of the raw bytes received from the Linky, to debug and replay real frames
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2023 GammaTroniques
+ *
+ */
+
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+/*==============================================================================
+ Local Include
+===============================================================================*/
+#include <stdio.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "linky.h"
+
+/*==============================================================================
+ Public Defines
+==============================================================================*/
+#define CAPTURE_PATH "/spiffs/capture.bin"     // Records being written
+#define CAPTURE_OLD_PATH "/spiffs/capture.old" // Previous records, dropped when CAPTURE_PATH is full again
+#define CAPTURE_MAX_SIZE (32 * 1024)           // Default size of the capture (both files)
+#define CAPTURE_RECORD_MAX (2 * 1024)          // Maximum bytes of a record (one frame buffer)
+
+/*==============================================================================
+ Public Macro
+==============================================================================*/
+
+/*==============================================================================
+ Public Type
+==============================================================================*/
+typedef struct __attribute__((packed))
+{
+    uint32_t time; // Arrival time since the start of the capture (ms)
+    uint16_t size; // Number of bytes following the record
+    uint8_t mode;  // linky_mode_t when the bytes were received
+    uint8_t reserved;
+} capture_record_t;
+
+/**
+ * @brief Called for each record of the capture, oldest first
+ *
+ * @param record the record
+ * @param data the bytes of the record
+ * @param arg the argument given to capture_read()
+ * @return true to continue, false to stop
+ */
+typedef bool (*capture_callback_t)(const capture_record_t *record, const uint8_t *data, void *arg);
+
+/*==============================================================================
+ Public Variables Declaration
+==============================================================================*/
+
+/*==============================================================================
+ Public Functions Declaration
+==============================================================================*/
+
+/**
+ * @brief Start recording the bytes received from the Linky, the previous capture is deleted
+ *
+ * @param max_size the size of the capture in bytes, 0 for CAPTURE_MAX_SIZE
+ * It is limited by the free space of the storage partition
+ * @return esp_err_t ESP_OK if the capture is started
+ */
+esp_err_t capture_start(uint32_t max_size);
+
+/**
+ * @brief Stop recording, the capture is kept until the next start
+ */
+void capture_stop();
+
+/**
+ * @brief Check if a capture is in progress
+ */
+bool capture_running();
+
+/**
+ * @brief Add received bytes to the capture, called by the UART task
+ * Does nothing if no capture is in progress
+ *
+ * @param data the bytes
+ * @param size the number of bytes
+ * @param mode the current mode
+ */
+void capture_add(const uint8_t *data, uint32_t size, linky_mode_t mode);
+
+/**
+ * @brief Read the records of the stopped capture, oldest first
+ *
+ * @param callback called for each record
+ * @param arg passed to the callback
+ * @return esp_err_t ESP_ERR_INVALID_STATE if a capture is in progress
+ */
+esp_err_t capture_read(capture_callback_t callback, void *arg);
+
+/**
+ * @brief Print the records in hexadecimal, to convert them with scripts/capture.py
+ *
+ * @return esp_err_t ESP_OK if the capture was read
+ */
+esp_err_t capture_dump();
+
+/**
+ * @brief Decode the records with the Linky parser and print the decoding time and errors
+ *
+ * @param speed 1 to wait between the records as when they were received, 1000 to go 1000 times faster, 0 to not wait
+ * @return esp_err_t ESP_FAIL if a frame had an invalid group
+ */
+esp_err_t capture_replay(uint32_t speed);
+
+#endif /* CAPTURE_H */
@@ -3,7 +3,8 @@
 
 #include "linky.h"
 #include "config.h"
-#define MAX_DATA_INDEX 10
+#define MAX_DATA_INDEX 100  // Maximum readings stored before sending them to the web server
+#define MAX_DATA_PER_POST 10 // Readings per POST request, bounds the size of the json
 
 void delete_task(TaskHandle_t task);
 void suspend_task(TaskHandle_t task);
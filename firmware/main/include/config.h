@@ -47,6 +47,7 @@
 #define PRIORITY_FETCH_LINKY 1
 #define PRIORITY_PAIRING 1
 #define PRIORITY_DNS 16
+#define PRIORITY_CAPTURE 2
 
 #define PRIORITY_LED 5
 #define PRIORITY_LED_PATTERN 5
@@ -154,6 +155,10 @@ typedef struct
     uint8_t sleep;
     index_offset_t index_offset;
     uint8_t boot_pairing;
+    uint8_t aggregate_period; // Duration of the load curve buckets in minutes (0: disabled, 15, 30 or 60)
+    uint8_t stream;           // Publish every frame while VUSB is connected (MQTT modes)
+    uint8_t mqtt_batch;       // Publish each reading as one json message on <topic>/state (MQTT modes)
+    linky_publish_override_t publish[LINKY_PUBLISH_OVERRIDES]; // Publish policies replacing the defaults of the labels (MQTT modes)
 } config_t;
 
 typedef struct
@@ -176,6 +181,7 @@ extern const char *const MODES[];
 
 extern config_t config_values;
 extern efuse_t efuse_values;
+extern uint32_t config_generation; // Changes when config_values is read or written: invalidates the values derived from it
 /*==============================================================================
  Public Functions Declaration
 ==============================================================================*/
@@ -190,6 +196,26 @@ uint8_t config_efuse_read();
 uint8_t config_efuse_write(const char *serialnumber, uint8_t len, const uint8_t *hw_version);
 uint8_t config_factory_reset();
 esp_err_t config_erase_partition(const char *partition_label);
+
+/**
+ * @brief Read a blob that is not part of config_values (module state kept across reboots)
+ *
+ * @param name the NVS key, 15 characters max
+ * @param value the destination
+ * @param size the size of value, the stored blob must have the same size
+ * @return esp_err_t ESP_ERR_NVS_NOT_FOUND if never written, ESP_ERR_NVS_INVALID_LENGTH if the size changed
+ */
+esp_err_t config_read_blob(const char *name, void *value, size_t size);
+
+/**
+ * @brief Write and commit a blob that is not part of config_values
+ *
+ * @param name the NVS key, 15 characters max
+ * @param value the data
+ * @param size the size of value
+ * @return esp_err_t ESP_OK if written
+ */
+esp_err_t config_write_blob(const char *name, const void *value, size_t size);
 uint32_t config_get_hw_version();
 const char *config_get_str_mode();
 
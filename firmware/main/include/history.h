@@ -0,0 +1,115 @@
+/**
+ * @file history.h
+ * @author Dorian Benech
+ * @brief Flash log of the readings that could not be sent
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2023 GammaTroniques
+ *
+ */
+
+#ifndef HISTORY_H
+#define HISTORY_H
+
+/*==============================================================================
+ Local Include
+===============================================================================*/
+#include <stdio.h>
+#include "esp_err.h"
+#include "linky.h"
+
+/*==============================================================================
+ Public Defines
+==============================================================================*/
+#define HISTORY_PARTITION "history"
+#define HISTORY_REPLAY_MAX 100 // Maximum readings replayed after a successful send
+
+/*==============================================================================
+ Public Macro
+==============================================================================*/
+
+/*==============================================================================
+ Public Type
+==============================================================================*/
+
+/**
+ * @brief Called for each reading read from the history
+ *
+ * @param data the reading
+ * @param arg the argument given to history_read()
+ * @return esp_err_t ESP_OK to continue, any other value stops the reading
+ */
+typedef esp_err_t (*history_callback_t)(const linky_data_t *data, void *arg);
+
+/*==============================================================================
+ Public Variables Declaration
+==============================================================================*/
+
+/*==============================================================================
+ Public Functions Declaration
+==============================================================================*/
+
+/**
+ * @brief Find the history partition and the last written position
+ *
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t history_init();
+
+/**
+ * @brief Append a reading to the history
+ * The oldest sector is erased when the partition is full
+ *
+ * @param data the reading to store
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t history_append(const linky_data_t *data);
+
+/**
+ * @brief Read the oldest readings not sent yet, without removing them
+ *
+ * @param callback called for each reading
+ * @param arg argument of the callback
+ * @param max the maximum number of readings
+ * @return uint32_t the number of readings accepted by the callback
+ */
+uint32_t history_read(history_callback_t callback, void *arg, uint32_t max);
+
+/**
+ * @brief Mark the oldest readings as sent, after a successful history_read()
+ *
+ * @param count the number of readings
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t history_consume(uint32_t count);
+
+/**
+ * @brief Get the number of readings not sent yet
+ *
+ * @return uint32_t the number of readings
+ */
+uint32_t history_count();
+
+/**
+ * @brief Erase the history
+ *
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t history_erase();
+
+/**
+ * @brief Print the history statistics
+ */
+void history_stats();
+
+/**
+ * @brief Measure the append time and the write amplification, then check the readings read back
+ * The history is erased: the benchmark does not run while readings are not sent
+ *
+ * @param count the number of readings to append
+ * @return esp_err_t ESP_OK if every reading was read back, ESP_ERR_INVALID_STATE if the history is not empty
+ */
+esp_err_t history_benchmark(uint32_t count);
+
+#endif /* HISTORY_H */
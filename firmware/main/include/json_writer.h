@@ -0,0 +1,159 @@
+/**
+ * @file json_writer.h
+ * @author Dorian Benech
+ * @brief Streaming json writer: the payloads are written without a cJSON tree and without allocation
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2023 GammaTroniques
+ *
+ */
+
+#ifndef JSON_WRITER_H
+#define JSON_WRITER_H
+
+/*==============================================================================
+ Local Include
+===============================================================================*/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+/*==============================================================================
+ Public Defines
+==============================================================================*/
+#define JSON_WRITER_MAX_DEPTH 32     // Nested objects and arrays
+#define JSON_WRITER_BUFFER_MIN 512  // First size of a json_writer_buffer_t, doubled when full
+
+/*==============================================================================
+ Public Macro
+==============================================================================*/
+
+/*==============================================================================
+ Public Type
+==============================================================================*/
+/**
+ * @brief Receive the json when the buffer of the writer is full, and at the end
+ *
+ * @param data the json, not NUL-terminated
+ * @param size the size of data
+ * @param arg the argument given to json_writer_init()
+ * @return esp_err_t ESP_OK to continue, an error stops the writer
+ */
+typedef esp_err_t (*json_writer_sink_t)(const char *data, size_t size, void *arg);
+
+typedef struct
+{
+    char *buffer;            // Destination, or chunk given to the sink
+    size_t size;             // Size of buffer
+    size_t length;           // Bytes in buffer
+    size_t total;            // Bytes of the json written so far
+    json_writer_sink_t sink; // NULL: the whole json is kept in buffer
+    void *arg;
+    uint32_t members; // Bit n: the object or the array at depth n already has a member
+    uint8_t depth;
+    esp_err_t error; // First error, the next calls do nothing
+} json_writer_t;
+
+typedef struct
+{
+    char *data;    // NUL-terminated json, to free
+    size_t length; // Bytes in data
+    size_t size;   // Allocated size, or the first size to allocate when data is NULL
+} json_writer_buffer_t;
+
+/*==============================================================================
+ Public Variables Declaration
+==============================================================================*/
+
+/*==============================================================================
+ Public Functions Declaration
+==============================================================================*/
+
+/**
+ * @brief Start a json
+ *
+ * @param writer the writer
+ * @param buffer without sink: the destination of the NUL-terminated json. With a sink: the chunk
+ * @param size the size of buffer
+ * @param sink called with each full chunk and the end of the json, or NULL
+ * @param arg the argument of the sink
+ */
+void json_writer_init(json_writer_t *writer, char *buffer, size_t size, json_writer_sink_t sink, void *arg);
+
+/**
+ * @brief Start an object, or an array
+ *
+ * @param writer the writer
+ * @param key the key in the parent object, NULL at the root and in an array
+ */
+void json_writer_object_start(json_writer_t *writer, const char *key);
+void json_writer_array_start(json_writer_t *writer, const char *key);
+
+/**
+ * @brief Close the last started object, or array
+ *
+ * @param writer the writer
+ */
+void json_writer_object_end(json_writer_t *writer);
+void json_writer_array_end(json_writer_t *writer);
+
+/**
+ * @brief Add a member to the current object, or an element to the current array
+ *
+ * @param writer the writer
+ * @param key the key of the member, NULL in an array
+ * @param value the value: strings are escaped, json_writer_raw() copies value as it is
+ */
+void json_writer_string(json_writer_t *writer, const char *key, const char *value);
+void json_writer_int(json_writer_t *writer, const char *key, int64_t value);
+void json_writer_uint(json_writer_t *writer, const char *key, uint64_t value);
+void json_writer_bool(json_writer_t *writer, const char *key, bool value);
+void json_writer_raw(json_writer_t *writer, const char *key, const char *value);
+
+/**
+ * @brief Add a number printed as cJSON does: the shortest of 15 or 17 digits that reads the same value back,
+ * null if it is not finite
+ *
+ * @param writer the writer
+ * @param key the key of the member, NULL in an array
+ * @param value the value
+ */
+void json_writer_double(json_writer_t *writer, const char *key, double value);
+
+/**
+ * @brief End the json: NUL-terminate the buffer, or give the last chunk to the sink
+ *
+ * @param writer the writer
+ * @return esp_err_t ESP_OK, ESP_ERR_NO_MEM if the buffer is too small, ESP_ERR_INVALID_STATE if an object is not closed, or the error of the sink
+ */
+esp_err_t json_writer_end(json_writer_t *writer);
+
+/**
+ * @brief Sink appending the chunks to an allocated json_writer_buffer_t, enlarged when full
+ *
+ * @param data the chunk
+ * @param size the size of the chunk
+ * @param arg the json_writer_buffer_t, zeroed or with the first size to allocate
+ * @return esp_err_t ESP_ERR_NO_MEM if the buffer cant be enlarged
+ */
+esp_err_t json_writer_buffer_sink(const char *data, size_t size, void *arg);
+
+/**
+ * @brief End a json written with json_writer_buffer_sink()
+ *
+ * @param writer the writer
+ * @param buffer the argument of the sink
+ * @return char* the json to free, NULL if it cant be written: the buffer is then freed
+ */
+char *json_writer_buffer_end(json_writer_t *writer, json_writer_buffer_t *buffer);
+
+/**
+ * @brief Check the json written for each type of value, the escaping, the nesting and the overflow
+ *
+ * @return esp_err_t ESP_OK if every json is correct
+ */
+esp_err_t json_writer_test();
+
+#endif /* JSON_WRITER_H */
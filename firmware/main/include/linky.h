@@ -23,10 +23,13 @@
 #include "string.h"
 #include "esp_zigbee_core.h"
 #include "time.h"
+#include "json_writer.h"
 
 /*==============================================================================
  Public Defines
 ==============================================================================*/
+#define LINKY_METRICS_DECODE_BUCKETS 8 // Decode time histogram: < 250 us, < 500 us, ... < 16 ms, longer
+#define LINKY_PUBLISH_OVERRIDES 8      // Labels with a publish policy set in the config
 
 /*==============================================================================
  Public Macro
@@ -295,6 +298,19 @@ typedef struct
 {
     ha_report_state_t reported; // HA discovery already done
 } linky_value_rw_t;
+
+typedef struct
+{
+    uint16_t deadband; // Minimal change to publish a numeric value: in the unit of the label, or in % of the published value
+    uint8_t relative;  // The deadband is in %
+    uint16_t max_age;  // Publish the value at least every max_age seconds, 0 for the default of the label
+} linky_publish_policy_t;
+
+typedef struct
+{
+    char label[16]; // Empty if not used
+    linky_publish_policy_t policy;
+} linky_publish_override_t;
 typedef struct
 {
     const uint16_t id;
@@ -318,12 +334,53 @@ typedef struct
 
 typedef struct
 {
-    linky_data_hist hist;
-    linky_data_std std;
+    union // only the data of the current mode is kept
+    {
+        linky_data_hist hist;
+        linky_data_std std;
+    };
+    linky_mode_t mode; // mode of the data in the union
     time_t timestamp;
     uint64_t uptime;
 } linky_data_t;
 
+typedef struct
+{
+    uint32_t start;                  // MILLIS of the last reset
+    uint32_t bytes;                  // Bytes read from the UART driver
+    uint32_t uart_wakeups;           // Events received by the UART task
+    uint32_t uart_data_events;       // UART_DATA events: RX FIFO drained before END_OF_FRAME
+    uint32_t frames_received;        // END_OF_FRAME detected by the UART driver
+    uint32_t frames_dropped;         // Frames lost because the decoder task still owned every buffer
+    uint32_t frames_decoded;         // Frames fed to the parser
+    uint32_t frames_valid;           // Frames without invalid group
+    uint32_t groups;                 // Groups decoded
+    uint32_t checksum_errors;        // Groups with a wrong checksum
+    uint32_t checksum_unknown_label; // Wrong checksum and unknown label (corrupted label)
+    uint32_t value_errors;           // Correct checksum but numeric value with a non-digit character
+    uint32_t uart_fifo_overflow;
+    uint32_t uart_buffer_full;
+    uint32_t uart_pattern_overflow; // END_OF_FRAME positions lost
+    uint32_t uart_break;
+    uint32_t uart_parity;
+    uint32_t uart_frame;
+    uint32_t decode_time[LINKY_METRICS_DECODE_BUCKETS]; // Number of frames per decode time bucket
+    uint32_t decode_time_max;                           // us
+    uint32_t first_frame_time;                          // Time to the first valid frame of the last reading (ms)
+    uint32_t first_frame_time_max;                      // ms
+} linky_metrics_t;
+
+typedef struct
+{
+    uint32_t bytes;           // Bytes fed to the parser
+    uint32_t frames;          // END_OF_FRAME received
+    uint32_t frames_valid;    // Frames without invalid group
+    uint32_t groups;          // Groups decoded
+    uint32_t checksum_errors; // Groups with a wrong checksum
+    uint32_t value_errors;    // Groups with an invalid numeric value
+    int64_t decode_time;      // Time spent in the parser (us)
+} linky_replay_t;
+
 typedef enum
 {
     DEBUG_NONE,
@@ -360,10 +417,12 @@ extern uint32_t linky_free_heap_size;
 extern const void *linky_protected_data[];
 extern const uint8_t linky_protected_data_size;
 
-extern uint32_t linky_frame_size;
 extern uint32_t linky_last_decode_count;
 extern uint32_t linky_decode_checksum_error;
 extern uint32_t linky_last_group_count;
+extern uint32_t linky_first_frame_time;
+extern uint32_t linky_read_time;
+extern linky_metrics_t linky_metrics;
 /*==============================================================================
  Public Functions Declaration
 ==============================================================================*/
@@ -380,7 +439,9 @@ void linky_stop();
 
 /**
  * @brief Get new data from the linky (read, decode and store in linky_data)
+ *        Return as soon as a complete frame is received, or after the timeout
  *
+ * @param timeout: max reading time in ms
  * @return char: 1 if success, 0 if error
  */
 char linky_update(uint32_t timeout);
@@ -418,6 +479,147 @@ esp_err_t linky_compute();
 const char *linky_get_str_mode();
 void linky_clear_data();
 
+/**
+ * @brief Reset the decoder metrics
+ */
+void linky_metrics_reset();
+
+/**
+ * @brief Write the decoder metrics, with the checksum errors per label, in the current object of a json writer
+ *
+ * @param writer the writer
+ */
+void linky_write_metrics(json_writer_t *writer);
+
+/**
+ * @brief Print the decoder metrics
+ */
+void linky_metrics_print();
+
+/**
+ * @brief Get if a value changed since the last successful send
+ *
+ * @param index: the index in linky_label_list
+ * @return true if the value has to be published
+ */
+bool linky_is_dirty(uint32_t index);
+
+/**
+ * @brief Mark every value to be published on the next send
+ */
+void linky_set_dirty();
+
+/**
+ * @brief Mark the computed values as published, call after a successful send
+ */
+void linky_clear_dirty();
+
+/**
+ * @brief Get the publish policy of a label: the override of config_values.publish,
+ * or the default of its class and update type
+ * The policies are used in the MQTT modes, the other modes publish every change
+ *
+ * @param index: the index in linky_label_list
+ * @param policy: the policy, max_age is never 0
+ */
+void linky_get_publish_policy(uint32_t index, linky_publish_policy_t *policy);
+
+/**
+ * @brief Parse publish policies: "LABEL:deadband[%][:max_age],..." e.g. "SINSTS:5%:300,URMS1:2"
+ *
+ * @param str: the policies, empty to remove every override
+ * @param overrides: LINKY_PUBLISH_OVERRIDES entries, only written if str is valid
+ * @return esp_err_t ESP_ERR_INVALID_ARG if a label is unknown or the syntax is wrong
+ */
+esp_err_t linky_publish_parse(const char *str, linky_publish_override_t *overrides);
+
+/**
+ * @brief Write the overrides of config_values.publish in the syntax of linky_publish_parse
+ *
+ * @param str: the destination
+ * @param size: the size of str
+ */
+void linky_publish_format(char *str, size_t size);
+
+/**
+ * @brief Print the publish policy of each label of the current mode
+ */
+void linky_publish_print();
+
 linky_value_rw_t *linky_get_value_rw(uint32_t index);
 
+/**
+ * @brief Find a label in linky_label_list
+ *
+ * @param label: the label to find (not necessarily null terminated)
+ * @param len: the length of the label
+ * @param mode: the mode of the label (MODE_HIST, MODE_STD or ANY)
+ * @return int32_t the index in linky_label_list, -1 if not found
+ */
+int32_t linky_get_label_index(const char *label, uint32_t len, linky_mode_t mode);
+
+/**
+ * @brief Get the labels used by a mode: the labels of the mode and the ANY labels, with a value
+ *        Use it instead of filtering linky_label_list on the mode
+ *
+ * @param mode: MODE_HIST or MODE_STD
+ * @param count: the number of labels
+ * @return const uint8_t* the indexes in linky_label_list, in list order (NULL if the mode is invalid)
+ */
+const uint8_t *linky_get_mode_labels(linky_mode_t mode, uint32_t *count);
+
+/**
+ * @brief Measure the decoding time of the standard debug frame
+ *        Built with LINKY_BENCHMARK, also compare the streaming parser with the previous buffer rescan
+ *
+ * @param iterations: number of frames to decode with each method
+ * @return esp_err_t ESP_OK if every frame is valid and the methods decode the same values
+ */
+esp_err_t linky_benchmark(uint32_t iterations);
+
+/**
+ * @brief Find the mode of the Linky by listening to each baud rate during a short time
+ *        and scoring the received bytes. The mode found is set.
+ *
+ * @return linky_mode_t MODE_HIST, MODE_STD or NONE if no frame was found
+ */
+linky_mode_t linky_detect_mode();
+
+/**
+ * @brief Check the mode detection scores on the debug frames
+ *
+ * @return esp_err_t ESP_OK if each frame is detected in its mode
+ */
+esp_err_t linky_sniff_test();
+
+/**
+ * @brief Prepare the decoding of captured bytes, see capture_replay()
+ * The current data is cleared and the metrics are saved
+ *
+ * @param mode the mode of the first captured bytes
+ */
+void linky_replay_start(linky_mode_t mode);
+
+/**
+ * @brief Decode captured bytes with the parser used for the UART
+ *
+ * @param data the bytes
+ * @param size the number of bytes
+ * @param mode the mode when the bytes were received
+ * @param replay the counters to update
+ */
+void linky_replay_feed(const uint8_t *data, uint32_t size, linky_mode_t mode, linky_replay_t *replay);
+
+/**
+ * @brief Restore the mode and the metrics after a replay
+ */
+void linky_replay_end();
+
+/**
+ * @brief Check the horodate conversion against mktime for every hour from 2000 to 2099, and compare their speed
+ *
+ * @return esp_err_t ESP_OK if every horodate is converted to the same epoch
+ */
+esp_err_t linky_time_test();
+
 #endif /* Linky_H */
\ No newline at end of file
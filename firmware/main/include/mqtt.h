@@ -28,6 +28,7 @@
 
 #include "esp_log.h"
 #include "linky.h"
+#include "aggregate.h"
 
 /*==============================================================================
  Public Defines
@@ -74,6 +75,11 @@ extern int mqtt_deinit();
  */
 extern void mqtt_setup_ha_discovery(bool with_delete);
 
+/**
+ * @brief Forget the published discovery configs, they are published again by the next mqtt_setup_ha_discovery
+ */
+extern void mqtt_reset_ha_discovery();
+
 /**
  * @brief Send linky_data_t to MQTT
  *
@@ -81,8 +87,55 @@ extern void mqtt_setup_ha_discovery(bool with_delete);
  */
 extern int mqtt_send();
 
+/**
+ * @brief Keep the connection up after mqtt_send, to publish each frame without reconnecting
+ *
+ * @param persistent true to keep the connection, false to disconnect after each send (disconnects now if connected)
+ */
+extern void mqtt_set_persistent(bool persistent);
+
+/**
+ * @brief Enqueue the values of the current mode that changed since the last send, one message per label,
+ * or the whole reading as one json message on <topic>/state when config_values.mqtt_batch is set
+ *
+ * @param linky unused, the values are read from linky_label_list
+ * @return uint8_t 1 if the messages are in the outbox
+ */
 extern uint8_t mqtt_prepare_publish(linky_data_t *linky);
 
+/**
+ * @brief Enqueue a reading from the history on the <topic>/history topic, as json with its timestamp
+ *
+ * @param data the reading
+ * @param arg unused, see history_callback_t
+ * @return esp_err_t ESP_OK if the message is in the outbox
+ */
+extern esp_err_t mqtt_prepare_history(const linky_data_t *data, void *arg);
+
+/**
+ * @brief Enqueue the decoder metrics on the <topic>/diagnostics topic, at most every 10 minutes
+ *
+ * @return esp_err_t ESP_OK if the message is in the outbox or not due yet
+ */
+extern esp_err_t mqtt_prepare_metrics();
+
+/**
+ * @brief Enqueue a closed load curve bucket on the <topic>/aggregate topic, as json
+ *
+ * @param bucket the bucket
+ * @return esp_err_t ESP_OK if the message is in the outbox
+ */
+extern esp_err_t mqtt_prepare_aggregate(const aggregate_bucket_t *bucket);
+
 esp_err_t mqtt_test(esp_mqtt_error_type_t *type, esp_mqtt_connect_return_code_t *return_code);
 
+/**
+ * @brief Measure the building of the messages of linky_data, without sending them:
+ * topic and value of each label, Home Assistant discovery config with its allocations and <topic>/state json
+ *
+ * @param iterations the number of frames
+ * @return esp_err_t ESP_FAIL if linky_data has no value to publish or a discovery config is too long
+ */
+esp_err_t mqtt_benchmark(uint32_t iterations);
+
 #endif /* MQTT_H */
@@ -0,0 +1,127 @@
+/**
+ * @file record.h
+ * @author Dorian Benech
+ * @brief Compact storage of the readings waiting to be sent
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2023 GammaTroniques
+ *
+ */
+
+#ifndef RECORD_H
+#define RECORD_H
+
+/*==============================================================================
+ Local Include
+===============================================================================*/
+#include <stdio.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "linky.h"
+
+/*==============================================================================
+ Public Defines
+==============================================================================*/
+#define RECORD_BUFFER_SIZE (4 * 1024) // Bytes available for the records
+
+/*==============================================================================
+ Public Macro
+==============================================================================*/
+
+/*==============================================================================
+ Public Type
+==============================================================================*/
+typedef struct
+{
+    linky_data_t data; // The last encoded or decoded reading, reference of the next deltas
+    bool started;      // false before the first record
+} record_state_t;
+
+typedef struct
+{
+    uint32_t offset;      // Offset of the next record in the buffer
+    uint32_t index;       // Number of records already read
+    record_state_t state; // state.data holds the last decoded reading
+} record_iterator_t;
+
+/*==============================================================================
+ Public Variables Declaration
+==============================================================================*/
+
+/*==============================================================================
+ Public Functions Declaration
+==============================================================================*/
+
+/**
+ * @brief Start a new sequence of records: the next record does not depend on the previous ones
+ *
+ * @param state the state to initialize
+ */
+void record_state_init(record_state_t *state);
+
+/**
+ * @brief Encode a reading as a record
+ * Only the fields changed since the previous record are written, the numbers as a delta
+ *
+ * @param state the state of the sequence, updated on success
+ * @param data the reading to encode
+ * @param buffer the destination
+ * @param size the size of the destination
+ * @return uint32_t the size of the record, 0 if the destination is too small
+ */
+uint32_t record_encode(record_state_t *state, const linky_data_t *data, uint8_t *buffer, uint32_t size);
+
+/**
+ * @brief Decode a record
+ *
+ * @param state the state of the sequence, state->data holds the reading on success
+ * @param buffer the record
+ * @param size the available bytes
+ * @return uint32_t the size of the record, 0 if it is corrupted
+ */
+uint32_t record_decode(record_state_t *state, const uint8_t *buffer, uint32_t size);
+
+/**
+ * @brief Remove all the records
+ */
+void record_reset();
+
+/**
+ * @brief Append a reading to the records
+ *
+ * @param data the reading to store
+ * @return esp_err_t ESP_OK, ESP_ERR_NO_MEM if the buffer is full
+ */
+esp_err_t record_add(const linky_data_t *data);
+
+/**
+ * @brief Get the number of stored records
+ *
+ * @return uint32_t the number of records
+ */
+uint32_t record_count();
+
+/**
+ * @brief Get the number of bytes used by the records
+ *
+ * @return uint32_t the used size
+ */
+uint32_t record_size();
+
+/**
+ * @brief Start reading the records from the oldest one
+ *
+ * @param it the iterator to initialize
+ */
+void record_iterator_init(record_iterator_t *it);
+
+/**
+ * @brief Decode the next record
+ *
+ * @param it the iterator, it->state.data holds the reading on success
+ * @return true if a record was decoded, false at the end of the records
+ */
+bool record_next(record_iterator_t *it);
+
+#endif /* RECORD_H */
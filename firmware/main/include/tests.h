@@ -39,6 +39,13 @@ typedef enum
     TEST_LINKY_READ,
     TEST_LINKY_STATS,
     TEST_PRODUCER,
+    TEST_LINKY_BENCH,
+    TEST_LINKY_SNIFF,
+    TEST_HISTORY,
+    TEST_AGGREGATE,
+    TEST_LINKY_TIME,
+    TEST_BENCH,
+    TEST_JSON,
 } tests_t;
 
 /*==============================================================================
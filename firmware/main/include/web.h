@@ -18,6 +18,8 @@
 #include "cJSON.h"
 #include "linky.h"
 #include "config.h"
+#include "record.h"
+#include "json_writer.h"
 
 /*==============================================================================
  Public Defines
@@ -39,14 +41,39 @@
  Public Functions Declaration
 ==============================================================================*/
 
+/**
+ * @brief Create the json object of a reading
+ *
+ * @param data the reading
+ * @return cJSON* the object with a member per available label
+ */
+extern cJSON *web_json_reading(const linky_data_t *data);
+
+/**
+ * @brief Write the members of a reading in the current object of a json writer
+ *
+ * @param writer the writer
+ * @param data the reading
+ */
+extern void web_write_reading(json_writer_t *writer, const linky_data_t *data);
+
 /**
  * @brief prepare json data to send to server
  *
- * @param data  the Array of data to send
- * @param dataIndex  the index of the data to send
- * @param json  the json destination
- * @param jsonSize the size of the json destination
+ * @param records  the records to send, continues after the last sent record
+ * @param max_count  the maximum number of readings in the json
+ * @param json  the json destination, to free. NULL if it cant be written
+ * @return uint32_t the number of readings added to the json
+ */
+extern uint32_t web_preapare_json_data(record_iterator_t *records, uint32_t max_count, char **json);
+
+/**
+ * @brief Compare the json of a reading built with cJSON and with the json writer: time and allocations
+ *
+ * @param data the reading
+ * @param iterations the number of frames
+ * @return esp_err_t ESP_OK if both json are the same
  */
-extern void web_preapare_json_data(linky_data_t *data, char dataIndex, char **json);
+esp_err_t web_benchmark(const linky_data_t *data, uint32_t iterations);
 
 #endif /* WEB_H */
\ No newline at end of file
@@ -0,0 +1,450 @@
+/**
+ * @file json_writer.c
+ * @author Dorian Benech
+ * @brief Streaming json writer: the payloads are written without a cJSON tree and without allocation
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2023 GammaTroniques
+ *
+ * Each value is written when it is added: the json is built in the buffer given by the caller,
+ * or in chunks given to a sink. The output is the same as cJSON_PrintUnformatted().
+ */
+
+/*==============================================================================
+ Local Include
+===============================================================================*/
+#include "json_writer.h"
+#include "esp_log.h"
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include <sys/param.h>
+
+/*==============================================================================
+ Local Define
+===============================================================================*/
+#define TAG "JSON"
+#define JSON_WRITER_DIGITS 21 // "-9223372036854775808" and "18446744073709551615"
+#define JSON_WRITER_DOUBLE 26 // "-2.2250738585072014e-308", as the buffer of cJSON
+
+/*==============================================================================
+ Local Macro
+===============================================================================*/
+
+/*==============================================================================
+ Local Type
+===============================================================================*/
+
+/*==============================================================================
+ Local Function Declaration
+===============================================================================*/
+static void json_writer_put(json_writer_t *writer, const char *data, size_t size);
+static void json_writer_escaped(json_writer_t *writer, const char *str);
+static void json_writer_key(json_writer_t *writer, const char *key);
+static void json_writer_start(json_writer_t *writer, const char *key, const char *open);
+static void json_writer_close(json_writer_t *writer, const char *close);
+static void json_writer_number(json_writer_t *writer, const char *key, uint64_t value, bool negative);
+static esp_err_t json_writer_test_sink(const char *data, size_t size, void *arg);
+
+/*==============================================================================
+ Public Variable
+===============================================================================*/
+
+/*==============================================================================
+ Local Variable
+===============================================================================*/
+
+/*==============================================================================
+Function Implementation
+===============================================================================*/
+
+void json_writer_init(json_writer_t *writer, char *buffer, size_t size, json_writer_sink_t sink, void *arg)
+{
+    memset(writer, 0, sizeof(json_writer_t));
+    writer->buffer = buffer;
+    writer->size = size;
+    writer->sink = sink;
+    writer->arg = arg;
+    if (buffer == NULL || size < 2)
+    {
+        writer->error = ESP_ERR_INVALID_ARG;
+    }
+}
+
+/**
+ * @brief Copy data to the buffer, and give the full buffer to the sink
+ */
+static void json_writer_put(json_writer_t *writer, const char *data, size_t size)
+{
+    while (size > 0 && writer->error == ESP_OK)
+    {
+        // without sink, the last byte is kept for the NUL
+        size_t space = writer->size - writer->length - (writer->sink == NULL ? 1 : 0);
+        if (space == 0)
+        {
+            if (writer->sink == NULL)
+            {
+                writer->error = ESP_ERR_NO_MEM;
+                return;
+            }
+            writer->error = writer->sink(writer->buffer, writer->length, writer->arg);
+            writer->length = 0;
+            continue;
+        }
+        size_t count = MIN(space, size);
+        memcpy(writer->buffer + writer->length, data, count);
+        writer->length += count;
+        writer->total += count;
+        data += count;
+        size -= count;
+    }
+}
+
+/**
+ * @brief Write a string between quotes, with the same escaping as cJSON
+ */
+static void json_writer_escaped(json_writer_t *writer, const char *str)
+{
+    json_writer_put(writer, "\"", 1);
+    const char *start = str; // characters written as they are, copied at once
+    for (; *str != '\0'; str++)
+    {
+        unsigned char c = *str;
+        if (c >= 0x20 && c != '"' && c != '\\')
+        {
+            continue;
+        }
+        json_writer_put(writer, start, str - start);
+        start = str + 1;
+
+        char escape[7] = {'\\', 0};
+        switch (c)
+        {
+        case '"':
+        case '\\':
+            escape[1] = c;
+            break;
+        case '\b':
+            escape[1] = 'b';
+            break;
+        case '\f':
+            escape[1] = 'f';
+            break;
+        case '\n':
+            escape[1] = 'n';
+            break;
+        case '\r':
+            escape[1] = 'r';
+            break;
+        case '\t':
+            escape[1] = 't';
+            break;
+        default:
+            snprintf(escape, sizeof(escape), "\\u%04x", c);
+            break;
+        }
+        json_writer_put(writer, escape, strlen(escape));
+    }
+    json_writer_put(writer, start, str - start);
+    json_writer_put(writer, "\"", 1);
+}
+
+/**
+ * @brief Write the separator from the previous member, and the key
+ */
+static void json_writer_key(json_writer_t *writer, const char *key)
+{
+    uint32_t bit = 1UL << writer->depth;
+    if (writer->members & bit)
+    {
+        json_writer_put(writer, ",", 1);
+    }
+    writer->members |= bit;
+    if (key != NULL)
+    {
+        json_writer_escaped(writer, key);
+        json_writer_put(writer, ":", 1);
+    }
+}
+
+static void json_writer_start(json_writer_t *writer, const char *key, const char *open)
+{
+    if (writer->depth + 1 >= JSON_WRITER_MAX_DEPTH)
+    {
+        writer->error = ESP_ERR_INVALID_STATE;
+        return;
+    }
+    json_writer_key(writer, key);
+    json_writer_put(writer, open, 1);
+    writer->depth++;
+    writer->members &= ~(1UL << writer->depth);
+}
+
+static void json_writer_close(json_writer_t *writer, const char *close)
+{
+    if (writer->depth == 0)
+    {
+        writer->error = ESP_ERR_INVALID_STATE;
+        return;
+    }
+    writer->depth--;
+    json_writer_put(writer, close, 1);
+}
+
+void json_writer_object_start(json_writer_t *writer, const char *key)
+{
+    json_writer_start(writer, key, "{");
+}
+
+void json_writer_array_start(json_writer_t *writer, const char *key)
+{
+    json_writer_start(writer, key, "[");
+}
+
+void json_writer_object_end(json_writer_t *writer)
+{
+    json_writer_close(writer, "}");
+}
+
+void json_writer_array_end(json_writer_t *writer)
+{
+    json_writer_close(writer, "]");
+}
+
+void json_writer_string(json_writer_t *writer, const char *key, const char *value)
+{
+    json_writer_key(writer, key);
+    json_writer_escaped(writer, value);
+}
+
+/**
+ * @brief Write the digits of an integer, without snprintf
+ */
+static void json_writer_number(json_writer_t *writer, const char *key, uint64_t value, bool negative)
+{
+    char digits[JSON_WRITER_DIGITS];
+    char *start = digits + sizeof(digits);
+    do
+    {
+        *--start = '0' + value % 10;
+        value /= 10;
+    } while (value > 0);
+    if (negative)
+    {
+        *--start = '-';
+    }
+    json_writer_key(writer, key);
+    json_writer_put(writer, start, digits + sizeof(digits) - start);
+}
+
+void json_writer_int(json_writer_t *writer, const char *key, int64_t value)
+{
+    // the magnitude of INT64_MIN does not fit in an int64_t
+    uint64_t magnitude = value < 0 ? (uint64_t)(-(value + 1)) + 1 : (uint64_t)value;
+    json_writer_number(writer, key, magnitude, value < 0);
+}
+
+void json_writer_uint(json_writer_t *writer, const char *key, uint64_t value)
+{
+    json_writer_number(writer, key, value, false);
+}
+
+void json_writer_double(json_writer_t *writer, const char *key, double value)
+{
+    if (!isfinite(value))
+    {
+        json_writer_raw(writer, key, "null");
+        return;
+    }
+    // as print_number() of cJSON: 15 digits avoid the nonsignificant ones, 17 if the value is not read back
+    char str[JSON_WRITER_DOUBLE];
+    snprintf(str, sizeof(str), "%1.15g", value);
+    if (strtod(str, NULL) != value)
+    {
+        snprintf(str, sizeof(str), "%1.17g", value);
+    }
+    json_writer_raw(writer, key, str);
+}
+
+void json_writer_bool(json_writer_t *writer, const char *key, bool value)
+{
+    json_writer_raw(writer, key, value ? "true" : "false");
+}
+
+void json_writer_raw(json_writer_t *writer, const char *key, const char *value)
+{
+    json_writer_key(writer, key);
+    json_writer_put(writer, value, strlen(value));
+}
+
+esp_err_t json_writer_end(json_writer_t *writer)
+{
+    if (writer->error == ESP_OK && writer->depth != 0)
+    {
+        writer->error = ESP_ERR_INVALID_STATE;
+    }
+    if (writer->sink == NULL)
+    {
+        if (writer->buffer != NULL && writer->size > 0)
+        {
+            writer->buffer[writer->length] = '\0'; // also after an overflow: the start of the json is readable
+        }
+    }
+    else if (writer->error == ESP_OK && writer->length > 0)
+    {
+        writer->error = writer->sink(writer->buffer, writer->length, writer->arg);
+        writer->length = 0;
+    }
+    return writer->error;
+}
+
+esp_err_t json_writer_buffer_sink(const char *data, size_t size, void *arg)
+{
+    json_writer_buffer_t *buffer = arg;
+    if (buffer->data == NULL || buffer->length + size + 1 > buffer->size)
+    {
+        size_t new_size = MAX(buffer->size, JSON_WRITER_BUFFER_MIN);
+        while (new_size < buffer->length + size + 1)
+        {
+            new_size *= 2;
+        }
+        char *new_data = realloc(buffer->data, new_size);
+        if (new_data == NULL)
+        {
+            return ESP_ERR_NO_MEM;
+        }
+        buffer->data = new_data;
+        buffer->size = new_size;
+    }
+    memcpy(buffer->data + buffer->length, data, size);
+    buffer->length += size;
+    buffer->data[buffer->length] = '\0';
+    return ESP_OK;
+}
+
+char *json_writer_buffer_end(json_writer_t *writer, json_writer_buffer_t *buffer)
+{
+    esp_err_t err = json_writer_end(writer);
+    if (err == ESP_OK && buffer->data == NULL)
+    {
+        err = json_writer_buffer_sink("", 0, buffer); // nothing written
+    }
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Cant write the json: %s", esp_err_to_name(err));
+        free(buffer->data);
+        buffer->data = NULL;
+    }
+    return buffer->data;
+}
+
+/**
+ * @brief Sink of the test: append the chunks to a buffer
+ */
+static esp_err_t json_writer_test_sink(const char *data, size_t size, void *arg)
+{
+    json_writer_t *output = arg;
+    json_writer_put(output, data, size);
+    return output->error;
+}
+
+esp_err_t json_writer_test()
+{
+    const char *expected = "{\"s\":\"a\\\"b\\\\c\\n\\t\\u0001\xc3\xa9\",\"i\":-42,\"min\":-9223372036854775808,\"u\":18446744073709551615,"
+                           "\"b\":true,\"r\":1.5,\"f\":3.2999999523162842,\"d\":0.1,\"e\":-2,\"n\":null,\"a\":[{},[],\"x\",0],\"o\":{\"k\\\\/\":false}}";
+    char json[300];
+    char chunk[5];
+    esp_err_t err = ESP_OK;
+
+    json_writer_t output;
+    json_writer_init(&output, json, sizeof(json), NULL, NULL);
+    for (uint32_t pass = 0; pass < 2; pass++)
+    {
+        // first in the buffer, then in chunks of 5 bytes copied to the buffer
+        json_writer_t writer;
+        if (pass == 0)
+        {
+            json_writer_init(&writer, json, sizeof(json), NULL, NULL);
+        }
+        else
+        {
+            json_writer_init(&writer, chunk, sizeof(chunk), json_writer_test_sink, &output);
+        }
+        json_writer_object_start(&writer, NULL);
+        json_writer_string(&writer, "s", "a\"b\\c\n\t\x01\xc3\xa9");
+        json_writer_int(&writer, "i", -42);
+        json_writer_int(&writer, "min", INT64_MIN);
+        json_writer_uint(&writer, "u", UINT64_MAX);
+        json_writer_bool(&writer, "b", true);
+        json_writer_raw(&writer, "r", "1.5");
+        json_writer_double(&writer, "f", 3.3f);
+        json_writer_double(&writer, "d", 0.1);
+        json_writer_double(&writer, "e", -2.0);
+        json_writer_double(&writer, "n", NAN);
+        json_writer_array_start(&writer, "a");
+        json_writer_object_start(&writer, NULL);
+        json_writer_object_end(&writer);
+        json_writer_array_start(&writer, NULL);
+        json_writer_array_end(&writer);
+        json_writer_string(&writer, NULL, "x");
+        json_writer_uint(&writer, NULL, 0);
+        json_writer_array_end(&writer);
+        json_writer_object_start(&writer, "o");
+        json_writer_bool(&writer, "k\\/", false);
+        json_writer_object_end(&writer);
+        json_writer_object_end(&writer);
+        esp_err_t ret = json_writer_end(&writer);
+        if (pass == 1)
+        {
+            ret = ret != ESP_OK ? ret : json_writer_end(&output);
+        }
+        bool ok = ret == ESP_OK && strcmp(json, expected) == 0 && writer.total == strlen(expected);
+        ESP_LOGI(TAG, "%s: %s: %s", pass == 0 ? "Buffer" : "Sink", json, ok ? "OK" : "FAIL");
+        if (!ok)
+        {
+            err = ESP_FAIL;
+        }
+    }
+
+    // in chunks appended to an allocated buffer, enlarged once
+    json_writer_t writer;
+    json_writer_buffer_t buffer = {0};
+    json_writer_init(&writer, chunk, sizeof(chunk), json_writer_buffer_sink, &buffer);
+    json_writer_array_start(&writer, NULL);
+    for (uint32_t i = 0; i < 200; i++)
+    {
+        json_writer_uint(&writer, NULL, i);
+    }
+    json_writer_array_end(&writer);
+    char *allocated = json_writer_buffer_end(&writer, &buffer);
+    // 490 digits, 199 commas and the brackets
+    if (allocated == NULL || buffer.length != 691 || strncmp(allocated, "[0,1,2,", 7) != 0 || strcmp(allocated + 687, "199]") != 0)
+    {
+        ESP_LOGE(TAG, "Allocated buffer: %s", allocated ? allocated : "NULL");
+        err = ESP_FAIL;
+    }
+    free(allocated);
+
+    // too small: truncated but NUL-terminated
+    char small[8];
+    json_writer_init(&writer, small, sizeof(small), NULL, NULL);
+    json_writer_object_start(&writer, NULL);
+    json_writer_string(&writer, "key", "value");
+    json_writer_object_end(&writer);
+    if (json_writer_end(&writer) != ESP_ERR_NO_MEM || strcmp(small, "{\"key\":") != 0)
+    {
+        ESP_LOGE(TAG, "Overflow not detected: %s", small);
+        err = ESP_FAIL;
+    }
+
+    // object not closed
+    json_writer_init(&writer, json, sizeof(json), NULL, NULL);
+    json_writer_object_start(&writer, NULL);
+    if (json_writer_end(&writer) != ESP_ERR_INVALID_STATE)
+    {
+        ESP_LOGE(TAG, "Unclosed object not detected");
+        err = ESP_FAIL;
+    }
+    return err;
+}
@@ -24,29 +24,53 @@
 #include "esp_pm.h"
 #include "led.h"
 #include "tests.h"
+#include "aggregate.h"
+#include "capture.h"
 #include "ota.h"
 #include "esp_sleep.h"
+#include "esp_timer.h"
+#include "freertos/event_groups.h"
 
 /*==============================================================================
  Local Define
 ===============================================================================*/
 // clang-format off
-#define LINKY_BUFFER_SIZE 16*1024 // The size of the UART buffer
-#define LINKY_DECODE_LEN 512 // The size of the UART buffer when start decoding
+#define LINKY_FRAME_SIZE 2*1024  // Size of a frame buffer (a STD frame is about 1 KB)
+#define LINKY_FRAME_BUFFER_COUNT 2 // One buffer filled by the UART task while the decoder task owns the other
+#define LINKY_BUFFER_SIZE LINKY_FRAME_SIZE // Raw copy of the last decoded frame (debug only)
+#define LINKY_GROUP_SIZE 128     // Max size of a group (between START_OF_GROUP and END_OF_GROUP)
+#define LINKY_CHUNK_SIZE 256     // Size of the chunks read from the UART driver to drop bytes
+#define LINKY_PATTERN_QUEUE_SIZE 8 // Number of END_OF_FRAME positions recorded by the UART driver
+#define LINKY_RX_FULL_THRESH (UART_HW_FIFO_LEN(LINKY_UART) - 4) // Drain the RX FIFO as late as possible: 4 bytes of interrupt latency (4 ms at 9600 bauds)
+#define LINKY_SNIFF_FULL_THRESH 32 // RX FIFO threshold during a mode detection: the bytes are scored as they arrive
+#define LINKY_SNIFF_TIMEOUT 10     // RX timeout during a mode detection (symbols)
 #define START_OF_FRAME  0x02 // The start of frame character
 #define END_OF_FRAME    0x03   // The end of frame character
 
 #define START_OF_GROUP  0x0A  // The start of group character
 #define END_OF_GROUP    0x0D    // The end of group character
 
-#define LINKY_SAME_FEILDS_COUNT 3
+#define LINKY_SAME_FEILDS_COUNT 3 // Number of frames with the same fields count to consider the reading complete
 
-#define RX_BUF_SIZE     8*1024 // The size of the UART buffer
+#define LINKY_FRAME_COMPLETE_BIT BIT0 // Set when a complete and valid frame has been received
+#define LINKY_DECODER_IDLE_BIT   BIT1 // Set while the decoder task is waiting for a frame
+#define LINKY_SNIFF_DONE_BIT     BIT2 // Set when enough valid groups were received during a mode detection
+
+#define LINKY_SNIFF_TIME_MS      900 // Listening time for each mode during a mode detection
+#define LINKY_SNIFF_VALID_GROUPS 3   // Number of valid groups to select a mode before the end of the listening time
+
+#define RX_BUF_SIZE     8*1024 // The size of the UART buffer (holds several frames until END_OF_FRAME is detected)
 #define GROUP_COUNT     256
 #define SEPARATOR_COUNT 3
 
 #define TAG "LINKY"
 
+// #define LINKY_BENCHMARK // Build the previous decoder and the linear label search, to compare them in linky_benchmark()
+#ifdef LINKY_BENCHMARK
+#define LINKY_RESCAN_BUFFER_SIZE (16 * 1024) // Previous buffer of the received bytes
+#define LINKY_DECODE_LEN 512 // Previous decode threshold
+#endif
+
 // clang-format on
 /*==============================================================================
  Local Macro
@@ -87,13 +111,86 @@ typedef struct
     uint8_t *end;
 } raw_group_t;
 
+typedef struct
+{
+    const uint8_t *data; // Points into the group, not null terminated
+    uint32_t size;
+} linky_span_t;
+
+typedef struct
+{
+    linky_span_t label;
+    linky_span_t time;  // Horodate (STD mode only), size 0 if the group has none
+    linky_span_t value;
+    uint8_t checksum;   // Checksum character received
+    uint8_t computed;   // Checksum computed on the received bytes
+} linky_tokens_t;
+
+typedef enum
+{
+    PARSER_WAIT_GROUP, // Waiting for a START_OF_GROUP
+    PARSER_IN_GROUP,   // Storing the bytes of a group until END_OF_GROUP
+} linky_parser_state_t;
+
+typedef struct
+{
+    linky_parser_state_t state;
+    uint8_t group[LINKY_GROUP_SIZE]; // Bytes of the current group, without START_OF_GROUP and END_OF_GROUP
+    uint32_t group_size;             // Number of bytes in group
+    uint32_t groups;                 // Number of groups committed
+    uint32_t frames;                 // Number of END_OF_FRAME received
+    uint32_t frames_valid;           // Number of frames without invalid group
+    bool in_frame;                   // START_OF_FRAME received, waiting for END_OF_FRAME
+    uint32_t frame_groups;           // Number of valid groups in the current frame
+    uint32_t frame_errors;           // Number of invalid groups in the current frame
+    uint8_t *raw;                    // Optional copy of the current frame (can be NULL)
+    uint32_t raw_size;               // Number of bytes in raw
+} linky_parser_t;
+
+typedef struct
+{
+    uint8_t data[LINKY_FRAME_SIZE]; // From START_OF_FRAME to END_OF_FRAME included
+    uint32_t size;
+    linky_mode_t mode; // Mode of the UART when the frame was received
+} linky_frame_buffer_t;
+
+typedef struct
+{
+    uint32_t bytes;
+    uint32_t errors;       // UART frame and parity errors
+    uint32_t groups;       // Groups with at least 2 separators of the mode
+    uint32_t valid_groups; // Groups with a valid checksum
+    uint32_t tabs;         // 0x09 received: never used in historique mode
+    uint32_t spaces;       // 0x20 received
+    uint8_t group[LINKY_GROUP_SIZE];
+    uint32_t group_size;
+    bool in_group;
+} linky_sniff_t;
+
 /*==============================================================================
  Local Function Declaration
 ===============================================================================*/
-static char linky_decode();                                      // Decode the frame
-static char linky_checksum(char *label, char *data, char *time); // Check the checksum
+static char linky_decode();                                      // Check the decoded groups and compute the values
+static void linky_parser_reset(linky_parser_t *parser);
+static void linky_parser_feed(linky_parser_t *parser, const uint8_t *data, uint32_t size);
+static void linky_capture_frame(uint32_t size); // Read a frame from the UART driver to a frame buffer
+static void linky_uart_discard(uint32_t size);
+static void linky_uart_rx_interrupts(bool sniffing);
+static void linky_uart_flush();
+static void linky_decoder_task(void *pvParameters);
+static void linky_decoder_pause();
+static void linky_sniff_feed(linky_sniff_t *sniff, const uint8_t *data, uint32_t size); // Score the bytes received in the current mode
+static int32_t linky_sniff_score(const linky_sniff_t *sniff);
+static void linky_wait_frame(uint32_t timeout); // Decode the frames until a complete frame is received
+static char linky_decode_group(const uint8_t *group, uint32_t size); // Decode one group
+static void linky_frame_end(linky_parser_t *parser);                 // Check if the received frame completes the reading
+static uint32_t linky_count_fields();                                // Count the fields with a value
+static void linky_build_label_index();                               // Sort the labels of each mode for linky_get_label_index
+static char linky_tokenize_group(const uint8_t *group, uint32_t size, linky_tokens_t *tokens); // Split a group and compute its checksum
+static char linky_checksum(const char *label, const char *data, const char *time); // Compute the checksum of a debug group
 static void linky_create_debug_frame(linky_debug_t debug);
-static time_t linky_decode_time(char *time); // Decode the time
+static bool linky_span_to_uint(const linky_span_t *span, uint64_t *value); // Convert decimal digits, 8 or 4 at a time
+static time_t linky_decode_time(const linky_span_t *time);    // Decode the time
 esp_err_t linky_handle_auto_check();
 
 /*==============================================================================
@@ -257,7 +354,7 @@ const linky_value_t linky_label_list[] =
     {121, 103, "Temps d'actualisation",              "now-refresh", &config_values.refresh_rate,   UINT16,       0,      ANY,  C_ANY,   G_ANY,  STATIC_VALUE,  TIME,        "mdi:refresh",                         0xFF42, 0x0002,  ZB_RW, ZB_UINT16    },
     {122, 000, "Temps d'actualisation",              "set-refresh", &config_values.refresh_rate,   HA_NUMBER,    0,      ANY,  C_ANY,   G_ANY,  STATIC_VALUE,  TIME,        "mdi:refresh",                         0x0000, 0x0000,  ZB_NO, ZB_NO        },
     {123, 105, "Mode TIC",                           "mode-tic",    &linky_mode,                   UINT16,       0,      ANY,  C_ANY,   G_ANY,  STATIC_VALUE,  NONE_CLASS,  "mdi:translate",                       0xFF42, 0x002c,  ZB_RO, ZB_UINT8     },
-    {124, 106, "Mode Electrique",                    "mode-elec",   &linky_three_phase,            UINT16,       0,      ANY,  C_ANY,   G_ANY,  STATIC_VALUE,  NONE_CLASS,  "mdi:power-plug-outline",              0xFF42, 0x002a,  ZB_RO, ZB_UINT8     },
+    {124, 106, "Mode Electrique",                    "mode-elec",   &linky_three_phase,            UINT8,        0,      ANY,  C_ANY,   G_ANY,  STATIC_VALUE,  NONE_CLASS,  "mdi:power-plug-outline",              0xFF42, 0x002a,  ZB_RO, ZB_UINT8     },
     {125, 104, "Temps de fonctionnement",            "uptime",      &linky_data.uptime,            UINT64,       0,      ANY,  C_ANY,   G_ANY,  REAL_TIME,     TIME_M,      "mdi:clock-time-eight-outline",        0xFF42, 0x002d,  ZB_RO, ZB_UINT48    },
     {126, 000, "Mise à jour disponible",             "update",      &ota_available,                UINT8,        0,      ANY,  C_ANY,   G_ANY,  STATIC_VALUE,  CLASS_BOOL,  "mdi:download",                        0x0000, 0x0000,  ZB_NO, ZB_NO        },
  // {127, 000, "Dernière actualisation",             "timestamp",   &linky_data.timestamp,         UINT64,       0,      ANY,  C_ANY,   G_ANY,  STATIC_VALUE,  TIMESTAMP,   "",                                    0x0000, 0x0000,  ZB_NO, ZB_NO        },
@@ -269,9 +366,11 @@ const int32_t linky_label_list_size = sizeof(linky_label_list) / sizeof(linky_la
 
 linky_value_rw_t linky_rw_values[sizeof(linky_label_list) / sizeof(linky_label_list[0])] = {0};
 
+#define LINKY_LABEL_LIST_SIZE (sizeof(linky_label_list) / sizeof(linky_label_list[0]))
+
 const void *linky_protected_data[] = {&config_values.refresh_rate, &linky_mode, &linky_three_phase, &ota_available};
 const uint8_t linky_protected_data_size = sizeof(linky_protected_data) / sizeof(linky_protected_data[0]);
-linky_data_t linky_data;        // The data
+linky_data_t linky_data = {.mode = NONE}; // The data
 linky_mode_t linky_mode = NONE; // The mode of the linky
 linky_contract_t linky_contract = C_ANY;
 
@@ -377,24 +476,95 @@ const char *const linky_str_mode[] = {
 static char linky_uart_rx = 0; // The RX pin of the linky
 // static char *linky_frame = NULL;             // The received frame from the linky
 static uint8_t linky_group_separator = 0x20; // The group separator character (changes depending on the mode) (0x20 in historique mode, 0x09 in standard mode)
-uint32_t linky_frame_size = 0;               // The size of the frame
 static const char linky_std_debug_buffer[] = {0x2, 0xa, 0x41, 0x44, 0x53, 0x43, 0x9, 0x58, 0x58, 0x58, 0x58, 0x58, 0x58, 0x58, 0x58, 0x58, 0x58, 0x58, 0x58, 0x9, 0x2d, 0xd, 0xa, 0x56, 0x54, 0x49, 0x43, 0x9, 0x30, 0x32, 0x9, 0x4a, 0xd, 0xa, 0x44, 0x41, 0x54, 0x45, 0x9, 0x48, 0x32, 0x34, 0x30, 0x31, 0x30, 0x37, 0x31, 0x37, 0x35, 0x38, 0x31, 0x30, 0x9, 0x9, 0x45, 0xd, 0xa, 0x4e, 0x47, 0x54, 0x46, 0x9, 0x20, 0x20, 0x20, 0x20, 0x20, 0x54, 0x45, 0x4d, 0x50, 0x4f, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x9, 0x46, 0xd, 0xa, 0x4c, 0x54, 0x41, 0x52, 0x46, 0x9, 0x20, 0x20, 0x20, 0x20, 0x48, 0x50, 0x20, 0x20, 0x42, 0x4c, 0x45, 0x55, 0x20, 0x20, 0x20, 0x20, 0x9, 0x2b, 0xd, 0xa, 0x45, 0x41, 0x53, 0x54, 0x9, 0x30, 0x35, 0x30, 0x30, 0x31, 0x39, 0x32, 0x32, 0x36, 0x9, 0x28, 0xd, 0xa, 0x45, 0x41, 0x53, 0x46, 0x30, 0x31, 0x9, 0x30, 0x32, 0x32, 0x32, 0x33, 0x35, 0x33, 0x34, 0x30, 0x9, 0x37, 0xd, 0xa, 0x45, 0x41, 0x53, 0x46, 0x30, 0x32, 0x9, 0x30, 0x32, 0x36, 0x35, 0x38, 0x37, 0x32, 0x37, 0x30, 0x9, 0x48, 0xd, 0xa, 0x45, 0x41, 0x53, 0x46, 0x30, 0x33, 0x9, 0x30, 0x30, 0x30, 0x34, 0x32, 0x35, 0x36, 0x39, 0x36, 0x9, 0x44, 0xd, 0xa, 0x45, 0x41, 0x53, 0x46, 0x30, 0x34, 0x9, 0x30, 0x30, 0x30, 0x34, 0x39, 0x34, 0x36, 0x31, 0x34, 0x9, 0x41, 0xd, 0xa, 0x45, 0x41, 0x53, 0x46, 0x30, 0x35, 0x9, 0x30, 0x30, 0x30, 0x31, 0x31, 0x35, 0x30, 0x34, 0x35, 0x9, 0x36, 0xd, 0xa, 0x45, 0x41, 0x53, 0x46, 0x30, 0x36, 0x9, 0x30, 0x30, 0x30, 0x31, 0x36, 0x31, 0x32, 0x36, 0x31, 0x9, 0x38, 0xd, 0xa, 0x45, 0x41, 0x53, 0x46, 0x30, 0x37, 0x9, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x9, 0x28, 0xd, 0xa, 0x45, 0x41, 0x53, 0x46, 0x30, 0x38, 0x9, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x9, 0x29, 0xd, 0xa, 0x45, 0x41, 0x53, 0x46, 0x30, 0x39, 0x9, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x9, 0x2a, 0xd, 0xa, 0x45, 0x41, 0x53, 0x46, 0x31, 0x30, 0x9, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x9, 0x22, 0xd, 0xa, 0x45, 0x41, 0x53, 0x44, 0x30, 0x31, 0x9, 0x30, 0x32, 0x30, 0x39, 0x37, 0x36, 0x37, 0x33, 0x38, 0x9, 0x4a, 0xd, 0xa, 0x45, 0x41, 0x53, 0x44, 0x30, 0x32, 0x9, 0x30, 0x32, 0x35, 0x30, 0x33, 0x33, 0x37, 0x33, 0x35, 0x9, 0x3d, 0xd, 0xa, 0x45, 0x41, 0x53, 0x44, 0x30, 0x33, 0x9, 0x30, 0x30, 0x31, 0x37, 0x39, 0x39, 0x33, 0x34, 0x33, 0x9, 0x46, 0xd, 0xa, 0x45, 0x41, 0x53, 0x44, 0x30, 0x34, 0x9, 0x30, 0x30, 0x32, 0x32, 0x30, 0x39, 0x34, 0x31, 0x30, 0x9, 0x35, 0xd, 0xa, 0x49, 0x52, 0x4d, 0x53, 0x31, 0x9, 0x30, 0x31, 0x37, 0x9, 0x36, 0xd, 0xa, 0x55, 0x52, 0x4d, 0x53, 0x31, 0x9, 0x32, 0x32, 0x37, 0x9, 0x45, 0xd, 0xa, 0x50, 0x52, 0x45, 0x46, 0x9, 0x31, 0x32, 0x9, 0x42, 0xd, 0xa, 0x50, 0x43, 0x4f, 0x55, 0x50, 0x9, 0x31, 0x32, 0x9, 0x5c, 0xd, 0xa, 0x53, 0x49, 0x4e, 0x53, 0x54, 0x53, 0x9, 0x30, 0x33, 0x39, 0x30, 0x30, 0x9, 0x52, 0xd, 0xa, 0x53, 0x4d, 0x41, 0x58, 0x53, 0x4e, 0x9, 0x48, 0x32, 0x34, 0x30, 0x31, 0x30, 0x37, 0x30, 0x32, 0x34, 0x37, 0x32, 0x33, 0x9, 0x30, 0x38, 0x36, 0x31, 0x31, 0x9, 0x3d, 0xd, 0xa, 0x53, 0x4d, 0x41, 0x58, 0x53, 0x4e, 0x2d, 0x31, 0x9, 0x48, 0x32, 0x34, 0x30, 0x31, 0x30, 0x36, 0x30, 0x33, 0x33, 0x37, 0x32, 0x35, 0x9, 0x30, 0x39, 0x39, 0x34, 0x31, 0x9, 0x23, 0xd, 0xa, 0x43, 0x43, 0x41, 0x53, 0x4e, 0x9, 0x48, 0x32, 0x34, 0x30, 0x31, 0x30, 0x37, 0x31, 0x37, 0x33, 0x30, 0x30, 0x30, 0x9, 0x30, 0x33, 0x35, 0x39, 0x34, 0x9, 0x49, 0xd, 0xa, 0x43, 0x43, 0x41, 0x53, 0x4e, 0x2d, 0x31, 0x9, 0x48, 0x32, 0x34, 0x30, 0x31, 0x30, 0x37, 0x31, 0x37, 0x30, 0x30, 0x30, 0x30, 0x9, 0x30, 0x33, 0x36, 0x36, 0x38, 0x9, 0x26, 0xd, 0xa, 0x55, 0x4d, 0x4f, 0x59, 0x31, 0x9, 0x48, 0x32, 0x34, 0x30, 0x31, 0x30, 0x37, 0x31, 0x37, 0x35, 0x30, 0x30, 0x30, 0x9, 0x32, 0x32, 0x35, 0x9, 0x32, 0xd, 0xa, 0x53, 0x54, 0x47, 0x45, 0x9, 0x30, 0x31, 0x33, 0x41, 0x43, 0x34, 0x30, 0x31, 0x9, 0x52, 0xd, 0xa, 0x44, 0x50, 0x4d, 0x32, 0x9, 0x20, 0x32, 0x34, 0x30, 0x31, 0x30, 0x38, 0x30, 0x36, 0x30, 0x30, 0x30, 0x30, 0x9, 0x30, 0x30, 0x9, 0x23, 0xd, 0xa, 0x46, 0x50, 0x4d, 0x32, 0x9, 0x20, 0x32, 0x34, 0x30, 0x31, 0x30, 0x39, 0x30, 0x36, 0x30, 0x30, 0x30, 0x30, 0x9, 0x30, 0x30, 0x9, 0x26, 0xd, 0xa, 0x4d, 0x53, 0x47, 0x31, 0x9, 0x50, 0x41, 0x53, 0x20, 0x44, 0x45, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x4d, 0x45, 0x53, 0x53, 0x41, 0x47, 0x45, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x9, 0x3c, 0xd, 0xa, 0x50, 0x52, 0x4d, 0x9, 0x30, 0x39, 0x33, 0x31, 0x32, 0x33, 0x30, 0x30, 0x39, 0x32, 0x36, 0x36, 0x39, 0x35, 0x9, 0x38, 0xd, 0xa, 0x52, 0x45, 0x4c, 0x41, 0x49, 0x53, 0x9, 0x30, 0x30, 0x30, 0x9, 0x42, 0xd, 0xa, 0x4e, 0x54, 0x41, 0x52, 0x46, 0x9, 0x30, 0x32, 0x9, 0x4f, 0xd, 0xa, 0x4e, 0x4a, 0x4f, 0x55, 0x52, 0x46, 0x9, 0x30, 0x30, 0x9, 0x26, 0xd, 0xa, 0x4e, 0x4a, 0x4f, 0x55, 0x52, 0x46, 0x2b, 0x31, 0x9, 0x30, 0x30, 0x9, 0x42, 0xd, 0xa, 0x50, 0x4a, 0x4f, 0x55, 0x52, 0x46, 0x2b, 0x31, 0x9, 0x30, 0x30, 0x30, 0x30, 0x34, 0x30, 0x30, 0x31, 0x20, 0x30, 0x36, 0x30, 0x30, 0x34, 0x30, 0x30, 0x32, 0x20, 0x32, 0x32, 0x30, 0x30, 0x34, 0x30, 0x30, 0x31, 0x20, 0x4e, 0x4f, 0x4e, 0x55, 0x54, 0x49, 0x4c, 0x45, 0x20, 0x4e, 0x4f, 0x4e, 0x55, 0x54, 0x49, 0x4c, 0x45, 0x20, 0x4e, 0x4f, 0x4e, 0x55, 0x54, 0x49, 0x4c, 0x45, 0x20, 0x4e, 0x4f, 0x4e, 0x55, 0x54, 0x49, 0x4c, 0x45, 0x20, 0x4e, 0x4f, 0x4e, 0x55, 0x54, 0x49, 0x4c, 0x45, 0x20, 0x4e, 0x4f, 0x4e, 0x55, 0x54, 0x49, 0x4c, 0x45, 0x20, 0x4e, 0x4f, 0x4e, 0x55, 0x54, 0x49, 0x4c, 0x45, 0x20, 0x4e, 0x4f, 0x4e, 0x55, 0x54, 0x49, 0x4c, 0x45, 0x9, 0x2e, 0xd, 0xa, 0x50, 0x50, 0x4f, 0x49, 0x4e, 0x54, 0x45, 0x9, 0x30, 0x30, 0x30, 0x30, 0x34, 0x30, 0x30, 0x35, 0x20, 0x30, 0x36, 0x30, 0x30, 0x34, 0x30, 0x30, 0x36, 0x20, 0x32, 0x32, 0x30, 0x30, 0x34, 0x30, 0x30, 0x35, 0x20, 0x4e, 0x4f, 0x4e, 0x55, 0x54, 0x49, 0x4c, 0x45, 0x20, 0x4e, 0x4f, 0x4e, 0x55, 0x54, 0x49, 0x4c, 0x45, 0x20, 0x4e, 0x4f, 0x4e, 0x55, 0x54, 0x49, 0x4c, 0x45, 0x20, 0x4e, 0x4f, 0x4e, 0x55, 0x54, 0x49, 0x4c, 0x45, 0x20, 0x4e, 0x4f, 0x4e, 0x55, 0x54, 0x49, 0x4c, 0x45, 0x20, 0x4e, 0x4f, 0x4e, 0x55, 0x54, 0x49, 0x4c, 0x45, 0x20, 0x4e, 0x4f, 0x4e, 0x55, 0x54, 0x49, 0x4c, 0x45, 0x20, 0x4e, 0x4f, 0x4e, 0x55, 0x54, 0x49, 0x4c, 0x45, 0x9, 0x27, 0xd, 0x3};
 static const char linky_std_debug_buffer_bad[] = {0x2, 0xa, 0x40, 0x40, 0x43, 0x43, 0x9, 0x58, 0x58, 0x58, 0x58, 0x58, 0x58, 0x58, 0x58, 0x58, 0x58, 0x58, 0x58, 0x9, 0x32, 0xd, 0xa, 0x56, 0x50, 0x49, 0x43, 0x9, 0x20, 0x22, 0x9, 0x4a, 0xd, 0xa, 0x44, 0x41, 0x54, 0x45, 0x9, 0x45, 0x32, 0x34, 0x30, 0x36, 0x31, 0x34, 0x32, 0x33, 0x32, 0x33, 0x32, 0x26, 0x9, 0x8, 0x42, 0xd, 0xa, 0x4e, 0x47, 0x54, 0x46, 0x9, 0x20, 0x20, 0x20, 0x20, 0x20, 0x54, 0x45, 0x4d, 0x50, 0x4f, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x9, 0x46, 0xd, 0xa, 0x4c, 0x54, 0x41, 0x52, 0x46, 0x9, 0x20, 0x20, 0x20, 0x20, 0x48, 0x43, 0x20, 0x20, 0x42, 0x4c, 0x45, 0x55, 0x0, 0x20, 0x20, 0x20, 0x9, 0x5e, 0xd, 0xa, 0x45, 0x41, 0x53, 0x54, 0x9, 0x30, 0x31, 0x33, 0x35, 0x38, 0x35, 0x37, 0x39, 0x31, 0x9, 0x36, 0xc, 0xa, 0x45, 0x41, 0x53, 0x46, 0x30, 0x31, 0x9, 0x30, 0x31, 0x30, 0x30, 0x39, 0x30, 0x35, 0x38, 0x31, 0x9, 0x3a, 0xd, 0xa, 0x40, 0x41, 0x42, 0x46, 0x30, 0x22, 0x9, 0x30, 0x30, 0x32, 0x32, 0x36, 0x39, 0x31, 0x38, 0x35, 0x9, 0x44, 0xd, 0xa, 0x45, 0x41, 0x52, 0x46, 0x30, 0x32, 0x8, 0x20, 0x20, 0x20, 0x22, 0x20, 0x30, 0x32, 0x39, 0x32, 0x9, 0x33, 0xd, 0xa, 0x45, 0x41, 0x53, 0x46, 0x30, 0x34, 0x9, 0x30, 0x30, 0x30, 0x30, 0x38, 0x20, 0x20, 0x26, 0x27, 0x9, 0x41, 0xd, 0xa, 0x45, 0x41, 0x53, 0x46, 0x30, 0x35, 0x9, 0x30, 0x30, 0x30, 0x30, 0x39, 0x36, 0x30, 0x32, 0x33, 0x0, 0x3a, 0xd, 0xa, 0x45, 0x41, 0x53, 0x46, 0x30, 0x36, 0x9, 0x30, 0x30, 0x30, 0x33, 0x33, 0x39, 0x35, 0x33, 0x33, 0x9, 0x41, 0xd, 0xa, 0x41, 0x41, 0x53, 0x46, 0x30, 0x37, 0x9, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x9, 0x28, 0xd, 0xa, 0x40, 0x41, 0x42, 0x46, 0x30, 0x38, 0x9, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x9, 0x29, 0xd, 0xa, 0x45, 0x41, 0x53, 0x46, 0x30, 0x30, 0x0, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x30, 0x30, 0x30, 0x9, 0x2a, 0xd, 0xa, 0x45, 0x41, 0x53, 0x46, 0x31, 0x30, 0x9, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x20, 0x20, 0x20, 0x8, 0x22, 0xd, 0xa, 0x45, 0x41, 0x53, 0x44, 0x30, 0x31, 0x9, 0x30, 0x30, 0x36, 0x33, 0x31, 0x36, 0x32, 0x33, 0x34, 0x0, 0x32, 0x8, 0xa, 0x45, 0x41, 0x53, 0x44, 0x30, 0x32, 0x9, 0x30, 0x30, 0x32, 0x30, 0x32, 0x30, 0x32, 0x30, 0x38, 0x9, 0x2f, 0xd, 0xa, 0x40, 0x41, 0x43, 0x44, 0x30, 0x33, 0x9, 0x30, 0x30, 0x31, 0x32, 0x35, 0x39, 0x36, 0x32, 0x36, 0x9, 0x41, 0xd, 0xa, 0x44, 0x41, 0x52, 0x40, 0x20, 0x20, 0x9, 0x20, 0x30, 0x33, 0x39, 0x38, 0x39, 0x37, 0x32, 0x32, 0x9, 0x4b, 0xd, 0xa, 0x49, 0x52, 0x4d, 0x53, 0x30, 0x9, 0x30, 0x30, 0x22, 0x9, 0x20, 0x8, 0xa, 0x55, 0x52, 0x4d, 0x53, 0x31, 0x9, 0x32, 0x33, 0x39, 0x9, 0x48, 0xd, 0xa, 0x50, 0x42, 0x45, 0x46, 0x9, 0x20, 0x26, 0x9, 0x45, 0xd, 0xa, 0x50, 0x43, 0x4f, 0x55, 0x50, 0x9, 0x30, 0x36, 0x9, 0x5f, 0xd, 0xa, 0x42, 0x49, 0x4e, 0x53, 0x54, 0x53, 0x9, 0x30, 0x30, 0x34, 0x32, 0x31, 0x9, 0x4d, 0xd, 0xa, 0x53, 0x4d, 0x41, 0x58, 0x53, 0x4e, 0x8, 0x40, 0x32, 0x34, 0x20, 0x26, 0x31, 0x34, 0x30, 0x30, 0x35, 0x35, 0x30, 0x37, 0x9, 0x30, 0x33, 0x32, 0x34, 0x34, 0x9, 0x39, 0xd, 0xa, 0x52, 0x48, 0x40, 0x58, 0x53, 0x4e, 0x29, 0x21, 0x9, 0x45, 0x32, 0x34, 0x30, 0x36, 0x31, 0x33, 0x30, 0x30, 0x34, 0x33, 0x31, 0x36, 0x9, 0x30, 0x32, 0x37, 0x35, 0x32, 0x9, 0x56, 0xc, 0xa, 0x43, 0x43, 0x41, 0x53, 0x4e, 0x9, 0x45, 0x32, 0x34, 0x30, 0x36, 0x31, 0x34, 0x32, 0x33, 0x30, 0x30, 0x30, 0x30, 0x9, 0x30, 0x30, 0x33, 0x30, 0x32, 0x9, 0x30, 0xd, 0xa, 0x43, 0x43, 0x41, 0x53, 0x4e, 0x2d, 0x31, 0x9, 0x45, 0x32, 0x34, 0x30, 0x36, 0x31, 0x34, 0x32, 0x32, 0x33, 0x30, 0x30, 0x30, 0x0, 0x30, 0x30, 0x22, 0x39, 0x20, 0x8, 0x59, 0xd, 0xa, 0x55, 0x4d, 0x4f, 0x59, 0x31, 0x9, 0x45, 0x32, 0x34, 0x30, 0x36, 0x31, 0x34, 0x32, 0x33, 0x32, 0x30, 0x30, 0x30, 0x8, 0x22, 0x33, 0x38, 0x9, 0x31, 0xd, 0xa, 0x53, 0x54, 0x47, 0x45, 0x9, 0x30, 0x31, 0x33, 0x41, 0x30, 0x30, 0x30, 0x30, 0x0, 0x32, 0xc, 0xa, 0x4d, 0x53, 0x47, 0x31, 0x9, 0x50, 0x41, 0x53, 0x20, 0x44, 0x45, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x4d, 0x44, 0x53, 0x52, 0x40, 0x46, 0x40, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x9, 0x3c, 0xd, 0xa, 0x50, 0x52, 0x4d, 0x9, 0x32, 0x34, 0x33, 0x30, 0x33, 0x32, 0x31, 0x32, 0x36, 0x26, 0x21, 0x24, 0x36, 0x31, 0x9, 0x36, 0xd, 0xa, 0x52, 0x45, 0x4c, 0x41, 0x49, 0x53, 0x9, 0x30, 0x30, 0x30, 0x9, 0x42, 0xd, 0xa, 0x4e, 0x54, 0x41, 0x52, 0x46, 0x9, 0x30, 0x31, 0x9, 0x4e, 0xd, 0xa, 0x4e, 0x4a, 0x4f, 0x55, 0x52, 0x46, 0x9, 0x20, 0x20, 0x8, 0x26, 0xd, 0xa, 0x4e, 0x4a, 0x4f, 0x55, 0x52, 0x46, 0x2b, 0x31, 0x9, 0x30, 0x30, 0x9, 0x42, 0xd, 0xa, 0x40, 0x4a, 0x4f, 0x55, 0x52, 0x46, 0x2b, 0x31, 0x9, 0x30, 0x30, 0x30, 0x30, 0x34, 0x30, 0x30, 0x31, 0x20, 0x30, 0x36, 0x30, 0x30, 0x34, 0x30, 0x30, 0x32, 0x20, 0x32, 0x32, 0x30, 0x20, 0x20, 0x30, 0x20, 0x21, 0x20, 0x4e, 0x4f, 0x4e, 0x55, 0x54, 0x49, 0x4c, 0x45, 0x20, 0x4e, 0x4f, 0x4e, 0x55, 0x54, 0x49, 0x4c, 0x45, 0x20, 0x4e, 0x4f, 0x4e, 0x55, 0x54, 0x49, 0x4c, 0x45, 0x20, 0x4e, 0x4e, 0x4e, 0x41, 0x54, 0x49, 0x4c, 0x45, 0x20, 0x4e, 0x4f, 0x4e, 0x55, 0x54, 0x49, 0x4c, 0x45, 0x20, 0x4e, 0x4f, 0x4e, 0x55, 0x54, 0x49, 0x4c, 0x45, 0x20, 0x4e, 0x4e, 0x4e, 0x50, 0x40, 0x49, 0x4c, 0x45, 0x20, 0x4e, 0x4f, 0x4e, 0x55, 0x54, 0x49, 0x4c, 0x45, 0x9, 0x2e, 0xd, 0x0, 0x0, 0x2, 0xa, 0x40, 0x40, 0x43, 0x43, 0x9, 0x30, 0x33, 0x32, 0x30, 0x36, 0x31, 0x32, 0x33, 0x37, 0x33, 0x31, 0x39, 0x9, 0x32, 0xd, 0xa, 0x56, 0x50, 0x49, 0x43, 0x9, 0x20, 0x20, 0x9, 0x4a, 0xd, 0xa, 0x44, 0x41, 0x50, 0x45, 0x9, 0x45, 0x32, 0x34, 0x30, 0x36, 0x31, 0x35, 0x30, 0x33, 0x30, 0x37, 0x30, 0x26, 0x8, 0x8, 0x42, 0x9, 0xa, 0x4e, 0x47, 0x54, 0x46, 0x9, 0x20, 0x20, 0x20, 0x20, 0x20, 0x54, 0x45, 0x4d, 0x50, 0x4f, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x9, 0x46, 0xd, 0xa, 0x4c, 0x54, 0x41, 0x52, 0x46, 0x9, 0x20, 0x20, 0x20, 0x20, 0x48, 0x50, 0x20, 0x20, 0x42, 0x4c, 0x45, 0x55, 0x0, 0x20, 0x20, 0x20, 0x9, 0x2a, 0x9, 0xa, 0x45, 0x41, 0x53, 0x54, 0x9, 0x30, 0x31, 0x33, 0x35, 0x39, 0x33, 0x36, 0x31, 0x36, 0x9, 0x30, 0xd, 0xa, 0x45, 0x41, 0x53, 0x46, 0x30, 0x31, 0x9, 0x30, 0x31, 0x30, 0x30, 0x39, 0x36, 0x38, 0x32, 0x37, 0x9, 0x43, 0xd, 0xa, 0x40, 0x41, 0x42, 0x46, 0x30, 0x20, 0x9, 0x30, 0x30, 0x32, 0x32, 0x37, 0x30, 0x37, 0x36, 0x34, 0x9, 0x3f, 0x9, 0xa, 0x45, 0x41, 0x52, 0x46, 0x30, 0x22, 0x8, 0x20, 0x20, 0x20, 0x20, 0x20, 0x30, 0x32, 0x39, 0x32, 0x9, 0x33, 0xd, 0xa, 0x45, 0x41, 0x53, 0x46, 0x30, 0x34, 0x9, 0x30, 0x30, 0x30, 0x30, 0x38, 0x20, 0x20, 0x26, 0x27, 0x9, 0x41, 0xd, 0xa, 0x45, 0x41, 0x53, 0x46, 0x30, 0x35, 0x9, 0x30, 0x30, 0x30, 0x30, 0x39, 0x36, 0x30, 0x32, 0x33, 0x0, 0x3a, 0xd, 0xa, 0x45, 0x41, 0x53, 0x46, 0x30, 0x36, 0x9, 0x30, 0x30, 0x30, 0x33, 0x33, 0x39, 0x35, 0x33, 0x33, 0x9, 0x41, 0xc, 0xa, 0x41, 0x41, 0x53, 0x46, 0x30, 0x37, 0x9, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x9, 0x28, 0xd, 0xa, 0x40, 0x41, 0x42, 0x46, 0x30, 0x38, 0x9, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x9, 0x29, 0xd, 0xa, 0x45, 0x41, 0x52, 0x46, 0x30, 0x30, 0x0, 0x20, 0x20, 0x20, 0x20, 0x20, 0x30, 0x30, 0x30, 0x30, 0x9, 0x2a, 0xd, 0xa, 0x45, 0x41, 0x53, 0x46, 0x31, 0x30, 0x9, 0x30, 0x30, 0x30, 0x30, 0x30, 0x20, 0x20, 0x20, 0x20, 0x9, 0x20, 0xd, 0xa, 0x45, 0x41, 0x53, 0x40, 0x30, 0x31, 0x9, 0x30, 0x30, 0x36, 0x33, 0x32, 0x32, 0x34, 0x38, 0x31, 0x9, 0x32, 0x8, 0xa, 0x45, 0x41, 0x53, 0x44, 0x30, 0x32, 0x9, 0x30, 0x30, 0x32, 0x30, 0x32, 0x31, 0x37, 0x38, 0x37, 0x9, 0x3c, 0xd, 0xa, 0x40, 0x41, 0x53, 0x44, 0x30, 0x33, 0x9, 0x30, 0x30, 0x31, 0x32, 0x35, 0x39, 0x36, 0x32, 0x36, 0x9, 0x41, 0xd, 0xa, 0x40, 0x41, 0x42, 0x40, 0x20, 0x20, 0x9, 0x20, 0x30, 0x33, 0x39, 0x38, 0x39, 0x37, 0x32, 0x32, 0x9, 0x4b, 0xd, 0xa, 0x49, 0x52, 0x4d, 0x52, 0x30, 0x9, 0x30, 0x20, 0x22, 0x8, 0x20, 0xd, 0xa, 0x55, 0x52, 0x4d, 0x53, 0x31, 0x9, 0x32, 0x33, 0x36, 0x9, 0x45, 0xd, 0xa, 0x50, 0x42, 0x45, 0x46, 0x9, 0x20, 0x36, 0x9, 0x45, 0xd, 0xa, 0x50, 0x43, 0x4f, 0x55, 0x50, 0x9, 0x30, 0x36, 0x9, 0x5f, 0xd, 0xa, 0x42, 0x49, 0x4e, 0x53, 0x54, 0x53, 0x9, 0x30, 0x30, 0x37, 0x33, 0x38, 0x9, 0x58, 0xd, 0xa, 0x53, 0x4d, 0x40, 0x50, 0x53, 0x4e, 0x8, 0x40, 0x32, 0x24, 0x20, 0x24, 0x31, 0x35, 0x30, 0x31, 0x30, 0x32, 0x33, 0x38, 0x9, 0x30, 0x34, 0x36, 0x31, 0x38, 0x9, 0x3d, 0xd, 0xa, 0x52, 0x48, 0x40, 0x58, 0x53, 0x4e, 0x29, 0x31, 0x9, 0x45, 0x32, 0x34, 0x30, 0x36, 0x31, 0x34, 0x30, 0x30, 0x31, 0x31, 0x30, 0x37, 0x9, 0x30, 0x33, 0x32, 0x34, 0x34, 0x9, 0x56, 0xd, 0xa, 0x43, 0x43, 0x41, 0x53, 0x4e, 0x9, 0x45, 0x32, 0x34, 0x30, 0x36, 0x31, 0x35, 0x31, 0x33, 0x30, 0x30, 0x30, 0x30, 0x9, 0x30, 0x30, 0x32, 0x39, 0x36, 0x0, 0x3e, 0x8, 0xa, 0x43, 0x43, 0x41, 0x53, 0x4e, 0x2d, 0x31, 0x9, 0x45, 0x32, 0x34, 0x30, 0x36, 0x31, 0x35, 0x31, 0x32, 0x33, 0x30, 0x30, 0x30, 0x0, 0x30, 0x20, 0x22, 0x22, 0x38, 0x9, 0x5b, 0xd, 0xa, 0x55, 0x4d, 0x4f, 0x59, 0x31, 0x9, 0x45, 0x32, 0x34, 0x30, 0x36, 0x31, 0x35, 0x31, 0x33, 0x30, 0x30, 0x30, 0x20, 0x8, 0x22, 0x23, 0x38, 0x9, 0x2f, 0xd, 0xa, 0x53, 0x54, 0x47, 0x41, 0x9, 0x30, 0x31, 0x33, 0x41, 0x34, 0x34, 0x30, 0x30, 0x9, 0x42, 0xd, 0xa, 0x4d, 0x53, 0x47, 0x31, 0x9, 0x50, 0x41, 0x53, 0x20, 0x44, 0x41, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x4d, 0x44, 0x53, 0x52, 0x40, 0x46, 0x40, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x9, 0x3c, 0xd, 0xa, 0x50, 0x52, 0x4d, 0x9, 0x32, 0x34, 0x33, 0x30, 0x33, 0x32, 0x31, 0x32, 0x36, 0x26, 0x21, 0x34, 0x36, 0x31, 0x9, 0x36, 0xd, 0xa, 0x52, 0x45, 0x4c, 0x41, 0x49, 0x53, 0x9, 0x30, 0x30, 0x30, 0x0, 0x42, 0x8, 0xa, 0x4e, 0x54, 0x41, 0x52, 0x46, 0x9, 0x30, 0x32, 0x9, 0x4f, 0xd, 0xa, 0x4e, 0x4a, 0x4f, 0x55, 0x52, 0x46, 0x9, 0x20, 0x20, 0x8, 0x26, 0xd, 0xa, 0x4e, 0x4a, 0x4f, 0x55, 0x52, 0x46, 0x2b, 0x31, 0x9, 0x30, 0x30, 0x9, 0x42, 0xd, 0xa, 0x40, 0x48, 0x4f, 0x55, 0x52, 0x46, 0x2b, 0x31, 0x9, 0x30, 0x30, 0x30, 0x30, 0x34, 0x30, 0x30, 0x31, 0x20, 0x30, 0x36, 0x30, 0x30, 0x34, 0x30, 0x30, 0x32, 0x20, 0x32, 0x32, 0x30, 0x20, 0x20, 0x20, 0x20, 0x21, 0x20, 0x4e, 0x4f, 0x4e, 0x55, 0x54, 0x49, 0x4c, 0x45, 0x20, 0x4e, 0x4f, 0x4e, 0x55, 0x54, 0x49, 0x4c, 0x45, 0x20, 0x4e, 0x4f, 0x4e, 0x54, 0x54, 0x49, 0x4c, 0x45, 0x20, 0x4e, 0x4e, 0x4e, 0x45, 0x54, 0x49, 0x4c, 0x45, 0x20, 0x4e, 0x4f, 0x4e, 0x55, 0x54, 0x49, 0x4c, 0x45, 0x20, 0x4e, 0x4f, 0x4e, 0x55, 0x54, 0x49, 0x4c, 0x45, 0x20, 0x4e, 0x4e, 0x4e, 0x40, 0x40, 0x49, 0x4c, 0x45, 0x20, 0x4e, 0x4f, 0x4e, 0x55, 0x54, 0x49, 0x4c, 0x45, 0x9, 0x2e, 0xd, 0x0, 0x0, 0x2, 0xa, 0x41, 0x40, 0x53, 0x43, 0x9, 0x30, 0x33, 0x32, 0x30, 0x36, 0x31, 0x32, 0x33, 0x36, 0x33, 0x20, 0x39, 0x8, 0x22, 0xd, 0xa, 0x56, 0x54, 0x49, 0x43, 0x9, 0x30, 0x32, 0x9, 0x4a, 0xd, 0xa, 0x40, 0x40, 0x40, 0x45, 0x9, 0x40, 0x32, 0x24, 0x30, 0x36, 0x31, 0x35, 0x31, 0x33, 0x31, 0x38, 0x35, 0x30, 0x9, 0x9, 0x42, 0x9, 0xa, 0x4e, 0x46, 0x50, 0x46, 0x9, 0x0, 0x20, 0x20, 0x20, 0x20, 0x44, 0x45, 0x4d, 0x50, 0x4f, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x9, 0x46, 0xd, 0xa, 0x4c, 0x54, 0x41, 0x52, 0x46, 0x9, 0x0, 0x20, 0x20, 0x20, 0x48, 0x50, 0x20, 0x20, 0x42, 0x4c, 0x45, 0x55, 0x20, 0x20, 0x20, 0x20, 0x9, 0x2b, 0x9, 0xa, 0x44, 0x41, 0x52, 0x50, 0x9, 0x20, 0x20, 0x23, 0x20, 0x39, 0x33, 0x36, 0x33, 0x36, 0x9, 0x33, 0xd, 0xa, 0x45, 0x41, 0x53, 0x46, 0x30, 0x31, 0x9, 0x30, 0x30, 0x30, 0x30, 0x30, 0x26, 0x38, 0x32, 0x27, 0x9, 0x43, 0xd, 0xa, 0x45, 0x41, 0x53, 0x46, 0x30, 0x32, 0x9, 0x30, 0x30, 0x32, 0x32, 0x37, 0x30, 0x36, 0x38, 0x34, 0x9, 0x40, 0x8, 0xa, 0x45, 0x41, 0x53, 0x46, 0x30, 0x33, 0x9, 0x30, 0x30, 0x30, 0x32, 0x30, 0x30, 0x32, 0x39, 0x32, 0x9, 0x33, 0xd, 0xa, 0x40, 0x41, 0x53, 0x46, 0x30, 0x34, 0x9, 0x30, 0x30, 0x30, 0x35, 0x39, 0x30, 0x30, 0x37, 0x37, 0x9, 0x41, 0xd, 0xa, 0x40, 0x41, 0x42, 0x46, 0x30, 0x20, 0x9, 0x20, 0x30, 0x30, 0x30, 0x39, 0x36, 0x31, 0x32, 0x33, 0x9, 0x3b, 0xd, 0xa, 0x45, 0x41, 0x53, 0x46, 0x30, 0x36, 0x0, 0x20, 0x20, 0x20, 0x22, 0x22, 0x39, 0x35, 0x33, 0x33, 0x9, 0x41, 0xd, 0xa, 0x41, 0x41, 0x53, 0x46, 0x30, 0x37, 0x9, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x20, 0x20, 0x20, 0x8, 0x28, 0xd, 0xa, 0x45, 0x41, 0x53, 0x46, 0x30, 0x38, 0x9, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x0, 0x0, 0xd, 0xa, 0x45, 0x41, 0x53, 0x46, 0x30, 0x39, 0x9, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x9, 0x2a, 0xd, 0xa, 0x40, 0x41, 0x43, 0x46, 0x31, 0x30, 0x9, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x9, 0x22, 0xd, 0xa, 0x44, 0x41, 0x52, 0x40, 0x20, 0x20, 0x9, 0x20, 0x20, 0x36, 0x33, 0x32, 0x32, 0x34, 0x38, 0x31, 0x9, 0x3a, 0xd, 0xa, 0x45, 0x41, 0x53, 0x44, 0x30, 0x32, 0x9, 0x30, 0x20, 0x22, 0x30, 0x22, 0x21, 0x38, 0x20, 0x37, 0x9, 0x35, 0xd, 0xa, 0x41, 0x41, 0x53, 0x44, 0x30, 0x33, 0x9, 0x30, 0x30, 0x31, 0x32, 0x35, 0x30, 0x26, 0x22, 0x36, 0x8, 0x40, 0x9, 0xa, 0x45, 0x41, 0x53, 0x44, 0x30, 0x30, 0x9, 0x30, 0x30, 0x33, 0x39, 0x38, 0x39, 0x37, 0x32, 0x32, 0x9, 0x42, 0x8, 0xa, 0x49, 0x52, 0x4d, 0x53, 0x31, 0x9, 0x30, 0x30, 0x33, 0x9, 0x31, 0xd, 0xa, 0x55, 0x52, 0x4d, 0x52, 0x30, 0x9, 0x22, 0x33, 0x26, 0x8, 0x1, 0xd, 0xa, 0x50, 0x52, 0x45, 0x46, 0x9, 0x30, 0x36, 0x9, 0x45, 0xd, 0xa, 0x40, 0x42, 0x4f, 0x55, 0x40, 0x9, 0x30, 0x36, 0x9, 0x5f, 0xd, 0xa, 0x53, 0x49, 0x4e, 0x53, 0x54, 0x53, 0x9, 0x30, 0x30, 0x37, 0x35, 0x30, 0x0, 0x52, 0xd, 0xa, 0x53, 0x4d, 0x41, 0x58, 0x53, 0x4e, 0x9, 0x45, 0x32, 0x34, 0x30, 0x36, 0x31, 0x35, 0x30, 0x31, 0x30, 0x32, 0x33, 0x30, 0x9, 0x30, 0x30, 0x36, 0x20, 0x38, 0x9, 0x38, 0x9, 0xa, 0x53, 0x4d, 0x41, 0x58, 0x53, 0x4e, 0x29, 0x31, 0x9, 0x45, 0x32, 0x34, 0x30, 0x36, 0x31, 0x34, 0x30, 0x30, 0x20, 0x20, 0x20, 0x26, 0x9, 0x20, 0x23, 0x32, 0x34, 0x34, 0x9, 0x57, 0xd, 0xa, 0x43, 0x43, 0x41, 0x53, 0x4e, 0x9, 0x45, 0x32, 0x34, 0x30, 0x36, 0x30, 0x35, 0x20, 0x33, 0x20, 0x20, 0x20, 0x30, 0x9, 0x30, 0x30, 0x32, 0x39, 0x36, 0x9, 0x3f, 0xd, 0xa, 0x43, 0x43, 0x41, 0x53, 0x4e, 0xc, 0x30, 0x9, 0x40, 0x32, 0x34, 0x30, 0x26, 0x21, 0x25, 0x31, 0x32, 0x33, 0x30, 0x30, 0x30, 0x9, 0x30, 0x30, 0x33, 0x32, 0x38, 0x9, 0x5b, 0xd, 0xa, 0x54, 0x48, 0x4e, 0x59, 0x20, 0x9, 0x40, 0x32, 0x24, 0x20, 0x36, 0x31, 0x35, 0x31, 0x33, 0x31, 0x30, 0x30, 0x30, 0x9, 0x32, 0x33, 0x38, 0x9, 0x2f, 0xd, 0xa, 0x52, 0x40, 0x47, 0x40, 0x9, 0x20, 0x21, 0x23, 0x41, 0x34, 0x34, 0x30, 0x31, 0x9, 0x43, 0xd, 0xa, 0x4d, 0x53, 0x47, 0x31, 0x9, 0x50, 0x40, 0x52, 0x0, 0x44, 0x40, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x4d, 0x45, 0x53, 0x53, 0x41, 0x47, 0x41, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x9, 0x3c, 0xc, 0xa, 0x40, 0x52, 0x4d, 0x9, 0x32, 0x34, 0x33, 0x38, 0x33, 0x32, 0x31, 0x32, 0x36, 0x36, 0x31, 0x34, 0x36, 0x31, 0x9, 0x36, 0xd, 0xa, 0x42, 0x45, 0x4c, 0x41, 0x49, 0x53, 0x9, 0x30, 0x30, 0x30, 0x9, 0x42, 0xd, 0xa, 0x4e, 0x50, 0x41, 0x42, 0x46, 0x9, 0x20, 0x22, 0x9, 0x4f, 0xd, 0xa, 0x4e, 0x4a, 0x4f, 0x55, 0x52, 0x46, 0x9, 0x30, 0x30, 0x9, 0x26, 0xd, 0xa, 0x4e, 0x48, 0x4f, 0x55, 0x52, 0x46, 0x2b, 0x31, 0x9, 0x30, 0x30, 0x9, 0x42, 0xd, 0xa, 0x50, 0x4a, 0x4f, 0x55, 0x52, 0x46, 0x2b, 0x30, 0x9, 0x20, 0x20, 0x20, 0x20, 0x24, 0x30, 0x30, 0x31, 0x20, 0x30, 0x36, 0x30, 0x30, 0x34, 0x30, 0x30, 0x32, 0x20, 0x32, 0x32, 0x30, 0x30, 0x34, 0x30, 0x30, 0x31, 0x20, 0x4e, 0x4e, 0x4e, 0x50, 0x40, 0x49, 0x4c, 0x45, 0x20, 0x4e, 0x4f, 0x4e, 0x55, 0x54, 0x49, 0x4c, 0x45, 0x20, 0x4e, 0x4f, 0x4e, 0x51, 0x50, 0x49, 0x4c, 0x45, 0x20, 0x4e, 0x4f, 0x4e, 0x55, 0x54, 0x49, 0x4c, 0x45, 0x20, 0x4e, 0x4e, 0x4e, 0x40, 0x0, 0x49, 0x4c, 0x45, 0x20, 0x4e, 0x4f, 0x4e, 0x55, 0x54, 0x49, 0x4c, 0x45, 0x20, 0x4e, 0x4f, 0x4e, 0x55, 0x54, 0x49, 0x4c, 0x45, 0x20, 0x4e, 0x4e, 0x4e, 0x50, 0x50, 0x49, 0x4c, 0x45, 0x9, 0x2c, 0xd, 0x0, 0x0, 0x2, 0xa, 0x40, 0x40, 0x52, 0x42, 0x9, 0x20, 0x22, 0x20, 0x20, 0x36, 0x31, 0x32, 0x33, 0x37, 0x33, 0x31, 0x39, 0x9, 0x32, 0xd, 0xa, 0x56, 0x54, 0x49, 0x43, 0x9, 0x30, 0x32, 0x9, 0x4a, 0xd, 0xa, 0x44, 0x41, 0x54, 0x45, 0x9, 0x45, 0x32, 0x34, 0x30, 0x36, 0x31, 0x35, 0x31, 0x33, 0x31, 0x39, 0x34, 0x33, 0x0, 0x0, 0x40, 0xd, 0xa, 0x4e, 0x47, 0x54, 0x46, 0x9, 0x20, 0x20, 0x20, 0x20, 0x20, 0x54, 0x45, 0x4d, 0x50, 0x4f, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x9, 0x46, 0xd, 0xa, 0x4c, 0x54, 0x41, 0x52, 0x46, 0x9, 0x20, 0x20, 0x20, 0x20, 0x48, 0x50, 0x20, 0x20, 0x42, 0x4c, 0x45, 0x55, 0x20, 0x20, 0x20, 0x20, 0x9, 0x2, 0x8, 0xa, 0x45, 0x41, 0x53, 0x54, 0x9, 0x30, 0x31, 0x33, 0x35, 0x39, 0x33, 0x36, 0x34, 0x35, 0x9, 0x33, 0xd, 0xa, 0x40, 0x41, 0x42, 0x46, 0x30, 0x21, 0x9, 0x30, 0x31, 0x30, 0x30, 0x39, 0x36, 0x38, 0x32, 0x37, 0x9, 0x43, 0xd, 0xa, 0x45, 0x41, 0x52, 0x46, 0x30, 0x22, 0x9, 0x20, 0x20, 0x22, 0x22, 0x27, 0x30, 0x37, 0x39, 0x33, 0x9, 0x41, 0xd, 0xa, 0x45, 0x41, 0x53, 0x46, 0x30, 0x33, 0x9, 0x30, 0x30, 0x30, 0x32, 0x30, 0x20, 0x22, 0x39, 0x20, 0x9, 0x33, 0xd, 0xa, 0x45, 0x41, 0x53, 0x46, 0x30, 0x34, 0x9, 0x30, 0x30, 0x30, 0x35, 0x39, 0x30, 0x30, 0x36, 0x37, 0x9, 0x40, 0x8, 0xa, 0x45, 0x41, 0x53, 0x46, 0x30, 0x35, 0x9, 0x30, 0x30, 0x30, 0x30, 0x39, 0x36, 0x31, 0x32, 0x33, 0x9, 0x3b, 0xd, 0xa, 0x41, 0x41, 0x53, 0x46, 0x30, 0x36, 0x9, 0x30, 0x30, 0x30, 0x33, 0x33, 0x39, 0x31, 0x33, 0x33, 0x9, 0x41, 0xd, 0xa, 0x40, 0x41, 0x42, 0x46, 0x30, 0x26, 0x9, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x9, 0x28, 0x9, 0xa, 0x45, 0x41, 0x52, 0x46, 0x30, 0x30, 0x9, 0x20, 0x20, 0x20, 0x20, 0x20, 0x30, 0x30, 0x30, 0x30, 0x9, 0x29, 0xd, 0xa, 0x45, 0x41, 0x53, 0x46, 0x30, 0x39, 0x9, 0x30, 0x30, 0x30, 0x30, 0x30, 0x20, 0x20, 0x20, 0x20, 0x8, 0x28, 0xd, 0xa, 0x45, 0x41, 0x53, 0x46, 0x31, 0x30, 0x9, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x0, 0x2, 0x8, 0xa, 0x45, 0x41, 0x53, 0x44, 0x30, 0x31, 0x9, 0x30, 0x30, 0x36, 0x33, 0x32, 0x32, 0x34, 0x38, 0x31, 0x9, 0x3a, 0xd, 0xa, 0x0, 0x41, 0x53, 0x44, 0x30, 0x32, 0x9, 0x30, 0x30, 0x32, 0x30, 0x32, 0x31, 0x38, 0x31, 0x36, 0x9, 0x35, 0xd, 0xa, 0x40, 0x41, 0x42, 0x40, 0x20, 0x22, 0x8, 0x20, 0x30, 0x31, 0x32, 0x35, 0x39, 0x36, 0x32, 0x36, 0x9, 0x41, 0xd, 0xa, 0x45, 0x41, 0x53, 0x44, 0x30, 0x30, 0x9, 0x20, 0x20, 0x22, 0x38, 0x38, 0x39, 0x37, 0x32, 0x32, 0x9, 0x4b, 0xd, 0xa, 0x49, 0x52, 0x4d, 0x53, 0x31, 0x9, 0x30, 0x30, 0x33, 0x0, 0x30, 0xd, 0xa, 0x55, 0x52, 0x4d, 0x53, 0x31, 0x9, 0x32, 0x33, 0x38, 0x9, 0x47, 0x9, 0xa, 0x50, 0x52, 0x45, 0x46, 0x9, 0x30, 0x26, 0x8, 0x40, 0xd, 0xa, 0x50, 0x43, 0x4f, 0x55, 0x50, 0x9, 0x30, 0x36, 0x9, 0x5f, 0xd, 0xa, 0x52, 0x40, 0x4e, 0x42, 0x40, 0x53, 0x8, 0x20, 0x30, 0x37, 0x34, 0x35, 0x9, 0x56, 0xd, 0xa, 0x53, 0x4d, 0x41, 0x58, 0x53, 0x4e, 0x9, 0x44, 0x32, 0x34, 0x30, 0x26, 0x20, 0x35, 0x20, 0x20, 0x20, 0x32, 0x33, 0x38, 0x9, 0x30, 0x34, 0x36, 0x31, 0x38, 0x9, 0x3d, 0xd, 0xa, 0x53, 0x4d, 0x41, 0x50, 0x53, 0x4e, 0x8, 0x20, 0x9, 0x40, 0x32, 0x20, 0x20, 0x36, 0x31, 0x34, 0x30, 0x30, 0x35, 0x35, 0x30, 0x37, 0x9, 0x30, 0x33, 0x32, 0x34, 0x34, 0x9, 0x57, 0xd, 0xa, 0x42, 0x43, 0x41, 0x42, 0x4e, 0x9, 0x45, 0x32, 0x34, 0x30, 0x36, 0x31, 0x35, 0x31, 0x33, 0x30, 0x30, 0x30, 0x30, 0x9, 0x30, 0x30, 0x32, 0x39, 0x36, 0x9, 0x3f, 0xd, 0xa, 0x42, 0x43, 0x41, 0x53, 0x4e, 0x2d, 0x31, 0x9, 0x45, 0x32, 0x34, 0x30, 0x36, 0x31, 0x35, 0x31, 0x32, 0x33, 0x30, 0x30, 0x30, 0x9, 0x30, 0x30, 0x33, 0x32, 0x38, 0x9, 0x52, 0xd, 0xa, 0x55, 0x4d, 0x4f, 0x59, 0x31, 0x9, 0x45, 0x32, 0x34, 0x30, 0x36, 0x31, 0x35, 0x31, 0x33, 0x31, 0x30, 0x30, 0x30, 0x0, 0x32, 0x33, 0x30, 0x9, 0xe, 0xd, 0xa, 0x53, 0x54, 0x47, 0x45, 0x9, 0x30, 0x31, 0x33, 0x41, 0x30, 0x34, 0x30, 0x31, 0x9, 0x43, 0xd, 0xa, 0x48, 0x42, 0x46, 0x21, 0x9, 0x50, 0x41, 0x53, 0x20, 0x44, 0x45, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x4d, 0x45, 0x53, 0x53, 0x41, 0x46, 0x44, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x9, 0x3c, 0xd, 0xa, 0x50, 0x52, 0x4d, 0x9, 0x32, 0x34, 0x33, 0x38, 0x33, 0x32, 0x31, 0x32, 0x36, 0x36, 0x30, 0x20, 0x36, 0x20, 0x9, 0x24, 0x9, 0xa, 0x52, 0x45, 0x4c, 0x41, 0x49, 0x53, 0x9, 0x30, 0x30, 0x30, 0x9, 0x42, 0xd, 0xa, 0x4e, 0x40, 0x41, 0x40, 0x46, 0x9, 0x30, 0x32, 0x9, 0x4f, 0xd, 0xa, 0x4e, 0x4a, 0x4f, 0x55, 0x52, 0x46, 0x9, 0x30, 0x30, 0x0, 0x6, 0xd, 0xa, 0x4e, 0x4a, 0x4f, 0x55, 0x52, 0x46, 0x2b, 0x31, 0x9, 0x30, 0x30, 0x9, 0x42, 0xd, 0xa, 0x50, 0x42, 0x4f, 0x55, 0x42, 0x46, 0x2b, 0x21, 0x9, 0x30, 0x30, 0x30, 0x30, 0x34, 0x30, 0x30, 0x31, 0x20, 0x30, 0x36, 0x30, 0x30, 0x34, 0x30, 0x30, 0x32, 0x20, 0x32, 0x32, 0x30, 0x30, 0x34, 0x30, 0x30, 0x20, 0x20, 0x4e, 0x4e, 0x4e, 0x1, 0x54, 0x49, 0x4c, 0x45, 0x20, 0x4e, 0x4f, 0x4e, 0x55, 0x54, 0x49, 0x4c, 0x45, 0x20, 0x4e, 0x4f, 0x4e, 0x55, 0x54, 0x49, 0x4c, 0x45, 0x20, 0x4e, 0x4e, 0x4e, 0x40, 0x40, 0x49, 0x4c, 0x45, 0x20, 0x4e, 0x4f, 0x4e, 0x55, 0x54, 0x49, 0x4c, 0x45, 0x20, 0x4e, 0x4f, 0x4e, 0x51, 0x50, 0x49, 0x4c, 0x45, 0x20, 0x4e, 0x4f, 0x4e, 0x55, 0x54, 0x49, 0x4c, 0x45, 0x20, 0x4e, 0x4e, 0x4e, 0x40, 0x0, 0x49, 0x4c, 0x45, 0x9, 0x2e, 0xd, 0x0, 0x0};
+// Historique frame from tramesLinky/HISTORIQUE Triphasé.txt (the checksum of OT is wrong in the capture)
+static const char linky_hist_debug_buffer[] = "\x02"
+                                              "\nADCO 031976306475 J\r"
+                                              "\nOPTARIF BASE 0\r"
+                                              "\nISOUSC 30 9\r"
+                                              "\nBASE 062105110 [\r"
+                                              "\nPTEC TH.. $\r"
+                                              "\nIINST1 000 H\r"
+                                              "\nIINST2 000 I\r"
+                                              "\nIINST3 002 L\r"
+                                              "\nIMAX1 060 6\r"
+                                              "\nIMAX2 060 7\r"
+                                              "\nIMAX3 060 8\r"
+                                              "\nPMAX 06082 6\r"
+                                              "\nPAPP 00540 *\r"
+                                              "\nHHPHC A ,\r"
+                                              "\nMOTDETAT 000000 B\r"
+                                              "\nOT 00 #\r"
+                                              "\x03";
 static esp_pm_lock_handle_t linky_pm_lock = NULL;
 
-static uint8_t linky_buffer[LINKY_BUFFER_SIZE] = {0}; // The UART buffer
-static uint8_t *linky_frame = linky_buffer;           // The received frame from the linky
+static uint8_t linky_buffer[LINKY_BUFFER_SIZE] = {0}; // Raw copy of the last frame decoded
+static linky_parser_t linky_uart_parser = {              // Only used by the decoder task
+    .raw = linky_buffer,
+};
+
+static linky_frame_buffer_t linky_frame_buffers[LINKY_FRAME_BUFFER_COUNT] = {0};
+static QueueHandle_t linky_frame_free_queue = NULL;  // Indexes of the buffers the UART task can fill
+static QueueHandle_t linky_frame_ready_queue = NULL; // Indexes of the complete frames, waiting for the decoder task
+static TaskHandle_t linky_decoder_task_handle = NULL;
+
+// Indexes of linky_label_list sorted by mode then label, built once by linky_build_label_index()
+static uint8_t linky_label_index[LINKY_LABEL_LIST_SIZE] = {0};
+static struct
+{
+    uint8_t start;
+    uint8_t count;
+} linky_label_index_range[ANY + 1] = {0}; // Part of linky_label_index for each mode
+static bool linky_label_index_ready = false;
+// Indexes of linky_label_list with a value in each mode (the labels of the mode then ANY, in list order), built with linky_label_index
+static uint8_t linky_mode_label_index[MODE_STD + 1][LINKY_LABEL_LIST_SIZE] = {0};
+static uint8_t linky_mode_label_count[MODE_STD + 1] = {0};
+#ifdef LINKY_BENCHMARK
+static bool linky_label_index_disabled = false; // Use a linear search
+#endif
+
+// Replay of a capture, see linky_replay_start()
+static linky_parser_t linky_replay_parser = {0};
+static linky_mode_t linky_replay_previous_mode = NONE;
+static linky_metrics_t linky_replay_saved_metrics = {0};
+
+// Hash of each value, to publish only the values changed since the last successful send
+#define LINKY_FULL_PUBLISH_INTERVAL (3600 * 1000) // Publish every value at least once per hour (ms)
+static uint32_t linky_value_hash[LINKY_LABEL_LIST_SIZE] = {0};     // Hash of the last computed values
+static uint32_t linky_published_hash[LINKY_LABEL_LIST_SIZE] = {0}; // Hash of the last published values
+static uint32_t linky_dirty[(LINKY_LABEL_LIST_SIZE + 31) / 32] = {0};
+static uint32_t linky_full_publish_time = 0; // MILLIS of the last full publish request
+static bool linky_full_publish_done = false;
+static uint64_t linky_published_value[LINKY_LABEL_LIST_SIZE] = {0}; // Numeric value of the last publish, UINT64_MAX if none (set by linky_clear_data)
+static uint32_t linky_published_time[LINKY_LABEL_LIST_SIZE] = {0};  // MILLIS of the last publish
+
+// Default publish policy of each class in the MQTT modes, max_age 0: LINKY_FULL_PUBLISH_INTERVAL or twice the refresh rate for real time values
+static const linky_publish_policy_t linky_class_policy[] = {
+    [POWER_VA] = {.deadband = 2, .relative = 1},
+    [POWER_W] = {.deadband = 2, .relative = 1},
+    [POWER_Q] = {.deadband = 2, .relative = 1},
+    [TENSION] = {.deadband = 2},
+};
 
-static raw_group_t raw_groups[GROUP_COUNT] = {0}; // store raw data of each group
 uint32_t linky_last_decode_count = 0;
 static uint32_t linky_same_feilds_count = 0;
 
 uint32_t linky_decode_checksum_error = 0;
 uint32_t linky_last_group_count = 0;
 
+static EventGroupHandle_t linky_event_group = NULL;
+static uint32_t linky_read_start = 0;         // MILLIS when the current reading started
+uint32_t linky_first_frame_time = UINT32_MAX; // Time to receive the first valid frame of the last reading (ms)
+uint32_t linky_read_time = 0;                 // Duration of the last reading (ms)
+linky_metrics_t linky_metrics = {0};          // Counters since the boot or the last linky_metrics_reset
+
 static QueueHandle_t linky_uart_queue;
 static TaskHandle_t linky_uart_task_handle = NULL;
-static bool uart_error = false;
+static uint16_t linky_label_checksum_errors[LINKY_LABEL_LIST_SIZE] = {0}; // Wrong checksums per label since the metrics reset
+
+static linky_sniff_t linky_sniff = {0}; // Written by the UART task while linky_sniffing is set
+static bool linky_sniffing = false;
 
 /*==============================================================================
 Function Implementation
@@ -434,58 +604,86 @@ static void uart_event_task(void *pvParameters)
 
         if (xQueueReceive(linky_uart_queue, (void *)&event, (TickType_t)portMAX_DELAY))
         {
+            linky_metrics.uart_wakeups++;
             // esp_rom_printf("event type: %d\n", event.type);
             switch (event.type)
             {
             // Event of UART receving data
-            /*We'd better handler data event fast, there would be much more data events than
-            other types of events. If we take too much time on data event, the queue might
-            be full.*/
             case UART_DATA:
-                uint32_t free_space = (LINKY_BUFFER_SIZE - 1) - linky_frame_size;
-                uint32_t to_read = (free_space > event.size) ? event.size : free_space;
-                uart_read_bytes(LINKY_UART, linky_buffer + linky_frame_size, to_read, 500 / portTICK_PERIOD_MS);
-                linky_frame_size += to_read;
-                // esp_rom_printf("add %ld:\n%s\n", to_read, linky_buffer + linky_frame_size - to_read);
-                if (linky_frame_size >= LINKY_DECODE_LEN)
+                linky_metrics.uart_data_events++;
+                if (linky_sniffing)
+                {
+                    // mode detection: the bytes are scored as they arrive, no frame is captured
+                    uint8_t chunk[LINKY_CHUNK_SIZE];
+                    int read = uart_read_bytes(LINKY_UART, chunk, MIN(event.size, sizeof(chunk)), 0);
+                    if (read > 0)
+                    {
+                        linky_metrics.bytes += read;
+                        linky_sniff_feed(&linky_sniff, chunk, read);
+                    }
+                    if (linky_sniff.valid_groups >= LINKY_SNIFF_VALID_GROUPS)
+                    {
+                        xEventGroupSetBits(linky_event_group, LINKY_SNIFF_DONE_BIT);
+                    }
+                }
+                // otherwise nothing to do: the bytes stay in the driver buffer until END_OF_FRAME is detected
+                break;
+            // Event of END_OF_FRAME detected
+            case UART_PATTERN_DET:
+            {
+                int position = uart_pattern_pop_pos(LINKY_UART);
+                if (position < 0)
+                {
+                    // the pattern position queue was full: the frames in the buffer can't be delimited
+                    ESP_LOGW(TAG, "pattern queue full");
+                    linky_metrics.uart_pattern_overflow++;
+                    linky_uart_flush();
+                    uart_pattern_queue_reset(LINKY_UART, LINKY_PATTERN_QUEUE_SIZE);
+                    break;
+                }
+                if (linky_sniffing)
                 {
-                    ESP_LOGD(TAG, "Buffer full: force decoding");
-                    linky_decode();
-                    // linky_frame_size = 0; // clear the frame size
+                    break; // the bytes are read by UART_DATA
                 }
+                linky_metrics.frames_received++;
+                linky_capture_frame(position + 1); // the frame and its END_OF_FRAME, in a single read
                 break;
+            }
             // Event of HW FIFO overflow detected
             case UART_FIFO_OVF:
                 ESP_LOGW(TAG, "hw fifo overflow");
+                linky_metrics.uart_fifo_overflow++;
                 // If fifo overflow happened, you should consider adding flow control for your application.
                 // The ISR has already reset the rx FIFO,
                 // As an example, we directly flush the rx buffer here in order to read more data.
-                uart_flush_input(LINKY_UART);
+                linky_uart_flush();
                 xQueueReset(linky_uart_queue);
                 break;
             // Event of UART ring buffer full
             case UART_BUFFER_FULL:
                 ESP_LOGW(TAG, "ring buffer full");
+                linky_metrics.uart_buffer_full++;
                 // If buffer full happened, you should consider increasing your buffer size
                 // As an example, we directly flush the rx buffer here in order to read more data.
-                uart_flush_input(LINKY_UART);
+                linky_uart_flush();
                 xQueueReset(linky_uart_queue);
                 break;
             // Event of UART RX break detected
             case UART_BREAK:
                 // ESP_LOGW(TAG, "uart rx break");
-                uart_error = true;
+                linky_metrics.uart_break++;
                 break;
             // Event of UART parity check error
             case UART_PARITY_ERR:
                 // ESP_LOGW(TAG, "uart parity error");
-                uart_error = true;
-
+                linky_metrics.uart_parity++;
+                linky_sniff.errors += linky_sniffing;
                 break;
             // Event of UART frame error
             case UART_FRAME_ERR:
                 // ESP_LOGW(TAG, "uart frame error");
-                uart_error = true;
+                linky_metrics.uart_frame++;
+                linky_sniff.errors += linky_sniffing; // a wrong baud rate gives frame errors
                 break;
             default:
                 ESP_LOGW(TAG, "uart event type: %d", event.type);
@@ -497,6 +695,163 @@ static void uart_event_task(void *pvParameters)
     vTaskDelete(NULL);
 }
 
+/**
+ * @brief Configure the RX interrupts of the UART
+ *
+ * The RX FIFO must still be drained before it is full, but out of a mode detection the bytes are only read
+ * at END_OF_FRAME: the timeout interrupt is disabled (the pattern interrupt drains the FIFO) and the FIFO
+ * full interrupt comes as late as possible, so each frame gives as few UART_DATA events as possible.
+ *
+ * @param sniffing true during a mode detection: the bytes are read as they arrive
+ */
+static void linky_uart_rx_interrupts(bool sniffing)
+{
+    uart_intr_config_t intr_config = {
+        .intr_enable_mask = UART_RXFIFO_FULL_INT_ENA_M | UART_RXFIFO_OVF_INT_ENA_M | UART_BRK_DET_INT_ENA_M | UART_PARITY_ERR_INT_ENA_M | UART_FRM_ERR_INT_ENA_M,
+        .rxfifo_full_thresh = sniffing ? LINKY_SNIFF_FULL_THRESH : LINKY_RX_FULL_THRESH,
+        .rx_timeout_thresh = LINKY_SNIFF_TIMEOUT,
+    };
+    if (sniffing)
+    {
+        intr_config.intr_enable_mask |= UART_RXFIFO_TOUT_INT_ENA_M;
+    }
+    else
+    {
+        uart_disable_intr_mask(LINKY_UART, UART_RXFIFO_TOUT_INT_ENA_M);
+    }
+    esp_err_t ret = uart_intr_config(LINKY_UART, &intr_config);
+    if (ret != ESP_OK)
+    {
+        ESP_LOGE(TAG, "uart_intr_config failed: %s", esp_err_to_name(ret));
+    }
+}
+
+/**
+ * @brief Flush the UART driver buffer, and configure the RX interrupts again
+ *
+ * uart_flush_input() enables the default RX interrupts again: the FIFO timeout interrupt would give an
+ * UART_DATA event for each chunk of bytes received.
+ */
+static void linky_uart_flush()
+{
+    uart_flush_input(LINKY_UART);
+    linky_uart_rx_interrupts(linky_sniffing);
+}
+
+/**
+ * @brief Drop bytes from the UART driver buffer
+ *
+ * @param size the number of bytes to drop
+ */
+static void linky_uart_discard(uint32_t size)
+{
+    uint8_t chunk[LINKY_CHUNK_SIZE];
+    while (size > 0)
+    {
+        int read = uart_read_bytes(LINKY_UART, chunk, MIN(size, sizeof(chunk)), 100 / portTICK_PERIOD_MS);
+        if (read <= 0)
+        {
+            break;
+        }
+        linky_metrics.bytes += read;
+        size -= read;
+    }
+}
+
+/**
+ * @brief Read a frame from the UART driver buffer to a free frame buffer, without decoding it
+ * The frame is handed to the decoder task through linky_frame_ready_queue
+ *
+ * @param size the number of bytes in the driver buffer up to END_OF_FRAME included
+ */
+static void linky_capture_frame(uint32_t size)
+{
+    int8_t index;
+    if (xQueueReceive(linky_frame_free_queue, &index, 0) != pdTRUE)
+    {
+        // the decoder task still owns every buffer: skip this frame
+        linky_metrics.frames_dropped++;
+        linky_uart_discard(size);
+        return;
+    }
+
+    linky_frame_buffer_t *buffer = &linky_frame_buffers[index];
+    if (size > LINKY_FRAME_SIZE)
+    {
+        // garbage or lost END_OF_FRAME before the frame: keep only the end
+        linky_uart_discard(size - LINKY_FRAME_SIZE);
+        size = LINKY_FRAME_SIZE;
+    }
+    int read = uart_read_bytes(LINKY_UART, buffer->data, size, 100 / portTICK_PERIOD_MS);
+    linky_metrics.bytes += MAX(read, 0);
+    if (read > 0)
+    {
+        capture_add(buffer->data, read, linky_mode); // raw bytes, before any check
+    }
+
+    // the bytes before START_OF_FRAME are the end of a frame which started before a flush
+    const uint8_t *start = read > 0 ? memchr(buffer->data, START_OF_FRAME, read) : NULL;
+    if (start == NULL)
+    {
+        xQueueSend(linky_frame_free_queue, &index, 0);
+        return;
+    }
+    buffer->size = buffer->data + read - start;
+    memmove(buffer->data, start, buffer->size);
+    buffer->mode = linky_mode;
+    xQueueSend(linky_frame_ready_queue, &index, 0); // never full: it can hold every buffer
+}
+
+/**
+ * @brief Decode the frames received by the UART task
+ * linky_data is only written by this task, and only while a reading is in progress
+ */
+static void linky_decoder_task(void *pvParameters)
+{
+    int8_t index;
+    for (;;)
+    {
+        xEventGroupSetBits(linky_event_group, LINKY_DECODER_IDLE_BIT);
+        if (xQueueReceive(linky_frame_ready_queue, &index, portMAX_DELAY) != pdTRUE)
+        {
+            continue;
+        }
+        // clear the bit before checking linky_reading, see linky_decoder_pause
+        xEventGroupClearBits(linky_event_group, LINKY_DECODER_IDLE_BIT);
+
+        linky_frame_buffer_t *buffer = &linky_frame_buffers[index];
+        if (linky_reading && buffer->mode == linky_mode) // frames received at the previous baud rate are garbage
+        {
+            int64_t start = esp_timer_get_time();
+            linky_parser_feed(&linky_uart_parser, buffer->data, buffer->size);
+            uint32_t time = esp_timer_get_time() - start;
+            // buckets of 250 us doubling each time, the last one counts the longer frames
+            uint32_t bucket = 0;
+            while (bucket < LINKY_METRICS_DECODE_BUCKETS - 1 && time >= (250U << bucket))
+            {
+                bucket++;
+            }
+            linky_metrics.decode_time[bucket]++;
+            linky_metrics.decode_time_max = MAX(linky_metrics.decode_time_max, time);
+        }
+        xQueueSend(linky_frame_free_queue, &index, 0);
+    }
+    vTaskDelete(NULL);
+}
+
+/**
+ * @brief Stop the decoding of the received frames and wait for the decoder task to release linky_data
+ * The frames received after this call are dropped until linky_reading is set again
+ */
+static void linky_decoder_pause()
+{
+    linky_reading = 0;
+    if (linky_event_group != NULL && linky_decoder_task_handle != NULL)
+    {
+        xEventGroupWaitBits(linky_event_group, LINKY_DECODER_IDLE_BIT, pdFALSE, pdTRUE, 1000 / portTICK_PERIOD_MS);
+    }
+}
+
 /**
  * @brief Linky init function
  *
@@ -507,6 +862,9 @@ void linky_init(int RX)
 {
     linky_uart_rx = RX;
     esp_log_level_set(TAG, ESP_LOG_DEBUG);
+    linky_build_label_index();
+    ESP_LOGI(TAG, "linky_data_t: %zu bytes (historique %zu, standard %zu, saved %zu by the union)", sizeof(linky_data_t), sizeof(linky_data_hist), sizeof(linky_data_std),
+             MIN(sizeof(linky_data_hist), sizeof(linky_data_std)));
 
     switch (config_values.linky_mode)
     {
@@ -531,6 +889,21 @@ void linky_init(int RX)
         break;
     }
 
+    if (linky_event_group == NULL)
+    {
+        linky_event_group = xEventGroupCreate();
+    }
+
+    if (linky_frame_free_queue == NULL)
+    {
+        linky_frame_free_queue = xQueueCreate(LINKY_FRAME_BUFFER_COUNT, sizeof(int8_t));
+        linky_frame_ready_queue = xQueueCreate(LINKY_FRAME_BUFFER_COUNT, sizeof(int8_t));
+        for (int8_t i = 0; i < LINKY_FRAME_BUFFER_COUNT; i++)
+        {
+            xQueueSend(linky_frame_free_queue, &i, 0);
+        }
+    }
+
     if (linky_pm_lock == NULL)
     {
         esp_err_t err = esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "linky", &linky_pm_lock);
@@ -542,6 +915,10 @@ void linky_init(int RX)
 
     linky_clear_data();
 
+    if (linky_decoder_task_handle == NULL)
+    {
+        xTaskCreate(linky_decoder_task, "linky_decoder_task", 4 * 1024, NULL, 11, &linky_decoder_task_handle);
+    }
     if (linky_uart_task_handle == NULL)
     {
         xTaskCreate(uart_event_task, "uart_event_task", 8 * 1024, NULL, 12, &linky_uart_task_handle);
@@ -562,6 +939,19 @@ void linky_stop()
         vTaskDelete(linky_uart_task_handle);
         linky_uart_task_handle = NULL;
     }
+    if (linky_decoder_task_handle != NULL)
+    {
+        vTaskDelete(linky_decoder_task_handle);
+        linky_decoder_task_handle = NULL;
+    }
+    if (linky_frame_free_queue != NULL)
+    {
+        // the UART task may have been deleted while it owned a buffer: recreated by linky_init
+        vQueueDelete(linky_frame_free_queue);
+        vQueueDelete(linky_frame_ready_queue);
+        linky_frame_free_queue = NULL;
+        linky_frame_ready_queue = NULL;
+    }
     if (linky_uart_queue != NULL)
     {
         vQueueDelete(linky_uart_queue);
@@ -572,8 +962,6 @@ void linky_stop()
 
 void linky_set_mode(linky_mode_t newMode)
 {
-    linky_data_t empty;
-    memset(&empty, 0, sizeof empty);
     if (newMode > MODE_STD)
     {
         newMode = MODE_HIST;
@@ -588,19 +976,12 @@ void linky_set_mode(linky_mode_t newMode)
     }
 
     linky_mode = newMode;
-    switch (newMode)
-    {
-    case MODE_HIST:
-        linky_data.hist = empty.hist;
-        break;
-    case MODE_STD:
-        linky_data.std = empty.std;
-        break;
-    default:
-        break;
-    }
+    linky_data.mode = newMode;
+    linky_clear_data(); // the union still holds the values of the old mode
     ESP_LOGI(TAG, "Changed mode to %s", linky_str_mode[linky_mode]);
     linky_last_group_count = 0;
+    linky_set_dirty(); // the labels of the new mode were never published
+    linky_parser_reset(&linky_uart_parser); // the frames received at the old baud rate are dropped by the decoder task
 
     uint32_t baud_rate;
 
@@ -656,6 +1037,20 @@ void linky_set_mode(linky_mode_t newMode)
             return;
         }
         // ESP_LOGD(TAG, "UART set up at %ld bauds", baud_rate);
+        // wake up the UART task once per frame, instead of each time the RX FIFO is read
+        ret = uart_enable_pattern_det_baud_intr(LINKY_UART, END_OF_FRAME, 1, 9, 0, 0);
+        if (ret != ESP_OK)
+        {
+            ESP_LOGE(TAG, "uart_enable_pattern_det_baud_intr failed: %s", esp_err_to_name(ret));
+            return;
+        }
+        ret = uart_pattern_queue_reset(LINKY_UART, LINKY_PATTERN_QUEUE_SIZE);
+        if (ret != ESP_OK)
+        {
+            ESP_LOGE(TAG, "uart_pattern_queue_reset failed: %s", esp_err_to_name(ret));
+            return;
+        }
+        linky_uart_rx_interrupts(false);
         ret = uart_set_wakeup_threshold(LINKY_UART, 8);
         if (ret != ESP_OK)
         {
@@ -677,232 +1072,402 @@ void linky_set_mode(linky_mode_t newMode)
             ESP_LOGE(TAG, "uart_set_baudrate failed: %s", esp_err_to_name(ret));
             return;
         }
-        ESP_LOGD(TAG, "UART already set up: baudrate set to %ld", baud_rate);
+        linky_uart_flush(); // the bytes received at the old baud rate are garbage
+        ESP_LOGD(TAG, "UART already set up: baudrate set to %" PRIu32, baud_rate);
     }
 
     linky_clear_data();
 }
 
 /**
- * @brief Decode the data from the buffer and store it in variables
+ * @brief Reset the parser state, the partially received group is dropped
  *
- * @return 0 if an error occured, 1 if the data is valid
+ * @param parser the parser to reset
  */
-static char linky_decode()
+static void linky_parser_reset(linky_parser_t *parser)
 {
-    //----------------------------------------------------------
-    // Clear the previous data
-    //----------------------------------------------------------
-
-#ifndef PRODUCTION
-    linky_create_debug_frame(linky_debug);
-#endif
-
-    ESP_LOGD(TAG, "Decoding frame... size: %lu", linky_frame_size);
+    parser->state = PARSER_WAIT_GROUP;
+    parser->group_size = 0;
+    parser->raw_size = 0;
+    parser->in_frame = false;
+}
 
-    // ESP_LOGI(TAG, "Uart error: %d", uart_error);
-    // linky_print_debug_frame();
-    if (linky_frame == NULL) // if no frame found
+/**
+ * @brief Called at each END_OF_FRAME: signal the end of the reading when
+ * a frame was received without error, or when the fields count is stable
+ * during LINKY_SAME_FEILDS_COUNT frames (some groups can be corrupted on a noisy line)
+ *
+ * @param parser the parser which received the frame
+ */
+static void linky_frame_end(linky_parser_t *parser)
+{
+    bool complete = false;
+    bool received = (parser == &linky_uart_parser); // the benchmark uses its own parser
+    linky_metrics.frames_decoded += received;
+    if (parser->frame_groups > 0 && parser->frame_errors == 0)
     {
-        ESP_LOGE(TAG, "No frame to decode");
-        return 0; // exit the function
+        complete = true;
+        parser->frames_valid++;
+        linky_metrics.frames_valid += received;
     }
-
-    // ESP_LOG_BUFFER_HEXDUMP(TAG, frame, endOfFrame - startOfFrame, ESP_LOG_INFO);
-    //-------------------------------------
-    // Second step: Find goups of data in the frame
-    //-------------------------------------
-    // unsigned int startOfGroup[GROUP_COUNT] = {UINT_MAX}; // store starts index of each group
-    // unsigned int endOfGroup[GROUP_COUNT] = {UINT_MAX};   // store ends index of each group
-
-    memset(raw_groups, 0, sizeof raw_groups);
-
-    uint32_t current_group_index = 0; // store the current index of the group
-
-    bool start_found = false;
-    for (unsigned int i = 0; i < linky_frame_size + 1; i++) // for each character in the frame
+    else
     {
-        switch (linky_frame[i])
+        uint32_t count = linky_count_fields();
+        if (count > 0 && count == linky_last_decode_count)
         {
-        case START_OF_GROUP: // if the character is a start of group
-            // ESP_LOGI(TAG, "START OF GROUP: %u (%x) --> startOfGroupIndex: %u", i, frame[i], startOfGroupIndex);
-            // startOfGroup[startOfGroupIndex++] = i; // store the index and increment it
-            raw_groups[current_group_index].start = linky_frame + i;
-            start_found = true;
-            break;         //
-        case END_OF_GROUP: // if the character is a end of group
-            // ESP_LOGI(TAG, "END OF GROUP: %u (%x) --> endOfGroupIndex: %u", i, frame[i], endOfGroupIndex);
-            // endOfGroup[endOfGroupIndex++] = i; // store the index and increment it
-            if (!start_found)
-            {
-                continue;
-            }
-            raw_groups[current_group_index].end = linky_frame + i;
-            current_group_index++;
-            start_found = false;
-            if (current_group_index >= GROUP_COUNT)
-            {
-                ESP_LOGE(TAG, "Too many groups: %ld, ingore the rest", current_group_index);
-                i = linky_frame_size; // exit the loop
-            }
-            break;
-        default:
-            break;
+            linky_same_feilds_count++;
+            ESP_LOGD(TAG, "Same fields count %" PRIu32 " times", linky_same_feilds_count);
+        }
+        else
+        {
+            linky_same_feilds_count = 0;
         }
+        linky_last_decode_count = count;
+        complete = linky_same_feilds_count + 1 >= LINKY_SAME_FEILDS_COUNT;
     }
 
-    if (current_group_index == 0 && linky_last_group_count == 0)
+    if (!complete)
     {
-        ESP_LOGI(TAG, "No group found");
-        linky_frame_size = 0;
-        return linky_handle_auto_check();
-        // exit the function (no group found)
+        return;
     }
+    if (linky_reading && linky_first_frame_time == UINT32_MAX)
+    {
+        linky_first_frame_time = MILLIS - linky_read_start;
+        linky_metrics.first_frame_time = linky_first_frame_time;
+        linky_metrics.first_frame_time_max = MAX(linky_metrics.first_frame_time_max, linky_first_frame_time);
+    }
+    if (linky_event_group != NULL)
+    {
+        xEventGroupSetBits(linky_event_group, LINKY_FRAME_COMPLETE_BIT);
+    }
+}
 
-    // ESP_LOGI(TAG, "Found %ld groups", current_group_index);
-    linky_last_group_count = current_group_index;
-
-    //------------------------------------------
-    // Third step: Find fields in each group
-    //------------------------------------------
-    for (raw_group_t *group = raw_groups; group < raw_groups + current_group_index; group++) // for each group
+/**
+ * @brief Feed received bytes to the parser
+ * Each group is decoded once, as soon as its END_OF_GROUP is received, so the cost is O(bytes)
+ *
+ * @param parser the parser to use
+ * @param data the received bytes
+ * @param size the number of bytes
+ */
+static void linky_parser_feed(linky_parser_t *parser, const uint8_t *data, uint32_t size)
+{
+    for (const uint8_t *c = data; c < data + size; c++)
     {
-        if (group->start == NULL || group->end == NULL)
+        if (parser->raw != NULL)
         {
-            ESP_LOGE(TAG, "Group: %p start or end is NULL", group);
-            continue;
+            if (*c == START_OF_FRAME)
+            {
+                parser->raw_size = 0;
+            }
+            if (parser->raw_size < LINKY_BUFFER_SIZE)
+            {
+                parser->raw[parser->raw_size++] = *c;
+            }
         }
 
-        uint8_t *separators[SEPARATOR_COUNT] = {0}; // store the index of the separators
-        uint8_t separator_count = 0;                // store the number of separators
-
-        for (uint8_t *j = group->start; j < group->end; j++) // for each character in group
+        switch (*c)
         {
-            if (*j == linky_group_separator) // if the character is a separator
+        case START_OF_FRAME:
+            parser->state = PARSER_WAIT_GROUP;
+            parser->in_frame = true;
+            parser->frame_groups = 0;
+            parser->frame_errors = 0;
+            break;
+        case END_OF_FRAME:
+            parser->state = PARSER_WAIT_GROUP;
+            parser->frames++;
+            if (parser->in_frame)
+            {
+                linky_frame_end(parser);
+            }
+            parser->in_frame = false;
+            break;
+        case START_OF_GROUP:
+            parser->state = PARSER_IN_GROUP;
+            parser->group_size = 0;
+            break;
+        case END_OF_GROUP:
+            if (parser->state == PARSER_IN_GROUP)
             {
-                separators[separator_count++] = j; // store the index of the separator
-                if (separator_count >= SEPARATOR_COUNT)
+                if (linky_decode_group(parser->group, parser->group_size))
                 {
-                    // ESP_LOGE(TAG, "Too many separators: %d, skip next", separator_count);
-                    break;
+                    parser->frame_groups++;
                 }
-                // ESP_LOGD(TAG, "Group: %p Add separator: %p", group, j);
+                else
+                {
+                    parser->frame_errors++;
+                }
+                parser->groups++;
             }
+            parser->state = PARSER_WAIT_GROUP;
+            break;
+        default:
+            if (parser->state != PARSER_IN_GROUP)
+            {
+                break;
+            }
+            if (parser->group_size >= sizeof(parser->group))
+            {
+                // group too long: missing END_OF_GROUP, drop it
+                parser->state = PARSER_WAIT_GROUP;
+                break;
+            }
+            parser->group[parser->group_size++] = *c;
+            break;
         }
+    }
+}
 
-        if (separator_count < 2 || separator_count > 3)
-        {
-            // ESP_LOGE(TAG, "Group: %p Separator count error: %d: skip", group, separator_count);
-            continue;
-        }
-
-        char label[20] = {0};   // store the label as a string
-        char value[100] = {0};  // store the data as a string
-        char time[20] = {0};    // store the time as a string (H081225223518)
-        char checksum[5] = {0}; // store the checksum as a string
+/**
+ * @brief Decode one group and store its value in linky_data
+ *
+ * @param group the bytes of the group, without START_OF_GROUP and END_OF_GROUP
+ * @param size the number of bytes in the group
+ * @return 1 if the group is valid, 0 otherwise
+ */
+static char linky_decode_group(const uint8_t *group, uint32_t size)
+{
+    linky_last_group_count++;
+    linky_metrics.groups++;
 
-        memcpy(label, group->start + 1, separators[0] - group->start - 1); // copy the label from the group
-        if (linky_mode == MODE_STD && separator_count == 3)                // if the mode is standard and the number of separators is 3
-        {
-            memcpy(time, separators[0] + 1, separators[1] - separators[0] - 1);  // copy the time from the group
-            memcpy(value, separators[1] + 1, separators[2] - separators[1] - 1); // copy the data from the group
-            memcpy(checksum, separators[2] + 1, group->end - separators[2] - 1); // copy the checksum from the group
-        }
-        else
-        {
-            memcpy(value, separators[0] + 1, separators[1] - separators[0] - 1); // copy the data from the group
-            memcpy(checksum, separators[1] + 1, group->end - separators[1] - 1); // copy the checksum from the group
-        }
-        // ESP_LOGI(TAG, "label: %s value: %s checksum: %s", label, value, checksum);
+    linky_tokens_t tokens;
+    if (!linky_tokenize_group(group, size, &tokens))
+    {
+        return 0;
+    }
 
-        if (linky_checksum(label, value, time) != checksum[0]) // check the checksum with the label, data and time
+    if (tokens.computed != tokens.checksum) // only convert the groups with a correct checksum
+    {
+        // error: checksum is not correct, skip the field
+        linky_decode_checksum_error++;
+        linky_metrics.checksum_errors++;
+        int32_t index = linky_get_label_index((const char *)tokens.label.data, tokens.label.size, linky_mode);
+        if (index >= 0)
         {
-            // error: checksum is not correct, skip the field
-            linky_decode_checksum_error++;
-            // ESP_LOGE(TAG, "%s = %s: checksum is not correct: %s, expected: %c", label, value, checksum, linky_checksum(label, value, time));
-            continue;
+            linky_label_checksum_errors[index]++;
         }
         else
         {
-            //------------------------------------------------------------
-            // Fourth step: Copy values from each field to the variables
-            //------------------------------------------------------------
-            for (uint32_t j = 0; j < linky_label_list_size; j++)
-            {
-                if (linky_mode != linky_label_list[j].mode)
-                    continue;
-                if (strcmp(linky_label_list[j].label, label) == 0)
-                {
-                    // ESP_LOGI(TAG, "Found label: %s value: %s", label, value);
-                    switch (linky_label_list[j].type)
-                    {
-                    case STRING:
-                    {
-                        uint32_t size = strlen(value);
-                        if (size > linky_label_list[j].size)
-                        {
-                            size = linky_label_list[j].size;
-                        }
-                        strncpy((char *)linky_label_list[j].data, value, size);
-                        ((char *)linky_label_list[j].data)[size] = 0;
-                        break;
-                    }
-
-                    case UINT8:
-                        *(uint8_t *)linky_label_list[j].data = strtoul(value, NULL, 10);
-                        break;
-                    case UINT16:
-                        *(uint16_t *)linky_label_list[j].data = strtoul(value, NULL, 10);
-                        break;
-                    case UINT32:
-                        *(uint32_t *)linky_label_list[j].data = strtoul(value, NULL, 10);
-                        break;
-                    case UINT64:
-                        *(uint64_t *)linky_label_list[j].data = strtoull(value, NULL, 10);
-                        break;
-                    case UINT32_TIME:
-                    {
-                        time_label_t timeLabel = {0};
-                        timeLabel.time = linky_decode_time(time);
-                        timeLabel.value = strtoull(value, NULL, 10);
-                        *(time_label_t *)linky_label_list[j].data = timeLabel;
-                        break;
-                    }
-                    default:
-                        break;
-                    }
-                }
-            }
+            linky_metrics.checksum_unknown_label++; // the label itself is corrupted
         }
+        // ESP_LOGE(TAG, "%.*s = %.*s: checksum is not correct: %c, expected: %c", tokens.label.size, tokens.label.data, tokens.value.size, tokens.value.data, tokens.checksum, tokens.computed);
+        return 0;
     }
 
-    raw_group_t last_group = raw_groups[current_group_index - 1];
-    if (last_group.start != NULL && last_group.end != NULL)
+    //------------------------------------------------------------
+    // Copy values from the field to the variables
+    //------------------------------------------------------------
+    int32_t j = linky_get_label_index((const char *)tokens.label.data, tokens.label.size, linky_mode);
+    if (j < 0)
     {
-        // copy data after the last group to the beginning of the buffer
-        uint32_t remaining_size = linky_frame_size - (last_group.end - linky_frame);
-        if (remaining_size > 0)
-        {
-            ESP_LOGD(TAG, "Recopy remaining data: %ld bytes", remaining_size);
-            memcpy(linky_frame, last_group.end, remaining_size);
-            linky_frame_size = remaining_size;
-        }
-        else
+        return 1; // valid group, but the label is not stored
+    }
+    // ESP_LOGI(TAG, "Found label: %.*s value: %.*s", tokens.label.size, tokens.label.data, tokens.value.size, tokens.value.data);
+    switch (linky_label_list[j].type)
+    {
+    case STRING:
+    {
+        uint32_t size = tokens.value.size;
+        if (size > linky_label_list[j].size)
         {
-            linky_frame_size = 0;
+            size = linky_label_list[j].size;
         }
+        memcpy(linky_label_list[j].data, tokens.value.data, size);
+        ((char *)linky_label_list[j].data)[size] = 0;
+        break;
     }
 
-    // count the number of fields found
-    uint32_t linky_decode_count = 0;
-    for (uint32_t j = 0; j < linky_label_list_size; j++)
+    case UINT8:
+    case UINT16:
+    case UINT32:
+    case UINT64:
+    case UINT32_TIME:
     {
-        if (linky_mode != linky_label_list[j].mode)
-            continue;
-        if (linky_label_list[j].data == NULL)
+        uint64_t value = 0;
+        if (!linky_span_to_uint(&tokens.value, &value))
         {
-            continue;
+            // the checksum only covers 6 bits per byte: drop a value with a corrupted digit
+            linky_metrics.value_errors++;
+            ESP_LOGD(TAG, "%.*s: invalid value %.*s", (int)tokens.label.size, tokens.label.data, (int)tokens.value.size, tokens.value.data);
+            return 0;
+        }
+        switch (linky_label_list[j].type)
+        {
+        case UINT8:
+            *(uint8_t *)linky_label_list[j].data = value;
+            break;
+        case UINT16:
+            *(uint16_t *)linky_label_list[j].data = value;
+            break;
+        case UINT32:
+            *(uint32_t *)linky_label_list[j].data = value;
+            break;
+        case UINT64:
+            *(uint64_t *)linky_label_list[j].data = value;
+            break;
+        default: // UINT32_TIME
+        {
+            time_label_t timeLabel = {0};
+            timeLabel.time = linky_decode_time(&tokens.time);
+            timeLabel.value = value;
+            *(time_label_t *)linky_label_list[j].data = timeLabel;
+            break;
+        }
+        }
+        break;
+    }
+    default:
+        break;
+    }
+    return 1;
+}
+
+/**
+ * @brief Split a group into spans and compute its checksum in the same pass
+ * HIST: LABEL SP VALUE SP CHECKSUM, the checksum covers LABEL SP VALUE
+ * STD: LABEL HT [TIME HT] VALUE HT CHECKSUM, the checksum covers everything before CHECKSUM
+ *
+ * @param group the bytes of the group, without START_OF_GROUP and END_OF_GROUP
+ * @param size the number of bytes in the group
+ * @param tokens the spans of the group, pointing into group
+ * @return 1 if the group is well formed, 0 otherwise
+ */
+static char linky_tokenize_group(const uint8_t *group, uint32_t size, linky_tokens_t *tokens)
+{
+    uint32_t separators[SEPARATOR_COUNT]; // position of the separators
+    uint32_t sums[SEPARATOR_COUNT];       // sum of the bytes before each separator
+    uint8_t separator_count = 0;
+    uint32_t sum = 0;
+
+    for (uint32_t i = 0; i < size; i++)
+    {
+        if (group[i] == linky_group_separator && separator_count < SEPARATOR_COUNT)
+        {
+            separators[separator_count] = i;
+            sums[separator_count] = sum;
+            separator_count++;
         }
+        sum += group[i];
+    }
+
+    if (separator_count < 2)
+    {
+        return 0;
+    }
+
+    uint32_t value_start = separators[0] + 1;
+    uint32_t value_end = separators[1];
+    tokens->time.data = NULL;
+    tokens->time.size = 0;
+    if (linky_mode == MODE_STD && separator_count == 3) // LABEL HT TIME HT VALUE HT CHECKSUM
+    {
+        tokens->time.data = group + separators[0] + 1;
+        tokens->time.size = separators[1] - separators[0] - 1;
+        value_start = separators[1] + 1;
+        value_end = separators[2];
+    }
+
+    if (value_end + 2 != size) // the checksum is the only character after the value separator
+    {
+        return 0;
+    }
+
+    tokens->label.data = group;
+    tokens->label.size = separators[0];
+    tokens->value.data = group + value_start;
+    tokens->value.size = value_end - value_start;
+    tokens->checksum = group[size - 1];
+    if (linky_mode == MODE_STD)
+    {
+        sum -= group[size - 1]; // everything before the checksum
+    }
+    else
+    {
+        sum = sums[1]; // the separator before the checksum is not included
+    }
+    tokens->computed = (sum & 0x3F) + 0x20;
+    return 1;
+}
+
+/**
+ * @brief Check the groups decoded since the last clear and compute the values
+ *
+ * @return 0 if an error occured, 1 if the data is valid, 2 if the mode was switched (auto mode)
+ */
+static char linky_decode()
+{
+#ifndef PRODUCTION
+    linky_create_debug_frame(linky_debug);
+#endif
+
+    ESP_LOGD(TAG, "Decoding frame... groups: %" PRIu32, linky_last_group_count);
+
+    if (linky_last_group_count == 0)
+    {
+        ESP_LOGI(TAG, "No group found");
+        return linky_handle_auto_check();
+        // exit the function (no group found)
+    }
+
+    // count the number of fields found
+    uint32_t linky_decode_count = linky_count_fields();
+
+    ESP_LOGD(TAG, "Groups: %" PRIu32 ", Total: %" PRIu32 " fields", linky_last_group_count, linky_decode_count);
+    if (linky_decode_count == 0)
+    {
+        ESP_LOGE(TAG, "No field found");
+        return linky_handle_auto_check();
+    }
+
+    linky_last_decode_count = linky_decode_count;
+
+    // if we have a valid frame, with mode auto and its a new value mode, we save it.
+    if (config_values.linky_mode == AUTO && linky_mode != config_values.last_linky_mode)
+    {
+        ESP_LOGI(TAG, "Linky mode: %d", linky_mode);
+        ESP_LOGI(TAG, "Auto mode: New mode found: %s", linky_str_mode[linky_mode]);
+        config_values.last_linky_mode = linky_mode;
+        config_write();
+    }
+
+#if PRODUCTION
+
+    if (linky_debug == 4)
+    {
+        ESP_LOGI(TAG, "Debug frame 4: STD ALL");
+        linky_set_mode(MODE_STD);
+        linky_data.std = tests_std_data;
+    }
+    else if (linky_debug == 5)
+    {
+        ESP_LOGI(TAG, "Debug frame 5: HIST ALL");
+        linky_set_mode(MODE_HIST);
+        linky_data.hist = tests_hist_data;
+    }
+
+#endif
+    linky_compute();
+    aggregate_update(&linky_data);
+
+    return 1;
+}
+
+/**
+ * @brief Count the fields of the current mode with a value
+ *
+ * @return uint32_t the number of fields
+ */
+static uint32_t linky_count_fields()
+{
+    uint32_t linky_decode_count = 0;
+    uint32_t count = 0;
+    const uint8_t *labels = linky_get_mode_labels(linky_mode, &count);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        uint32_t j = labels[i];
+        if (linky_mode != linky_label_list[j].mode)
+            continue; // a label of ANY
         void *data = linky_label_list[j].data;
         switch (linky_label_list[j].type)
         {
@@ -960,77 +1525,335 @@ static char linky_decode()
             break;
         }
     }
+    return linky_decode_count;
+}
 
-    ESP_LOGD(TAG, "Groups: %ld, Total: %ld fields", current_group_index, linky_decode_count);
-    if (linky_decode_count == 0)
+esp_err_t linky_handle_auto_check()
+{
+    if (config_values.linky_mode == AUTO)
     {
-        ESP_LOGE(TAG, "No field found");
-        return linky_handle_auto_check();
+        ESP_LOGI(TAG, "Auto mode: Mode %s Not Found!", linky_str_mode[linky_mode]);
+        return 2; // linky_update detects the mode
+    }
+    return 0;
+}
+
+/**
+ * @brief Hash the value of a label (FNV-1a)
+ *
+ * @param label the label to hash
+ * @return uint32_t the hash of the value
+ */
+static uint32_t linky_hash_value(const linky_value_t *label)
+{
+    uint32_t size = 0;
+    switch (label->type)
+    {
+    case STRING:
+        size = strnlen((const char *)label->data, label->size);
+        break;
+    case UINT8:
+    case UINT16:
+    case UINT32:
+    case UINT64:
+        size = label->type; // the type is the size of the value
+        break;
+    case UINT32_TIME:
+        size = sizeof(time_label_t);
+        break;
+    case HA_NUMBER:
+        size = sizeof(uint16_t);
+        break;
+    default:
+        break;
     }
 
-    if (linky_decode_count > linky_last_decode_count)
+    uint32_t hash = 2166136261u;
+    const uint8_t *data = (const uint8_t *)label->data;
+    for (uint32_t i = 0; i < size; i++)
     {
-        linky_last_decode_count = linky_decode_count;
-        linky_same_feilds_count = 0;
+        hash = (hash ^ data[i]) * 16777619u;
     }
-    else
+    return hash;
+}
+
+/**
+ * @brief Get the numeric value of a label
+ *
+ * @param label the label
+ * @param value the value
+ * @return true if the label is numeric and has a value
+ */
+static bool linky_numeric_value(const linky_value_t *label, uint64_t *value)
+{
+    switch (label->type)
     {
-        linky_same_feilds_count++;
-        ESP_LOGD(TAG, "Same fields count %ld times", linky_same_feilds_count);
+    case UINT8:
+        *value = *(uint8_t *)label->data;
+        return *value != UINT8_MAX;
+    case UINT16:
+        *value = *(uint16_t *)label->data;
+        return *value != UINT16_MAX;
+    case UINT32:
+        *value = *(uint32_t *)label->data;
+        return *value != UINT32_MAX;
+    case UINT64:
+        *value = *(uint64_t *)label->data;
+        return *value != UINT64_MAX;
+    case UINT32_TIME:
+        *value = ((time_label_t *)label->data)->value;
+        return *value != UINT32_MAX;
+    default:
+        return false;
     }
+}
 
-    // if we have a valid frame, with mode auto and its a new value mode, we save it.
-    if (config_values.linky_mode == AUTO && linky_mode != config_values.last_linky_mode)
+/**
+ * @brief Check if the publish policies apply: only the MQTT modes compare with the published values
+ */
+static bool linky_publish_policy_enabled()
+{
+    return config_values.mode == MODE_MQTT || config_values.mode == MODE_MQTT_HA;
+}
+
+void linky_get_publish_policy(uint32_t index, linky_publish_policy_t *policy)
+{
+    const linky_value_t *label = &linky_label_list[index];
+    *policy = (linky_publish_policy_t){0};
+    if (label->device_class < sizeof(linky_class_policy) / sizeof(linky_class_policy[0]))
     {
-        ESP_LOGI(TAG, "Linky mode: %d", linky_mode);
-        ESP_LOGI(TAG, "Auto mode: New mode found: %s", linky_str_mode[linky_mode]);
-        config_values.last_linky_mode = linky_mode;
-        config_write();
+        *policy = linky_class_policy[label->device_class];
+    }
+    for (uint32_t n = 0; n < LINKY_PUBLISH_OVERRIDES; n++)
+    {
+        if (config_values.publish[n].label[0] != '\0' && strcmp(config_values.publish[n].label, label->label) == 0)
+        {
+            *policy = config_values.publish[n].policy;
+            break;
+        }
+    }
+    if (policy->max_age == 0)
+    {
+        // Home Assistant marks the real time values unavailable after 4 refresh periods without message
+        policy->max_age = label->realTime == REAL_TIME ? config_values.refresh_rate * 2 : LINKY_FULL_PUBLISH_INTERVAL / 1000;
     }
+}
 
-#if PRODUCTION
+/**
+ * @brief Check if the change of a value since its last publish is within the deadband of its policy
+ *
+ * @param index the index in linky_label_list
+ * @param policy the policy of the label
+ * @return true if the value doesn't need to be published
+ */
+static bool linky_in_deadband(uint32_t index, const linky_publish_policy_t *policy)
+{
+    uint64_t value = 0;
+    uint64_t published = linky_published_value[index];
+    if (policy->deadband == 0 || published == UINT64_MAX || !linky_numeric_value(&linky_label_list[index], &value))
+    {
+        return false;
+    }
+    uint64_t diff = value > published ? value - published : published - value;
+    uint64_t band = policy->relative ? published * policy->deadband / 100 : policy->deadband;
+    return diff <= band;
+}
 
-    if (linky_debug == 4)
+/**
+ * @brief Mark the values changed since the last successful send
+ * Every value is marked once per LINKY_FULL_PUBLISH_INTERVAL, for the consumers without retained values
+ * In the MQTT modes, each label follows its publish policy instead: deadband and maximum age
+ */
+static void linky_update_dirty()
+{
+    bool policy_enabled = linky_publish_policy_enabled();
+    if (!linky_full_publish_done || (!policy_enabled && MILLIS - linky_full_publish_time >= LINKY_FULL_PUBLISH_INTERVAL))
     {
-        ESP_LOGI(TAG, "Debug frame 4: STD ALL");
-        linky_set_mode(MODE_STD);
-        linky_data.std = tests_std_data;
+        linky_set_dirty();
+        linky_full_publish_time = MILLIS;
+        linky_full_publish_done = true;
     }
-    else if (linky_debug == 5)
+
+    // the labels of the other mode are not published: a mode change sets every value dirty
+    uint32_t changed = 0;
+    uint32_t count = 0;
+    const uint8_t *labels = linky_get_mode_labels(linky_mode, &count);
+    for (uint32_t n = 0; n < count; n++)
     {
-        ESP_LOGI(TAG, "Debug frame 5: HIST ALL");
-        linky_set_mode(MODE_HIST);
-        linky_data.hist = tests_hist_data;
+        uint32_t i = labels[n];
+        linky_value_hash[i] = linky_hash_value(&linky_label_list[i]);
+        if (policy_enabled)
+        {
+            linky_publish_policy_t policy;
+            linky_get_publish_policy(i, &policy);
+            if ((linky_value_hash[i] != linky_published_hash[i] && !linky_in_deadband(i, &policy)) ||
+                MILLIS - linky_published_time[i] >= policy.max_age * 1000)
+            {
+                linky_dirty[i / 32] |= 1UL << (i % 32);
+            }
+        }
+        else if (linky_value_hash[i] != linky_published_hash[i])
+        {
+            linky_dirty[i / 32] |= 1UL << (i % 32);
+        }
+        if (linky_is_dirty(i))
+        {
+            changed++;
+        }
     }
+    ESP_LOGD(TAG, "%" PRIu32 " values to publish", changed);
+}
 
-#endif
-    linky_compute();
+bool linky_is_dirty(uint32_t index)
+{
+    if (index >= LINKY_LABEL_LIST_SIZE)
+    {
+        return false;
+    }
+    return (linky_dirty[index / 32] >> (index % 32)) & 1;
+}
 
-    return 1;
+void linky_set_dirty()
+{
+    memset(linky_dirty, 0xFF, sizeof(linky_dirty));
 }
 
-esp_err_t linky_handle_auto_check()
+void linky_clear_dirty()
 {
-    if (config_values.linky_mode == AUTO)
+    // only the published values become the reference: a slow drift within the deadband adds up
+    uint32_t count = 0;
+    const uint8_t *labels = linky_get_mode_labels(linky_mode, &count);
+    for (uint32_t n = 0; n < count; n++)
     {
-        switch (linky_mode)
+        uint32_t i = labels[n];
+        if (!linky_is_dirty(i))
+        {
+            continue;
+        }
+        linky_published_hash[i] = linky_value_hash[i];
+        if (!linky_numeric_value(&linky_label_list[i], &linky_published_value[i]))
         {
-        case MODE_HIST:
-            ESP_LOGI(TAG, "Auto mode: Mode Historique Not Found! Try Mode Standard");
-            linky_set_mode(MODE_STD);
+            linky_published_value[i] = UINT64_MAX;
+        }
+        linky_published_time[i] = MILLIS;
+    }
+    memset(linky_dirty, 0, sizeof(linky_dirty));
+}
 
-            break;
-        case MODE_STD:
-            ESP_LOGI(TAG, "Auto mode: Mode Standard Not Found! Try Mode Historique");
-            linky_set_mode(MODE_HIST);
+esp_err_t linky_publish_parse(const char *str, linky_publish_override_t *overrides)
+{
+    linky_publish_override_t parsed[LINKY_PUBLISH_OVERRIDES] = {0};
+    uint32_t count = 0;
+    const char *p = str;
+    while (*p != '\0')
+    {
+        if (*p == ',' || *p == ' ')
+        {
+            p++;
+            continue;
+        }
+        if (count >= LINKY_PUBLISH_OVERRIDES)
+        {
+            ESP_LOGE(TAG, "Too many publish policies, max %d", LINKY_PUBLISH_OVERRIDES);
+            return ESP_ERR_INVALID_ARG;
+        }
 
-            break;
-        default:
-            break;
+        // label
+        size_t len = strcspn(p, ":");
+        if (p[len] != ':' || len == 0 || len >= sizeof(parsed[count].label))
+        {
+            ESP_LOGE(TAG, "Invalid publish policy: %s", p);
+            return ESP_ERR_INVALID_ARG;
+        }
+        memcpy(parsed[count].label, p, len);
+        bool found = false;
+        for (uint32_t i = 0; i < LINKY_LABEL_LIST_SIZE && !found; i++)
+        {
+            found = linky_label_list[i].data != NULL && strcmp(linky_label_list[i].label, parsed[count].label) == 0;
+        }
+        if (!found)
+        {
+            ESP_LOGE(TAG, "Unknown label: %s", parsed[count].label);
+            return ESP_ERR_INVALID_ARG;
+        }
+        p += len + 1;
+
+        // deadband[%][:max_age]
+        char *end = NULL;
+        unsigned long deadband = strtoul(p, &end, 10);
+        if (end == p || deadband > UINT16_MAX)
+        {
+            ESP_LOGE(TAG, "Invalid deadband for %s", parsed[count].label);
+            return ESP_ERR_INVALID_ARG;
+        }
+        parsed[count].policy.deadband = deadband;
+        p = end;
+        if (*p == '%')
+        {
+            parsed[count].policy.relative = 1;
+            p++;
         }
-        return 2;
+        if (*p == ':')
+        {
+            p++;
+            unsigned long max_age = strtoul(p, &end, 10);
+            if (end == p || max_age > UINT16_MAX)
+            {
+                ESP_LOGE(TAG, "Invalid max age for %s", parsed[count].label);
+                return ESP_ERR_INVALID_ARG;
+            }
+            parsed[count].policy.max_age = max_age;
+            p = end;
+        }
+        if (*p != '\0' && *p != ',' && *p != ' ')
+        {
+            ESP_LOGE(TAG, "Invalid publish policy for %s", parsed[count].label);
+            return ESP_ERR_INVALID_ARG;
+        }
+        count++;
+    }
+    memcpy(overrides, parsed, sizeof(parsed));
+    return ESP_OK;
+}
+
+void linky_publish_format(char *str, size_t size)
+{
+    size_t len = 0;
+    str[0] = '\0';
+    for (uint32_t n = 0; n < LINKY_PUBLISH_OVERRIDES && len < size; n++)
+    {
+        const linky_publish_override_t *override = &config_values.publish[n];
+        if (override->label[0] == '\0')
+        {
+            continue;
+        }
+        len += snprintf(str + len, size - len, "%s%.*s:%d%s", len > 0 ? "," : "", (int)sizeof(override->label), override->label,
+                        override->policy.deadband, override->policy.relative ? "%" : "");
+        if (override->policy.max_age != 0 && len < size)
+        {
+            len += snprintf(str + len, size - len, ":%d", override->policy.max_age);
+        }
+    }
+}
+
+void linky_publish_print()
+{
+    printf("Publish policies%s:\n", linky_publish_policy_enabled() ? "" : " (not used in this mode)");
+    uint32_t count = 0;
+    const uint8_t *labels = linky_get_mode_labels(linky_mode, &count);
+    for (uint32_t n = 0; n < count; n++)
+    {
+        uint32_t i = labels[n];
+        linky_publish_policy_t policy;
+        linky_get_publish_policy(i, &policy);
+        char age[16] = "never";
+        if (linky_published_time[i] != 0)
+        {
+            snprintf(age, sizeof(age), "%" PRIu32 " s", (MILLIS - linky_published_time[i]) / 1000);
+        }
+        printf("  %-12s deadband: %d%s, max age: %d s, published: %s\n", linky_label_list[i].label, policy.deadband, policy.relative ? "%" : "",
+               policy.max_age, age);
     }
-    return 0;
 }
 
 esp_err_t linky_compute()
@@ -1119,7 +1942,7 @@ esp_err_t linky_compute()
 
         if (linky_data.std.EAIT != UINT64_MAX) // if we are producer
         {
-            ESP_LOGI(TAG, "Producer: EAIT: %llu", linky_data.std.EAIT);
+            ESP_LOGI(TAG, "Producer: EAIT: %" PRIu64, linky_data.std.EAIT);
             if (linky_data.std.SINSTI == UINT32_MAX) // and inst power is not available
             {
                 ESP_LOGI(TAG, "Producer: SINSTI not available: no current production");
@@ -1130,7 +1953,7 @@ esp_err_t linky_compute()
         if (strnlen(linky_data.std.STGE, sizeof(linky_data.std.STGE)) > 0)
         {
             uint64_t value = strtoull(linky_data.std.STGE, NULL, 16);
-            ESP_LOGD(TAG, "STGE: 0x%llx", value);
+            ESP_LOGD(TAG, "STGE: 0x%" PRIx64, value);
             // tomorrow color: bit 26 and 27
             uint8_t tomorrow_color = (value >> 26) & 0x3;
             ESP_LOGD(TAG, "tomorrow color: %d", tomorrow_color);
@@ -1189,9 +2012,160 @@ esp_err_t linky_compute()
         break;
     }
 
+    linky_update_dirty();
     return err;
 }
 
+/**
+ * @brief Decode the received frames until a complete frame is decoded or the timeout expires
+ *
+ * @param timeout the maximum waiting time in ms
+ */
+static void linky_wait_frame(uint32_t timeout)
+{
+    linky_same_feilds_count = 0;
+    if (linky_event_group != NULL)
+    {
+        xEventGroupClearBits(linky_event_group, LINKY_FRAME_COMPLETE_BIT);
+    }
+    linky_reading = 1;
+    if (linky_event_group != NULL)
+    {
+        // the decoder task sets the bit as soon as a complete frame is decoded
+        xEventGroupWaitBits(linky_event_group, LINKY_FRAME_COMPLETE_BIT, pdTRUE, pdTRUE, timeout / portTICK_PERIOD_MS);
+    }
+    else
+    {
+        vTaskDelay(timeout / portTICK_PERIOD_MS);
+    }
+    linky_decoder_pause(); // linky_data is not modified until the next reading
+}
+
+/**
+ * @brief Feed received bytes to the mode detection
+ * The groups are checked with the separator of the current mode
+ *
+ * @param sniff the detection counters
+ * @param data the received bytes
+ * @param size the number of bytes
+ */
+static void linky_sniff_feed(linky_sniff_t *sniff, const uint8_t *data, uint32_t size)
+{
+    for (const uint8_t *c = data; c < data + size; c++)
+    {
+        sniff->bytes++;
+        switch (*c)
+        {
+        case 0x09:
+            sniff->tabs++;
+            break;
+        case 0x20:
+            sniff->spaces++;
+            break;
+        case START_OF_GROUP:
+            sniff->in_group = true;
+            sniff->group_size = 0;
+            continue;
+        case END_OF_GROUP:
+        {
+            if (!sniff->in_group)
+            {
+                break;
+            }
+            sniff->in_group = false;
+            linky_tokens_t tokens;
+            if (linky_tokenize_group(sniff->group, sniff->group_size, &tokens))
+            {
+                sniff->groups++;
+                if (tokens.computed == tokens.checksum)
+                {
+                    sniff->valid_groups++;
+                }
+            }
+            continue;
+        }
+        default:
+            break;
+        }
+
+        if (sniff->in_group)
+        {
+            if (sniff->group_size >= sizeof(sniff->group))
+            {
+                sniff->in_group = false; // too long: not a group
+                continue;
+            }
+            sniff->group[sniff->group_size++] = *c;
+        }
+    }
+}
+
+/**
+ * @brief Score the bytes received in the current mode: valid groups are a proof of the mode,
+ * the group structure and the separators a hint, and UART errors a sign of a wrong baud rate
+ *
+ * @return int32_t the score, <= 0 if nothing looks like a frame
+ */
+static int32_t linky_sniff_score(const linky_sniff_t *sniff)
+{
+    int32_t score = 8 * (int32_t)sniff->valid_groups + 2 * (int32_t)sniff->groups - (int32_t)sniff->errors;
+    if (linky_mode == MODE_HIST)
+    {
+        score -= (int32_t)sniff->tabs; // the historique mode only uses spaces
+    }
+    return score;
+}
+
+linky_mode_t linky_detect_mode()
+{
+    if (linky_uart_task_handle == NULL || linky_event_group == NULL)
+    {
+        return NONE;
+    }
+
+    uint32_t start = MILLIS;
+    linky_mode_t modes[2] = {linky_mode, linky_mode == MODE_STD ? MODE_HIST : MODE_STD}; // current mode first
+    int32_t scores[2] = {0};
+    uint8_t best = 0;
+    for (uint8_t i = 0; i < 2; i++)
+    {
+        linky_set_mode(modes[i]);
+        memset(&linky_sniff, 0, sizeof(linky_sniff));
+        xEventGroupClearBits(linky_event_group, LINKY_SNIFF_DONE_BIT);
+        linky_sniffing = true;
+        linky_uart_rx_interrupts(true);
+        xEventGroupWaitBits(linky_event_group, LINKY_SNIFF_DONE_BIT, pdTRUE, pdTRUE, LINKY_SNIFF_TIME_MS / portTICK_PERIOD_MS);
+        linky_sniffing = false;
+        linky_uart_rx_interrupts(false);
+
+        scores[i] = linky_sniff_score(&linky_sniff);
+        ESP_LOGI(TAG, "Mode detection: %s: %" PRIu32 " bytes, %" PRIu32 " errors, %" PRIu32 "/%" PRIu32 " valid groups, score: %" PRId32,
+                 linky_str_mode[modes[i]], linky_sniff.bytes, linky_sniff.errors, linky_sniff.valid_groups, linky_sniff.groups, scores[i]);
+        if (scores[i] > scores[best])
+        {
+            best = i;
+        }
+        if (linky_sniff.valid_groups >= LINKY_SNIFF_VALID_GROUPS)
+        {
+            break;
+        }
+    }
+
+    // the pattern positions recorded during the detection are wrong: the bytes were read by the sniffer
+    linky_uart_flush();
+    uart_pattern_queue_reset(LINKY_UART, LINKY_PATTERN_QUEUE_SIZE);
+
+    if (scores[best] <= 0)
+    {
+        ESP_LOGW(TAG, "Mode detection: no frame found in %" PRIu32 " ms", MILLIS - start);
+        linky_set_mode(modes[0]);
+        return NONE;
+    }
+    linky_set_mode(modes[best]);
+    ESP_LOGI(TAG, "Mode detection: %s found in %" PRIu32 " ms", linky_str_mode[modes[best]], MILLIS - start);
+    return modes[best];
+}
+
 /**
  * @brief Update the data from the Linky
  * Read the UART and decode the frame
@@ -1202,44 +2176,39 @@ char linky_update(uint32_t timeout)
 {
     uint8_t ret;
 
-    esp_pm_lock_acquire(linky_pm_lock);
-    linky_reading = 1;
-    linky_same_feilds_count = 0;
     if (linky_mode > MODE_STD)
     {
         ESP_LOGE(TAG, "Error: Unknown mode: %d", linky_mode);
         return 0;
     }
-    ESP_LOGI(TAG, "Mode: %s", linky_str_mode[linky_mode]);
+    esp_pm_lock_acquire(linky_pm_lock);
+    linky_read_start = MILLIS;
+    linky_first_frame_time = UINT32_MAX;
 
     led_start_pattern(LED_LINKY_READING);
 
-    uint32_t try = 0;
-    ESP_LOGI(TAG, "Reading frame...");
-    timeout += MILLIS;
-    do
+    if (config_values.linky_mode == AUTO && config_values.last_linky_mode == NONE)
     {
-        ESP_LOGI(TAG, "Reading frame: remaining: %ld ms, VCONDO: %f, feilds: %ld", timeout - MILLIS, gpio_get_vcondo(), linky_last_decode_count);
-        vTaskDelay(1000 / portTICK_PERIOD_MS);
-    } while (MILLIS < timeout);
+        linky_detect_mode(); // first reading: don't wait for a frame in a wrong mode
+    }
 
-    // if (linky_same_feilds_count >= LINKY_SAME_FEILDS_COUNT)
-    // {
-    //     ESP_LOGI(TAG, "End: Same fields count %ld times", linky_same_feilds_count);
-    // }
+    ESP_LOGI(TAG, "Mode: %s", linky_str_mode[linky_mode]);
+    ESP_LOGI(TAG, "Reading frame: timeout: %" PRIu32 " ms, VCONDO: %f", timeout, gpio_get_vcondo());
+    linky_wait_frame(timeout);
+    ESP_LOGI(TAG, "Reading frame: done in %" PRIu32 " ms, fields: %" PRIu32, MILLIS - linky_read_start, linky_last_decode_count);
 
     ret = linky_decode(); // decode the frame
 
-    while (ret == 2 && try < 2) // if the mode is auto, we try the other mode if the first one failed
+    if (ret == 2) // auto mode: nothing decoded in the current mode
     {
-        vTaskDelay(5000 / portTICK_PERIOD_MS);
-        ESP_LOGI(TAG, "Retry to find the mode");
-        ret = linky_decode(); // decode the frame
-        try++;
+        if (linky_detect_mode() != NONE)
+        {
+            ESP_LOGI(TAG, "Retry in mode %s", linky_str_mode[linky_mode]);
+            linky_wait_frame(timeout);
+            ret = linky_decode(); // decode the frame
+        }
     }
-    linky_reading = 0;
-
-    linky_frame_size = 0; // clear the frame size
+    linky_read_time = MILLIS - linky_read_start;
 
     led_stop_pattern(LED_LINKY_READING);
 
@@ -1275,12 +2244,11 @@ char linky_update(uint32_t timeout)
 void linky_print()
 {
     ESP_LOGI(TAG, "-------------------");
-    for (uint32_t i = 0; i < linky_label_list_size; i++)
+    uint32_t count = 0;
+    const uint8_t *labels = linky_get_mode_labels(linky_mode, &count);
+    for (uint32_t n = 0; n < count; n++)
     {
-        if (linky_label_list[i].data == NULL)
-            continue;
-        if (linky_mode != linky_label_list[i].mode)
-            continue;
+        uint32_t i = labels[n];
 
         char str_value[100] = {0};
         switch (linky_label_list[i].type)
@@ -1307,13 +2275,13 @@ void linky_print()
             if (*(uint32_t *)linky_label_list[i].data == UINT32_MAX) // print only if we have a value
                 continue;
             // ESP_LOGI(TAG, "%s: %lu", linky_label_list[i].label, *(uint32_t *)linky_label_list[i].data);
-            snprintf(str_value, sizeof(str_value), "%lu", *(uint32_t *)linky_label_list[i].data);
+            snprintf(str_value, sizeof(str_value), "%" PRIu32, *(uint32_t *)linky_label_list[i].data);
             break;
         case UINT64:
             if (*(uint64_t *)linky_label_list[i].data == UINT64_MAX) // print only if we have a value
                 continue;
             // ESP_LOGI(TAG, "%s: %llu", linky_label_list[i].label, *(uint64_t *)linky_label_list[i].data);
-            snprintf(str_value, sizeof(str_value), "%llu", *(uint64_t *)linky_label_list[i].data);
+            snprintf(str_value, sizeof(str_value), "%" PRIu64, *(uint64_t *)linky_label_list[i].data);
             break;
         case UINT32_TIME:
         {
@@ -1324,7 +2292,7 @@ void linky_print()
             char timeString[20];
             strftime(timeString, sizeof(timeString), "%d/%m/%Y %H:%M:%S", timeinfo);
             // ESP_LOGI(TAG, "%s: %s %lu", linky_label_list[i].label, timeString, timeLabel.value);
-            snprintf(str_value, sizeof(str_value), "%s %lu", timeString, timeLabel.value);
+            snprintf(str_value, sizeof(str_value), "%s %" PRIu32, timeString, timeLabel.value);
 
             break;
         }
@@ -1359,41 +2327,156 @@ void linky_print()
 }
 
 /**
- * @brief Calculate the checksum
+ * @brief Calculate the checksum of a group built from strings (debug frames)
  *
  * @param label name of the field
  * @param data value of the field
+ * @param time horodate of the field (STD mode only), can be NULL
  * @return return the character of the checksum
  */
-static char linky_checksum(char *label, char *data, char *time)
-{
-    int S1 = 0;                             // sum of the ASCII codes of the characters in the label
-    for (int i = 0; i < strlen(label); i++) // for each character in the label
-    {                                       //
-        S1 += label[i];                     // add the ASCII code of the label character to the sum
-    } //
-    S1 += linky_group_separator;           // add the ASCII code of the separator to the sum
-    for (int i = 0; i < strlen(data); i++) // for each character in the data
-    {                                      //
-        S1 += data[i];                     // add the ASCII code of the data character to the sum
-    } //
-    if (linky_mode == MODE_STD)                    // if the mode is standard
-    {                                              //
-        S1 += linky_group_separator;               // add the ASCII code of the separator to the sum
-        if (time != NULL && strlen(time) != 0)     //
-        {                                          //
-            for (int i = 0; i < strlen(time); i++) // for each character in the time
-            {                                      //
-                S1 += time[i];                     // add the ASCII code of the time character to the sum
-            } //
-            S1 += linky_group_separator; //
-        } //
-    } //
+static char linky_checksum(const char *label, const char *data, const char *time)
+{
+    int S1 = 0;                          // sum of the ASCII codes of the characters
+    for (const char *c = label; *c; c++) // for each character in the label
+    {
+        S1 += *c;
+    }
+    S1 += linky_group_separator;
+    for (const char *c = data; *c; c++) // for each character in the data
+    {
+        S1 += *c;
+    }
+    if (linky_mode == MODE_STD)
+    {
+        S1 += linky_group_separator;
+        if (time != NULL && time[0] != 0)
+        {
+            for (const char *c = time; *c; c++) // for each character in the time
+            {
+                S1 += *c;
+            }
+            S1 += linky_group_separator;
+        }
+    }
     return (S1 & 0x3F) + 0x20; // return the checksum
 }
 
-static time_t linky_decode_time(char *time)
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "linky_span_to_uint expects the first digit in the lowest byte of a word"
+#endif
+
+/**
+ * @brief Check that the 8 bytes of a word are ASCII digits
+ * The high nibble must be 3, and adding 6 to the low nibble must not carry into it
+ */
+static inline bool linky_swar_is_digits_8(uint64_t chunk)
+{
+    return (chunk & 0xF0F0F0F0F0F0F0F0ULL) == 0x3030303030303030ULL && ((chunk + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) == 0x3030303030303030ULL;
+}
+
+/**
+ * @brief Convert 8 ASCII digits loaded in a word, the first digit being the most significant
+ * Each step merges adjacent pairs: 8 digits -> 4 numbers < 100 -> 2 numbers < 10000 -> 1 number
+ */
+static inline uint32_t linky_swar_parse_8(uint64_t chunk)
+{
+    chunk &= 0x0F0F0F0F0F0F0F0FULL;
+    chunk = (chunk * (1 + (10ULL << 8))) >> 8;
+    chunk = ((chunk & 0x00FF00FF00FF00FFULL) * (1 + (100ULL << 16))) >> 16;
+    chunk = ((chunk & 0x0000FFFF0000FFFFULL) * (1 + (10000ULL << 32))) >> 32;
+    return (uint32_t)chunk;
+}
+
+static inline bool linky_swar_is_digits_4(uint32_t chunk)
+{
+    return (chunk & 0xF0F0F0F0UL) == 0x30303030UL && ((chunk + 0x06060606UL) & 0xF0F0F0F0UL) == 0x30303030UL;
+}
+
+static inline uint32_t linky_swar_parse_4(uint32_t chunk)
+{
+    chunk &= 0x0F0F0F0FUL;
+    chunk = (chunk * (1 + (10UL << 8))) >> 8;
+    chunk = ((chunk & 0x00FF00FFUL) * (1 + (100UL << 16))) >> 16;
+    return chunk & 0xFFFF;
+}
+
+/**
+ * @brief Convert the decimal digits of a span: the TIC values have a fixed width (9 digits for the indexes,
+ * 5 for the powers, 3 for the currents and voltages), converted 8 then 4 digits at a time
+ *
+ * @param span the digits, an empty span is 0
+ * @param value the result
+ * @return true if the span only contains digits and fits in 64 bits
+ */
+static bool linky_span_to_uint(const linky_span_t *span, uint64_t *value)
+{
+    const uint8_t *data = span->data;
+    uint32_t size = span->size;
+    uint64_t result = 0;
+    if (size > 19)
+    {
+        return false;
+    }
+
+    while (size >= 8)
+    {
+        uint64_t chunk;
+        memcpy(&chunk, data, sizeof(chunk)); // unaligned load
+        if (!linky_swar_is_digits_8(chunk))
+        {
+            return false;
+        }
+        result = result * 100000000ULL + linky_swar_parse_8(chunk);
+        data += 8;
+        size -= 8;
+    }
+    if (size >= 4)
+    {
+        uint32_t chunk;
+        memcpy(&chunk, data, sizeof(chunk));
+        if (!linky_swar_is_digits_4(chunk))
+        {
+            return false;
+        }
+        result = result * 10000 + linky_swar_parse_4(chunk);
+        data += 4;
+        size -= 4;
+    }
+    for (uint32_t i = 0; i < size; i++)
+    {
+        uint8_t digit = data[i] - '0';
+        if (digit > 9)
+        {
+            return false;
+        }
+        result = result * 10 + digit;
+    }
+    *value = result;
+    return true;
+}
+
+/**
+ * @brief Number of days since 1970-01-01 of a date of the gregorian calendar (days from civil, for the years >= 0)
+ * The years start in March, so that the leap day is the last day of the year
+ */
+static int32_t linky_days_from_civil(uint32_t year, uint32_t month, uint32_t day)
+{
+    year -= month <= 2;
+    uint32_t era = year / 400;
+    uint32_t year_of_era = year - era * 400;                                              // [0, 399]
+    uint32_t day_of_year = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1; // [0, 365]
+    uint32_t day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+    return (int32_t)(era * 146097 + day_of_era) - 719468;
+}
+
+/**
+ * @brief Convert an horodate to an UTC epoch, without mktime
+ *
+ * @return time_t the epoch, 0 if the horodate is not valid
+ */
+static time_t linky_decode_time(const linky_span_t *span)
 {
+    const uint8_t *time = span->data;
     // Le format utilisé pour les horodates est SAAMMJJhhmmss, c'est-à-dire Saison, Année, Mois, Jour, heure, minute, seconde.
     // La saison est codée sur 1 caractère :
     // - H pour Hiver (du 1er novembre au 31 mars)
@@ -1404,20 +2487,49 @@ static time_t linky_decode_time(char *time)
     // L'heure est codée sur 2 caractères.
     // La minute est codée sur 2 caractères.
     // La seconde est codée sur 2 caractères.
-    if (strlen(time) != 13)
+    // Une saison en minuscule (h, e) indique une horloge dégradée, un espace une saison non précisée.
+    if (span->size != 13)
     {
         ESP_LOGE(TAG, "Error: Time format is not correct");
         return 0;
     }
-    struct tm tm;
-    memset(&tm, 0, sizeof(struct tm));
-    tm.tm_year = (time[1] - '0') * 10 + (time[2] - '0') + 100; // year since 1900
-    tm.tm_mon = (time[3] - '0') * 10 + (time[4] - '0') - 1;    // month sinc S1 += linky_group_separator;e January [0-11]
-    tm.tm_mday = (time[5] - '0') * 10 + (time[6] - '0');       // day of the month [1-31]
-    tm.tm_hour = (time[7] - '0') * 10 + (time[8] - '0');       // hours since midnight [0-23]
-    tm.tm_min = (time[9] - '0') * 10 + (time[10] - '0');       // minutes after the hour [0-59]
-    tm.tm_sec = (time[11] - '0') * 10 + (time[12] - '0');      // seconds after the minute [0-60]
-    return mktime(&tm);
+    uint64_t date;
+    uint32_t clock;
+    memcpy(&date, time + 1, sizeof(date));   // AAMMJJhh
+    memcpy(&clock, time + 9, sizeof(clock)); // mmss
+    if (!linky_swar_is_digits_8(date) || !linky_swar_is_digits_4(clock))
+    {
+        ESP_LOGD(TAG, "Error: Time is not a number: %.*s", 13, time);
+        return 0;
+    }
+    uint32_t year = (time[1] - '0') * 10 + (time[2] - '0') + 2000;
+    uint32_t month = (time[3] - '0') * 10 + (time[4] - '0');
+    uint32_t day = (time[5] - '0') * 10 + (time[6] - '0');
+    uint32_t hour = (time[7] - '0') * 10 + (time[8] - '0');
+    uint32_t minute = (time[9] - '0') * 10 + (time[10] - '0');
+    uint32_t second = (time[11] - '0') * 10 + (time[12] - '0');
+    if (month < 1 || month > 12 || day < 1 || day > 31 || hour > 23 || minute > 59 || second > 59)
+    {
+        ESP_LOGD(TAG, "Error: Time is out of range: %.*s", 13, time);
+        return 0;
+    }
+
+    uint32_t utc_offset; // the horodates are in local time: UTC+1 in winter, UTC+2 in summer
+    switch (time[0])
+    {
+    case 'H':
+    case 'h':
+        utc_offset = 3600;
+        break;
+    case 'E':
+    case 'e':
+        utc_offset = 7200;
+        break;
+    default:
+        utc_offset = (month >= 4 && month <= 10) ? 7200 : 3600;
+        break;
+    }
+    return (time_t)linky_days_from_civil(year, month, day) * 86400 + hour * 3600 + minute * 60 + second - utc_offset;
 }
 
 uint8_t linky_presence()
@@ -1444,6 +2556,8 @@ uint8_t linky_presence()
 
 static void linky_create_debug_frame(linky_debug_t debug)
 {
+    // debug frames use their own parser: the UART task can be in the middle of a group
+    linky_parser_t parser = {0};
 
     switch (debug)
     {
@@ -1476,47 +2590,45 @@ static void linky_create_debug_frame(linky_debug_t debug)
         linky_set_mode(MODE_HIST);
 
         // random base value
-        snprintf(debug_hist[3].value, sizeof(debug_hist[3].value), "%ld", esp_random() % 1000000);
+        snprintf(debug_hist[3].value, sizeof(debug_hist[3].value), "%" PRIu32, esp_random() % 1000000);
         debug_hist[3].checksum = linky_checksum(debug_hist[3].name, debug_hist[3].value, NULL);
 
         const uint16_t debugGroupCount = sizeof(debug_hist) / sizeof(debug_hist[0]);
-        linky_frame_size = 0;
-        linky_buffer[linky_frame_size++] = START_OF_FRAME;
+        uint8_t frame[512];
+        uint32_t frame_size = 0;
+        frame[frame_size++] = START_OF_FRAME;
         for (uint16_t i = 0; i < debugGroupCount - 1; i++)
         {
-            linky_buffer[linky_frame_size++] = START_OF_GROUP;
+            frame[frame_size++] = START_OF_GROUP;
             for (uint16_t j = 0; j < strlen(debug_hist[i].name); j++)
             {
-                linky_buffer[linky_frame_size++] = debug_hist[i].name[j];
+                frame[frame_size++] = debug_hist[i].name[j];
             }
-            linky_buffer[linky_frame_size++] = linky_group_separator;
+            frame[frame_size++] = linky_group_separator;
             for (uint16_t j = 0; j < strlen(debug_hist[i].value); j++)
             {
-                linky_buffer[linky_frame_size++] = debug_hist[i].value[j];
+                frame[frame_size++] = debug_hist[i].value[j];
             }
-            linky_buffer[linky_frame_size++] = linky_group_separator;
-            linky_buffer[linky_frame_size++] = debug_hist[i].checksum;
-            linky_buffer[linky_frame_size++] = END_OF_GROUP;
+            frame[frame_size++] = linky_group_separator;
+            frame[frame_size++] = debug_hist[i].checksum;
+            frame[frame_size++] = END_OF_GROUP;
         }
-        linky_buffer[linky_frame_size++] = END_OF_FRAME;
+        frame[frame_size++] = END_OF_FRAME;
+        linky_parser_feed(&parser, frame, frame_size);
         break;
     }
     case DEBUG_STD:
     {
         ESP_LOGI(TAG, "Debug frame: Mode Standard");
         linky_set_mode(MODE_STD);
-        linky_frame_size = 0;
-        memcpy(linky_buffer, linky_std_debug_buffer, sizeof(linky_std_debug_buffer));
-        linky_frame_size = sizeof(linky_std_debug_buffer);
+        linky_parser_feed(&parser, (const uint8_t *)linky_std_debug_buffer, sizeof(linky_std_debug_buffer));
         break;
     }
     case DEBUG_BAD_STD:
     {
         ESP_LOGI(TAG, "Debug frame: BAD frame");
         linky_set_mode(MODE_STD);
-        linky_frame_size = 0;
-        memcpy(linky_buffer, linky_std_debug_buffer_bad, sizeof(linky_std_debug_buffer_bad));
-        linky_frame_size = sizeof(linky_std_debug_buffer_bad);
+        linky_parser_feed(&parser, (const uint8_t *)linky_std_debug_buffer_bad, sizeof(linky_std_debug_buffer_bad));
         break;
     }
     default:
@@ -1532,12 +2644,12 @@ void linky_clear_data()
     linky_decode_checksum_error = 0;
     linky_last_group_count = 0;
     linky_same_feilds_count = 0;
-    for (uint32_t i = 0; i < linky_label_list_size; i++)
+    memset(linky_published_value, 0xFF, sizeof(linky_published_value)); // no reference for the deadbands: the next values are published
+    uint32_t count = 0;
+    const uint8_t *labels = linky_get_mode_labels(linky_mode, &count); // the labels of the other mode share the same memory
+    for (uint32_t n = 0; n < count; n++)
     {
-        if (linky_label_list[i].data == NULL)
-        {
-            continue;
-        }
+        uint32_t i = labels[n];
         uint8_t found = 0;
         for (uint32_t j = 0; j < linky_protected_data_size; j++)
         {
@@ -1582,24 +2694,26 @@ void linky_clear_data()
 
 void linky_print_debug_frame()
 {
-    if (linky_frame == NULL)
+    const uint8_t *frame = linky_uart_parser.raw;
+    uint32_t frame_size = linky_uart_parser.raw_size;
+    if (frame_size == 0)
     {
         ESP_LOGE(TAG, "No frame found");
         return;
     }
 
     printf("\n");
-    for (int i = 0; i < linky_frame_size + 2; i++)
+    for (int i = 0; i < frame_size; i++)
     {
-        if (linky_frame[i] <= 0x20)
+        if (frame[i] <= 0x20)
         {
-            printf("[%d]", linky_frame[i]);
+            printf("[%d]", frame[i]);
         }
         else
         {
-            printf("%c", linky_frame[i]);
+            printf("%c", frame[i]);
         }
-        if (linky_frame[i] == 13)
+        if (frame[i] == 13)
         {
             printf("\n");
         }
@@ -1677,8 +2791,252 @@ void linky_stats()
     ESP_LOGI(TAG, "Linky presence: %s", linky_presence() ? "Yes" : "No");
     ESP_LOGI(TAG, "Linky contract: %s", linky_get_str_contract());
     ESP_LOGI(TAG, "Linky refresh rate: %d", config_values.refresh_rate);
-    ESP_LOGI(TAG, "Linky decode count: %ld", linky_last_decode_count);
-    ESP_LOGI(TAG, "Linky checksum error: %ld", linky_decode_checksum_error);
+    ESP_LOGI(TAG, "Linky decode count: %" PRIu32, linky_last_decode_count);
+    ESP_LOGI(TAG, "Linky checksum error: %" PRIu32, linky_decode_checksum_error);
+    ESP_LOGI(TAG, "Linky frames dropped: %" PRIu32, linky_metrics.frames_dropped);
+    ESP_LOGI(TAG, "Linky UART errors: %" PRIu32, linky_metrics.uart_break + linky_metrics.uart_parity + linky_metrics.uart_frame);
+    if (linky_metrics.frames_received > 0)
+    {
+        ESP_LOGI(TAG, "Linky UART wakeups per frame: %.1f, data events per frame: %.1f (%" PRIu32 " frames)", (float)linky_metrics.uart_wakeups / linky_metrics.frames_received,
+                 (float)linky_metrics.uart_data_events / linky_metrics.frames_received, linky_metrics.frames_received);
+    }
+    if (linky_first_frame_time != UINT32_MAX)
+    {
+        ESP_LOGI(TAG, "Linky first valid frame: %" PRIu32 " ms", linky_first_frame_time);
+    }
+    else
+    {
+        ESP_LOGI(TAG, "Linky first valid frame: none");
+    }
+    ESP_LOGI(TAG, "Linky read time: %" PRIu32 " ms", linky_read_time);
+}
+
+void linky_metrics_reset()
+{
+    memset(&linky_metrics, 0, sizeof(linky_metrics));
+    memset(linky_label_checksum_errors, 0, sizeof(linky_label_checksum_errors));
+    linky_metrics.start = MILLIS;
+}
+
+void linky_write_metrics(json_writer_t *writer)
+{
+    const linky_metrics_t *m = &linky_metrics;
+    uint32_t elapsed = (MILLIS - m->start) / 1000;
+    json_writer_uint(writer, "duration", elapsed);
+    json_writer_uint(writer, "bytes", m->bytes);
+    json_writer_uint(writer, "bytes_per_s", elapsed > 0 ? m->bytes / elapsed : 0);
+
+    json_writer_object_start(writer, "frames");
+    json_writer_uint(writer, "received", m->frames_received);
+    json_writer_uint(writer, "dropped", m->frames_dropped);
+    json_writer_uint(writer, "decoded", m->frames_decoded);
+    json_writer_uint(writer, "valid", m->frames_valid);
+    json_writer_object_end(writer);
+    json_writer_uint(writer, "groups", m->groups);
+    json_writer_uint(writer, "value_errors", m->value_errors);
+
+    json_writer_object_start(writer, "checksum_errors");
+    json_writer_uint(writer, "total", m->checksum_errors);
+    json_writer_uint(writer, "unknown_label", m->checksum_unknown_label);
+    for (uint32_t i = 0; i < LINKY_LABEL_LIST_SIZE; i++)
+    {
+        if (linky_label_checksum_errors[i] > 0)
+        {
+            json_writer_uint(writer, linky_label_list[i].label, linky_label_checksum_errors[i]);
+        }
+    }
+    json_writer_object_end(writer);
+
+    json_writer_object_start(writer, "uart");
+    json_writer_uint(writer, "fifo_overflow", m->uart_fifo_overflow);
+    json_writer_uint(writer, "buffer_full", m->uart_buffer_full);
+    json_writer_uint(writer, "pattern_overflow", m->uart_pattern_overflow);
+    json_writer_uint(writer, "break", m->uart_break);
+    json_writer_uint(writer, "parity", m->uart_parity);
+    json_writer_uint(writer, "frame", m->uart_frame);
+    json_writer_uint(writer, "wakeups", m->uart_wakeups);
+    json_writer_uint(writer, "data_events", m->uart_data_events);
+    json_writer_double(writer, "wakeups_per_frame", m->frames_received > 0 ? (double)m->uart_wakeups / m->frames_received : 0);
+    json_writer_object_end(writer);
+
+    json_writer_object_start(writer, "decode_us");
+    json_writer_uint(writer, "max", m->decode_time_max);
+    json_writer_array_start(writer, "histogram"); // < 250 us, < 500 us, ... < 16 ms, longer
+    for (uint32_t i = 0; i < LINKY_METRICS_DECODE_BUCKETS; i++)
+    {
+        json_writer_uint(writer, NULL, m->decode_time[i]);
+    }
+    json_writer_array_end(writer);
+    json_writer_object_end(writer);
+
+    json_writer_object_start(writer, "first_frame_ms");
+    json_writer_uint(writer, "last", m->first_frame_time);
+    json_writer_uint(writer, "max", m->first_frame_time_max);
+    json_writer_object_end(writer);
+}
+
+void linky_metrics_print()
+{
+    const linky_metrics_t *m = &linky_metrics;
+    uint32_t elapsed = (MILLIS - m->start) / 1000;
+    printf("Duration: %" PRIu32 " s, bytes: %" PRIu32 " (%" PRIu32 " B/s)\n", elapsed, m->bytes, elapsed > 0 ? m->bytes / elapsed : 0);
+    printf("Frames: received: %" PRIu32 ", dropped: %" PRIu32 ", decoded: %" PRIu32 ", valid: %" PRIu32 "\n", m->frames_received, m->frames_dropped, m->frames_decoded, m->frames_valid);
+    printf("Groups: %" PRIu32 ", checksum errors: %" PRIu32 " (unknown label: %" PRIu32 "), invalid values: %" PRIu32 "\n", m->groups, m->checksum_errors, m->checksum_unknown_label,
+           m->value_errors);
+    for (uint32_t i = 0; i < LINKY_LABEL_LIST_SIZE; i++)
+    {
+        if (linky_label_checksum_errors[i] > 0)
+        {
+            printf("  %s: %d\n", linky_label_list[i].label, linky_label_checksum_errors[i]);
+        }
+    }
+    printf("UART: fifo overflow: %" PRIu32 ", buffer full: %" PRIu32 ", pattern overflow: %" PRIu32 ", break: %" PRIu32 ", parity: %" PRIu32 ", frame: %" PRIu32 "\n",
+           m->uart_fifo_overflow, m->uart_buffer_full, m->uart_pattern_overflow, m->uart_break, m->uart_parity, m->uart_frame);
+    printf("UART: wakeups: %" PRIu32 ", data events: %" PRIu32 ", %.1f wakeups per frame\n", m->uart_wakeups, m->uart_data_events,
+           m->frames_received > 0 ? (float)m->uart_wakeups / m->frames_received : 0);
+    printf("Decode time: max %" PRIu32 " us\n", m->decode_time_max);
+    for (uint32_t i = 0; i < LINKY_METRICS_DECODE_BUCKETS; i++)
+    {
+        if (i < LINKY_METRICS_DECODE_BUCKETS - 1)
+        {
+            printf("  < %5ld us: %" PRIu32 "\n", 250UL << i, m->decode_time[i]);
+        }
+        else
+        {
+            printf("  longer    : %" PRIu32 "\n", m->decode_time[i]);
+        }
+    }
+    printf("First valid frame: last %" PRIu32 " ms, max %" PRIu32 " ms\n", m->first_frame_time, m->first_frame_time_max);
+}
+
+/**
+ * @brief Compare a label of linky_label_list with a label of a given length
+ *
+ * @return <0, 0 or >0 like strcmp
+ */
+static int linky_label_compare(const char *list_label, const char *label, uint32_t len)
+{
+    int cmp = strncmp(list_label, label, len);
+    if (cmp != 0)
+    {
+        return cmp;
+    }
+    return (unsigned char)list_label[len]; // 0 if same length, >0 if list_label is longer
+}
+
+static int linky_label_index_sort(const void *a, const void *b)
+{
+    const linky_value_t *first = &linky_label_list[*(const uint8_t *)a];
+    const linky_value_t *second = &linky_label_list[*(const uint8_t *)b];
+    if (first->mode != second->mode)
+    {
+        return (int)first->mode - (int)second->mode;
+    }
+    return strcmp(first->label, second->label);
+}
+
+static void linky_build_label_index()
+{
+    if (linky_label_index_ready)
+    {
+        return;
+    }
+    _Static_assert(LINKY_LABEL_LIST_SIZE <= UINT8_MAX, "linky_label_index uses uint8_t indexes");
+    for (uint32_t i = 0; i < LINKY_LABEL_LIST_SIZE; i++)
+    {
+        linky_label_index[i] = i;
+    }
+    qsort(linky_label_index, LINKY_LABEL_LIST_SIZE, sizeof(linky_label_index[0]), linky_label_index_sort);
+
+    memset(linky_label_index_range, 0, sizeof(linky_label_index_range));
+    for (uint32_t i = 0; i < LINKY_LABEL_LIST_SIZE; i++)
+    {
+        linky_mode_t mode = linky_label_list[linky_label_index[i]].mode;
+        if (linky_label_index_range[mode].count == 0)
+        {
+            linky_label_index_range[mode].start = i;
+        }
+        linky_label_index_range[mode].count++;
+    }
+
+    memset(linky_mode_label_count, 0, sizeof(linky_mode_label_count));
+    for (uint32_t mode = MODE_HIST; mode <= MODE_STD; mode++)
+    {
+        for (uint32_t i = 0; i < LINKY_LABEL_LIST_SIZE; i++)
+        {
+            if (linky_label_list[i].data == NULL || (linky_label_list[i].mode != mode && linky_label_list[i].mode != ANY))
+            {
+                continue;
+            }
+            linky_mode_label_index[mode][linky_mode_label_count[mode]++] = i;
+        }
+    }
+    linky_label_index_ready = true;
+}
+
+int32_t linky_get_label_index(const char *label, uint32_t len, linky_mode_t mode)
+{
+    if (label == NULL || mode > ANY)
+    {
+        return -1;
+    }
+
+#ifdef LINKY_BENCHMARK
+    if (linky_label_index_disabled)
+    {
+        for (uint32_t i = 0; i < LINKY_LABEL_LIST_SIZE; i++)
+        {
+            if (linky_label_list[i].mode == mode && linky_label_compare(linky_label_list[i].label, label, len) == 0)
+            {
+                return i;
+            }
+        }
+        return -1;
+    }
+#endif
+
+    if (!linky_label_index_ready)
+    {
+        linky_build_label_index();
+    }
+
+    // binary search in the labels of the mode
+    const uint8_t *index = linky_label_index + linky_label_index_range[mode].start;
+    int32_t low = 0;
+    int32_t high = (int32_t)linky_label_index_range[mode].count - 1;
+    while (low <= high)
+    {
+        int32_t middle = (low + high) / 2;
+        int cmp = linky_label_compare(linky_label_list[index[middle]].label, label, len);
+        if (cmp == 0)
+        {
+            return index[middle];
+        }
+        if (cmp < 0)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle - 1;
+        }
+    }
+    return -1;
+}
+
+const uint8_t *linky_get_mode_labels(linky_mode_t mode, uint32_t *count)
+{
+    if (mode > MODE_STD)
+    {
+        *count = 0;
+        return NULL;
+    }
+    if (!linky_label_index_ready)
+    {
+        linky_build_label_index();
+    }
+    *count = linky_mode_label_count[mode];
+    return linky_mode_label_index[mode];
 }
 
 linky_value_rw_t *linky_get_value_rw(uint32_t index)
@@ -1689,3 +3047,472 @@ linky_value_rw_t *linky_get_value_rw(uint32_t index)
     }
     return &linky_rw_values[index];
 }
+
+#ifdef LINKY_BENCHMARK
+/**
+ * @brief Decode a group like the previous implementation: the fields are copied to strings, and the label is
+ * compared with strcmp to every label of the list
+ *
+ * @param start the START_OF_GROUP
+ * @param end the END_OF_GROUP
+ */
+static void linky_benchmark_decode_group(const uint8_t *start, const uint8_t *end)
+{
+    const uint8_t *separators[SEPARATOR_COUNT] = {0};
+    uint8_t separator_count = 0;
+    for (const uint8_t *j = start; j < end; j++)
+    {
+        if (*j == linky_group_separator)
+        {
+            separators[separator_count++] = j;
+            if (separator_count >= SEPARATOR_COUNT)
+            {
+                break;
+            }
+        }
+    }
+    if (separator_count < 2 || separator_count > 3)
+    {
+        return;
+    }
+
+    char label[20] = {0};
+    char value[100] = {0};
+    char time[20] = {0};
+    char checksum[5] = {0};
+    memcpy(label, start + 1, separators[0] - start - 1);
+    if (linky_mode == MODE_STD && separator_count == 3)
+    {
+        memcpy(time, separators[0] + 1, separators[1] - separators[0] - 1);
+        memcpy(value, separators[1] + 1, separators[2] - separators[1] - 1);
+        memcpy(checksum, separators[2] + 1, end - separators[2] - 1);
+    }
+    else
+    {
+        memcpy(value, separators[0] + 1, separators[1] - separators[0] - 1);
+        memcpy(checksum, separators[1] + 1, end - separators[1] - 1);
+    }
+    if (linky_checksum(label, value, time) != checksum[0])
+    {
+        return;
+    }
+
+    for (uint32_t j = 0; j < linky_label_list_size; j++)
+    {
+        if (linky_mode != linky_label_list[j].mode || strcmp(linky_label_list[j].label, label) != 0)
+        {
+            continue;
+        }
+        switch (linky_label_list[j].type)
+        {
+        case STRING:
+        {
+            uint32_t size = MIN(strlen(value), linky_label_list[j].size);
+            strncpy((char *)linky_label_list[j].data, value, size);
+            ((char *)linky_label_list[j].data)[size] = 0;
+            break;
+        }
+        case UINT8:
+            *(uint8_t *)linky_label_list[j].data = strtoul(value, NULL, 10);
+            break;
+        case UINT16:
+            *(uint16_t *)linky_label_list[j].data = strtoul(value, NULL, 10);
+            break;
+        case UINT32:
+            *(uint32_t *)linky_label_list[j].data = strtoul(value, NULL, 10);
+            break;
+        case UINT64:
+            *(uint64_t *)linky_label_list[j].data = strtoull(value, NULL, 10);
+            break;
+        case UINT32_TIME:
+        {
+            linky_span_t span = {(const uint8_t *)time, strlen(time)};
+            time_label_t timeLabel = {0};
+            timeLabel.time = linky_decode_time(&span);
+            timeLabel.value = strtoull(value, NULL, 10);
+            *(time_label_t *)linky_label_list[j].data = timeLabel;
+            break;
+        }
+        default:
+            break;
+        }
+    }
+}
+
+/**
+ * @brief Decode a frame like the previous implementation: each UART chunk was appended to a buffer, and once
+ * it held LINKY_DECODE_LEN bytes, the whole buffer was scanned again from its first byte at each UART_DATA event.
+ * Only used to compare the streaming parser with the old behavior.
+ */
+static void linky_benchmark_rescan(const uint8_t *data, uint32_t size, uint8_t *buffer, raw_group_t *groups)
+{
+    uint32_t buffer_size = 0;
+    for (uint32_t offset = 0; offset < size; offset += UART_HW_FIFO_LEN(LINKY_UART))
+    {
+        uint32_t chunk = MIN(MIN(UART_HW_FIFO_LEN(LINKY_UART), size - offset), (LINKY_RESCAN_BUFFER_SIZE - 1) - buffer_size);
+        memcpy(buffer + buffer_size, data + offset, chunk);
+        buffer_size += chunk;
+        if (buffer_size < LINKY_DECODE_LEN)
+        {
+            continue;
+        }
+
+        memset(groups, 0, GROUP_COUNT * sizeof(raw_group_t));
+        uint32_t group_count = 0;
+        bool start_found = false;
+        for (uint32_t i = 0; i < buffer_size && group_count < GROUP_COUNT; i++)
+        {
+            if (buffer[i] == START_OF_GROUP)
+            {
+                groups[group_count].start = buffer + i;
+                start_found = true;
+            }
+            else if (buffer[i] == END_OF_GROUP && start_found)
+            {
+                groups[group_count++].end = buffer + i;
+                start_found = false;
+            }
+        }
+        for (uint32_t i = 0; i < group_count; i++)
+        {
+            linky_benchmark_decode_group(groups[i].start, groups[i].end);
+        }
+    }
+}
+#endif
+
+/**
+ * @brief Decode a frame with the streaming parser, fed with chunks of the UART FIFO size
+ *
+ * @return int64_t the total decoding time in us
+ */
+static int64_t linky_benchmark_stream(const uint8_t *frame, uint32_t frame_size, uint32_t iterations, linky_parser_t *parser)
+{
+    int64_t start = esp_timer_get_time();
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+        for (uint32_t offset = 0; offset < frame_size; offset += UART_HW_FIFO_LEN(LINKY_UART))
+        {
+            linky_parser_feed(parser, frame + offset, MIN(UART_HW_FIFO_LEN(LINKY_UART), frame_size - offset));
+        }
+    }
+    return esp_timer_get_time() - start;
+}
+
+esp_err_t linky_benchmark(uint32_t iterations)
+{
+    const uint8_t *frame = (const uint8_t *)linky_std_debug_buffer;
+    const uint32_t frame_size = sizeof(linky_std_debug_buffer);
+    linky_mode_t previous_mode = linky_mode;
+    esp_err_t err = ESP_OK;
+
+    raw_group_t *groups = malloc(GROUP_COUNT * sizeof(raw_group_t));
+    if (groups == NULL)
+    {
+        ESP_LOGE(TAG, "Benchmark: out of memory");
+        return ESP_ERR_NO_MEM;
+    }
+
+    linky_set_mode(MODE_STD);
+    linky_parser_t parser = {0};
+
+#ifdef LINKY_BENCHMARK
+    // previous implementation, with a linear search of the labels
+    uint8_t *buffer = malloc(LINKY_RESCAN_BUFFER_SIZE);
+    if (buffer == NULL)
+    {
+        ESP_LOGE(TAG, "Benchmark: out of memory");
+        free(groups);
+        return ESP_ERR_NO_MEM;
+    }
+    linky_clear_data();
+    int64_t rescan_time = esp_timer_get_time();
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+        linky_benchmark_rescan(frame, frame_size, buffer, groups);
+    }
+    rescan_time = esp_timer_get_time() - rescan_time;
+    linky_data_std rescan_data = linky_data.std;
+    free(buffer);
+
+    // streaming parser, with a linear search of the labels
+    linky_label_index_disabled = true;
+    linky_clear_data();
+    int64_t linear_time = linky_benchmark_stream(frame, frame_size, iterations, &parser);
+    if (memcmp(&rescan_data, &linky_data.std, sizeof(rescan_data)) != 0)
+    {
+        ESP_LOGE(TAG, "Benchmark: decoded values differ (stream, linear search)");
+        err = ESP_FAIL;
+    }
+    linky_label_index_disabled = false;
+#endif
+
+    // streaming parser, with the label index
+    linky_clear_data();
+    memset(&parser, 0, sizeof(parser));
+    int64_t index_time = linky_benchmark_stream(frame, frame_size, iterations, &parser);
+    if (parser.frames_valid != iterations)
+    {
+        ESP_LOGE(TAG, "Benchmark: %" PRIu32 " valid frames out of %" PRIu32, parser.frames_valid, iterations);
+        err = ESP_FAIL;
+    }
+
+    ESP_LOGI(TAG, "Benchmark: %" PRIu32 " frames of %" PRIu32 " bytes, %" PRIu32 " groups per frame", iterations, frame_size, parser.groups / iterations);
+#ifdef LINKY_BENCHMARK
+    if (memcmp(&rescan_data, &linky_data.std, sizeof(rescan_data)) != 0)
+    {
+        ESP_LOGE(TAG, "Benchmark: decoded values differ (stream, label index)");
+        err = ESP_FAIL;
+    }
+    ESP_LOGI(TAG, "Benchmark: rescan: %" PRId64 " us/frame", rescan_time / iterations);
+    ESP_LOGI(TAG, "Benchmark: stream, linear search: %" PRId64 " us/frame", linear_time / iterations);
+#endif
+    ESP_LOGI(TAG, "Benchmark: stream, label index: %" PRId64 " us/frame", index_time / iterations);
+
+    // tokenize and checksum of the groups, without the label lookup and the conversion
+    uint32_t group_count = 0;
+    memset(groups, 0, GROUP_COUNT * sizeof(raw_group_t));
+    for (uint32_t i = 0; i < frame_size && group_count < GROUP_COUNT; i++)
+    {
+        if (frame[i] == START_OF_GROUP)
+        {
+            groups[group_count].start = (uint8_t *)frame + i + 1;
+        }
+        else if (frame[i] == END_OF_GROUP && groups[group_count].start != NULL)
+        {
+            groups[group_count++].end = (uint8_t *)frame + i;
+        }
+    }
+    uint32_t valid_groups = 0;
+    int64_t start = esp_timer_get_time();
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+        for (uint32_t j = 0; j < group_count; j++)
+        {
+            linky_tokens_t tokens;
+            valid_groups += linky_tokenize_group(groups[j].start, groups[j].end - groups[j].start, &tokens) && tokens.computed == tokens.checksum;
+        }
+    }
+    int64_t checksum_time = esp_timer_get_time() - start;
+    if (valid_groups != group_count * iterations)
+    {
+        ESP_LOGE(TAG, "Benchmark: %" PRIu32 " invalid groups", group_count * iterations - valid_groups);
+        err = ESP_FAIL;
+    }
+    ESP_LOGI(TAG, "Benchmark: tokenize and checksum of %" PRIu32 " groups: %" PRId64 " ns/frame", group_count, checksum_time * 1000 / iterations);
+
+    // numeric values of the debug frames: previous conversion of a null terminated copy with strtoull
+    static const char *const values[] = {"050019226", "022235340", "000000000", "062105110", "03900", "06082", "00540", "017", "227", "12", "30", "00"};
+    const uint32_t values_count = sizeof(values) / sizeof(values[0]);
+    uint64_t strtoull_sum = 0;
+    start = esp_timer_get_time();
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+        for (uint32_t j = 0; j < values_count; j++)
+        {
+            char copy[20];
+            uint32_t size = strlen(values[j]);
+            memcpy(copy, values[j], size);
+            copy[size] = '\0';
+            strtoull_sum += strtoull(copy, NULL, 10);
+        }
+    }
+    int64_t strtoull_time = esp_timer_get_time() - start;
+
+    uint64_t swar_sum = 0;
+    start = esp_timer_get_time();
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+        for (uint32_t j = 0; j < values_count; j++)
+        {
+            linky_span_t span = {(const uint8_t *)values[j], strlen(values[j])};
+            uint64_t value = 0;
+            linky_span_to_uint(&span, &value);
+            swar_sum += value;
+        }
+    }
+    int64_t swar_time = esp_timer_get_time() - start;
+    if (swar_sum != strtoull_sum)
+    {
+        ESP_LOGE(TAG, "Benchmark: converted values differ (strtoull %" PRIu64 ", swar %" PRIu64 ")", strtoull_sum, swar_sum);
+        err = ESP_FAIL;
+    }
+    const linky_span_t corrupted = {(const uint8_t *)"05001*226", 9};
+    uint64_t corrupted_value = 0;
+    if (linky_span_to_uint(&corrupted, &corrupted_value))
+    {
+        ESP_LOGE(TAG, "Benchmark: corrupted value accepted");
+        err = ESP_FAIL;
+    }
+    ESP_LOGI(TAG, "Benchmark: %" PRIu32 " values: strtoull: %" PRId64 " ns/value, swar: %" PRId64 " ns/value", values_count, strtoull_time * 1000 / (iterations * values_count),
+             swar_time * 1000 / (iterations * values_count));
+
+    free(groups);
+    if (previous_mode <= MODE_STD)
+    {
+        linky_set_mode(previous_mode);
+    }
+    linky_clear_data();
+    return err;
+}
+
+void linky_replay_start(linky_mode_t mode)
+{
+    linky_replay_previous_mode = linky_mode;
+    linky_replay_saved_metrics = linky_metrics; // the replayed groups must not count in the metrics of the line
+    memset(&linky_replay_parser, 0, sizeof(linky_replay_parser));
+    linky_set_mode(mode <= MODE_STD ? mode : MODE_STD);
+    linky_clear_data();
+}
+
+void linky_replay_feed(const uint8_t *data, uint32_t size, linky_mode_t mode, linky_replay_t *replay)
+{
+    if (mode <= MODE_STD && mode != linky_mode)
+    {
+        linky_set_mode(mode); // the capture was recorded across a mode change
+    }
+    uint32_t checksum_errors = linky_metrics.checksum_errors;
+    uint32_t value_errors = linky_metrics.value_errors;
+    int64_t start = esp_timer_get_time();
+    linky_parser_feed(&linky_replay_parser, data, size);
+    replay->decode_time += esp_timer_get_time() - start;
+
+    replay->bytes += size;
+    replay->frames = linky_replay_parser.frames;
+    replay->frames_valid = linky_replay_parser.frames_valid;
+    replay->groups = linky_replay_parser.groups;
+    replay->checksum_errors += linky_metrics.checksum_errors - checksum_errors;
+    replay->value_errors += linky_metrics.value_errors - value_errors;
+}
+
+void linky_replay_end()
+{
+    linky_metrics = linky_replay_saved_metrics;
+    if (linky_replay_previous_mode <= MODE_STD)
+    {
+        linky_set_mode(linky_replay_previous_mode);
+    }
+    linky_clear_data();
+}
+
+/**
+ * @brief Score a frame for the mode detection, as if it was received in a given mode
+ */
+static int32_t linky_sniff_frame(const char *frame, uint32_t size, linky_mode_t mode, linky_sniff_t *sniff)
+{
+    linky_mode_t previous_mode = linky_mode;
+    uint8_t previous_separator = linky_group_separator;
+    linky_mode = mode;
+    linky_group_separator = mode == MODE_STD ? 0x09 : 0x20;
+
+    memset(sniff, 0, sizeof(*sniff));
+    linky_sniff_feed(sniff, (const uint8_t *)frame, size);
+    int32_t score = linky_sniff_score(sniff);
+
+    linky_mode = previous_mode;
+    linky_group_separator = previous_separator;
+    return score;
+}
+
+esp_err_t linky_sniff_test()
+{
+    const struct
+    {
+        const char *name;
+        const char *frame;
+        uint32_t size;
+        linky_mode_t mode;
+    } frames[] = {
+        {"historique", linky_hist_debug_buffer, sizeof(linky_hist_debug_buffer) - 1, MODE_HIST},
+        {"standard", linky_std_debug_buffer, sizeof(linky_std_debug_buffer), MODE_STD},
+        {"standard corrupted", linky_std_debug_buffer_bad, sizeof(linky_std_debug_buffer_bad), MODE_STD},
+    };
+    esp_err_t err = ESP_OK;
+    linky_sniff_t *sniff = malloc(sizeof(linky_sniff_t));
+    if (sniff == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    for (uint32_t i = 0; i < sizeof(frames) / sizeof(frames[0]); i++)
+    {
+        int32_t hist = linky_sniff_frame(frames[i].frame, frames[i].size, MODE_HIST, sniff);
+        int32_t std = linky_sniff_frame(frames[i].frame, frames[i].size, MODE_STD, sniff);
+        linky_mode_t found = std > hist ? MODE_STD : MODE_HIST;
+        ESP_LOGI(TAG, "Mode detection: %s frame: score historique: %" PRId32 ", standard: %" PRId32, frames[i].name, hist, std);
+        if (found != frames[i].mode || MAX(hist, std) <= 0)
+        {
+            ESP_LOGE(TAG, "Mode detection: %s frame detected as %s", frames[i].name, linky_str_mode[found]);
+            err = ESP_FAIL;
+        }
+    }
+    free(sniff);
+    return err;
+}
+
+esp_err_t linky_time_test()
+{
+    static const uint8_t days_in_month[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    esp_err_t err = ESP_OK;
+    uint32_t checked = 0;
+    int64_t mktime_time = 0;
+    int64_t decode_time = 0;
+    char horodate[32]; // 13 characters, the compiler cannot bound the %02 fields
+
+    // every hour from 2000 to 2099, compared with mktime (the system time zone is UTC)
+    for (uint32_t year = 2000; year <= 2099; year++)
+    {
+        for (uint32_t month = 1; month <= 12; month++)
+        {
+            uint32_t days = days_in_month[month - 1] + (month == 2 && year % 4 == 0);
+            for (uint32_t day = 1; day <= days; day++)
+            {
+                for (uint32_t hour = 0; hour < 24; hour++)
+                {
+                    uint32_t minute = (hour * 7 + day) % 60;
+                    uint32_t second = (day * 13 + month) % 60;
+                    char season = (checked % 2) ? 'E' : 'H';
+                    snprintf(horodate, sizeof(horodate), "%c%02" PRIu32 "%02" PRIu32 "%02" PRIu32 "%02" PRIu32 "%02" PRIu32 "%02" PRIu32, season, year % 100, month, day, hour, minute, second);
+
+                    int64_t start = esp_timer_get_time();
+                    struct tm tm = {
+                        .tm_year = year - 1900,
+                        .tm_mon = month - 1,
+                        .tm_mday = day,
+                        .tm_hour = hour,
+                        .tm_min = minute,
+                        .tm_sec = second,
+                    };
+                    time_t expected = mktime(&tm) - (season == 'E' ? 7200 : 3600);
+                    mktime_time += esp_timer_get_time() - start;
+
+                    start = esp_timer_get_time();
+                    linky_span_t span = {(const uint8_t *)horodate, 13};
+                    time_t decoded = linky_decode_time(&span);
+                    decode_time += esp_timer_get_time() - start;
+
+                    if (decoded != expected)
+                    {
+                        ESP_LOGE(TAG, "Time test: %s: %" PRId64 ", expected %" PRId64, horodate, (int64_t)decoded, (int64_t)expected);
+                        err = ESP_FAIL;
+                    }
+                    checked++;
+                }
+            }
+        }
+    }
+
+    static const char *const invalid[] = {"H24010717581X", "H241307175810", "H240100175810", "H240107245810", "H240107176010", "H2401071758"};
+    for (uint32_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++)
+    {
+        linky_span_t span = {(const uint8_t *)invalid[i], strlen(invalid[i])};
+        if (linky_decode_time(&span) != 0)
+        {
+            ESP_LOGE(TAG, "Time test: %s accepted", invalid[i]);
+            err = ESP_FAIL;
+        }
+    }
+
+    ESP_LOGI(TAG, "Time test: %" PRIu32 " horodates, mktime: %" PRId64 " ns, decode: %" PRId64 " ns", checked, mktime_time * 1000 / checked, decode_time * 1000 / checked);
+    return err;
+}
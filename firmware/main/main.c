@@ -36,6 +36,9 @@
 
 #include "common.h"
 #include "linky.h"
+#include "record.h"
+#include "history.h"
+#include "aggregate.h"
 #include "main.h"
 #include "config.h"
 #include "wifi.h"
@@ -53,6 +56,7 @@
 #include "esp_heap_trace.h"
 #include "esp_err.h"
 #include "esp_system.h"
+#include <sys/param.h>
 
 /*==============================================================================
  Local Define
@@ -75,6 +79,11 @@
 ===============================================================================*/
 static void main_print_heap_diff();
 static void main_ota_check();
+static uint32_t main_post_records();
+static void main_records_to_history(uint32_t sent);
+static esp_err_t main_history_to_records(const linky_data_t *data, void *arg);
+static bool main_stream_available();
+static void main_stream();
 
 /*==============================================================================
 Public Variable
@@ -85,9 +94,9 @@ uint32_t main_sleep_time = 99999;
  Local Variable
 ===============================================================================*/
 static esp_pm_lock_handle_t main_init_lock;
+static bool main_streaming = false;         // The connection stays up between the readings (VUSB connected)
+static uint32_t main_stream_history_time = 0; // Last reading stored in the history while streaming (ms)
 
-linky_data_t main_data_array[MAX_DATA_INDEX];
-unsigned int main_data_index = 0;
 
 /*==============================================================================
 Function Implementation
@@ -116,6 +125,7 @@ void app_main(void)
   config_begin();
   led_start_pattern(LED_BOOT);
   linky_init(RX_LINKY);
+  history_init();
   esp_pm_lock_create(ESP_PM_APB_FREQ_MAX, 0, "main_init", &main_init_lock);
   esp_pm_lock_acquire(main_init_lock);
 
@@ -277,10 +287,16 @@ void main_task(void *pvParameters)
 
   while (1)
   {
-    main_sleep_time = abs((int32_t)config_values.refresh_rate - (int32_t)fetching_time[config_values.mode] - ((LINKY_READING_TIMEOUT / 1000) - 2));
+    if (main_stream_available())
+    {
+      main_stream(); // returns when VUSB is disconnected
+    }
+
+    // linky_update returns as soon as a frame is received: use the last reading time instead of the timeout
+    main_sleep_time = abs((int32_t)config_values.refresh_rate - (int32_t)fetching_time[config_values.mode] - (int32_t)(linky_read_time / 1000));
     ESP_LOGI(MAIN_TAG, "Waiting for %ld seconds", main_sleep_time);
     esp_pm_lock_release(main_init_lock);
-    while (main_sleep_time > 0)
+    while (main_sleep_time > 0 && !main_stream_available())
     {
       vTaskDelay(1000 / portTICK_PERIOD_MS);
       main_sleep_time--;
@@ -333,41 +349,50 @@ esp_err_t main_send_data(linky_data_t *data)
   {
   case MODE_HTTP:
   {
-    // send data to web server
-    if (main_data_index >= MAX_DATA_INDEX)
+    // store the reading in the records, sent to the web server every store_before_send readings
+    err = record_add(data);
+    bool full = (err == ESP_ERR_NO_MEM);
+    uint32_t sent = 0; // records posted, the others go to the history
+    err = ESP_OK;
+    ESP_LOGI(MAIN_TAG, "Data stored: %ld/%d (%ld bytes): time: %lld", record_count(), config_values.web.store_before_send, record_size(), linky_data.timestamp);
+    if (record_count() >= config_values.web.store_before_send || record_count() >= MAX_DATA_INDEX || full)
     {
-      main_data_index = 0;
-    }
-    main_data_array[main_data_index++] = *data;
-    ESP_LOGI(MAIN_TAG, "Data stored: %d/%d: time: %lld", main_data_index, config_values.web.store_before_send, linky_data.timestamp);
-    if (main_data_index >= config_values.web.store_before_send || main_data_index >= MAX_DATA_INDEX)
-    {
-      char *json = NULL;
-      web_preapare_json_data(main_data_array, main_data_index, &json);
-      if (json == NULL)
-      {
-        ESP_LOGE(MAIN_TAG, "Cant prepare json data");
-        err = ESP_FAIL;
-        break;
-      }
-
       ESP_LOGI(MAIN_TAG, "Sending data to server");
       err = wifi_connect();
       if (err == ESP_OK)
       {
-        ESP_LOGI(MAIN_TAG, "POST: %s", json);
-        wifi_send_to_server(json);
+        sent = main_post_records();
+        err = sent == record_count() ? ESP_OK : ESP_FAIL;
+        // the readings stored while the server was unreachable are sent after the new ones
+        for (uint32_t replayed = 0; err == ESP_OK && replayed < HISTORY_REPLAY_MAX && history_count() > 0;)
+        {
+          record_reset();
+          uint32_t count = history_read(main_history_to_records, NULL, MAX_DATA_PER_POST);
+          uint32_t posted = count > 0 ? main_post_records() : 0;
+          history_consume(posted); // the oldest readings are posted first
+          replayed += posted;
+          if (count == 0 || posted != count)
+          {
+            break;
+          }
+        }
         main_ota_check();
-        err = ESP_OK;
       }
       else
       {
         ESP_LOGE(MAIN_TAG, "Wifi connection failed");
-        err = ESP_FAIL;
       }
-      free(json);
       wifi_disconnect();
-      main_data_index = 0;
+      if (err != ESP_OK)
+      {
+        main_records_to_history(sent); // keep the readings not posted until the next successful send
+        err = ESP_FAIL;
+      }
+      record_reset();
+      if (full)
+      {
+        record_add(data); // the reading that did not fit starts the next batch
+      }
     }
     break;
   }
@@ -380,6 +405,20 @@ esp_err_t main_send_data(linky_data_t *data)
     {
       ESP_LOGE(MAIN_TAG, "Some data will not be sent, but we continue");
     }
+    // the readings stored while the server was unreachable are published on the history topic
+    uint32_t replayed = history_read(mqtt_prepare_history, NULL, MAX_DATA_PER_POST);
+    mqtt_prepare_metrics();
+    // the closed load curve buckets are kept until they are published
+    aggregate_bucket_t buckets[AGGREGATE_QUEUE_SIZE];
+    uint32_t bucket_count = aggregate_read(buckets, AGGREGATE_QUEUE_SIZE);
+    for (uint32_t i = 0; i < bucket_count; i++)
+    {
+      if (mqtt_prepare_aggregate(&buckets[i]) != ESP_OK)
+      {
+        bucket_count = i;
+        break;
+      }
+    }
     ret = wifi_connect();
     if (ret != ESP_OK)
     {
@@ -394,7 +433,13 @@ esp_err_t main_send_data(linky_data_t *data)
       goto send_error;
     }
 
+    history_consume(replayed);
+    aggregate_consume(bucket_count);
     main_ota_check();
+    if (main_streaming)
+    {
+      break; // the connection is kept for the next frame
+    }
     vTaskDelay(100 / portTICK_PERIOD_MS);
     wifi_disconnect();
     led_start_pattern(LED_SEND_OK);
@@ -403,6 +448,12 @@ esp_err_t main_send_data(linky_data_t *data)
   send_error:
     wifi_disconnect();
     led_start_pattern(LED_SEND_FAILED);
+    // while streaming, store one reading per refresh period to limit the flash writes
+    if (!main_streaming || MILLIS - main_stream_history_time >= config_values.refresh_rate * 1000)
+    {
+      history_append(data); // published with the next successful send
+      main_stream_history_time = MILLIS;
+    }
     err = ESP_FAIL;
     break;
   }
@@ -474,11 +525,135 @@ esp_err_t main_send_data(linky_data_t *data)
   default:
     break;
   }
+  if (err == ESP_OK)
+  {
+    linky_clear_dirty(); // the next send only publishes the changed values
+  }
   ESP_LOGI(MAIN_TAG, "Data sent, clear data");
   linky_clear_data();
   return err;
 }
 
+/**
+ * @brief Send the stored records to the web server, stopping at the first failed request
+ *
+ * @return uint32_t the number of records sent, counted from the first one
+ */
+static uint32_t main_post_records()
+{
+  record_iterator_t *records = malloc(sizeof(record_iterator_t));
+  if (records == NULL)
+  {
+    ESP_LOGE(MAIN_TAG, "Cant allocate the records iterator");
+    return 0;
+  }
+
+  record_iterator_init(records);
+  uint32_t sent = 0;
+  uint32_t count = 0;
+  do
+  {
+    char *json = NULL;
+    count = web_preapare_json_data(records, MAX_DATA_PER_POST, &json);
+    if (json == NULL)
+    {
+      ESP_LOGE(MAIN_TAG, "Cant prepare json data");
+      break;
+    }
+    ESP_LOGI(MAIN_TAG, "POST: %s", json);
+    bool posted = wifi_send_to_server(json);
+    free(json);
+    if (!posted)
+    {
+      break;
+    }
+    sent += count;
+  } while (count == MAX_DATA_PER_POST && records->index < record_count());
+  free(records);
+  return sent;
+}
+
+/**
+ * @brief Move the stored records not sent yet to the flash history
+ *
+ * @param sent the number of records already sent, counted from the first one
+ */
+static void main_records_to_history(uint32_t sent)
+{
+  record_iterator_t *records = malloc(sizeof(record_iterator_t));
+  if (records == NULL)
+  {
+    ESP_LOGE(MAIN_TAG, "Cant allocate the records iterator: %ld readings lost", record_count() - sent);
+    return;
+  }
+  record_iterator_init(records);
+  for (uint32_t i = 0; record_next(records); i++)
+  {
+    if (i >= sent)
+    {
+      history_append(&records->state.data);
+    }
+  }
+  free(records);
+}
+
+static esp_err_t main_history_to_records(const linky_data_t *data, void *arg)
+{
+  return record_add(data);
+}
+
+/**
+ * @brief Check if every frame can be published: VUSB connected, streaming enabled and a MQTT mode
+ *
+ * @return true if main_stream can be used
+ */
+static bool main_stream_available()
+{
+  return config_values.stream && gpio_vusb_connected() && (config_values.mode == MODE_MQTT || config_values.mode == MODE_MQTT_HA);
+}
+
+/**
+ * @brief Publish the changed values of each frame while VUSB is connected
+ * The wifi and MQTT connections stay up between the frames.
+ * Returns when VUSB is disconnected: the readings are then done every refresh_rate seconds
+ */
+static void main_stream()
+{
+  ESP_LOGI(MAIN_TAG, "VUSB connected: publishing every frame");
+  esp_pm_lock_acquire(main_init_lock);
+  main_streaming = true;
+  mqtt_set_persistent(true);
+  uint32_t err_count = 0;
+
+  while (main_stream_available())
+  {
+    if (!linky_update(LINKY_READING_TIMEOUT))
+    {
+      ESP_LOGE(MAIN_TAG, "Linky update failed");
+      led_start_pattern(LED_LINKY_FAILED);
+      continue;
+    }
+
+    if (main_send_data(&linky_data) != ESP_OK)
+    {
+      // the frames received while waiting are dropped, the next reading gets a complete frame
+      err_count++;
+      ESP_LOGE(MAIN_TAG, "Stream send failed %ld times, retry in %ld s", err_count, MIN(err_count, 30));
+      vTaskDelay(MIN(err_count, 30) * 1000 / portTICK_PERIOD_MS);
+    }
+    else
+    {
+      err_count = 0;
+    }
+  }
+
+  main_streaming = false;
+  mqtt_set_persistent(false);
+  wifi_disconnect();
+  esp_pm_lock_release(main_init_lock);
+  ESP_LOGI(MAIN_TAG, "VUSB disconnected: reading every %d seconds", config_values.refresh_rate);
+}
+
 static void main_ota_check()
 {
   static uint64_t next_update_check = 0;
@@ -20,9 +20,12 @@
 #include "wifi.h"
 #include "gpio.h"
 #include "led.h"
-#include "cJSON.h"
+#include "web.h"
+#include "json_writer.h"
 #include "esp_ota_ops.h"
 #include "mbedtls/md.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
 
 /*==============================================================================
  Local Define
@@ -35,6 +38,19 @@
 #define MQTT_SEND_TIMEOUT 10000 // in ms
 #define MANUFACTURER "GammaTroniques"
 #define MQTT_QOS 1
+#define MQTT_METRICS_INTERVAL (10 * 60 * 1000) // Minimum time between two diagnostics messages (ms)
+#define MQTT_STATE_TOPIC "state"                // Topic of the whole reading when config_values.mqtt_batch is set
+#define MQTT_HA_STATUS_TOPIC "homeassistant/status" // Home Assistant publishes "online" on it when it starts
+#define MQTT_DISCOVERY_NVS "ha-discovery"           // Hash of the published discovery config of each label
+#define MQTT_PENDING_MAX 256                        // Messages waiting for their acknowledgment, beyond: wait for the empty outbox
+#define MQTT_EARLY_ACK_MAX 8                        // Acknowledgments received before esp_mqtt_client_enqueue returned
+#define MQTT_DISCOVERY_SIZE 1024                    // Discovery config of a label
+#define MQTT_JSON_CHUNK 256                         // Chunk of the state and diagnostics messages, copied to the allocated json
+
+#define MQTT_CONNECTED_BIT BIT0
+#define MQTT_DISCONNECTED_BIT BIT1
+#define MQTT_ERROR_BIT BIT2
+#define MQTT_PUBLISHED_BIT BIT3 // The last pending message is acknowledged
 /*==============================================================================
  Local Macro
 ===============================================================================*/
@@ -60,6 +76,12 @@ typedef struct
     char ha_discovery_configured_temp;
 } mqtt_topic_t;
 
+typedef struct
+{
+    uint16_t offset; // Offset of the topic in mqtt_topic_pool
+    uint8_t length;  // 0 if the label is not in the pool
+} mqtt_topic_entry_t;
+
 // #define MQTT_DEBUG
 
 #ifdef MQTT_DEBUG
@@ -75,7 +97,21 @@ typedef struct
  Local Function Declaration
 ===============================================================================*/
 static void log_error_if_nonzero(const char *message, int error_code);
-static void mqtt_create_sensor(char *json, char *config_topic, linky_value_t sensor);
+static esp_err_t mqtt_create_sensor(char *json, size_t size, char *config_topic, size_t config_topic_size, linky_value_t sensor);
+static void mqtt_config_topic(char *config_topic, size_t size, const linky_value_t *sensor);
+static uint32_t mqtt_hash(uint32_t hash, const void *data, size_t size);
+static uint32_t mqtt_discovery_base_hash();
+static bool mqtt_discovery_load();
+static void mqtt_discovery_save();
+static int mqtt_enqueue(const char *topic, const char *data, int qos, int retain);
+static bool mqtt_pending_remove(int msg_id);
+static void mqtt_pending_reset();
+static uint16_t mqtt_pending_get(bool *overflow);
+static void mqtt_build_topics();
+static const char *mqtt_get_topic(uint32_t index);
+static bool mqtt_format_value(uint32_t i, char *str, size_t size);
+static char *mqtt_state_json(bool *dirty);
+static uint8_t mqtt_prepare_state();
 void mqtt_setup_ha_discovery(bool with_delete);
 void mqtt_topic_comliance(char *topic, int size);
 void mqtt_disconnect_task(void *pvParameters);
@@ -89,11 +125,31 @@ esp_mqtt_client_handle_t mqtt_client = NULL;
  Local Variable
 ===============================================================================*/
 static mqtt_state_t mqtt_state = MQTT_DEINIT;
+static bool mqtt_persistent = false; // Keep the connection up after mqtt_send (streaming mode)
 static uint16_t mqtt_sent_count = 0;
 static uint16_t mqtt_sensors_count = 0;
+static uint32_t *mqtt_discovery_hash = NULL; // Hash of the discovery config published for each label, 0 if not published
+static bool mqtt_discovery_loaded = false;   // mqtt_discovery_hash is read from the NVS
+static bool mqtt_discovery_changed = false;  // mqtt_discovery_hash is not saved yet
+static uint32_t mqtt_discovery_cleaned = 0;   // Mode and config for which the labels of the other mode are deleted, 0 if not done
+static volatile bool mqtt_ha_restarted = false; // Set by the MQTT task when Home Assistant publishes "online"
 
 static mqtt_topic_t mqtt_topics = {0};
+static char *mqtt_topic_pool = NULL;                 // "<topic>/<label>" of each label of the mode, null terminated
+static mqtt_topic_entry_t *mqtt_topic_entries = NULL; // Topic of each label of linky_label_list
+static uint32_t mqtt_topic_generation = UINT32_MAX;   // config_generation of the pool
+static linky_mode_t mqtt_topic_mode = MODE_HIST;
 static EventGroupHandle_t mqtt_event_group = NULL;
+
+static portMUX_TYPE mqtt_pending_lock = portMUX_INITIALIZER_UNLOCKED; // The acknowledgments are received by the MQTT task
+static int mqtt_pending[MQTT_PENDING_MAX];              // Id of the messages waiting for their acknowledgment
+static uint16_t mqtt_pending_count = 0;
+static bool mqtt_pending_overflow = false;              // Some messages are not in mqtt_pending
+static int mqtt_early_acks[MQTT_EARLY_ACK_MAX] = {0};   // Acknowledged ids not found in mqtt_pending (0: empty)
+static uint8_t mqtt_early_ack_next = 0;
+static uint16_t mqtt_lost_count = 0;                    // Messages deleted from the outbox without acknowledgment during the cycle
+static uint32_t mqtt_lost_total = 0;                    // Same, since the boot
+static uint32_t mqtt_last_latency = 0;                  // Time from mqtt_send to the last acknowledgment of the last cycle (ms)
 static esp_mqtt_connect_return_code_t last_return_code = 0;
 static esp_mqtt_error_type_t last_error_type;
 
@@ -112,6 +168,173 @@ static void log_error_if_nonzero(const char *message, int error_code)
     }
 }
 
+/**
+ * @brief Enqueue a message and track its acknowledgment
+ *
+ * @return int the message id, -1 on error, -2 if the outbox is full
+ */
+static int mqtt_enqueue(const char *topic, const char *data, int qos, int retain)
+{
+    int msg_id = esp_mqtt_client_enqueue(mqtt_client, topic, data, 0, qos, retain, true);
+    if (msg_id <= 0)
+    {
+        return msg_id; // error, or QoS 0 without acknowledgment
+    }
+
+    taskENTER_CRITICAL(&mqtt_pending_lock);
+    bool acknowledged = false;
+    for (uint32_t i = 0; i < MQTT_EARLY_ACK_MAX; i++)
+    {
+        if (mqtt_early_acks[i] == msg_id)
+        {
+            mqtt_early_acks[i] = 0; // the connection is up: already acknowledged
+            acknowledged = true;
+            break;
+        }
+    }
+    if (!acknowledged && mqtt_pending_count < MQTT_PENDING_MAX)
+    {
+        mqtt_pending[mqtt_pending_count++] = msg_id;
+    }
+    else if (!acknowledged)
+    {
+        mqtt_pending_overflow = true;
+    }
+    taskEXIT_CRITICAL(&mqtt_pending_lock);
+    return msg_id;
+}
+
+/**
+ * @brief Remove an acknowledged or deleted message from the pending ones
+ *
+ * @param msg_id the message id
+ * @return true if it was the last pending message
+ */
+static bool mqtt_pending_remove(int msg_id)
+{
+    bool found = false;
+    taskENTER_CRITICAL(&mqtt_pending_lock);
+    for (uint32_t i = 0; i < mqtt_pending_count; i++)
+    {
+        if (mqtt_pending[i] == msg_id)
+        {
+            mqtt_pending[i] = mqtt_pending[--mqtt_pending_count];
+            found = true;
+            break;
+        }
+    }
+    if (!found)
+    {
+        // mqtt_enqueue has not recorded it yet
+        mqtt_early_acks[mqtt_early_ack_next] = msg_id;
+        mqtt_early_ack_next = (mqtt_early_ack_next + 1) % MQTT_EARLY_ACK_MAX;
+    }
+    bool last = found && mqtt_pending_count == 0;
+    taskEXIT_CRITICAL(&mqtt_pending_lock);
+    return last;
+}
+
+/**
+ * @brief Forget the messages of the previous send: an acknowledgment or a loss must not be counted in the next one
+ */
+static void mqtt_pending_reset()
+{
+    taskENTER_CRITICAL(&mqtt_pending_lock);
+    mqtt_pending_count = 0;
+    mqtt_pending_overflow = false;
+    memset(mqtt_early_acks, 0, sizeof(mqtt_early_acks));
+    mqtt_early_ack_next = 0;
+    mqtt_lost_count = 0;
+    taskEXIT_CRITICAL(&mqtt_pending_lock);
+}
+
+/**
+ * @brief Get the number of messages waiting for their acknowledgment
+ *
+ * @param overflow set to true if some messages are not tracked
+ */
+static uint16_t mqtt_pending_get(bool *overflow)
+{
+    taskENTER_CRITICAL(&mqtt_pending_lock);
+    uint16_t count = mqtt_pending_count;
+    *overflow = mqtt_pending_overflow;
+    taskEXIT_CRITICAL(&mqtt_pending_lock);
+    return count;
+}
+
+/**
+ * @brief Build the topics of the labels of the current mode in one allocation
+ */
+static void mqtt_build_topics()
+{
+    if (mqtt_topic_entries == NULL)
+    {
+        mqtt_topic_entries = calloc(linky_label_list_size, sizeof(mqtt_topic_entry_t));
+        if (mqtt_topic_entries == NULL)
+        {
+            return;
+        }
+    }
+    free(mqtt_topic_pool);
+    mqtt_topic_pool = NULL;
+    memset(mqtt_topic_entries, 0, linky_label_list_size * sizeof(mqtt_topic_entry_t));
+    mqtt_topic_generation = config_generation;
+    mqtt_topic_mode = linky_mode;
+
+    uint32_t count = 0;
+    const uint8_t *labels = linky_get_mode_labels(linky_mode, &count);
+    size_t prefix = strnlen(config_values.mqtt.topic, sizeof(config_values.mqtt.topic));
+    size_t size = 0;
+    for (uint32_t n = 0; n < count; n++)
+    {
+        size += prefix + 1 + strlen(linky_label_list[labels[n]].label) + 1;
+    }
+    if (size == 0 || size > UINT16_MAX || (mqtt_topic_pool = malloc(size)) == NULL)
+    {
+        ESP_LOGE(TAG, "Failed to build the topics: %zu bytes", size);
+        return;
+    }
+
+    uint16_t offset = 0;
+    for (uint32_t n = 0; n < count; n++)
+    {
+        uint32_t i = labels[n];
+        size_t label = strlen(linky_label_list[i].label);
+        size_t length = prefix + 1 + label;
+        if (length > UINT8_MAX)
+        {
+            continue;
+        }
+        char *topic = mqtt_topic_pool + offset;
+        memcpy(topic, config_values.mqtt.topic, prefix);
+        topic[prefix] = '/';
+        memcpy(topic + prefix + 1, linky_label_list[i].label, label + 1);
+        mqtt_topic_comliance(topic, length);
+        mqtt_topic_entries[i] = (mqtt_topic_entry_t){.offset = offset, .length = length};
+        offset += length + 1;
+    }
+    ESP_LOGI(TAG, "Topics of %" PRIu32 " labels built: %zu bytes", count, size);
+}
+
+/**
+ * @brief Get the topic of a label of the current mode, the topics are built again when the mode or the config changes
+ *
+ * @param index the index in linky_label_list
+ * @return const char* the topic, NULL if the label is not in the current mode
+ */
+static const char *mqtt_get_topic(uint32_t index)
+{
+    if (mqtt_topic_generation != config_generation || mqtt_topic_mode != linky_mode)
+    {
+        mqtt_build_topics();
+    }
+    if (mqtt_topic_pool == NULL || index >= linky_label_list_size || mqtt_topic_entries[index].length == 0)
+    {
+        return NULL;
+    }
+    return mqtt_topic_pool + mqtt_topic_entries[index].offset;
+}
+
 static void mqtt_remove_plus(char *topic)
 {
     for (int j = 0; j < strlen(topic); j++)
@@ -123,86 +346,109 @@ static void mqtt_remove_plus(char *topic)
     }
 }
 
-static void mqtt_create_sensor(char *json, char *config_topic, linky_value_t sensor)
+/**
+ * @brief Build the Home Assistant discovery topic of a label
+ *
+ * @param config_topic the destination
+ * @param size the size of config_topic
+ * @param sensor the label
+ */
+static void mqtt_config_topic(char *config_topic, size_t size, const linky_value_t *sensor)
 {
-    const esp_app_desc_t *app_desc = esp_app_get_description();
-    cJSON *jsonDevice = cJSON_CreateObject(); // Create the root object
-    cJSON_AddStringToObject(jsonDevice, "name", mqtt_topics.name);
-    cJSON_AddStringToObject(jsonDevice, "mdl", app_desc->project_name);
-    cJSON_AddStringToObject(jsonDevice, "mf", MANUFACTURER);
-    cJSON_AddStringToObject(jsonDevice, "sw", app_desc->version);
-    cJSON_AddStringToObject(jsonDevice, "sn", efuse_values.serial_number);
-    char hw_version[15];
-    snprintf(hw_version, sizeof(hw_version), "%d.%d.%d", efuse_values.hw_version[0], efuse_values.hw_version[1], efuse_values.hw_version[2]);
-    cJSON_AddStringToObject(jsonDevice, "hw", hw_version);
-    cJSON_AddStringToObject(jsonDevice, "ids", efuse_values.serial_number);
+    linky_label_type_t type = sensor->device_class == CLASS_BOOL ? BOOL : sensor->type;
+    snprintf(config_topic, size, "homeassistant/%s/%s/%s/config", ha_sensors_str[type], mqtt_topics.name, sensor->label);
+    if (strcmp(sensor->label, "ADCO") == 0 || strcmp(sensor->label, "ADSC") == 0)
+    {
+        strncpy(mqtt_topics.ha_identifier_topic, config_topic, sizeof(mqtt_topics.ha_identifier_topic));
+    }
+}
 
-    cJSON *sensorConfig = cJSON_CreateObject(); // Create the root object
-    cJSON_AddStringToObject(sensorConfig, "~", config_values.mqtt.topic);
-    cJSON_AddStringToObject(sensorConfig, "name", sensor.name);
+static esp_err_t mqtt_create_sensor(char *json, size_t size, char *config_topic, size_t config_topic_size, linky_value_t sensor)
+{
+    json_writer_t writer;
+    json_writer_init(&writer, json, size, NULL, NULL); // written in json, without a cJSON tree
+    json_writer_object_start(&writer, NULL);
+    json_writer_string(&writer, "~", config_values.mqtt.topic);
+    json_writer_string(&writer, "name", sensor.name);
     char uniq_id[50];
     snprintf(uniq_id, sizeof(uniq_id), "%s_%s", mqtt_topics.unique_id_base, sensor.label);
-    cJSON_AddStringToObject(sensorConfig, "uniq_id", uniq_id);
-    cJSON_AddStringToObject(sensorConfig, "obj_id", uniq_id);
+    json_writer_string(&writer, "uniq_id", uniq_id);
+    json_writer_string(&writer, "obj_id", uniq_id);
 
     char state_topic[100];
-    snprintf(state_topic, sizeof(state_topic), "~/%s", sensor.label);
-    linky_label_type_t type = sensor.type;
-    if (sensor.device_class == CLASS_BOOL)
+    bool batch = config_values.mqtt_batch && sensor.type != HA_NUMBER;
+    if (batch)
     {
-        type = BOOL;
-        cJSON_AddStringToObject(sensorConfig, "pl_on", "1");
-        cJSON_AddStringToObject(sensorConfig, "pl_off", "0");
+        snprintf(state_topic, sizeof(state_topic), "~/%s", MQTT_STATE_TOPIC);
     }
-    snprintf(config_topic, sizeof(state_topic), "homeassistant/%s/%s/%s/config", ha_sensors_str[type], mqtt_topics.name, sensor.label);
-    if (strcmp(sensor.label, "ADCO") == 0 || strcmp(sensor.label, "ADSC") == 0)
+    else
     {
-        strncpy(mqtt_topics.ha_identifier_topic, config_topic, sizeof(mqtt_topics.ha_identifier_topic));
+        snprintf(state_topic, sizeof(state_topic), "~/%s", sensor.label);
+    }
+    if (sensor.device_class == CLASS_BOOL)
+    {
+        json_writer_string(&writer, "pl_on", "1");
+        json_writer_string(&writer, "pl_off", "0");
     }
+    mqtt_config_topic(config_topic, config_topic_size, &sensor);
 
     if (sensor.type == HA_NUMBER)
     {
-        cJSON_AddStringToObject(sensorConfig, "cmd_t", state_topic);
-        cJSON_AddStringToObject(sensorConfig, "mode", "box");
-        cJSON_AddNumberToObject(sensorConfig, "min", 30);
-        cJSON_AddNumberToObject(sensorConfig, "max", 3600);
-        cJSON_AddStringToObject(sensorConfig, "ret", "true");
-        cJSON_AddNumberToObject(sensorConfig, "qos", 2);
+        json_writer_string(&writer, "cmd_t", state_topic);
+        json_writer_string(&writer, "mode", "box");
+        json_writer_uint(&writer, "min", 30);
+        json_writer_uint(&writer, "max", 3600);
+        json_writer_string(&writer, "ret", "true");
+        json_writer_uint(&writer, "qos", 2);
     }
     else
     {
         mqtt_remove_plus(state_topic);
-        cJSON_AddStringToObject(sensorConfig, "stat_t", state_topic);
+        json_writer_string(&writer, "stat_t", state_topic);
     }
-    if (sensor.device_class == TIMESTAMP)
+    if (batch)
     {
-        cJSON_AddStringToObject(sensorConfig, "val_tpl", "{{ as_datetime(value) }}");
+        // some labels have a '-': the bracket notation works for all of them
+        char value_template[60];
+        if (sensor.device_class == TIMESTAMP)
+        {
+            snprintf(value_template, sizeof(value_template), "{{ as_datetime(value_json['%s']) }}", sensor.label);
+        }
+        else
+        {
+            snprintf(value_template, sizeof(value_template), "{{ value_json['%s'] }}", sensor.label);
+        }
+        json_writer_string(&writer, "val_tpl", value_template);
+    }
+    else if (sensor.device_class == TIMESTAMP)
+    {
+        json_writer_string(&writer, "val_tpl", "{{ as_datetime(value) }}");
     }
 
     if (HADeviceClassStr[sensor.device_class] && strlen(HADeviceClassStr[sensor.device_class]) > 0)
     {
-        cJSON_AddStringToObject(sensorConfig, "dev_cla", HADeviceClassStr[sensor.device_class]);
+        json_writer_string(&writer, "dev_cla", HADeviceClassStr[sensor.device_class]);
     }
     if (strlen(sensor.icon) > 0)
     {
-        cJSON_AddStringToObject(sensorConfig, "icon", sensor.icon);
+        json_writer_string(&writer, "icon", sensor.icon);
     }
 
     if (sensor.device_class != NONE_CLASS && sensor.device_class != TIMESTAMP && sensor.device_class != CLASS_BOOL)
     {
-        cJSON_AddStringToObject(sensorConfig, "unit_of_meas", HAUnitsStr[sensor.device_class]);
+        json_writer_string(&writer, "unit_of_meas", HAUnitsStr[sensor.device_class]);
     }
 
     if (sensor.realTime == REAL_TIME)
     {
-        cJSON_AddNumberToObject(sensorConfig, "exp_aft", config_values.refresh_rate * 4);
+        json_writer_uint(&writer, "exp_aft", config_values.refresh_rate * 4);
     }
 
     switch (sensor.device_class)
     {
     case ENERGY:
     case ENERGY_Q:
-        cJSON_AddStringToObject(sensorConfig, "stat_cla", "total_increasing");
+        json_writer_string(&writer, "stat_cla", "total_increasing");
         break;
 
     case POWER_kVA:
@@ -212,17 +458,209 @@ static void mqtt_create_sensor(char *json, char *config_topic, linky_value_t sen
     case POWER_kW:
     case CURRENT:
     case TENSION:
-        cJSON_AddStringToObject(sensorConfig, "stat_cla", "measurement");
+        json_writer_string(&writer, "stat_cla", "measurement");
         break;
     default:
         break;
     }
 
-    cJSON_AddItemToObject(sensorConfig, "dev", jsonDevice);
-    char *jsonString = cJSON_PrintUnformatted(sensorConfig);
-    strncpy(json, jsonString, 1024);
-    free(jsonString);
-    cJSON_Delete(sensorConfig);
+    const esp_app_desc_t *app_desc = esp_app_get_description();
+    json_writer_object_start(&writer, "dev");
+    json_writer_string(&writer, "name", mqtt_topics.name);
+    json_writer_string(&writer, "mdl", app_desc->project_name);
+    json_writer_string(&writer, "mf", MANUFACTURER);
+    json_writer_string(&writer, "sw", app_desc->version);
+    json_writer_string(&writer, "sn", efuse_values.serial_number);
+    char hw_version[15];
+    snprintf(hw_version, sizeof(hw_version), "%d.%d.%d", efuse_values.hw_version[0], efuse_values.hw_version[1], efuse_values.hw_version[2]);
+    json_writer_string(&writer, "hw", hw_version);
+    json_writer_string(&writer, "ids", efuse_values.serial_number);
+    json_writer_object_end(&writer);
+    json_writer_object_end(&writer);
+    return json_writer_end(&writer);
+}
+
+/**
+ * @brief Format the value of a label as published on its topic
+ *
+ * @param i the index of the label in linky_label_list
+ * @param str the destination
+ * @param size the size of str
+ * @return true if the label has a value to publish
+ */
+static bool mqtt_format_value(uint32_t i, char *str, size_t size)
+{
+    switch (linky_label_list[i].type)
+    {
+    case UINT8:
+    {
+        uint8_t *value = (uint8_t *)linky_label_list[i].data;
+        if (*value == UINT8_MAX)
+            return false;
+        snprintf(str, size, "%d", *value);
+        break;
+    }
+    case UINT16:
+    {
+        uint16_t *value = (uint16_t *)linky_label_list[i].data;
+        if (*value == UINT16_MAX)
+            return false;
+        snprintf(str, size, "%d", *value);
+        break;
+    }
+    case UINT32:
+    {
+        uint32_t *value = (uint32_t *)linky_label_list[i].data;
+        if (*value == UINT32_MAX)
+            return false;
+        if (linky_label_list[i].device_class == ENERGY && *(uint32_t *)(linky_label_list[i].data) == 0)
+            return false;
+        snprintf(str, size, "%" PRIu32, *value);
+        break;
+    }
+    case UINT64:
+    {
+        uint64_t *value = (uint64_t *)linky_label_list[i].data;
+        if (*value == UINT64_MAX)
+            return false;
+        if (linky_label_list[i].device_class == ENERGY && *(uint64_t *)(linky_label_list[i].data) == 0)
+            return false;
+        snprintf(str, size, "%" PRIu64, *value);
+        break;
+    }
+    case STRING:
+    {
+        char *value = (char *)linky_label_list[i].data;
+        if (strlen(value) == 0)
+            return false;
+        snprintf(str, size, "%s", value);
+        break;
+    }
+    case UINT32_TIME:
+    {
+        time_label_t *timeLabel = (time_label_t *)linky_label_list[i].data;
+        if (timeLabel->value == UINT32_MAX || timeLabel->value == 0)
+            return false;
+        snprintf(str, size, "%" PRIu32, timeLabel->value);
+        break;
+    }
+    case HA_NUMBER:
+        return false;
+        break;
+
+    default:
+        ESP_LOGE(TAG, "Unknown type: %s %d", linky_label_list[i].label, linky_label_list[i].type);
+        return false;
+    }
+
+    if (linky_label_list[i].data == &linky_mode)
+    {
+        switch (linky_mode)
+        {
+        case MODE_HIST:
+            snprintf(str, size, "Historique");
+            break;
+        case MODE_STD:
+            snprintf(str, size, "Standard");
+            break;
+        default:
+            snprintf(str, size, "Inconnu");
+            break;
+        }
+    }
+    else if (linky_label_list[i].data == &linky_three_phase)
+    {
+        if (linky_three_phase == 1)
+        {
+            snprintf(str, size, "Triphasé");
+        }
+        else
+        {
+            snprintf(str, size, "Monophasé");
+        }
+    }
+    else if (linky_label_list[i].device_class == TIME_M)
+    {
+        snprintf(str, size, "%" PRIu32, *((uint32_t *)linky_label_list[i].data) / 1000);
+    }
+    return true;
+}
+
+/**
+ * @brief Build the json of every value of the current mode, published on <topic>/state
+ *
+ * @param dirty set to true if a value changed since the last successful send
+ * @return char* the json to free, NULL if out of memory
+ */
+static char *mqtt_state_json(bool *dirty)
+{
+    char strValue[100];
+    char chunk[MQTT_JSON_CHUNK];
+    json_writer_buffer_t buffer = {.size = JSON_WRITER_BUFFER_MIN};
+    json_writer_t writer;
+    json_writer_init(&writer, chunk, sizeof(chunk), json_writer_buffer_sink, &buffer);
+    json_writer_object_start(&writer, NULL);
+    *dirty = false;
+
+    uint32_t count = 0;
+    const uint8_t *labels = linky_get_mode_labels(linky_mode, &count);
+    for (uint32_t n = 0; n < count; n++)
+    {
+        uint32_t i = labels[n];
+        *dirty |= linky_is_dirty(i);
+        if (!mqtt_format_value(i, strValue, sizeof(strValue)))
+        {
+            continue;
+        }
+        // the whole state is sent: Home Assistant reads every entity from each message
+        if (linky_label_list[i].type != STRING && strValue[0] != '\0' && strspn(strValue, "0123456789") == strlen(strValue))
+        {
+            json_writer_raw(&writer, linky_label_list[i].label, strValue);
+        }
+        else
+        {
+            json_writer_string(&writer, linky_label_list[i].label, strValue);
+        }
+    }
+    json_writer_object_end(&writer);
+    return json_writer_buffer_end(&writer, &buffer);
+}
+
+/**
+ * @brief Enqueue the values of the current mode as one json message on <topic>/state
+ *
+ * @return uint8_t 1 if the message is in the outbox or nothing changed
+ */
+static uint8_t mqtt_prepare_state()
+{
+    char topic[150];
+    snprintf(topic, sizeof(topic), "%s/%s", config_values.mqtt.topic, MQTT_STATE_TOPIC);
+    mqtt_topic_comliance(topic, sizeof(topic));
+
+    bool dirty = false;
+    char *json = mqtt_state_json(&dirty);
+    if (json == NULL)
+    {
+        ESP_LOGE(TAG, "Failed to build the state");
+        return 0;
+    }
+    if (!dirty)
+    {
+        free(json);
+        ESP_LOGI(TAG, "State not changed since the last send");
+        return 1;
+    }
+
+    int ret = mqtt_enqueue(topic, json, MQTT_QOS, 0);
+    ESP_LOGI(TAG, "Prepared \"%s\": %d bytes", topic, (int)strlen(json));
+    free(json);
+    if (ret < 0)
+    {
+        ESP_LOGE(TAG, "Error while enqueue state: %d", ret);
+        return 0;
+    }
+    mqtt_sensors_count++;
+    return 1;
 }
 
 uint8_t mqtt_prepare_publish(linky_data_t *linkydata)
@@ -234,136 +672,61 @@ uint8_t mqtt_prepare_publish(linky_data_t *linkydata)
         ESP_LOGE(TAG, "Cant prepare data: MQTT not initialized");
         return 0;
     }
+    mqtt_pending_reset(); // start of the send: the messages of mqtt_send() are enqueued from here
 
     uint8_t has_error = 0;
     mqtt_topics.ha_discovery_configured_temp = 0;
     // ESP_LOGI(TAG, "ha_discovery_configured = %d", mqtt_topics.ha_discovery_configured);
     if (config_values.mode == MODE_MQTT_HA)
     {
+        if (mqtt_ha_restarted)
+        {
+            mqtt_ha_restarted = false;
+            mqtt_reset_ha_discovery(); // Home Assistant restarted: it may have lost the configs
+            linky_set_dirty();         // and the states, which are not retained
+        }
         mqtt_setup_ha_discovery(true);
     }
 
-    char topic[150];
     char strValue[100];
 
     ESP_LOGI(TAG, "Pre-send Outbox size: %d", esp_mqtt_client_get_outbox_size(mqtt_client));
 
-    for (int i = 0; i < linky_label_list_size; i++)
+    if (config_values.mqtt_batch)
     {
-        if (linky_label_list[i].mode != linky_mode && linky_label_list[i].mode != ANY)
-        {
-            continue;
-        }
+        return mqtt_prepare_state();
+    }
 
-        if (linky_label_list[i].data == NULL)
+    uint32_t count = 0;
+    const uint8_t *labels = linky_get_mode_labels(linky_mode, &count);
+    for (uint32_t n = 0; n < count; n++)
+    {
+        uint32_t i = labels[n];
+        if (!linky_is_dirty(i))
         {
-            continue;
+            continue; // not changed since the last successful send
         }
 
-        snprintf(topic, sizeof(topic), "%s/%s", config_values.mqtt.topic, (char *)linky_label_list[i].label);
-        switch (linky_label_list[i].type)
-        {
-        case UINT8:
-        {
-            uint8_t *value = (uint8_t *)linky_label_list[i].data;
-            if (*value == UINT8_MAX)
-                continue;
-            snprintf(strValue, sizeof(strValue), "%d", *value);
-            break;
-        }
-        case UINT16:
-        {
-            uint16_t *value = (uint16_t *)linky_label_list[i].data;
-            if (*value == UINT16_MAX)
-                continue;
-            snprintf(strValue, sizeof(strValue), "%d", *value);
-            break;
-        }
-        case UINT32:
+        if (!mqtt_format_value(i, strValue, sizeof(strValue)))
         {
-            uint32_t *value = (uint32_t *)linky_label_list[i].data;
-            if (*value == UINT32_MAX)
-                continue;
-            if (linky_label_list[i].device_class == ENERGY && *(uint32_t *)(linky_label_list[i].data) == 0)
-                continue;
-            snprintf(strValue, sizeof(strValue), "%ld", *value);
-            break;
-        }
-        case UINT64:
-        {
-            uint64_t *value = (uint64_t *)linky_label_list[i].data;
-            if (*value == UINT64_MAX)
-                continue;
-            if (linky_label_list[i].device_class == ENERGY && *(uint64_t *)(linky_label_list[i].data) == 0)
-                continue;
-            snprintf(strValue, sizeof(strValue), "%lld", *value);
-            break;
-        }
-        case STRING:
-        {
-            char *value = (char *)linky_label_list[i].data;
-            if (strlen(value) == 0)
-                continue;
-            snprintf(strValue, sizeof(strValue), "%s", value);
-            break;
-        }
-        case UINT32_TIME:
-        {
-            time_label_t *timeLabel = (time_label_t *)linky_label_list[i].data;
-            if (timeLabel->value == UINT32_MAX || timeLabel->value == 0)
-                continue;
-            snprintf(strValue, sizeof(strValue), "%lu", timeLabel->value);
-            break;
-        }
-        case HA_NUMBER:
             continue;
-            break;
-
-        default:
-            ESP_LOGE(TAG, "Unknown type: %s %d", linky_label_list[i].label, linky_label_list[i].type);
-            break;
-        }
-
-        if (linky_label_list[i].data == &linky_mode)
-        {
-            switch (linky_mode)
-            {
-            case MODE_HIST:
-                snprintf(strValue, sizeof(strValue), "Historique");
-                break;
-            case MODE_STD:
-                snprintf(strValue, sizeof(strValue), "Standard");
-                break;
-            default:
-                snprintf(strValue, sizeof(strValue), "Inconnu");
-                break;
-            }
         }
-        else if (linky_label_list[i].data == &linky_three_phase)
+        const char *topic = mqtt_get_topic(i);
+        if (topic == NULL)
         {
-            if (linky_three_phase == 1)
-            {
-                snprintf(strValue, sizeof(strValue), "Triphasé");
-            }
-            else
-            {
-                snprintf(strValue, sizeof(strValue), "Monophasé");
-            }
-        }
-        else if (linky_label_list[i].device_class == TIME_M)
-        {
-            snprintf(strValue, sizeof(strValue), "%lu", *((uint32_t *)linky_label_list[i].data) / 1000);
+            ESP_LOGE(TAG, "No topic for %s", linky_label_list[i].label);
+            has_error = 1;
+            continue;
         }
 
         mqtt_sensors_count++;
         // esp_mqtt_client_publish(mqtt_client, topic, strValue, 0, 2, 0);
-        mqtt_topic_comliance(topic, sizeof(topic));
-        int ret = esp_mqtt_client_enqueue(mqtt_client, topic, strValue, 0, MQTT_QOS, 0, true);
-        ESP_LOGI(TAG, "Prepared \"%s\" = \"%s\"", topic, strValue);
+        int ret = mqtt_enqueue(topic, strValue, MQTT_QOS, 0);
+        ESP_LOGD(TAG, "Prepared \"%s\" = \"%s\"", topic, strValue);
 
 #ifdef MQTT_DEBUG
         mqtt_messages[mqtt_messages_count++].id = ret;
-        strncpy(mqtt_messages[mqtt_messages_count - 1].name, topic, sizeof(topic));
+        strncpy(mqtt_messages[mqtt_messages_count - 1].name, topic, sizeof(mqtt_messages[0].name));
         strncpy(mqtt_messages[mqtt_messages_count - 1].value, strValue, sizeof(strValue));
 #endif
         if (ret == -1)
@@ -387,124 +750,386 @@ uint8_t mqtt_prepare_publish(linky_data_t *linkydata)
     return 1;
 }
 
-void mqtt_setup_ha_discovery(bool with_delete)
+esp_err_t mqtt_prepare_history(const linky_data_t *data, void *arg)
 {
-    char mqtt_buffer[1024];
-    char config_topic[100];
-    bool delete = false;
+    if (mqtt_state == MQTT_DEINIT)
+    {
+        ESP_LOGE(TAG, "Cant prepare history: MQTT not initialized");
+        return ESP_ERR_INVALID_STATE;
+    }
 
-    for (int i = 0; i < linky_label_list_size; i++)
+    char topic[150];
+    snprintf(topic, sizeof(topic), "%s/history", config_values.mqtt.topic);
+    mqtt_topic_comliance(topic, sizeof(topic));
+
+    char chunk[MQTT_JSON_CHUNK];
+    json_writer_buffer_t buffer = {.size = JSON_WRITER_BUFFER_MIN};
+    json_writer_t writer;
+    json_writer_init(&writer, chunk, sizeof(chunk), json_writer_buffer_sink, &buffer);
+    json_writer_object_start(&writer, NULL);
+    web_write_reading(&writer, data);
+    json_writer_int(&writer, "timestamp", data->timestamp);
+    json_writer_object_end(&writer);
+    char *json = json_writer_buffer_end(&writer, &buffer);
+    if (json == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    int ret = mqtt_enqueue(topic, json, MQTT_QOS, 0);
+    free(json);
+    if (ret < 0)
+    {
+        ESP_LOGE(TAG, "Error while enqueue history: %d", ret);
+        return ESP_FAIL;
+    }
+    mqtt_sensors_count++;
+    ESP_LOGI(TAG, "Prepared history of %" PRId64, data->timestamp);
+    return ESP_OK;
+}
+
+esp_err_t mqtt_prepare_metrics()
+{
+    static uint32_t last_publish = 0;
+    if (mqtt_state == MQTT_DEINIT)
+    {
+        ESP_LOGE(TAG, "Cant prepare metrics: MQTT not initialized");
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (last_publish != 0 && MILLIS - last_publish < MQTT_METRICS_INTERVAL)
+    {
+        return ESP_OK;
+    }
+
+    char topic[150];
+    snprintf(topic, sizeof(topic), "%s/diagnostics", config_values.mqtt.topic);
+    mqtt_topic_comliance(topic, sizeof(topic));
+
+    char chunk[MQTT_JSON_CHUNK];
+    json_writer_buffer_t buffer = {.size = JSON_WRITER_BUFFER_MIN};
+    json_writer_t writer;
+    json_writer_init(&writer, chunk, sizeof(chunk), json_writer_buffer_sink, &buffer);
+    json_writer_object_start(&writer, NULL);
+    linky_write_metrics(&writer);
+    json_writer_uint(&writer, "mqtt_latency", mqtt_last_latency);
+    json_writer_uint(&writer, "mqtt_lost", mqtt_lost_total);
+    json_writer_object_end(&writer);
+    char *json = json_writer_buffer_end(&writer, &buffer);
+    if (json == NULL)
     {
-        if (linky_label_list[i].data == NULL)
+        return ESP_ERR_NO_MEM;
+    }
+
+    int ret = mqtt_enqueue(topic, json, MQTT_QOS, 0);
+    free(json);
+    if (ret < 0)
+    {
+        ESP_LOGE(TAG, "Error while enqueue metrics: %d", ret);
+        return ESP_FAIL;
+    }
+    mqtt_sensors_count++;
+    last_publish = MILLIS;
+    return ESP_OK;
+}
+
+esp_err_t mqtt_prepare_aggregate(const aggregate_bucket_t *bucket)
+{
+    if (mqtt_state == MQTT_DEINIT)
+    {
+        ESP_LOGE(TAG, "Cant prepare aggregate: MQTT not initialized");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    char topic[150];
+    snprintf(topic, sizeof(topic), "%s/aggregate", config_values.mqtt.topic);
+    mqtt_topic_comliance(topic, sizeof(topic));
+
+    char json[AGGREGATE_JSON_SIZE];
+    json_writer_t writer;
+    json_writer_init(&writer, json, sizeof(json), NULL, NULL);
+    aggregate_write_json(&writer, bucket);
+    esp_err_t err = json_writer_end(&writer);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Cant write aggregate: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    int ret = mqtt_enqueue(topic, json, MQTT_QOS, 0);
+    if (ret < 0)
+    {
+        ESP_LOGE(TAG, "Error while enqueue aggregate: %d", ret);
+        return ESP_FAIL;
+    }
+    mqtt_sensors_count++;
+    return ESP_OK;
+}
+
+/**
+ * @brief FNV-1a hash, same as the linky values
+ */
+static uint32_t mqtt_hash(uint32_t hash, const void *data, size_t size)
+{
+    const uint8_t *bytes = (const uint8_t *)data;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * @brief Hash of everything the discovery configs depend on, except the label itself:
+ * the label table and the templates are covered by the firmware version
+ */
+static uint32_t mqtt_discovery_base_hash()
+{
+    const esp_app_desc_t *app_desc = esp_app_get_description();
+    uint32_t hash = 2166136261u;
+    hash = mqtt_hash(hash, app_desc->version, strnlen(app_desc->version, sizeof(app_desc->version)));
+    hash = mqtt_hash(hash, config_values.mqtt.host, strnlen(config_values.mqtt.host, sizeof(config_values.mqtt.host)));
+    hash = mqtt_hash(hash, &config_values.mqtt.port, sizeof(config_values.mqtt.port));
+    hash = mqtt_hash(hash, config_values.mqtt.topic, strnlen(config_values.mqtt.topic, sizeof(config_values.mqtt.topic)));
+    hash = mqtt_hash(hash, mqtt_topics.name, strnlen(mqtt_topics.name, sizeof(mqtt_topics.name)));
+    hash = mqtt_hash(hash, efuse_values.serial_number, strnlen(efuse_values.serial_number, sizeof(efuse_values.serial_number)));
+    hash = mqtt_hash(hash, efuse_values.hw_version, sizeof(efuse_values.hw_version));
+    hash = mqtt_hash(hash, &config_values.refresh_rate, sizeof(config_values.refresh_rate));
+    hash = mqtt_hash(hash, &config_values.mqtt_batch, sizeof(config_values.mqtt_batch));
+    return hash;
+}
+
+/**
+ * @brief Read the hashes of the published discovery configs, once per boot or after a failed send
+ *
+ * @return true if mqtt_discovery_hash can be used
+ */
+static bool mqtt_discovery_load()
+{
+    size_t size = linky_label_list_size * sizeof(uint32_t);
+    if (mqtt_discovery_hash == NULL)
+    {
+        mqtt_discovery_hash = calloc(linky_label_list_size, sizeof(uint32_t));
+        if (mqtt_discovery_hash == NULL)
         {
-            continue;
+            return false;
         }
+    }
+    if (!mqtt_discovery_loaded)
+    {
+        esp_err_t err = config_read_blob(MQTT_DISCOVERY_NVS, mqtt_discovery_hash, size);
+        if (err != ESP_OK)
+        {
+            ESP_LOGI(TAG, "No discovery cache (%s): publishing every config", esp_err_to_name(err));
+            memset(mqtt_discovery_hash, 0, size);
+        }
+        mqtt_discovery_loaded = true;
+        mqtt_discovery_changed = false;
+    }
+    return true;
+}
 
+void mqtt_reset_ha_discovery()
+{
+    for (int i = 0; i < linky_label_list_size; i++)
+    {
         linky_value_rw_t *rw = linky_get_value_rw(i);
-        if (rw == NULL)
+        if (rw != NULL)
         {
-            ESP_LOGW(TAG, "RW not found for %s", linky_label_list[i].label);
-            continue;
+            rw->reported = HA_REPORT_STATE_UNKNOWN;
         }
+    }
+    if (mqtt_discovery_load())
+    {
+        memset(mqtt_discovery_hash, 0, linky_label_list_size * sizeof(uint32_t));
+        mqtt_discovery_changed = true;
+        mqtt_discovery_save(); // a failed send must not read the old hashes back
+    }
+    mqtt_discovery_cleaned = 0;
+    ESP_LOGI(TAG, "Discovery configs will be published again");
+}
 
-        delete = false;
-
-        ESP_LOGD(TAG, "HA Discovery: %s", linky_label_list[i].label);
-        switch (linky_label_list[i].type)
+void mqtt_setup_ha_discovery(bool with_delete)
+{
+    char mqtt_buffer[MQTT_DISCOVERY_SIZE];
+    char config_topic[100];
+    bool delete = false;
+    bool cache = mqtt_discovery_load();
+    uint32_t base_hash = mqtt_discovery_base_hash();
+    uint32_t published = 0;
+
+    // the labels of the mode and the ANY labels are created, then the labels of the other mode are deleted
+    linky_mode_t first = linky_mode == MODE_STD ? MODE_STD : MODE_HIST;
+    uint32_t cleaned = mqtt_hash(base_hash, &linky_mode, sizeof(linky_mode));
+    cleaned = cleaned != 0 ? cleaned : 1; // 0 is not done
+    for (uint32_t pass = 0; pass < 2; pass++)
+    {
+        if (pass == 1 && mqtt_discovery_cleaned == cleaned)
         {
-        case UINT8:
-            if (*(uint8_t *)linky_label_list[i].data == UINT8_MAX)
-            {
-                delete = true;
-            }
-            ESP_LOGD(TAG, "Adding %s: value = %d", linky_label_list[i].label, *(uint8_t *)linky_label_list[i].data);
-            break;
-        case UINT16:
-            if (*(uint16_t *)linky_label_list[i].data == UINT16_MAX)
-            {
-                delete = true;
-            }
-            ESP_LOGD(TAG, "Adding %s: value = %d", linky_label_list[i].label, *(uint16_t *)linky_label_list[i].data);
-            break;
-        case UINT32:
-            if (*(uint32_t *)linky_label_list[i].data == UINT32_MAX)
-            {
-                delete = true;
-            }
-            if (linky_label_list[i].device_class == ENERGY && *(uint32_t *)(linky_label_list[i].data) == 0)
+            break; // already deleted since the last change of mode or config
+        }
+        uint32_t count = 0;
+        const uint8_t *labels = linky_get_mode_labels(pass == 0 ? first : (first == MODE_HIST ? MODE_STD : MODE_HIST), &count);
+        for (uint32_t n = 0; n < count; n++)
+        {
+            int i = labels[n];
+            if (pass == 1 && linky_label_list[i].mode == ANY)
             {
-                delete = true;
+                continue; // already visited with the labels of the mode
             }
-            ESP_LOGD(TAG, "Adding %s: value = %ld", linky_label_list[i].label, *(uint32_t *)linky_label_list[i].data);
-            break;
-        case UINT64:
-            if (*(uint64_t *)linky_label_list[i].data == UINT64_MAX)
+
+            linky_value_rw_t *rw = linky_get_value_rw(i);
+            if (rw == NULL)
             {
-                delete = true;
+                ESP_LOGW(TAG, "RW not found for %s", linky_label_list[i].label);
+                continue;
             }
-            if (linky_label_list[i].device_class == ENERGY && *(uint64_t *)(linky_label_list[i].data) == 0)
+
+            delete = false;
+
+            ESP_LOGD(TAG, "HA Discovery: %s", linky_label_list[i].label);
+            switch (linky_label_list[i].type)
             {
-                delete = true;
+            case UINT8:
+                if (*(uint8_t *)linky_label_list[i].data == UINT8_MAX)
+                {
+                    delete = true;
+                }
+                ESP_LOGD(TAG, "Adding %s: value = %d", linky_label_list[i].label, *(uint8_t *)linky_label_list[i].data);
+                break;
+            case UINT16:
+                if (*(uint16_t *)linky_label_list[i].data == UINT16_MAX)
+                {
+                    delete = true;
+                }
+                ESP_LOGD(TAG, "Adding %s: value = %d", linky_label_list[i].label, *(uint16_t *)linky_label_list[i].data);
+                break;
+            case UINT32:
+                if (*(uint32_t *)linky_label_list[i].data == UINT32_MAX)
+                {
+                    delete = true;
+                }
+                if (linky_label_list[i].device_class == ENERGY && *(uint32_t *)(linky_label_list[i].data) == 0)
+                {
+                    delete = true;
+                }
+                ESP_LOGD(TAG, "Adding %s: value = %" PRIu32, linky_label_list[i].label, *(uint32_t *)linky_label_list[i].data);
+                break;
+            case UINT64:
+                if (*(uint64_t *)linky_label_list[i].data == UINT64_MAX)
+                {
+                    delete = true;
+                }
+                if (linky_label_list[i].device_class == ENERGY && *(uint64_t *)(linky_label_list[i].data) == 0)
+                {
+                    delete = true;
+                }
+                ESP_LOGD(TAG, "Adding %s: value = %" PRIu64, linky_label_list[i].label, *(uint64_t *)linky_label_list[i].data);
+                break;
+            case STRING:
+                if (strlen((char *)linky_label_list[i].data) == 0)
+                {
+                    delete = true;
+                }
+                ESP_LOGD(TAG, "Adding %s: value = %s", linky_label_list[i].label, (char *)linky_label_list[i].data);
+                break;
+            case UINT32_TIME:
+                if (((time_label_t *)linky_label_list[i].data)->value == UINT32_MAX || ((time_label_t *)linky_label_list[i].data)->value == 0)
+                {
+                    delete = true;
+                }
+                ESP_LOGD(TAG, "Adding %s: value = %" PRIu32, linky_label_list[i].label, ((time_label_t *)linky_label_list[i].data)->value);
+                break;
+            case HA_NUMBER:
+                break;
+            default:
+                ESP_LOGE(TAG, "Unknown type %d", linky_label_list[i].type);
+                continue;
+                break;
             }
-            ESP_LOGD(TAG, "Adding %s: value = %lld", linky_label_list[i].label, *(uint64_t *)linky_label_list[i].data);
-            break;
-        case STRING:
-            if (strlen((char *)linky_label_list[i].data) == 0)
+
+            if (linky_label_list[i].mode == linky_mode || linky_label_list[i].mode == ANY)
             {
-                delete = true;
+                // dont delete entity of the current mode
+                ESP_LOGD(TAG, "Dont delete %s: same mode", linky_label_list[i].label);
             }
-            ESP_LOGD(TAG, "Adding %s: value = %s", linky_label_list[i].label, (char *)linky_label_list[i].data);
-            break;
-        case UINT32_TIME:
-            if (((time_label_t *)linky_label_list[i].data)->value == UINT32_MAX || ((time_label_t *)linky_label_list[i].data)->value == 0)
+            else
             {
-                delete = true;
+                delete = true; // the data of the other mode is overlaid by the current one
             }
-            ESP_LOGD(TAG, "Adding %s: value = %lu", linky_label_list[i].label, ((time_label_t *)linky_label_list[i].data)->value);
-            break;
-        case HA_NUMBER:
-            break;
-        default:
-            ESP_LOGE(TAG, "Unknown type %d", linky_label_list[i].type);
-            continue;
-            break;
-        }
-
-        if (linky_label_list[i].mode == linky_mode || linky_label_list[i].mode == ANY)
-        {
-            // dont delete entity of the current mode
-            ESP_LOGD(TAG, "Dont delete %s: same mode", linky_label_list[i].label);
-        }
 
-        mqtt_create_sensor(mqtt_buffer, config_topic, linky_label_list[i]);
-        mqtt_topic_comliance(config_topic, sizeof(config_topic));
+            // the config is only built when it differs from the one published, even before a reboot
+            uint32_t hash = mqtt_hash(base_hash, &i, sizeof(i));
+            hash = mqtt_hash(hash, &delete, sizeof(delete));
+            hash = hash != 0 ? hash : 1; // 0 is not published
+            mqtt_config_topic(config_topic, sizeof(config_topic), &linky_label_list[i]);
+            mqtt_topic_comliance(config_topic, sizeof(config_topic));
 
-        if (delete)
-        {
-            if (with_delete && rw->reported != HA_REPORT_STATE_DELETED)
+            if (delete)
             {
-                rw->reported = HA_REPORT_STATE_DELETED;
-                ESP_LOGW(TAG, "Delete %s", config_topic);
-                esp_mqtt_client_enqueue(mqtt_client, config_topic, "", 0, 1, 0, true);
+                if (with_delete && (cache ? mqtt_discovery_hash[i] != hash : rw->reported != HA_REPORT_STATE_DELETED))
+                {
+                    rw->reported = HA_REPORT_STATE_DELETED;
+                    ESP_LOGW(TAG, "Delete %s", config_topic);
+                    mqtt_enqueue(config_topic, "", 1, 0);
+                    published++;
+                }
+                else
+                {
+                    hash = 0; // not deleted, keep the hash
+                }
             }
-        }
-        else
-        {
-            if (rw->reported != HA_REPORT_STATE_REPORTED)
+            else
             {
-                ESP_LOGW(TAG, "Create %s", config_topic);
-                rw->reported = HA_REPORT_STATE_REPORTED;
-                esp_mqtt_client_enqueue(mqtt_client, config_topic, mqtt_buffer, 0, 2, 1, true);
+                if (cache ? mqtt_discovery_hash[i] != hash : rw->reported != HA_REPORT_STATE_REPORTED)
+                {
+                    ESP_LOGW(TAG, "Create %s", config_topic);
+                    rw->reported = HA_REPORT_STATE_REPORTED;
+                    if (mqtt_create_sensor(mqtt_buffer, sizeof(mqtt_buffer), config_topic, sizeof(config_topic), linky_label_list[i]) != ESP_OK)
+                    {
+                        ESP_LOGE(TAG, "Discovery config of %s too long", linky_label_list[i].label);
+                        hash = 0; // not published, dont keep the hash
+                    }
+                    else
+                    {
+                        mqtt_topic_comliance(config_topic, sizeof(config_topic));
+                        mqtt_enqueue(config_topic, mqtt_buffer, 2, 1);
+                        published++;
+                    }
+                }
+                else
+                {
+                    ESP_LOGD(TAG, "Already reported %s", linky_label_list[i].label);
+                }
             }
-            else
+
+            if (cache && hash != 0 && mqtt_discovery_hash[i] != hash)
             {
-                ESP_LOGW(TAG, "Already reported %s", linky_label_list[i].label);
+                mqtt_discovery_hash[i] = hash;
+                mqtt_discovery_changed = true;
             }
+            mqtt_sensors_count++;
         }
+    }
+    if (with_delete)
+    {
+        mqtt_discovery_cleaned = cleaned;
+    }
+    ESP_LOGI(TAG, "Home Assistant Discovery done: %" PRIu32 " configs published", published);
+}
 
-        mqtt_sensors_count++;
+/**
+ * @brief Save the hashes of the discovery configs, once they are acknowledged by the broker
+ */
+static void mqtt_discovery_save()
+{
+    if (!mqtt_discovery_changed || mqtt_discovery_hash == NULL)
+    {
+        return;
+    }
+    if (config_write_blob(MQTT_DISCOVERY_NVS, mqtt_discovery_hash, linky_label_list_size * sizeof(uint32_t)) == ESP_OK)
+    {
+        mqtt_discovery_changed = false;
     }
-    ESP_LOGI(TAG, "Home Assistant Discovery done");
 }
 
 void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_t event_id, void *event_data)
@@ -517,7 +1142,7 @@ void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_t event
     case MQTT_EVENT_CONNECTED:
         if (mqtt_event_group)
         {
-            xEventGroupSetBits(mqtt_event_group, BIT0);
+            xEventGroupSetBits(mqtt_event_group, MQTT_CONNECTED_BIT);
         }
         if (mqtt_state != MQTT_CONNECTED)
         {
@@ -539,12 +1164,16 @@ void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_t event
             ESP_LOGI(TAG, "Subscribing to identifier %s", mqtt_topics.ha_identifier_topic);
             esp_mqtt_client_subscribe(mqtt_client, mqtt_topics.ha_identifier_topic, 1);
         }
+        if (config_values.mode == MODE_MQTT_HA)
+        {
+            esp_mqtt_client_subscribe(mqtt_client, MQTT_HA_STATUS_TOPIC, 1);
+        }
 
         break;
     case MQTT_EVENT_DISCONNECTED:
         if (mqtt_event_group)
         {
-            xEventGroupSetBits(mqtt_event_group, BIT1);
+            xEventGroupSetBits(mqtt_event_group, MQTT_DISCONNECTED_BIT);
         }
         if (mqtt_state != MQTT_FAILED)
         {
@@ -569,6 +1198,20 @@ void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_t event
         }
 #endif
         mqtt_sent_count++;
+        if (mqtt_pending_remove(event->msg_id) && mqtt_event_group)
+        {
+            xEventGroupSetBits(mqtt_event_group, MQTT_PUBLISHED_BIT);
+        }
+        break;
+    case MQTT_EVENT_DELETED:
+        // expired in the outbox without acknowledgment
+        ESP_LOGW(TAG, "Message %d lost", event->msg_id);
+        mqtt_lost_count++;
+        mqtt_lost_total++;
+        if (mqtt_pending_remove(event->msg_id) && mqtt_event_group)
+        {
+            xEventGroupSetBits(mqtt_event_group, MQTT_PUBLISHED_BIT);
+        }
         break;
     case MQTT_EVENT_DATA:
     {
@@ -593,52 +1236,62 @@ void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_t event
                 mqtt_topics.ha_discovery_configured = 1;
                 break;
             }
+            if (strcmp(fullname, MQTT_HA_STATUS_TOPIC) == 0)
+            {
+                ESP_LOGI(TAG, "Home Assistant status: %s", strValue);
+                if (strcmp(strValue, "online") == 0)
+                {
+                    mqtt_ha_restarted = true; // reset by mqtt_prepare_publish in the main task, which owns mqtt_discovery_hash
+                }
+                break;
+            }
         }
         char *name = fullname + strlen(config_values.mqtt.topic) + 1; // +1 for '/'
-        for (int i = 0; i < linky_label_list_size; i++)
+        int32_t i = linky_get_label_index(name, strlen(name), ANY);
+        if (i < 0)
+        {
+            i = linky_get_label_index(name, strlen(name), linky_mode);
+        }
+        if (i >= 0)
         {
-            if (strcmp(linky_label_list[i].label, name) == 0)
+            if (linky_label_list[i].data == NULL)
             {
-                if (linky_label_list[i].data == NULL)
-                {
-                    ESP_LOGE(TAG, "Null pointer for %s", name);
-                    break;
-                }
+                ESP_LOGE(TAG, "Null pointer for %s", name);
+                break;
+            }
 
-                switch (linky_label_list[i].type)
+            switch (linky_label_list[i].type)
+            {
+            case UINT8:
+                *(uint8_t *)linky_label_list[i].data = atoi(strValue);
+                break;
+            case UINT16:
+                *(uint16_t *)linky_label_list[i].data = atoi(strValue);
+                break;
+            case UINT32:
+                *(uint32_t *)linky_label_list[i].data = atol(strValue);
+                break;
+            case UINT64:
+                *(uint64_t *)linky_label_list[i].data = atoll(strValue);
+                break;
+            case STRING:
+                strncpy((char *)linky_label_list[i].data, strValue, linky_label_list[i].size);
+                break;
+            case UINT32_TIME:
+                ((time_label_t *)linky_label_list[i].data)->value = atol(strValue);
+                break;
+            case HA_NUMBER:
+                uint16_t value = atoi(strValue);
+                uint16_t *config = (uint16_t *)linky_label_list[i].data;
+                if (value != *config)
                 {
-                case UINT8:
-                    *(uint8_t *)linky_label_list[i].data = atoi(strValue);
-                    break;
-                case UINT16:
-                    *(uint16_t *)linky_label_list[i].data = atoi(strValue);
-                    break;
-                case UINT32:
-                    *(uint32_t *)linky_label_list[i].data = atol(strValue);
-                    break;
-                case UINT64:
-                    *(uint64_t *)linky_label_list[i].data = atoll(strValue);
-                    break;
-                case STRING:
-                    strncpy((char *)linky_label_list[i].data, strValue, linky_label_list[i].size);
-                    break;
-                case UINT32_TIME:
-                    ((time_label_t *)linky_label_list[i].data)->value = atol(strValue);
-                    break;
-                case HA_NUMBER:
-                    uint16_t value = atoi(strValue);
-                    uint16_t *config = (uint16_t *)linky_label_list[i].data;
-                    if (value != *config)
-                    {
-                        *config = value;
-                        ESP_LOGI(TAG, "Set %s = %d", name, *config);
-                        config_write();
-                    }
-                    break;
-                default:
-                    break;
+                    *config = value;
+                    ESP_LOGI(TAG, "Set %s = %d", name, *config);
+                    config_write();
                 }
                 break;
+            default:
+                break;
             }
         }
     }
@@ -663,7 +1316,7 @@ void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_t event
         last_return_code = event->error_handle->connect_return_code;
         if (mqtt_event_group)
         {
-            xEventGroupSetBits(mqtt_event_group, BIT2);
+            xEventGroupSetBits(mqtt_event_group, MQTT_ERROR_BIT);
         }
         break;
     default:
@@ -679,6 +1332,10 @@ int mqtt_init(void)
 #ifdef MQTT_DEBUG
     ESP_LOGW(TAG, "MQTT_DEBUG enabled");
 #endif
+    if (mqtt_event_group == NULL)
+    {
+        mqtt_event_group = xEventGroupCreate();
+    }
 
     if (wifi_state == WIFI_DISCONNECTED)
     {
@@ -719,6 +1376,7 @@ int mqtt_deinit()
         esp_mqtt_client_destroy(mqtt_client);
         mqtt_client = NULL;
     }
+    mqtt_pending_reset(); // the outbox is destroyed with the client
     mqtt_state = MQTT_DEINIT;
     return 1;
 }
@@ -755,17 +1413,33 @@ int mqtt_send()
         mqtt_init();
     }
 
-    err = esp_mqtt_client_start(mqtt_client);
-    if (err != ESP_OK)
+    int64_t send_start = esp_timer_get_time();
+    if (!mqtt_persistent || mqtt_state != MQTT_CONNECTED) // the client is still running after a persistent send
     {
-        ESP_LOGE(TAG, "Start failed with 0x%x", err);
-        goto error;
+        xEventGroupClearBits(mqtt_event_group, MQTT_CONNECTED_BIT | MQTT_DISCONNECTED_BIT | MQTT_ERROR_BIT);
+        mqtt_state = MQTT_CONNECTING;
+        err = esp_mqtt_client_start(mqtt_client);
+        if (err != ESP_OK)
+        {
+            ESP_LOGE(TAG, "Start failed with 0x%x", err);
+            goto error;
+        }
     }
 
-    ESP_LOGI(TAG, "Waiting for MQTT send done, outbox size: %d", esp_mqtt_client_get_outbox_size(mqtt_client));
+    bool overflow = false;
+    xEventGroupClearBits(mqtt_event_group, MQTT_PUBLISHED_BIT);
+    uint16_t pending = mqtt_pending_get(&overflow); // read after the clear: the bit is set after the last removal
+    ESP_LOGI(TAG, "Waiting for %d acknowledgments, outbox size: %d", pending, esp_mqtt_client_get_outbox_size(mqtt_client));
+    if (!overflow && pending > 0)
+    {
+        // set by the event handler as soon as the last message is acknowledged
+        xEventGroupWaitBits(mqtt_event_group, MQTT_PUBLISHED_BIT | MQTT_DISCONNECTED_BIT | MQTT_ERROR_BIT, pdFALSE, pdFALSE,
+                            MQTT_SEND_TIMEOUT / portTICK_PERIOD_MS);
+    }
     time_t mqtt_send_timeout = MILLIS + MQTT_SEND_TIMEOUT;
-    while ((mqtt_send_timeout > MILLIS) && /*mqtt_sent_count < mqtt_sensors_count*/ esp_mqtt_client_get_outbox_size(mqtt_client) > 0)
+    while (overflow && (mqtt_send_timeout > MILLIS) && esp_mqtt_client_get_outbox_size(mqtt_client) > 0)
     {
+        // more than MQTT_PENDING_MAX messages: wait for the empty outbox
         if (mqtt_state == MQTT_DISCONNETED)
         {
             ESP_LOGE(TAG, "MQTT Exit: %d", mqtt_state);
@@ -786,6 +1460,13 @@ int mqtt_send()
     // ESP_LOGW(TAG, "set ha_discovery_configured to %d", mqtt_topics.ha_discovery_configured_temp);
     mqtt_topics.ha_discovery_configured = mqtt_topics.ha_discovery_configured_temp;
     led_stop_pattern(LED_SENDING);
+    int64_t latency = (esp_timer_get_time() - send_start) / 1000;
+    pending = mqtt_pending_get(&overflow);
+    if (mqtt_lost_count > 0)
+    {
+        ESP_LOGE(TAG, "Send Failed: %d messages lost in the outbox", mqtt_lost_count);
+        goto error;
+    }
 
 #ifdef MQTT_DEBUG
 
@@ -804,24 +1485,45 @@ int mqtt_send()
         goto error;
     }
 
-    if (/*mqtt_sent_count < mqtt_sensors_count*/ esp_mqtt_client_get_outbox_size(mqtt_client) > 0)
+    if (overflow ? esp_mqtt_client_get_outbox_size(mqtt_client) > 0 : pending > 0)
     {
-        ESP_LOGE(TAG, "Send Timeout: %d/%d", mqtt_sent_count, mqtt_sensors_count);
+        ESP_LOGE(TAG, "Send Timeout: %d/%d, %d not acknowledged after %" PRId64 " ms", mqtt_sent_count, mqtt_sensors_count, pending, latency);
         goto error;
     }
     else
     {
-        ESP_LOGI(TAG, "Send Done: %d msg", mqtt_sent_count);
+        ESP_LOGI(TAG, "Send Done: %d msg in %" PRId64 " ms", mqtt_sent_count, latency);
+    }
+    if (overflow)
+    {
+        mqtt_pending_reset(); // every message is acknowledged, including the untracked ones
+    }
+    mqtt_last_latency = latency;
+    mqtt_discovery_save();
+    if (!mqtt_persistent)
+    {
+        xTaskCreate(mqtt_disconnect_task, "mqtt_disconnect_task", 4096, NULL, 5, NULL);
+        led_start_pattern(LED_SEND_OK);
     }
-    xTaskCreate(mqtt_disconnect_task, "mqtt_disconnect_task", 4096, NULL, 5, NULL);
-    led_start_pattern(LED_SEND_OK);
     return 1;
 error:
+    mqtt_pending_reset(); // the late acknowledgments of this send are not counted in the next one
+    mqtt_discovery_loaded = false; // the configs may not be published: read the saved hashes back
+    mqtt_discovery_cleaned = 0;
     xTaskCreate(mqtt_disconnect_task, "mqtt_disconnect_task", 4096, NULL, 5, NULL);
     led_start_pattern(LED_SEND_FAILED);
     return 0;
 }
 
+void mqtt_set_persistent(bool persistent)
+{
+    if (mqtt_persistent && !persistent && mqtt_state == MQTT_CONNECTED)
+    {
+        xTaskCreate(mqtt_disconnect_task, "mqtt_disconnect_task", 4096, NULL, 5, NULL);
+    }
+    mqtt_persistent = persistent;
+}
+
 void mqtt_disconnect_task(void *pvParameters)
 {
     ESP_LOGI(TAG, "Disconnecting MQTT");
@@ -859,12 +1561,12 @@ esp_err_t mqtt_test(esp_mqtt_error_type_t *type, esp_mqtt_connect_return_code_t
         return err;
     }
     EventBits_t bits = xEventGroupWaitBits(mqtt_event_group,
-                                           BIT0 | BIT1 | BIT2,
+                                           MQTT_CONNECTED_BIT | MQTT_DISCONNECTED_BIT | MQTT_ERROR_BIT,
                                            pdFALSE,
                                            pdFALSE,
                                            30000 / portTICK_PERIOD_MS);
 
-    xEventGroupClearBits(mqtt_event_group, BIT0 | BIT1 | BIT2);
+    xEventGroupClearBits(mqtt_event_group, MQTT_CONNECTED_BIT | MQTT_DISCONNECTED_BIT | MQTT_ERROR_BIT);
 
     if (type != NULL)
     {
@@ -875,7 +1577,7 @@ esp_err_t mqtt_test(esp_mqtt_error_type_t *type, esp_mqtt_connect_return_code_t
         *return_code = last_return_code;
     }
 
-    if (bits & BIT0)
+    if (bits & MQTT_CONNECTED_BIT)
     {
         return ESP_OK;
     }
@@ -883,4 +1585,95 @@ esp_err_t mqtt_test(esp_mqtt_error_type_t *type, esp_mqtt_connect_return_code_t
     {
         return ESP_FAIL;
     }
-}
\ No newline at end of file
+}
+
+esp_err_t mqtt_benchmark(uint32_t iterations)
+{
+    char topic[150];
+    char strValue[100];
+    char *config = malloc(MQTT_DISCOVERY_SIZE);
+    char config_topic[100];
+    if (config == NULL || iterations == 0)
+    {
+        free(config);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    uint32_t count = 0;
+    const uint8_t *labels = linky_get_mode_labels(linky_mode, &count);
+
+    // topics formatted for each label, as before the topic pool
+    int64_t start = esp_timer_get_time();
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+        for (uint32_t n = 0; n < count; n++)
+        {
+            snprintf(topic, sizeof(topic), "%s/%s", config_values.mqtt.topic, linky_label_list[labels[n]].label);
+            mqtt_topic_comliance(topic, sizeof(topic));
+        }
+    }
+    int64_t topic_time = esp_timer_get_time() - start;
+
+    // topic and value of each label, as mqtt_prepare_publish() without the outbox
+    uint32_t messages = 0;
+    mqtt_get_topic(0); // build the pool out of the measure
+    start = esp_timer_get_time();
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+        for (uint32_t n = 0; n < count; n++)
+        {
+            const char *pool_topic = mqtt_get_topic(labels[n]);
+            if (pool_topic != NULL && mqtt_format_value(labels[n], strValue, sizeof(strValue)))
+            {
+                messages++;
+            }
+        }
+    }
+    int64_t publish_time = esp_timer_get_time() - start;
+
+    // Home Assistant discovery config of each label, and the blocks allocated for one label
+    multi_heap_info_t before;
+    multi_heap_info_t after;
+    heap_caps_get_info(&before, MALLOC_CAP_DEFAULT);
+    esp_err_t err = count > 0 ? mqtt_create_sensor(config, MQTT_DISCOVERY_SIZE, config_topic, sizeof(config_topic), linky_label_list[labels[0]]) : ESP_FAIL;
+    heap_caps_get_info(&after, MALLOC_CAP_DEFAULT);
+    uint32_t discovery_blocks = after.allocated_blocks - before.allocated_blocks;
+    start = esp_timer_get_time();
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+        for (uint32_t n = 0; n < count; n++)
+        {
+            if (mqtt_create_sensor(config, MQTT_DISCOVERY_SIZE, config_topic, sizeof(config_topic), linky_label_list[labels[n]]) != ESP_OK)
+            {
+                err = ESP_FAIL;
+            }
+            mqtt_topic_comliance(config_topic, sizeof(config_topic));
+        }
+    }
+    int64_t discovery_time = esp_timer_get_time() - start;
+    free(config);
+
+    // single json message of the batch mode
+    bool dirty = false;
+    uint32_t state_size = 0;
+    start = esp_timer_get_time();
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+        char *json = mqtt_state_json(&dirty);
+        if (json == NULL)
+        {
+            return ESP_ERR_NO_MEM;
+        }
+        state_size = strlen(json);
+        free(json);
+    }
+    int64_t state_time = esp_timer_get_time() - start;
+
+    ESP_LOGI(TAG, "Benchmark: %" PRIu32 " messages per frame", messages / iterations);
+    ESP_LOGI(TAG, "Benchmark: formatted topics: %" PRId64 " ns/frame", topic_time * 1000 / iterations);
+    ESP_LOGI(TAG, "Benchmark: pooled topics and values: %" PRId64 " ns/frame", publish_time * 1000 / iterations);
+    ESP_LOGI(TAG, "Benchmark: discovery configs of %" PRIu32 " labels: %" PRId64 " ns/frame, %" PRIu32 " blocks allocated per config", count, discovery_time * 1000 / iterations,
+             discovery_blocks);
+    ESP_LOGI(TAG, "Benchmark: state message of %" PRIu32 " bytes: %" PRId64 " ns/frame", state_size, state_time * 1000 / iterations);
+    return messages > 0 && err == ESP_OK ? ESP_OK : ESP_FAIL;
+}
@@ -0,0 +1,533 @@
+/**
+ * @file record.c
+ * @author Dorian Benech
+ * @brief Compact storage of the readings waiting to be sent
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2023 GammaTroniques
+ *
+ */
+
+/*==============================================================================
+ Local Include
+===============================================================================*/
+#include "record.h"
+#include "esp_log.h"
+#include <inttypes.h>
+#include <string.h>
+
+/*==============================================================================
+ Local Define
+===============================================================================*/
+#define TAG "RECORD"
+#define RECORD_END 0xFF // Marks the end of the fields of a record
+
+/*==============================================================================
+ Local Macro
+===============================================================================*/
+
+/*==============================================================================
+ Local Type
+===============================================================================*/
+typedef struct
+{
+    uint8_t *data;
+    uint32_t size;
+    uint32_t pos;
+    bool overflow;
+} record_writer_t;
+
+typedef struct
+{
+    const uint8_t *data;
+    uint32_t size;
+    uint32_t pos;
+    bool error;
+} record_reader_t;
+
+/*==============================================================================
+ Local Function Declaration
+===============================================================================*/
+static void *record_value(const linky_data_t *data, uint32_t index);
+static uint32_t record_value_size(uint32_t index);
+static bool record_has_label(const linky_data_t *data, uint32_t index);
+static void record_build_alias();
+static void record_clear(linky_data_t *data, linky_mode_t mode);
+static void record_put_byte(record_writer_t *w, uint8_t value);
+static void record_put_varint(record_writer_t *w, uint64_t value);
+static void record_put_signed(record_writer_t *w, int64_t value);
+static void record_put_number(record_writer_t *w, const void *value, const void *last, uint8_t size);
+static uint8_t record_get_byte(record_reader_t *r);
+static uint64_t record_get_varint(record_reader_t *r);
+static int64_t record_get_signed(record_reader_t *r);
+static void record_get_number(record_reader_t *r, void *value, uint8_t size);
+
+/*==============================================================================
+Public Variable
+===============================================================================*/
+
+/*==============================================================================
+ Local Variable
+===============================================================================*/
+static uint8_t record_buffer[RECORD_BUFFER_SIZE] = {0};
+static uint32_t record_used = 0;
+static uint32_t record_number = 0;
+static record_state_t record_state; // Reference of the deltas of the next record
+
+// Labels stored inside the value of another label (ex: the time of a UINT32_TIME), never written in a record
+static uint32_t record_alias[(RECORD_END + 31) / 32] = {0};
+static bool record_alias_ready = false;
+
+// Value of a number or a time label cleared by linky_clear_data()
+static const uint8_t record_unset[sizeof(time_label_t)] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+
+/*==============================================================================
+Function Implementation
+===============================================================================*/
+
+void record_state_init(record_state_t *state)
+{
+    record_clear(&state->data, NONE);
+    state->data.timestamp = 0;
+    state->started = false;
+}
+
+uint32_t record_encode(record_state_t *state, const linky_data_t *data, uint8_t *buffer, uint32_t size)
+{
+    record_writer_t w = {
+        .data = buffer,
+        .size = size,
+    };
+
+    // the deltas of the first record and after a mode change start from the cleared values
+    bool reset = !state->started || state->data.mode != data->mode;
+    time_t last_timestamp = state->started ? state->data.timestamp : 0;
+
+    record_put_byte(&w, data->mode);
+    record_put_signed(&w, data->timestamp - last_timestamp);
+
+    for (uint32_t i = 0; i < linky_label_list_size && i < RECORD_END; i++)
+    {
+        if (!record_has_label(data, i))
+        {
+            continue;
+        }
+        const void *value = record_value(data, i);
+        const void *last = reset ? record_unset : record_value(&state->data, i);
+
+        switch (linky_label_list[i].type)
+        {
+        case UINT8:
+        case BOOL:
+            if (*(uint8_t *)value == *(uint8_t *)last)
+                continue;
+            record_put_byte(&w, i);
+            record_put_byte(&w, *(uint8_t *)value);
+            break;
+        case UINT16:
+        case UINT32:
+        case UINT64:
+            if (memcmp(value, last, linky_label_list[i].type) == 0) // the type is the size of the value
+                continue;
+            record_put_byte(&w, i);
+            record_put_number(&w, value, last, linky_label_list[i].type);
+            break;
+        case UINT32_TIME:
+        {
+            const time_label_t *time_value = value;
+            const time_label_t *time_last = last;
+            if (time_value->value == time_last->value && time_value->time == time_last->time)
+                continue;
+            record_put_byte(&w, i);
+            record_put_number(&w, &time_value->value, &time_last->value, sizeof(uint32_t));
+            record_put_signed(&w, time_value->time - time_last->time);
+            break;
+        }
+        case STRING:
+        {
+            if (reset)
+            {
+                last = "";
+            }
+            if (strncmp(value, last, linky_label_list[i].size) == 0)
+                continue;
+            uint8_t len = strnlen(value, linky_label_list[i].size);
+            record_put_byte(&w, i);
+            record_put_byte(&w, len);
+            for (uint32_t j = 0; j < len; j++)
+            {
+                record_put_byte(&w, ((const uint8_t *)value)[j]);
+            }
+            break;
+        }
+        default:
+            break;
+        }
+    }
+    record_put_byte(&w, RECORD_END);
+
+    if (w.overflow)
+    {
+        return 0;
+    }
+    state->data = *data;
+    state->started = true;
+    return w.pos;
+}
+
+uint32_t record_decode(record_state_t *state, const uint8_t *buffer, uint32_t size)
+{
+    record_reader_t r = {
+        .data = buffer,
+        .size = size,
+    };
+
+    linky_mode_t mode = record_get_byte(&r);
+    if (!state->started || mode != state->data.mode)
+    {
+        time_t timestamp = state->started ? state->data.timestamp : 0;
+        record_clear(&state->data, mode);
+        state->data.timestamp = timestamp;
+    }
+    state->started = true;
+    state->data.timestamp += record_get_signed(&r);
+
+    while (!r.error)
+    {
+        uint8_t i = record_get_byte(&r);
+        if (i == RECORD_END)
+        {
+            break;
+        }
+        if (i >= linky_label_list_size || !record_has_label(&state->data, i))
+        {
+            ESP_LOGE(TAG, "Invalid label %d", i);
+            return 0;
+        }
+        void *value = record_value(&state->data, i);
+
+        switch (linky_label_list[i].type)
+        {
+        case UINT8:
+        case BOOL:
+            *(uint8_t *)value = record_get_byte(&r);
+            break;
+        case UINT16:
+        case UINT32:
+        case UINT64:
+            record_get_number(&r, value, linky_label_list[i].type);
+            break;
+        case UINT32_TIME:
+        {
+            time_label_t *time_value = value;
+            record_get_number(&r, &time_value->value, sizeof(uint32_t));
+            time_value->time += record_get_signed(&r);
+            break;
+        }
+        case STRING:
+        {
+            uint8_t len = record_get_byte(&r);
+            if (len > linky_label_list[i].size || r.pos + len > r.size)
+            {
+                r.error = true;
+                break;
+            }
+            memset(value, 0, linky_label_list[i].size + 1); // the terminator of a value of the full size
+            memcpy(value, r.data + r.pos, len);
+            r.pos += len;
+            break;
+        }
+        default:
+            break;
+        }
+    }
+
+    if (r.error)
+    {
+        ESP_LOGE(TAG, "Corrupted record");
+        return 0;
+    }
+    return r.pos;
+}
+
+void record_reset()
+{
+    record_used = 0;
+    record_number = 0;
+    record_state_init(&record_state);
+}
+
+esp_err_t record_add(const linky_data_t *data)
+{
+    uint32_t size = record_encode(&record_state, data, record_buffer + record_used, RECORD_BUFFER_SIZE - record_used);
+    if (size == 0)
+    {
+        ESP_LOGW(TAG, "Buffer full: %" PRIu32 " records, %" PRIu32 " bytes", record_number, record_used);
+        return ESP_ERR_NO_MEM;
+    }
+
+    record_used += size;
+    record_number++;
+    ESP_LOGI(TAG, "Record %" PRIu32 ": %" PRIu32 " bytes, %" PRIu32 "/%d bytes used", record_number, size, record_used, RECORD_BUFFER_SIZE);
+    return ESP_OK;
+}
+
+uint32_t record_count()
+{
+    return record_number;
+}
+
+uint32_t record_size()
+{
+    return record_used;
+}
+
+void record_iterator_init(record_iterator_t *it)
+{
+    it->offset = 0;
+    it->index = 0;
+    record_state_init(&it->state);
+}
+
+bool record_next(record_iterator_t *it)
+{
+    if (it->index >= record_number || it->offset >= record_used)
+    {
+        return false;
+    }
+
+    uint32_t size = record_decode(&it->state, record_buffer + it->offset, record_used - it->offset);
+    if (size == 0)
+    {
+        ESP_LOGE(TAG, "Cant decode record %" PRIu32, it->index);
+        return false;
+    }
+    it->offset += size;
+    it->index++;
+    return true;
+}
+
+/**
+ * @brief Get the address of the value of a label in a reading
+ *
+ * @param data the reading
+ * @param index the index in linky_label_list
+ * @return void* the address of the value, NULL if the label is not stored in linky_data
+ */
+static void *record_value(const linky_data_t *data, uint32_t index)
+{
+    const char *address = linky_label_list[index].data;
+    if (address == NULL || address < (const char *)&linky_data || address >= (const char *)&linky_data + sizeof(linky_data_t))
+    {
+        return NULL;
+    }
+    return (char *)data + (address - (const char *)&linky_data);
+}
+
+/**
+ * @brief Get the size of the value of a label
+ *
+ * @param index the index in linky_label_list
+ * @return uint32_t the size in bytes, 0 if the type is not stored in the records
+ */
+static uint32_t record_value_size(uint32_t index)
+{
+    switch (linky_label_list[index].type)
+    {
+    case UINT8:
+    case BOOL:
+        return 1;
+    case UINT16:
+    case UINT32:
+    case UINT64:
+        return linky_label_list[index].type;
+    case UINT32_TIME:
+        return sizeof(time_label_t);
+    case STRING:
+        return linky_label_list[index].size;
+    default:
+        return 0;
+    }
+}
+
+/**
+ * @brief Get if a label is stored in the records of a reading
+ *
+ * @param data the reading
+ * @param index the index in linky_label_list
+ * @return true if the label is part of the reading
+ */
+static bool record_has_label(const linky_data_t *data, uint32_t index)
+{
+    if (linky_label_list[index].mode != data->mode && linky_label_list[index].mode != ANY)
+    {
+        return false;
+    }
+    if (!record_alias_ready)
+    {
+        record_build_alias();
+    }
+    if ((record_alias[index / 32] >> (index % 32)) & 1)
+    {
+        return false;
+    }
+    return record_value(data, index) != NULL && record_value_size(index) > 0;
+}
+
+/**
+ * @brief Find the labels stored inside a bigger label of the same mode
+ * Writing both would apply the same delta twice when decoding
+ */
+static void record_build_alias()
+{
+    for (uint32_t i = 0; i < linky_label_list_size && i < RECORD_END; i++)
+    {
+        const char *start = linky_label_list[i].data;
+        for (uint32_t j = 0; j < linky_label_list_size; j++)
+        {
+            const char *other = linky_label_list[j].data;
+            if (j == i || start == NULL || other == NULL || record_value_size(j) <= record_value_size(i))
+            {
+                continue;
+            }
+            if (linky_label_list[i].mode != linky_label_list[j].mode && linky_label_list[j].mode != ANY)
+            {
+                continue;
+            }
+            if (start >= other && start < other + record_value_size(j))
+            {
+                record_alias[i / 32] |= 1UL << (i % 32);
+                break;
+            }
+        }
+    }
+    record_alias_ready = true;
+}
+
+/**
+ * @brief Reset a reading to the values of linky_clear_data()
+ *
+ * @param data the reading to clear
+ * @param mode the mode of the reading
+ */
+static void record_clear(linky_data_t *data, linky_mode_t mode)
+{
+    memset(data, 0xFF, sizeof(linky_data_t));
+    data->mode = mode;
+    for (uint32_t i = 0; i < linky_label_list_size && i < RECORD_END; i++)
+    {
+        if (linky_label_list[i].type == STRING && record_has_label(data, i))
+        {
+            memset(record_value(data, i), 0, linky_label_list[i].size + 1); // the arrays hold the terminator after the size
+        }
+    }
+}
+
+static void record_put_byte(record_writer_t *w, uint8_t value)
+{
+    if (w->pos >= w->size)
+    {
+        w->overflow = true;
+        return;
+    }
+    w->data[w->pos++] = value;
+}
+
+static void record_put_varint(record_writer_t *w, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        record_put_byte(w, (value & 0x7F) | 0x80);
+        value >>= 7;
+    }
+    record_put_byte(w, value);
+}
+
+/**
+ * @brief Write a signed number as a zigzag varint: small negative numbers stay short
+ */
+static void record_put_signed(record_writer_t *w, int64_t value)
+{
+    record_put_varint(w, ((uint64_t)value << 1) ^ (uint64_t)(value >> 63));
+}
+
+/**
+ * @brief Write a number as a delta from the last value, or as is if the last value was not available
+ *
+ * @param w the writer
+ * @param value the number to write
+ * @param last the number of the previous record
+ * @param size the size of the number: 2, 4 or 8 bytes
+ */
+static void record_put_number(record_writer_t *w, const void *value, const void *last, uint8_t size)
+{
+    uint64_t v = 0;
+    uint64_t l = 0;
+    memcpy(&v, value, size);
+    memcpy(&l, last, size);
+    uint8_t shift = 64 - size * 8;
+    uint64_t max = UINT64_MAX >> shift;
+    if (l == max)
+    {
+        record_put_varint(w, v);
+        return;
+    }
+    record_put_signed(w, (int64_t)((v - l) << shift) >> shift); // sign extend the delta to 64 bits
+}
+
+static uint8_t record_get_byte(record_reader_t *r)
+{
+    if (r->pos >= r->size)
+    {
+        r->error = true;
+        return RECORD_END;
+    }
+    return r->data[r->pos++];
+}
+
+static uint64_t record_get_varint(record_reader_t *r)
+{
+    uint64_t value = 0;
+    for (uint8_t shift = 0; shift < 64 && !r->error; shift += 7)
+    {
+        uint8_t byte = record_get_byte(r);
+        value |= (uint64_t)(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0)
+        {
+            break;
+        }
+    }
+    return value;
+}
+
+static int64_t record_get_signed(record_reader_t *r)
+{
+    uint64_t value = record_get_varint(r);
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+/**
+ * @brief Read a number written by record_put_number()
+ *
+ * @param r the reader
+ * @param value the number of the previous record, replaced by the read one
+ * @param size the size of the number: 2, 4 or 8 bytes
+ */
+static void record_get_number(record_reader_t *r, void *value, uint8_t size)
+{
+    uint64_t l = 0;
+    memcpy(&l, value, size);
+    uint8_t shift = 64 - size * 8;
+    uint64_t max = UINT64_MAX >> shift;
+    uint64_t v;
+    if (l == max)
+    {
+        v = record_get_varint(r);
+    }
+    else
+    {
+        v = l + record_get_signed(r);
+    }
+    memcpy(value, &v, size); // little endian: the low bytes hold the value
+}
@@ -28,6 +28,8 @@
 #include "esp_pm.h"
 #include "led.h"
 #include "tuya.h"
+#include "aggregate.h"
+#include "capture.h"
 /*==============================================================================
  Local Define
 ===============================================================================*/
@@ -88,6 +90,11 @@ static int set_linky_mode_command(int argc, char **argv);
 static int get_linky_mode_command(int argc, char **argv);
 static int linky_print_command(int argc, char **argv);
 static int linky_simulate(int argc, char **argv);
+static int linky_metrics_command(int argc, char **argv);
+static int capture_start_command(int argc, char **argv);
+static int capture_stop_command(int argc, char **argv);
+static int capture_dump_command(int argc, char **argv);
+static int capture_replay_command(int argc, char **argv);
 
 static int wifi_start_captive_portal_command(int argc, char **argv);
 static int mqtt_discovery_command(int argc, char **argv);
@@ -106,6 +113,14 @@ static int ota_start(int argc, char **argv);
 
 static int set_refresh_command(int argc, char **argv);
 static int get_refresh_command(int argc, char **argv);
+static int set_aggregate_command(int argc, char **argv);
+static int get_aggregate_command(int argc, char **argv);
+static int set_stream_command(int argc, char **argv);
+static int get_stream_command(int argc, char **argv);
+static int set_mqtt_batch_command(int argc, char **argv);
+static int get_mqtt_batch_command(int argc, char **argv);
+static int set_publish_command(int argc, char **argv);
+static int get_publish_command(int argc, char **argv);
 // static esp_err_t esp_console_register_reset_command(void);
 static int led_off(int argc, char **argv);
 static int factory_reset(int argc, char **argv);
@@ -163,6 +178,14 @@ static const shell_cmd_t shell_cmds[] = {
 
     {"set-refresh",                 "Set refresh rate",                         &set_refresh_command,               1, {"<refresh>"}, {"Refresh rate in seconds"}},
     {"get-refresh",                 "Get refresh rate",                         &get_refresh_command,               0, {}, {}},
+    {"set-aggregate",               "Set load curve period",                    &set_aggregate_command,             1, {"<period>"}, {"Period in minutes: 0 (disabled), 15, 30 or 60"}},
+    {"get-aggregate",               "Get load curve buckets",                   &get_aggregate_command,             0, {}, {}},
+    {"set-stream",                  "Enable/Disable streaming on USB power",    &set_stream_command,                1, {"<enable>"}, {"Publish every frame while USB is connected (0/1)"}},
+    {"get-stream",                  "Get streaming state",                      &get_stream_command,                0, {}, {}},
+    {"set-mqtt-batch",              "Enable/Disable the mqtt state message",    &set_mqtt_batch_command,            1, {"<enable>"}, {"Publish each reading as one json message on <topic>/state (0/1)"}},
+    {"get-mqtt-batch",              "Get the mqtt state message state",         &get_mqtt_batch_command,            0, {}, {}},
+    {"set-publish",                 "Set the mqtt publish policies",            &set_publish_command,               1, {"<policies>"}, {"LABEL:deadband[%][:max_age],... e.g. SINSTS:5%:300,URMS1:2 (\"\" for the defaults)"}},
+    {"get-publish",                 "Get the mqtt publish policies",            &get_publish_command,               0, {}, {}},
     {"get-config",                  "Get config",                               &get_config_command,                0, {}, {}},
     {"set-config",                  "Set config",                               &set_config_command,                0, {}, {}},
     {"get-VCondo",                  "Get VCondo",                               &get_VCondo_command,                0, {}, {}},
@@ -177,6 +200,11 @@ static const shell_cmd_t shell_cmds[] = {
     {"get-linky-mode",              "Get linky mode",                           &get_linky_mode_command,            0, {}, {}},
     {"linky-print",                 "Print linky linky_data",                   &linky_print_command,               1, {"<debug>"}, {"View raw frame, bool 0/1"}},
     {"linky-simulate",              "Simulate linky linky_data",                &linky_simulate,                    1, {"<std>"}, {"Mode STD ? 0/1"}},
+    {"linky-metrics",               "Print linky decoder metrics",              &linky_metrics_command,             1, {"<reset>"}, {"Reset the metrics after printing, bool 0/1"}},
+    {"capture-start",               "Record the raw linky bytes",               &capture_start_command,             1, {"<size>"}, {"Size of the capture in bytes, 0 for the default"}},
+    {"capture-stop",                "Stop recording the raw linky bytes",       &capture_stop_command,              0, {}, {}},
+    {"capture-dump",                "Print the capture in hexadecimal",         &capture_dump_command,              0, {}, {}},
+    {"capture-replay",              "Decode the capture",                       &capture_replay_command,            1, {"<speed>"}, {"1 for real time, 1000 for 1000x, 0 without delay"}},
     {"get-voltage",                 "Get Voltages",                             &get_voltages,                      0, {}, {}},
     {"set-sleep",                   "Enable/Disable sleep",                     &set_sleep_command,                 1, {"<enable>"}, {"Enable/Disable deep sleep"}},
     {"get-sleep",                   "Get sleep state",                          &get_sleep_command,                 0, {}, {}},
@@ -450,6 +478,7 @@ static int mqtt_discovery_command(int argc, char **argv)
     return ESP_ERR_INVALID_ARG;
   }
   printf("MQTT discovery\n");
+  mqtt_reset_ha_discovery();
   mqtt_setup_ha_discovery(false);
   return 0;
 }
@@ -648,6 +677,53 @@ static int linky_print_command(int argc, char **argv)
   return 0;
 }
 
+static int linky_metrics_command(int argc, char **argv)
+{
+  if (argc < 1 || argc > 2)
+  {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  linky_metrics_print();
+  if (argc == 2 && atoi(argv[1]) == 1)
+  {
+    linky_metrics_reset();
+    printf("Metrics reset\n");
+  }
+  return 0;
+}
+
+static int capture_start_command(int argc, char **argv)
+{
+  if (argc > 2)
+  {
+    return ESP_ERR_INVALID_ARG;
+  }
+  uint32_t size = argc == 2 ? strtoul(argv[1], NULL, 10) : 0;
+  return capture_start(size);
+}
+
+static int capture_stop_command(int argc, char **argv)
+{
+  capture_stop();
+  return 0;
+}
+
+static int capture_dump_command(int argc, char **argv)
+{
+  return capture_dump();
+}
+
+static int capture_replay_command(int argc, char **argv)
+{
+  if (argc > 2)
+  {
+    return ESP_ERR_INVALID_ARG;
+  }
+  uint32_t speed = argc == 2 ? strtoul(argv[1], NULL, 10) : 1000;
+  return capture_replay(speed);
+}
+
 static int linky_simulate(int argc, char **argv)
 {
   if (argc > 2)
@@ -781,6 +857,111 @@ static int get_refresh_command(int argc, char **argv)
   return 0;
 }
 
+static int set_aggregate_command(int argc, char **argv)
+{
+  if (argc != 2)
+  {
+    return ESP_ERR_INVALID_ARG;
+  }
+  uint8_t period = atoi(argv[1]);
+  if (!AGGREGATE_PERIOD_VALID(period))
+  {
+    printf("Invalid period: %s\n", argv[1]);
+    return ESP_ERR_INVALID_ARG;
+  }
+  config_values.aggregate_period = period;
+  config_write();
+  printf("Aggregate period saved\n");
+  get_aggregate_command(1, NULL);
+  return 0;
+}
+
+static int get_aggregate_command(int argc, char **argv)
+{
+  if (argc != 1)
+  {
+    return ESP_ERR_INVALID_ARG;
+  }
+  aggregate_print();
+  return 0;
+}
+
+static int set_stream_command(int argc, char **argv)
+{
+  if (argc != 2)
+  {
+    return ESP_ERR_INVALID_ARG;
+  }
+  config_values.stream = atoi(argv[1]) ? 1 : 0;
+  config_write();
+  printf("Stream saved\n");
+  get_stream_command(1, NULL);
+  return 0;
+}
+
+static int get_stream_command(int argc, char **argv)
+{
+  if (argc != 1)
+  {
+    return ESP_ERR_INVALID_ARG;
+  }
+  printf("Stream: %d, VUSB: %d\n", config_values.stream, gpio_vusb_connected());
+  return 0;
+}
+
+static int set_mqtt_batch_command(int argc, char **argv)
+{
+  if (argc != 2)
+  {
+    return ESP_ERR_INVALID_ARG;
+  }
+  config_values.mqtt_batch = atoi(argv[1]) ? 1 : 0;
+  config_write();
+  printf("MQTT batch saved\n");
+  get_mqtt_batch_command(1, NULL);
+  return 0;
+}
+
+static int get_mqtt_batch_command(int argc, char **argv)
+{
+  if (argc != 1)
+  {
+    return ESP_ERR_INVALID_ARG;
+  }
+  printf("MQTT batch: %d\n", config_values.mqtt_batch);
+  return 0;
+}
+
+static int set_publish_command(int argc, char **argv)
+{
+  if (argc != 2)
+  {
+    return ESP_ERR_INVALID_ARG;
+  }
+  esp_err_t err = linky_publish_parse(argv[1], config_values.publish);
+  if (err != ESP_OK)
+  {
+    return err;
+  }
+  config_write();
+  printf("Publish policies saved\n");
+  get_publish_command(1, NULL);
+  return 0;
+}
+
+static int get_publish_command(int argc, char **argv)
+{
+  if (argc != 1)
+  {
+    return ESP_ERR_INVALID_ARG;
+  }
+  char policies[LINKY_PUBLISH_OVERRIDES * 32];
+  linky_publish_format(policies, sizeof(policies));
+  printf("Overrides: %s\n", strlen(policies) > 0 ? policies : "none");
+  linky_publish_print();
+  return 0;
+}
+
 static int led_off(int argc, char **argv)
 {
   gpio_set_level(LED_EN, 0);
@@ -23,6 +23,11 @@
 #include "gpio.h"
 #include "driver/uart.h"
 #include "linky.h"
+#include "history.h"
+#include "aggregate.h"
+#include "json_writer.h"
+#include "web.h"
+#include "mqtt.h"
 #include "common.h"
 #include "wifi.h"
 #include "main.h"
@@ -30,6 +35,7 @@
  Local Define
 ===============================================================================*/
 #define TAG "TESTS"
+#define TESTS_BENCH_ITERATIONS 100
 /*==============================================================================
  Local Macro
 ===============================================================================*/
@@ -49,6 +55,13 @@ static esp_err_t test_linky_read(void *ptr);
 static esp_err_t test_linky_stats(void *ptr);
 static void tests_task(void *pvParameters);
 static esp_err_t test_producer(void *ptr);
+static esp_err_t test_linky_bench(void *ptr);
+static esp_err_t test_linky_sniff(void *ptr);
+static esp_err_t test_history(void *ptr);
+static esp_err_t test_aggregate(void *ptr);
+static esp_err_t test_linky_time(void *ptr);
+static esp_err_t test_bench(void *ptr);
+static esp_err_t test_json(void *ptr);
 
 /*==============================================================================
 Public Variable
@@ -62,6 +75,13 @@ esp_err_t (*tests_available_tests[])(void *ptr) = {
     [TEST_LINKY_READ] = test_linky_read,
     [TEST_LINKY_STATS] = test_linky_stats,
     [TEST_PRODUCER] = test_producer,
+    [TEST_LINKY_BENCH] = test_linky_bench,
+    [TEST_LINKY_SNIFF] = test_linky_sniff,
+    [TEST_HISTORY] = test_history,
+    [TEST_AGGREGATE] = test_aggregate,
+    [TEST_LINKY_TIME] = test_linky_time,
+    [TEST_BENCH] = test_bench,
+    [TEST_JSON] = test_json,
 
 };
 
@@ -74,6 +94,13 @@ const char *const tests_str_available_tests[] = {
     [TEST_LINKY_READ] = "linky-read",
     [TEST_LINKY_STATS] = "linky-stats",
     [TEST_PRODUCER] = "producer",
+    [TEST_LINKY_BENCH] = "linky-bench",
+    [TEST_LINKY_SNIFF] = "linky-sniff",
+    [TEST_HISTORY] = "history",
+    [TEST_AGGREGATE] = "aggregate",
+    [TEST_LINKY_TIME] = "linky-time",
+    [TEST_BENCH] = "bench",
+    [TEST_JSON] = "json",
 };
 
 const uint32_t tests_count = sizeof(tests_str_available_tests) / sizeof(char *);
@@ -322,4 +349,59 @@ static esp_err_t test_producer(void *ptr)
     }
 
     return ESP_OK;
-}
\ No newline at end of file
+}
+
+static esp_err_t test_linky_bench(void *ptr)
+{
+    return linky_benchmark(100);
+}
+
+static esp_err_t test_linky_sniff(void *ptr)
+{
+    return linky_sniff_test();
+}
+
+static esp_err_t test_history(void *ptr)
+{
+    return history_benchmark(1000);
+}
+
+static esp_err_t test_aggregate(void *ptr)
+{
+    return aggregate_test();
+}
+
+static esp_err_t test_linky_time(void *ptr)
+{
+    return linky_time_test();
+}
+
+static esp_err_t test_bench(void *ptr)
+{
+    // decode and checksum of the standard debug frame
+    esp_err_t err = linky_benchmark(TESTS_BENCH_ITERATIONS);
+
+    // messages built from the standard test data
+    linky_mode_t previous_mode = linky_mode;
+    linky_set_mode(MODE_STD);
+    linky_data.std = tests_std_data;
+    if (web_benchmark(&linky_data, TESTS_BENCH_ITERATIONS) != ESP_OK)
+    {
+        err = ESP_FAIL;
+    }
+    if (mqtt_benchmark(TESTS_BENCH_ITERATIONS) != ESP_OK)
+    {
+        err = ESP_FAIL;
+    }
+    if (previous_mode <= MODE_STD)
+    {
+        linky_set_mode(previous_mode);
+    }
+    linky_clear_data();
+    return err;
+}
+
+static esp_err_t test_json(void *ptr)
+{
+    return json_writer_test();
+}
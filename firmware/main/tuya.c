@@ -19,6 +19,7 @@
 #include "tuya_iot.h"
 #include "tuya_ota.h"
 #include "cJSON.h"
+#include "json_writer.h"
 #include "qrcode.h"
 #include "gpio.h"
 #include "wifi.h"
@@ -47,6 +48,7 @@
 ===============================================================================*/
 
 #define TAG "TUYA"
+#define TUYA_JSON_SIZE 2048 // Dps of a report: the strings have at most 255 characters
 #define GATT_SVR_SVC_ALERT_UUID 0x1811
 #define GATT_SVR_CHR_SUP_NEW_ALERT_CAT_UUID 0x2A47
 #define GATT_SVR_CHR_NEW_ALERT 0x2A46
@@ -280,7 +282,7 @@ static void user_ota_event_cb(tuya_ota_handle_t *handle, tuya_ota_event_t *event
         break;
 
     case TUYA_OTA_EVENT_ON_DATA:
-        ESP_LOGI(TAG, "OTA data len: %d %d/%d", event->data_len, event->offset, event->file_size);
+        ESP_LOGI(TAG, "OTA data len: %zu %zu/%zu", event->data_len, event->offset, event->file_size);
         ret = ota_zlib_write(event->data, event->data_len);
         if (ret != ESP_OK)
         {
@@ -476,7 +478,7 @@ uint32_t tuya_cap_value(uint64_t value_in)
     uint32_t value;
     if (value_in > INT32_MAX)
     {
-        ESP_LOGW(TAG, "Tuya value capped: %llu", value_in);
+        ESP_LOGW(TAG, "Tuya value capped: %" PRIu64, value_in);
         value = INT32_MAX;
     }
     else
@@ -518,7 +520,15 @@ static char *tuya_verify_enum(char *input, const char *const *valid_values)
 uint8_t tuya_send_data(linky_data_t *linky)
 {
     ESP_LOGI(TAG, "Send data to tuya");
-    cJSON *jsonObject = cJSON_CreateObject(); // Create the root object
+    char *json = malloc(TUYA_JSON_SIZE); // the dps are written directly in it, without a cJSON tree
+    if (json == NULL)
+    {
+        ESP_LOGE(TAG, "Cant allocate the json");
+        return 1;
+    }
+    json_writer_t writer;
+    json_writer_init(&writer, json, TUYA_JSON_SIZE, NULL, NULL);
+    json_writer_object_start(&writer, NULL);
 
     // add index:
     index_offset_t now = {0};
@@ -532,7 +542,7 @@ uint8_t tuya_send_data(linky_data_t *linky)
     {
     case C_BASE:
     {
-        cJSON_AddNumberToObject(jsonObject, "111", tuya_cap_value(now.index_total));
+        json_writer_uint(&writer, "111", tuya_cap_value(now.index_total));
     }
 
     break;
@@ -543,9 +553,9 @@ uint8_t tuya_send_data(linky_data_t *linky)
     case C_SEM_WE_MERCREDI:
     case C_SEM_WE_VENDREDI:
     case C_ZEN_FLEX:
-        cJSON_AddNumberToObject(jsonObject, "111", tuya_cap_value(now.index_total));
-        cJSON_AddNumberToObject(jsonObject, "112", tuya_cap_value(now.index_hc));
-        cJSON_AddNumberToObject(jsonObject, "113", tuya_cap_value(now.index_hp));
+        json_writer_uint(&writer, "111", tuya_cap_value(now.index_total));
+        json_writer_uint(&writer, "112", tuya_cap_value(now.index_hc));
+        json_writer_uint(&writer, "113", tuya_cap_value(now.index_hp));
         break;
 
     default:
@@ -553,16 +563,15 @@ uint8_t tuya_send_data(linky_data_t *linky)
         break;
     }
 
-    for (int i = 0; i < linky_label_list_size; i++)
+    uint32_t count = 0;
+    const uint8_t *labels = linky_get_mode_labels(linky_mode, &count); // dont send data for label not used by current mode
+    for (uint32_t n = 0; n < count; n++)
     {
+        uint32_t i = labels[n];
         if (linky_label_list[i].tuya_id < 101 || linky_label_list[i].tuya_id > 199)
         {
             continue; // dont send data for label < 101 : they are not used by tuya
         }
-        if (linky_label_list[i].mode != linky_mode && linky_label_list[i].mode != ANY)
-        {
-            continue; // dont send data for label not used by current mode
-        }
         // json
         char str_id[5];
         snprintf(str_id, sizeof(str_id), "%d", linky_label_list[i].tuya_id);
@@ -577,7 +586,7 @@ uint8_t tuya_send_data(linky_data_t *linky)
                 max_power *= 3;
             }
 
-            cJSON_AddNumberToObject(jsonObject, "102", max_power);
+            json_writer_uint(&writer, "102", max_power);
             continue;
             break;
 
@@ -593,25 +602,25 @@ uint8_t tuya_send_data(linky_data_t *linky)
                 refresh_rate = 10;
             }
 
-            cJSON_AddNumberToObject(jsonObject, "103", refresh_rate);
+            json_writer_uint(&writer, "103", refresh_rate);
             continue;
             break;
 
         case 104:
-            cJSON_AddNumberToObject(jsonObject, "104", tuya_cap_value(linky_data.uptime / 1000));
+            json_writer_uint(&writer, "104", tuya_cap_value(linky_data.uptime / 1000));
             continue;
             break;
         case 105:
             switch (linky_mode)
             {
             case MODE_HIST:
-                cJSON_AddStringToObject(jsonObject, "105", "HISTORIQUE");
+                json_writer_string(&writer, "105", "HISTORIQUE");
                 break;
             case MODE_STD:
-                cJSON_AddStringToObject(jsonObject, "105", "STANDARD");
+                json_writer_string(&writer, "105", "STANDARD");
                 break;
             default:
-                cJSON_AddStringToObject(jsonObject, "105", "INCONNU");
+                json_writer_string(&writer, "105", "INCONNU");
                 break;
             }
             continue;
@@ -619,11 +628,11 @@ uint8_t tuya_send_data(linky_data_t *linky)
         case 106:
             if (linky_three_phase)
             {
-                cJSON_AddStringToObject(jsonObject, "106", "TRIPHASE");
+                json_writer_string(&writer, "106", "TRIPHASE");
             }
             else
             {
-                cJSON_AddStringToObject(jsonObject, "106", "MONOPHASE");
+                json_writer_string(&writer, "106", "MONOPHASE");
             }
             continue;
             break;
@@ -641,7 +650,7 @@ uint8_t tuya_send_data(linky_data_t *linky)
 
             str = tuya_verify_enum(str, linky_tuya_str_contract);
 
-            cJSON_AddStringToObject(jsonObject, "107", str);
+            json_writer_string(&writer, "107", str);
             continue;
             break;
         }
@@ -649,7 +658,7 @@ uint8_t tuya_send_data(linky_data_t *linky)
         {
             char *str = (char *)linky_label_list[i].data;
             str = tuya_replace(str, str_current_tarif_replace);
-            cJSON_AddStringToObject(jsonObject, "108", str);
+            json_writer_string(&writer, "108", str);
             continue;
             break;
         }
@@ -667,7 +676,7 @@ uint8_t tuya_send_data(linky_data_t *linky)
                 str = "INCONNU";
             }
 
-            cJSON_AddStringToObject(jsonObject, str_id, str);
+            json_writer_string(&writer, str_id, str);
             continue;
             break;
         }
@@ -675,6 +684,11 @@ uint8_t tuya_send_data(linky_data_t *linky)
             break;
         }
 
+        if (!linky_is_dirty(i))
+        {
+            continue; // the computed dps above are always sent, the others only when changed
+        }
+
         switch (linky_label_list[i].type)
         {
         case UINT8:
@@ -682,7 +696,7 @@ uint8_t tuya_send_data(linky_data_t *linky)
             uint8_t *value = (uint8_t *)linky_label_list[i].data;
             if (value == NULL || *value == UINT8_MAX)
                 continue;
-            cJSON_AddNumberToObject(jsonObject, str_id, *value);
+            json_writer_uint(&writer, str_id, *value);
             break;
         }
         case UINT16:
@@ -690,7 +704,7 @@ uint8_t tuya_send_data(linky_data_t *linky)
             uint16_t *value = (uint16_t *)linky_label_list[i].data;
             if (value == NULL || *value == UINT16_MAX)
                 continue;
-            cJSON_AddNumberToObject(jsonObject, str_id, *value);
+            json_writer_uint(&writer, str_id, *value);
             break;
         }
         case UINT32:
@@ -698,7 +712,7 @@ uint8_t tuya_send_data(linky_data_t *linky)
             uint32_t *value = (uint32_t *)linky_label_list[i].data;
             if (value == NULL || *value == UINT32_MAX)
                 continue;
-            cJSON_AddNumberToObject(jsonObject, str_id, tuya_cap_value(*value));
+            json_writer_uint(&writer, str_id, tuya_cap_value(*value));
             break;
         }
         case UINT32_TIME:
@@ -709,7 +723,7 @@ uint8_t tuya_send_data(linky_data_t *linky)
             if (linky_label_list[i].device_class == ENERGY && *value == 0)
                 continue;
 
-            cJSON_AddNumberToObject(jsonObject, str_id, tuya_cap_value(*value));
+            json_writer_uint(&writer, str_id, tuya_cap_value(*value));
             break;
         }
         case UINT64:
@@ -719,7 +733,7 @@ uint8_t tuya_send_data(linky_data_t *linky)
                 continue;
             if (linky_label_list[i].device_class == ENERGY && *value == 0)
                 continue;
-            cJSON_AddNumberToObject(jsonObject, str_id, tuya_cap_value(*value));
+            json_writer_uint(&writer, str_id, tuya_cap_value(*value));
             break;
         }
         case STRING:
@@ -731,7 +745,7 @@ uint8_t tuya_send_data(linky_data_t *linky)
             if (len == 0 || len > 255)
                 continue;
 
-            cJSON_AddStringToObject(jsonObject, str_id, value);
+            json_writer_string(&writer, str_id, value);
             break;
         }
         default:
@@ -739,10 +753,16 @@ uint8_t tuya_send_data(linky_data_t *linky)
         }
     }
 
-    cJSON_AddStringToObject(jsonObject, "193", efuse_values.serial_number);
+    json_writer_string(&writer, "193", efuse_values.serial_number);
 
-    char *json = cJSON_PrintUnformatted(jsonObject); // Convert the json object to string
-    cJSON_Delete(jsonObject);                        // Delete the json object
+    json_writer_object_end(&writer);
+    esp_err_t err = json_writer_end(&writer);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Cant write the json: %s", esp_err_to_name(err));
+        free(json);
+        return 1;
+    }
 
     printf("JSON: %s\n", json);
     uint8_t sendComplete = 0;
@@ -18,11 +18,17 @@
 #include "wifi.h"
 #include "common.h"
 #include "led.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include <sys/param.h>
 
 /*==============================================================================
  Local Define
 ===============================================================================*/
 #define TAG "WEB"
+#define WEB_JSON_CHUNK 256     // Chunk of the json writer, copied to the payload
+#define WEB_JSON_MIN_SIZE 2048 // First size of the payload, doubled when full
+#define WEB_READING_MAX 4096   // Largest json of one reading, in the benchmark
 
 /*==============================================================================
  Local Macro
@@ -37,6 +43,7 @@
 ===============================================================================*/
 static void web_create_http_url(char *url, const char *host, const char *path);
 static esp_err_t web_http_send_data_handler(esp_http_client_event_handle_t evt);
+static const void *web_reading_value(const linky_data_t *data, uint32_t j);
 
 /*==============================================================================
 Public Variable
@@ -50,119 +57,161 @@ Public Variable
 Function Implementation
 ===============================================================================*/
 
-void web_preapare_json_data(linky_data_t *data, char count, char **json)
+/**
+ * @brief Find the value of a label in a reading
+ *
+ * @param data the reading
+ * @param j the index of the label in linky_label_list
+ * @return const void* the value, NULL if the label is protected or has no value
+ */
+static const void *web_reading_value(const linky_data_t *data, uint32_t j)
 {
-    cJSON *jsonObject = cJSON_CreateObject(); // Create the root object
-    cJSON_AddStringToObject(jsonObject, "TOKEN", config_values.web.token);
-    cJSON_AddNumberToObject(jsonObject, "VCONDO", gpio_get_vcondo());
-    cJSON *dataObject = cJSON_CreateArray(); // Create the data array
-    for (int i = 0; i < count; i++)          // Add data to the array
+    for (uint32_t k = 0; k < linky_protected_data_size; k++)
     {
-        ESP_LOGI(TAG, "Data index: %d: timestamp: %lld", i, data[i].timestamp);
-        cJSON *dataItem = cJSON_CreateObject();
-        for (uint32_t j = 0; j < linky_label_list_size; j++)
+        if (linky_label_list[j].data == linky_protected_data[k])
         {
-            if (linky_label_list[j].data == NULL)
-            {
-                continue;
-            }
-            if (linky_mode != linky_label_list[j].mode && linky_label_list[j].mode != ANY)
-            {
-                continue;
-            }
-            uint8_t found = 0;
-            for (uint32_t k = 0; k < linky_protected_data_size; k++)
-            {
-                if (linky_label_list[j].data == linky_protected_data[k])
-                {
-                    found = 1;
-                    continue;
-                }
-            }
-            if (found)
-            {
-                continue;
-            }
-            uint32_t delta_in_data = (char *)linky_label_list[j].data - (char *)&linky_data;
-            ESP_LOGD(TAG, "Adress in data: 0x%lx", delta_in_data);
-            void *value = (char *)&data[i] + delta_in_data;
-            ESP_LOGD(TAG, "Adress in value: 0x%p", value);
-            switch (linky_label_list[j].type)
-            {
-            case UINT8:
-                if (*(uint8_t *)value == UINT8_MAX)
-                {
-                    continue;
-                }
-                ESP_LOGD(TAG, "Name: %s Type: UINT8 Value: %d", linky_label_list[j].label, *(uint8_t *)value);
-                cJSON_AddNumberToObject(dataItem, linky_label_list[j].label, *(uint8_t *)value);
-                break;
-            case UINT16:
-                if (*(uint16_t *)value == UINT16_MAX)
-                {
-                    continue;
-                }
-                ESP_LOGD(TAG, "Name: %s Type: UINT16 Value: %d", linky_label_list[j].label, *(uint16_t *)value);
-                cJSON_AddNumberToObject(dataItem, linky_label_list[j].label, *(uint16_t *)value);
-                break;
-            case UINT32:
-                if (*(uint32_t *)value == UINT32_MAX)
-                {
-                    continue;
-                }
-                if (linky_label_list[j].device_class == ENERGY && *(uint32_t *)value == 0)
-                {
-                    continue;
-                }
-                ESP_LOGD(TAG, "Name: %s Type: UINT32 Value: %ld", linky_label_list[j].label, *(uint32_t *)value);
-                cJSON_AddNumberToObject(dataItem, linky_label_list[j].label, *(uint32_t *)value);
-                break;
-            case UINT64:
-                if (*(uint64_t *)value == UINT64_MAX)
-                {
-                    continue;
-                }
-                if (linky_label_list[j].device_class == ENERGY && *(uint64_t *)value == 0)
-                {
-                    continue;
-                }
-                ESP_LOGD(TAG, "Name: %s Type: UINT64 Value: %lld", linky_label_list[j].label, *(uint64_t *)value);
-                cJSON_AddNumberToObject(dataItem, linky_label_list[j].label, *(uint64_t *)value);
-                break;
-            case STRING:
-                if (strlen((char *)value) == 0)
-                {
-                    continue;
-                }
-                ESP_LOGD(TAG, "Name: %s Type: STRING Value: %s", linky_label_list[j].label, (char *)value);
-                cJSON_AddStringToObject(dataItem, linky_label_list[j].label, (char *)value);
-                break;
-            case UINT32_TIME:
-                if (*(uint32_t *)value == UINT32_MAX)
-                {
-                    continue;
-                }
-                ESP_LOGD(TAG, "Name: %s Type: UINT32_TIME Value: %ld", linky_label_list[j].label, *(uint32_t *)value);
-                cJSON_AddNumberToObject(dataItem, linky_label_list[j].label, *(uint32_t *)value);
-                break;
-            case BOOL:
-                ESP_LOGD(TAG, "Name: %s Type: BOOL Value: %d", linky_label_list[j].label, *(bool *)value);
-                cJSON_AddBoolToObject(dataItem, linky_label_list[j].label, *(bool *)value);
-                break;
-            default:
-                break;
-            }
+            return NULL;
         }
-        cJSON_AddItemToArray(dataObject, dataItem);
     }
+    uint32_t delta_in_data = (char *)linky_label_list[j].data - (char *)&linky_data;
+    const void *value = (const char *)data + delta_in_data;
+    switch (linky_label_list[j].type)
+    {
+    case UINT8:
+        return *(uint8_t *)value == UINT8_MAX ? NULL : value;
+    case UINT16:
+        return *(uint16_t *)value == UINT16_MAX ? NULL : value;
+    case UINT32:
+        if (linky_label_list[j].device_class == ENERGY && *(uint32_t *)value == 0)
+        {
+            return NULL;
+        }
+        return *(uint32_t *)value == UINT32_MAX ? NULL : value;
+    case UINT64:
+        if (linky_label_list[j].device_class == ENERGY && *(uint64_t *)value == 0)
+        {
+            return NULL;
+        }
+        return *(uint64_t *)value == UINT64_MAX ? NULL : value;
+    case STRING:
+        return strlen((char *)value) == 0 ? NULL : value;
+    case UINT32_TIME:
+        return *(uint32_t *)value == UINT32_MAX ? NULL : value;
+    case BOOL:
+        return value;
+    default:
+        return NULL;
+    }
+}
+
+cJSON *web_json_reading(const linky_data_t *data)
+{
+    cJSON *dataItem = cJSON_CreateObject();
+    uint32_t count = 0;
+    const uint8_t *labels = linky_get_mode_labels(data->mode, &count); // the union only holds the data of the mode of this reading
+    for (uint32_t n = 0; n < count; n++)
+    {
+        uint32_t j = labels[n];
+        const void *value = web_reading_value(data, j);
+        if (value == NULL)
+        {
+            continue;
+        }
+        switch (linky_label_list[j].type)
+        {
+        case UINT8:
+            cJSON_AddNumberToObject(dataItem, linky_label_list[j].label, *(uint8_t *)value);
+            break;
+        case UINT16:
+            cJSON_AddNumberToObject(dataItem, linky_label_list[j].label, *(uint16_t *)value);
+            break;
+        case UINT32:
+        case UINT32_TIME:
+            cJSON_AddNumberToObject(dataItem, linky_label_list[j].label, *(uint32_t *)value);
+            break;
+        case UINT64:
+            cJSON_AddNumberToObject(dataItem, linky_label_list[j].label, *(uint64_t *)value);
+            break;
+        case STRING:
+            cJSON_AddStringToObject(dataItem, linky_label_list[j].label, (char *)value);
+            break;
+        case BOOL:
+            cJSON_AddBoolToObject(dataItem, linky_label_list[j].label, *(bool *)value);
+            break;
+        default:
+            break;
+        }
+    }
+    return dataItem;
+}
+
+void web_write_reading(json_writer_t *writer, const linky_data_t *data)
+{
+    uint32_t count = 0;
+    const uint8_t *labels = linky_get_mode_labels(data->mode, &count); // the union only holds the data of the mode of this reading
+    for (uint32_t n = 0; n < count; n++)
+    {
+        uint32_t j = labels[n];
+        const void *value = web_reading_value(data, j);
+        if (value == NULL)
+        {
+            continue;
+        }
+        switch (linky_label_list[j].type)
+        {
+        case UINT8:
+            json_writer_uint(writer, linky_label_list[j].label, *(uint8_t *)value);
+            break;
+        case UINT16:
+            json_writer_uint(writer, linky_label_list[j].label, *(uint16_t *)value);
+            break;
+        case UINT32:
+        case UINT32_TIME:
+            json_writer_uint(writer, linky_label_list[j].label, *(uint32_t *)value);
+            break;
+        case UINT64:
+            json_writer_uint(writer, linky_label_list[j].label, *(uint64_t *)value);
+            break;
+        case STRING:
+            json_writer_string(writer, linky_label_list[j].label, (char *)value);
+            break;
+        case BOOL:
+            json_writer_bool(writer, linky_label_list[j].label, *(bool *)value);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+uint32_t web_preapare_json_data(record_iterator_t *records, uint32_t max_count, char **json)
+{
+    uint32_t count = 0;
+    char chunk[WEB_JSON_CHUNK];
+    json_writer_buffer_t buffer = {.size = WEB_JSON_MIN_SIZE};
+    json_writer_t writer;
+    json_writer_init(&writer, chunk, sizeof(chunk), json_writer_buffer_sink, &buffer);
+    json_writer_object_start(&writer, NULL); // the readings are written one by one, without a cJSON tree
+    json_writer_string(&writer, "TOKEN", config_values.web.token);
+    json_writer_double(&writer, "VCONDO", gpio_get_vcondo());
+    json_writer_array_start(&writer, "data");
+    for (; count < max_count && record_next(records); count++)
+    {
+        const linky_data_t *data = &records->state.data; // the records are expanded one by one
+        ESP_LOGI(TAG, "Data index: %" PRIu32 ": timestamp: %" PRId64, records->index - 1, data->timestamp);
+        json_writer_object_start(&writer, NULL);
+        web_write_reading(&writer, data);
+        json_writer_object_end(&writer);
+    }
+    json_writer_array_end(&writer);
     if (count == 0)
     {
         // Send empty data to server to keep the connection alive
-        cJSON_AddStringToObject(jsonObject, "ERROR", "Cant read data from linky");
+        json_writer_string(&writer, "ERROR", "Cant read data from linky");
     }
-    cJSON_AddItemToObject(jsonObject, "data", dataObject); // Add the data array to the root object
-    *json = cJSON_PrintUnformatted(jsonObject);            // Convert the json object to string
-    cJSON_Delete(jsonObject);                              // Delete the json object
+    json_writer_object_end(&writer);
+    *json = json_writer_buffer_end(&writer, &buffer);
+    return count;
 }
 
 static esp_err_t web_http_send_data_handler(esp_http_client_event_handle_t evt)
@@ -204,10 +253,17 @@ uint8_t wifi_send_to_server(const char *json)
     esp_http_client_set_header(client, "Content-Type", "application/json");
 
     // send post request
-    esp_http_client_perform(client);
+    esp_err_t err = esp_http_client_perform(client);
+    int status = esp_http_client_get_status_code(client);
     esp_http_client_cleanup(client);
 
     led_stop_pattern(LED_SENDING);
+    if (err != ESP_OK || status >= 400)
+    {
+        ESP_LOGE(TAG, "POST failed: %s, status %d", esp_err_to_name(err), status);
+        led_start_pattern(LED_SEND_FAILED);
+        return 0;
+    }
     led_start_pattern(LED_SEND_OK);
     return 1;
 }
@@ -294,4 +350,82 @@ static void web_create_http_url(char *url, const char *host, const char *path)
     url = strcat(url, "http://");
     url = strcat(url, host);
     url = strcat(url, path);
-}
\ No newline at end of file
+}
+
+esp_err_t web_benchmark(const linky_data_t *data, uint32_t iterations)
+{
+    char *buffer = malloc(WEB_READING_MAX); // buffer of the writer, given by the caller
+    if (buffer == NULL || iterations == 0)
+    {
+        free(buffer);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // blocks and bytes allocated for one json, counted before it is freed
+    multi_heap_info_t before;
+    multi_heap_info_t after;
+    heap_caps_get_info(&before, MALLOC_CAP_DEFAULT);
+    cJSON *reading = web_json_reading(data);
+    char *json = cJSON_PrintUnformatted(reading);
+    heap_caps_get_info(&after, MALLOC_CAP_DEFAULT);
+    cJSON_Delete(reading);
+    uint32_t cjson_blocks = after.allocated_blocks - before.allocated_blocks;
+    uint32_t cjson_bytes = after.total_allocated_bytes - before.total_allocated_bytes;
+
+    json_writer_t writer;
+    heap_caps_get_info(&before, MALLOC_CAP_DEFAULT);
+    json_writer_init(&writer, buffer, WEB_READING_MAX, NULL, NULL);
+    json_writer_object_start(&writer, NULL);
+    web_write_reading(&writer, data);
+    json_writer_object_end(&writer);
+    esp_err_t err = json_writer_end(&writer);
+    heap_caps_get_info(&after, MALLOC_CAP_DEFAULT);
+    uint32_t writer_blocks = after.allocated_blocks - before.allocated_blocks;
+    uint32_t writer_bytes = after.total_allocated_bytes - before.total_allocated_bytes;
+
+    if (json == NULL || err != ESP_OK)
+    {
+        free(json);
+        free(buffer);
+        return ESP_ERR_NO_MEM;
+    }
+    if (strcmp(json, buffer) != 0)
+    {
+        ESP_LOGE(TAG, "Benchmark: the json of the writer differs from cJSON:\n%s\n%s", json, buffer);
+        err = ESP_FAIL;
+    }
+    uint32_t size = strlen(json);
+    free(json);
+
+    int64_t start = esp_timer_get_time();
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+        reading = web_json_reading(data);
+        json = cJSON_PrintUnformatted(reading);
+        cJSON_Delete(reading);
+        if (json == NULL)
+        {
+            free(buffer);
+            return ESP_ERR_NO_MEM;
+        }
+        free(json);
+    }
+    int64_t cjson_time = esp_timer_get_time() - start;
+
+    start = esp_timer_get_time();
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+        json_writer_init(&writer, buffer, WEB_READING_MAX, NULL, NULL);
+        json_writer_object_start(&writer, NULL);
+        web_write_reading(&writer, data);
+        json_writer_object_end(&writer);
+        json_writer_end(&writer);
+    }
+    int64_t writer_time = esp_timer_get_time() - start;
+    free(buffer);
+
+    ESP_LOGI(TAG, "Benchmark: json of a reading: %" PRIu32 " bytes", size);
+    ESP_LOGI(TAG, "Benchmark: cJSON: %" PRId64 " ns/frame, %" PRIu32 " blocks, %" PRIu32 " bytes allocated", cjson_time * 1000 / iterations, cjson_blocks, cjson_bytes);
+    ESP_LOGI(TAG, "Benchmark: json writer: %" PRId64 " ns/frame, %" PRIu32 " blocks, %" PRIu32 " bytes allocated", writer_time * 1000 / iterations, writer_blocks, writer_bytes);
+    return err;
+}
@@ -108,23 +108,16 @@ void zigbee_config_report()
 {
     // uint32_t record_count = 0;
     uint32_t reportable_change = 0;
-    for (int i = 0; i < linky_label_list_size; i++)
+    uint32_t count = 0;
+    const uint8_t *labels = linky_get_mode_labels(linky_mode, &count);
+    for (uint32_t n = 0; n < count; n++)
     {
+        uint32_t i = labels[n];
         if (linky_label_list[i].zb_access == 0)
         {
             continue;
         }
 
-        if (linky_label_list[i].mode != linky_mode && linky_label_list[i].mode != ANY)
-        {
-            continue;
-        }
-
-        if (linky_label_list[i].data == NULL)
-        {
-            continue;
-        }
-
         switch (linky_label_list[i].type)
         {
         case UINT8:
@@ -318,8 +311,11 @@ static esp_err_t zigbee_attribute_handler(const esp_zb_zcl_set_attr_value_messag
 
     uint8_t *data = message->attribute.data.value;
     char buffer[101];
-    for (int i = 0; i < linky_label_list_size; i++)
+    uint32_t count = 0;
+    const uint8_t *labels = linky_get_mode_labels(linky_mode, &count); // the data of the other mode is overlaid by the current one
+    for (uint32_t n = 0; n < count; n++)
     {
+        uint32_t i = labels[n];
         if (linky_label_list[i].clusterID == message->info.cluster && linky_label_list[i].attributeID == message->attribute.id)
         {
             switch (linky_label_list[i].type)
@@ -563,22 +559,16 @@ static void zigbee_task(void *pvParameters)
     // ------------------ Add attributes ------------------
     uint32_t attributes_count = 0;
 
-    for (int i = 0; i < linky_label_list_size; i++)
+    uint32_t count = 0;
+    const uint8_t *labels = linky_get_mode_labels(linky_mode, &count);
+    for (uint32_t n = 0; n < count; n++)
     {
+        uint32_t i = labels[n];
         if (linky_label_list[i].zb_access == 0)
         {
             continue;
         }
 
-        if (linky_label_list[i].mode != linky_mode && linky_label_list[i].mode != ANY)
-        {
-            continue;
-        }
-        if (linky_label_list[i].data == NULL)
-        {
-            continue;
-        }
-
         switch (linky_label_list[i].type)
         {
         case UINT8:
@@ -809,22 +799,21 @@ esp_err_t zigbee_send(linky_data_t *data)
     }
     zigbee_sending = true;
 
-    for (int i = 0; i < linky_label_list_size; i++)
+    uint32_t count = 0;
+    const uint8_t *labels = linky_get_mode_labels(linky_mode, &count);
+    for (uint32_t n = 0; n < count; n++)
     {
+        uint32_t i = labels[n];
         char str_value[102];
         void *ptr_value = linky_label_list[i].data;
-        ESP_LOGD(TAG, "check %s %d", linky_label_list[i].label, i);
-        if (linky_label_list[i].mode != linky_mode && linky_label_list[i].mode != ANY)
-        {
-            continue;
-        }
-        if (linky_label_list[i].data == NULL)
+        ESP_LOGD(TAG, "check %s %ld", linky_label_list[i].label, i);
+        if (linky_label_list[i].clusterID == 0 || linky_label_list[i].zb_access == 0)
         {
             continue;
         }
-        if (linky_label_list[i].clusterID == 0 || linky_label_list[i].zb_access == 0)
+        if (!linky_is_dirty(i))
         {
-            continue;
+            continue; // the attribute already holds this value
         }
 
         switch (linky_label_list[i].type)
@@ -0,0 +1,77 @@
+# Convert a Linky capture to readable frames and to a C array for linky.c
+# The capture is the file downloaded from http://<ip>/capture, or the output of the capture-dump shell command
+# Usage: python capture.py <capture.bin | dump.txt> [--c]
+# Example: python capture.py capture.bin --c > trame.h
+
+import struct
+import sys
+
+RECORD_HEADER = struct.Struct("<IHBB")  # time (ms), size, mode, reserved
+MODES = {0: "HISTORIQUE", 1: "STANDARD"}
+
+
+def read_binary(content):
+    records = []
+    offset = 0
+    while offset + RECORD_HEADER.size <= len(content):
+        time, size, mode, _ = RECORD_HEADER.unpack_from(content, offset)
+        offset += RECORD_HEADER.size
+        if offset + size > len(content):
+            print("Truncated record at %d ms" % time, file=sys.stderr)
+            break
+        records.append((time, mode, content[offset : offset + size]))
+        offset += size
+    return records
+
+
+def read_dump(content):
+    records = []
+    for line in content.decode(errors="ignore").splitlines():
+        line = line.strip()
+        if line.startswith("# ") or not line:
+            continue
+        if line.startswith("#"):
+            time, mode, size = (int(value) for value in line[1:].split())
+            records.append((time, mode, bytearray()))
+        elif records:
+            records[-1][2].extend(bytes.fromhex(line))
+    return records
+
+
+def readable(data):
+    # same notation as trames.py: control characters between brackets
+    output = ""
+    for byte in data:
+        if byte == 10:
+            output += "\n[10]"
+        elif byte < 32 or byte > 126 or byte in (ord("["), ord("]")):
+            output += "[%d]" % byte
+        else:
+            output += chr(byte)
+    return output
+
+
+def c_array(data):
+    return "static const char trame[] = {" + ",".join(hex(byte) for byte in data) + "};"
+
+
+with open(sys.argv[1], "rb") as f:
+    content = f.read()
+
+if content.startswith(b"#"):
+    records = read_dump(content)
+else:
+    records = read_binary(content)
+
+previous = None
+for time, mode, data in records:
+    delay = "" if previous is None else " (+%d ms)" % (time - previous)
+    previous = time
+    print("// %d ms%s, %s, %d bytes" % (time, delay, MODES.get(mode, "mode %d" % mode), len(data)))
+    if "--c" in sys.argv:
+        print(c_array(data))
+    else:
+        print(readable(data))
+    print()
+
+print("// %d records" % len(records), file=sys.stderr)
@@ -472,6 +472,11 @@ function handleSubmit(event) {
     delete config["mqtt-password"];
   }
 
+  // an unchecked switch is not in the form data: send 0 to disable it
+  for (const key of ["mqtt-batch", "stream"]) {
+    config[key] = document.querySelector(`[name="${key}"]`).checked ? "1" : "0";
+  }
+
   if (config["server-mode"] == 2 && mqtt_ha_discovery.checked) {
     config["server-mode"] = "3";
   }
@@ -620,7 +625,9 @@ window.addEventListener("load", function () {
             continue;
           }
           const input = document.querySelector(`[name="${key}"]`);
-          if (input) {
+          if (input && input.type == "checkbox") {
+            input.checked = element == 1;
+          } else if (input) {
             input.value = element;
           }
         }